@@ -157,6 +157,8 @@ enet_host_destroy (ENetHost * host)
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
 
+    enet_host_socket_batch (host, 0);
+
     enet_free (host -> peers);
     enet_free (host);
 }
@@ -324,6 +326,59 @@ enet_host_bandwidth_limit (ENetHost * host, enet_uint32 incomingBandwidth, enet_
     host -> recalculateBandwidthLimits = 1;
 }
 
+static int
+enet_socket_batch_resize (ENetSocketBatch * batch, size_t capacity)
+{
+    enet_free (batch -> datagrams);
+    enet_free (batch -> data);
+    memset (batch, 0, sizeof (ENetSocketBatch));
+
+    if (capacity <= 1)
+      return 0;
+
+    batch -> datagrams = (ENetDatagram *) enet_malloc (capacity * sizeof (ENetDatagram));
+    batch -> data = (enet_uint8 *) enet_malloc (capacity * ENET_PROTOCOL_MAXIMUM_MTU);
+    if (batch -> datagrams == NULL || batch -> data == NULL)
+    {
+       enet_socket_batch_resize (batch, 0);
+
+       return -1;
+    }
+    memset (batch -> datagrams, 0, capacity * sizeof (ENetDatagram));
+    batch -> capacity = capacity;
+
+    return 0;
+}
+
+/** Sets how many datagrams a host sends or receives with one system call
+    (using sendmmsg / recvmmsg where available).
+    @param host host to adjust
+    @param batchSize maximum number of datagrams per system call, at most
+    ENET_HOST_SOCKET_BATCH_MAXIMUM, 0 or 1 to send and receive datagrams one by one
+    @returns 0 on success, < 0 on failure
+    @remarks datagrams received but not processed yet are discarded, so this should be
+    called before the host is serviced.
+*/
+int
+enet_host_socket_batch (ENetHost * host, size_t batchSize)
+{
+    if (batchSize > ENET_HOST_SOCKET_BATCH_MAXIMUM)
+      batchSize = ENET_HOST_SOCKET_BATCH_MAXIMUM;
+
+    if (host -> sendBatch.count > 0)
+      enet_host_flush (host);
+
+    if (enet_socket_batch_resize (& host -> receiveBatch, batchSize) < 0 ||
+        enet_socket_batch_resize (& host -> sendBatch, batchSize) < 0)
+    {
+       enet_socket_batch_resize (& host -> receiveBatch, 0);
+
+       return -1;
+    }
+
+    return 0;
+}
+
 void
 enet_host_bandwidth_throttle (ENetHost * host)
 {
@@ -31,6 +31,8 @@ extern "C"
 #define ENET_VERSION_GET_MINOR(version) (((version)>>8)&0xFF)
 #define ENET_VERSION_GET_PATCH(version) ((version)&0xFF)
 #define ENET_VERSION ENET_VERSION_CREATE(ENET_VERSION_MAJOR, ENET_VERSION_MINOR, ENET_VERSION_PATCH)
+/** Set by the enet bundled with STK, which supports enet_host_socket_batch(). */
+#define ENET_HAS_SOCKET_BATCH 1
 
 typedef enet_uint32 ENetVersion;
 
@@ -228,6 +230,7 @@ enum
    ENET_HOST_DEFAULT_MTU                  = 1400,
    ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE  = 32 * 1024 * 1024,
    ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA = 32 * 1024 * 1024,
+   ENET_HOST_SOCKET_BATCH_MAXIMUM         = 64,
 
    ENET_PEER_DEFAULT_ROUND_TRIP_TIME      = 500,
    ENET_PEER_DEFAULT_PACKET_THROTTLE      = 32,
@@ -346,6 +349,29 @@ typedef struct _ENetCompressor
    void (ENET_CALLBACK * destroy) (void * context);
 } ENetCompressor;
 
+/** A datagram sent or received by enet_socket_send_batch() or
+    enet_socket_receive_batch(). When receiving, buffer holds the capacity
+    on input and the received length on output (0 if the datagram was
+    truncated or from an unexpected address family, it should be ignored).
+ */
+typedef struct _ENetDatagram
+{
+   ENetAddress address;
+   ENetBuffer  buffer;
+} ENetDatagram;
+
+/** Datagrams of a host waiting to be sent, or received but not processed
+    yet, see enet_host_socket_batch().
+ */
+typedef struct _ENetSocketBatch
+{
+   size_t         capacity;   /**< maximum number of datagrams per system call, 0 if batching is disabled */
+   ENetDatagram * datagrams;
+   enet_uint8 *   data;       /**< capacity * ENET_PROTOCOL_MAXIMUM_MTU bytes */
+   size_t         count;      /**< number of datagrams in use */
+   size_t         current;    /**< next received datagram to process */
+} ENetSocketBatch;
+
 /** Callback that computes the checksum of the data held in buffers[0:bufferCount-1] */
 typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * buffers, size_t bufferCount);
 
@@ -406,6 +432,8 @@ typedef struct _ENetHost
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
    size_t               maximumPacketSize;           /**< the maximum allowable packet size that may be sent or received on a peer */
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
+   ENetSocketBatch      receiveBatch;
+   ENetSocketBatch      sendBatch;
 } ENetHost;
 
 /**
@@ -511,6 +539,8 @@ ENET_API int        enet_socket_connect (ENetSocket, const ENetAddress *);
 ENET_API int        enet_socket_send (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t);
 ENET_API int        enet_socket_receive (ENetSocket, ENetAddress *, ENetBuffer *, size_t);
 ENET_API int        enet_socket_wait (ENetSocket, enet_uint32 *, enet_uint32);
+ENET_API int        enet_socket_send_batch (ENetSocket, const ENetDatagram *, size_t);
+ENET_API int        enet_socket_receive_batch (ENetSocket, ENetDatagram *, size_t);
 ENET_API int        enet_socket_set_option (ENetSocket, ENetSocketOption, int);
 ENET_API int        enet_socket_get_option (ENetSocket, ENetSocketOption, int *);
 ENET_API int        enet_socket_shutdown (ENetSocket, ENetSocketShutdown);
@@ -581,6 +611,7 @@ ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
+ENET_API int        enet_host_socket_batch (ENetHost *, size_t);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
 extern  enet_uint32 enet_host_random_seed (void);
 
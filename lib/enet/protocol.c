@@ -1201,12 +1201,17 @@ commandError:
     return 0;
 }
  
+/** Makes the next received datagram the current one (receivedData), reading
+    a whole batch of datagrams from the socket if none is left.
+    @returns the length of the datagram, 0 if none was received, < 0 on failure
+*/
 static int
-enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
+enet_protocol_receive_datagram (ENetHost * host)
 {
-    int packets;
+    ENetSocketBatch * batch = & host -> receiveBatch;
+    ENetDatagram * datagram;
 
-    for (packets = 0; packets < 256; ++ packets)
+    if (batch -> capacity == 0)
     {
        int receivedLength;
        ENetBuffer buffer;
@@ -1218,15 +1223,62 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
                                              & host -> receivedAddress,
                                              & buffer,
                                              1);
+       if (receivedLength > 0)
+       {
+          host -> receivedData = host -> packetData [0];
+          host -> receivedDataLength = receivedLength;
+       }
+
+       return receivedLength;
+    }
+
+    do
+    {
+       if (batch -> current >= batch -> count)
+       {
+          int received;
+          size_t i;
+
+          for (i = 0; i < batch -> capacity; ++ i)
+          {
+             batch -> datagrams [i].buffer.data = & batch -> data [i * ENET_PROTOCOL_MAXIMUM_MTU];
+             batch -> datagrams [i].buffer.dataLength = ENET_PROTOCOL_MAXIMUM_MTU;
+          }
+
+          batch -> current = batch -> count = 0;
+
+          received = enet_socket_receive_batch (host -> socket, batch -> datagrams, batch -> capacity);
+          if (received <= 0)
+            return received;
+
+          batch -> count = (size_t) received;
+       }
+
+       datagram = & batch -> datagrams [batch -> current ++];
+    }
+    while (datagram -> buffer.dataLength == 0);
+
+    host -> receivedAddress = datagram -> address;
+    host -> receivedData = (enet_uint8 *) datagram -> buffer.data;
+    host -> receivedDataLength = datagram -> buffer.dataLength;
+
+    return (int) datagram -> buffer.dataLength;
+}
+
+static int
+enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
+{
+    int packets;
+
+    for (packets = 0; packets < 256; ++ packets)
+    {
+       int receivedLength = enet_protocol_receive_datagram (host);
 
        if (receivedLength < 0)
          return -1;
 
        if (receivedLength == 0)
          return 0;
-
-       host -> receivedData = host -> packetData [0];
-       host -> receivedDataLength = receivedLength;
       
        host -> totalReceivedData += receivedLength;
        host -> totalReceivedPackets ++;
@@ -1597,8 +1649,82 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
     return canPing;
 }
 
+/** Sends the datagrams queued by enet_protocol_send_datagram().
+    @returns 0 on success, < 0 on failure
+*/
 static int
-enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+enet_protocol_flush_datagrams (ENetHost * host)
+{
+    ENetSocketBatch * batch = & host -> sendBatch;
+    size_t sent = 0;
+
+    while (sent < batch -> count)
+    {
+       int result = enet_socket_send_batch (host -> socket, & batch -> datagrams [sent], batch -> count - sent);
+
+       if (result < 0)
+       {
+          batch -> count = 0;
+
+          return -1;
+       }
+
+       // Socket buffer is full, drop the rest like enet_socket_send would
+       if (result == 0)
+         break;
+
+       sent += result;
+    }
+
+    batch -> count = 0;
+
+    return 0;
+}
+
+/** Sends a datagram, or copies it into the send batch of the host if batching is
+    enabled, in which case enet_protocol_flush_datagrams() sends it later.
+    @returns the length of the datagram, < 0 on failure
+*/
+static int
+enet_protocol_send_datagram (ENetHost * host, const ENetAddress * address, const ENetBuffer * buffers, size_t bufferCount)
+{
+    ENetSocketBatch * batch = & host -> sendBatch;
+    ENetDatagram * datagram;
+    enet_uint8 * data;
+    size_t i, length = 0;
+
+    for (i = 0; i < bufferCount; ++ i)
+      length += buffers [i].dataLength;
+
+    if (batch -> capacity == 0 || length > ENET_PROTOCOL_MAXIMUM_MTU)
+    {
+       // Keep the order of datagrams sent to a peer
+       if (batch -> count > 0 && enet_protocol_flush_datagrams (host) < 0)
+         return -1;
+
+       return enet_socket_send (host -> socket, address, buffers, bufferCount);
+    }
+
+    if (batch -> count >= batch -> capacity && enet_protocol_flush_datagrams (host) < 0)
+      return -1;
+
+    datagram = & batch -> datagrams [batch -> count ++];
+    data = & batch -> data [(datagram - batch -> datagrams) * ENET_PROTOCOL_MAXIMUM_MTU];
+    datagram -> address = * address;
+    datagram -> buffer.data = data;
+    datagram -> buffer.dataLength = length;
+
+    for (i = 0; i < bufferCount; ++ i)
+    {
+       memcpy (data, buffers [i].data, buffers [i].dataLength);
+       data += buffers [i].dataLength;
+    }
+
+    return (int) length;
+}
+
+static int
+enet_protocol_queue_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
 {
     enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint32)];
     ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
@@ -1732,7 +1858,7 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         currentPeer -> lastSendTime = host -> serviceTime;
 
-        sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+        sentLength = enet_protocol_send_datagram (host, & currentPeer -> address, host -> buffers, host -> bufferCount);
 
         enet_protocol_remove_sent_unreliable_commands (currentPeer);
 
@@ -1746,6 +1872,17 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
     return 0;
 }
 
+static int
+enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+{
+    int result = enet_protocol_queue_outgoing_commands (host, event, checkForTimeouts);
+
+    if (host -> sendBatch.count > 0 && enet_protocol_flush_datagrams (host) < 0)
+      return -1;
+
+    return result;
+}
+
 /** Sends any queued packets on the host specified to its designated peers.
 
     @param host   host to flush
@@ -1901,6 +2038,16 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
        if (ENET_TIME_GREATER_EQUAL (host -> serviceTime, timeout))
          return 0;
 
+       /* Datagrams left in the receive batch after the 256 packet limit are
+          no longer in the socket, so waiting on it could block while they
+          are pending. */
+       if (host -> receiveBatch.current < host -> receiveBatch.count)
+       {
+          waitCondition = ENET_SOCKET_WAIT_RECEIVE;
+          host -> serviceTime = enet_time_get ();
+          continue;
+       }
+
        do
        {
           host -> serviceTime = enet_time_get ();
@@ -4,6 +4,11 @@
 */
 #ifndef _WIN32
 
+#if defined(HAS_MMSG) && !defined(_GNU_SOURCE)
+// For recvmmsg and sendmmsg
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -481,6 +486,57 @@ enet_socket_destroy (ENetSocket socket)
       close (socket);
 }
 
+static socklen_t
+enet_address_to_sockaddr (const ENetAddress * address, struct sockaddr_storage * sin)
+{
+    memset (sin, 0, sizeof (struct sockaddr_storage));
+    if (isIPv6Socket() == 1)
+    {
+        struct sockaddr_in6 * v6 = (struct sockaddr_in6 *) sin;
+        v6 -> sin6_family = AF_INET6;
+        v6 -> sin6_port = ENET_HOST_TO_NET_16 (address -> port);
+        memcpy (v6 -> sin6_addr.s6_addr, & address -> host.p0, 16);
+        v6 -> sin6_scope_id = address -> host.p4;
+
+        return sizeof (struct sockaddr_in6);
+    }
+    else
+    {
+        struct sockaddr_in * v4 = (struct sockaddr_in *) sin;
+        v4 -> sin_family = AF_INET;
+        v4 -> sin_port = ENET_HOST_TO_NET_16 (address -> port);
+        v4 -> sin_addr.s_addr = address -> host.p0;
+
+        return sizeof (struct sockaddr_in);
+    }
+}
+
+static int
+enet_address_from_sockaddr (const struct sockaddr_storage * sin, ENetAddress * address)
+{
+    switch (sin -> ss_family)
+    {
+    case AF_INET:
+        // Should not happen if dual stack is working
+        if (isIPv6Socket() == 1)
+            return -1;
+        const struct sockaddr_in * v4 = (const struct sockaddr_in *) sin;
+        address -> host.p0 = (enet_uint32) v4 -> sin_addr.s_addr;
+        address -> port = ENET_NET_TO_HOST_16 (v4->sin_port);
+        return 0;
+    case AF_INET6:
+        if (isIPv6Socket() != 1)
+            return -1;
+        const struct sockaddr_in6 * v6 = (const struct sockaddr_in6 *) sin;
+        memcpy (& address -> host.p0, v6 -> sin6_addr.s6_addr, 16);
+        address -> host.p4 = v6 -> sin6_scope_id;
+        address -> port = ENET_NET_TO_HOST_16 (v6 -> sin6_port);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
 int
 enet_socket_send (ENetSocket socket,
                   const ENetAddress * address,
@@ -489,34 +545,14 @@ enet_socket_send (ENetSocket socket,
 {
     struct msghdr msgHdr;
     struct sockaddr_storage sin;
-    memset (& sin, 0, sizeof (sin));
     int sentLength;
 
     memset (& msgHdr, 0, sizeof (struct msghdr));
 
     if (address != NULL)
     {
-        if (isIPv6Socket() == 1)
-        {
-            struct sockaddr_in6 * v6 = (struct sockaddr_in6 *) & sin;
-            v6 -> sin6_family = AF_INET6;
-            v6 -> sin6_port = ENET_HOST_TO_NET_16 (address -> port);
-            memcpy (v6 -> sin6_addr.s6_addr, & address -> host.p0, 16);
-            v6 -> sin6_scope_id = address -> host.p4;
-
-            msgHdr.msg_name = & sin;
-            msgHdr.msg_namelen = sizeof (struct sockaddr_in6);
-        }
-        else
-        {
-            struct sockaddr_in * v4 = (struct sockaddr_in *) & sin;
-            v4 -> sin_family = AF_INET;
-            v4 -> sin_port = ENET_HOST_TO_NET_16 (address -> port);
-            v4 -> sin_addr.s_addr = address -> host.p0;
-
-            msgHdr.msg_name = & sin;
-            msgHdr.msg_namelen = sizeof (struct sockaddr_in);
-        }
+        msgHdr.msg_name = & sin;
+        msgHdr.msg_namelen = enet_address_to_sockaddr (address, & sin);
     }
 
     msgHdr.msg_iov = (struct iovec *) buffers;
@@ -572,32 +608,132 @@ enet_socket_receive (ENetSocket socket,
       return -1;
 #endif
 
-    if (address != NULL)
+    if (address != NULL && enet_address_from_sockaddr (& sin, address) < 0)
+      return -1;
+
+    return recvLength;
+}
+
+/** Sends several datagrams, with one system call if sendmmsg is available.
+    @returns the number of datagrams sent, 0 if the socket would block, < 0 on failure
+*/
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetDatagram * datagrams,
+                        size_t datagramCount)
+{
+#ifdef HAS_MMSG
+    struct mmsghdr msgHdrs [ENET_HOST_SOCKET_BATCH_MAXIMUM];
+    struct sockaddr_storage sins [ENET_HOST_SOCKET_BATCH_MAXIMUM];
+    size_t i;
+    int sentCount;
+
+    if (datagramCount > ENET_HOST_SOCKET_BATCH_MAXIMUM)
+      datagramCount = ENET_HOST_SOCKET_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, datagramCount * sizeof (struct mmsghdr));
+    for (i = 0; i < datagramCount; ++ i)
     {
-        switch (sin.ss_family)
-        {
-        case AF_INET:
-            // Should not happen if dual stack is working
-            if (isIPv6Socket() == 1)
-                return -1;
-            struct sockaddr_in * v4 = (struct sockaddr_in *) & sin;
-            address -> host.p0 = (enet_uint32) v4 -> sin_addr.s_addr;
-            address -> port = ENET_NET_TO_HOST_16 (v4->sin_port);
-            break;
-        case AF_INET6:
-            if (isIPv6Socket() != 1)
-            return -1;
-            struct sockaddr_in6 * v6 = (struct sockaddr_in6 *) & sin;
-            memcpy (& address -> host.p0, v6 -> sin6_addr.s6_addr, 16);
-            address -> host.p4 = v6 -> sin6_scope_id;
-            address -> port = ENET_NET_TO_HOST_16 (v6 -> sin6_port);
-            break;
-        default:
-            return -1;
-        }
+        msgHdrs [i].msg_hdr.msg_name = & sins [i];
+        msgHdrs [i].msg_hdr.msg_namelen = enet_address_to_sockaddr (& datagrams [i].address, & sins [i]);
+        msgHdrs [i].msg_hdr.msg_iov = (struct iovec *) & datagrams [i].buffer;
+        msgHdrs [i].msg_hdr.msg_iovlen = 1;
     }
 
-    return recvLength;
+    sentCount = sendmmsg (socket, msgHdrs, (unsigned int) datagramCount, MSG_NOSIGNAL);
+
+    if (sentCount == -1)
+    {
+       if (errno == EWOULDBLOCK)
+         return 0;
+
+       return -1;
+    }
+
+    return sentCount;
+#else
+    size_t i;
+
+    for (i = 0; i < datagramCount; ++ i)
+    {
+        int sentLength = enet_socket_send (socket, & datagrams [i].address, & datagrams [i].buffer, 1);
+
+        if (sentLength < 0)
+          return i > 0 ? (int) i : -1;
+
+        if (sentLength == 0)
+          return (int) i;
+    }
+
+    return (int) datagramCount;
+#endif
+}
+
+/** Receives up to datagramCount datagrams, with one system call if recvmmsg is
+    available.
+    @returns the number of datagrams received, 0 if none is available, < 0 on failure
+*/
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetDatagram * datagrams,
+                           size_t datagramCount)
+{
+#ifdef HAS_MMSG
+    struct mmsghdr msgHdrs [ENET_HOST_SOCKET_BATCH_MAXIMUM];
+    struct sockaddr_storage sins [ENET_HOST_SOCKET_BATCH_MAXIMUM];
+    size_t i;
+    int recvCount;
+
+    if (datagramCount > ENET_HOST_SOCKET_BATCH_MAXIMUM)
+      datagramCount = ENET_HOST_SOCKET_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, datagramCount * sizeof (struct mmsghdr));
+    for (i = 0; i < datagramCount; ++ i)
+    {
+        msgHdrs [i].msg_hdr.msg_name = & sins [i];
+        msgHdrs [i].msg_hdr.msg_namelen = sizeof (struct sockaddr_storage);
+        msgHdrs [i].msg_hdr.msg_iov = (struct iovec *) & datagrams [i].buffer;
+        msgHdrs [i].msg_hdr.msg_iovlen = 1;
+    }
+
+    recvCount = recvmmsg (socket, msgHdrs, (unsigned int) datagramCount, MSG_NOSIGNAL, NULL);
+
+    if (recvCount == -1)
+    {
+       if (errno == EWOULDBLOCK)
+         return 0;
+
+       return -1;
+    }
+
+    for (i = 0; i < (size_t) recvCount; ++ i)
+    {
+        datagrams [i].buffer.dataLength = msgHdrs [i].msg_len;
+
+        if (msgHdrs [i].msg_hdr.msg_flags & MSG_TRUNC ||
+            enet_address_from_sockaddr (& sins [i], & datagrams [i].address) < 0)
+          datagrams [i].buffer.dataLength = 0;
+    }
+
+    return recvCount;
+#else
+    size_t i;
+
+    for (i = 0; i < datagramCount; ++ i)
+    {
+        int recvLength = enet_socket_receive (socket, & datagrams [i].address, & datagrams [i].buffer, 1);
+
+        if (recvLength < 0)
+          return i > 0 ? (int) i : -1;
+
+        if (recvLength == 0)
+          return (int) i;
+
+        datagrams [i].buffer.dataLength = recvLength;
+    }
+
+    return (int) datagramCount;
+#endif
 }
 
 int
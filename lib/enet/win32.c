@@ -481,6 +481,56 @@ enet_socket_receive (ENetSocket socket,
     return (int) recvLength;
 }
 
+/** Sends several datagrams, one by one as Windows has no sendmmsg.
+    @returns the number of datagrams sent, 0 if the socket would block, < 0 on failure
+*/
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetDatagram * datagrams,
+                        size_t datagramCount)
+{
+    size_t i;
+
+    for (i = 0; i < datagramCount; ++ i)
+    {
+        int sentLength = enet_socket_send (socket, & datagrams [i].address, & datagrams [i].buffer, 1);
+
+        if (sentLength < 0)
+          return i > 0 ? (int) i : -1;
+
+        if (sentLength == 0)
+          return (int) i;
+    }
+
+    return (int) datagramCount;
+}
+
+/** Receives up to datagramCount datagrams, one by one as Windows has no recvmmsg.
+    @returns the number of datagrams received, 0 if none is available, < 0 on failure
+*/
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetDatagram * datagrams,
+                           size_t datagramCount)
+{
+    size_t i;
+
+    for (i = 0; i < datagramCount; ++ i)
+    {
+        int recvLength = enet_socket_receive (socket, & datagrams [i].address, & datagrams [i].buffer, 1);
+
+        if (recvLength < 0)
+          return i > 0 ? (int) i : -1;
+
+        if (recvLength == 0)
+          return (int) i;
+
+        datagrams [i].buffer.dataLength = recvLength;
+    }
+
+    return (int) datagramCount;
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {
@@ -506,6 +506,11 @@ namespace UserConfigParams
     PARAM_PREFIX BoolUserConfigParam          m_addon_tux_online
             PARAM_DEFAULT(  BoolUserConfigParam(false, "addon-tux-online",
             &m_race_setup_group, "Always show online addon karts as tux when live join is on.") );
+    PARAM_PREFIX IntUserConfigParam          m_ai_threads
+            PARAM_DEFAULT(  IntUserConfigParam(2, "ai-threads",
+            &m_race_setup_group, "Number of additional threads used to compute "
+            "the AI of karts in parallel, 0 to compute it in the game thread "
+            "only.") );
     PARAM_PREFIX BoolUserConfigParam          m_random_player_pos
             PARAM_DEFAULT(  BoolUserConfigParam(false, "random-player-pos",
             &m_race_setup_group, "Randomize the position of the players at the start of a race. Doesn't apply to story mode.") );
@@ -786,6 +791,13 @@ namespace UserConfigParams
     /** If unit testing is enabled. */
     PARAM_PREFIX bool m_unit_testing PARAM_DEFAULT(false);
 
+    /** If micro benchmarks should be run. */
+    PARAM_PREFIX bool m_run_benchmarks PARAM_DEFAULT(false);
+
+    /** If the profiler should record from the start (also without
+     *  graphics), and write its data when STK exits. */
+    PARAM_PREFIX bool m_cpu_profile PARAM_DEFAULT(false);
+
     /** If gamepad debugging is enabled. */
     PARAM_PREFIX bool m_gamepad_debug PARAM_DEFAULT( false );
 
@@ -814,6 +826,10 @@ namespace UserConfigParams
     /** True if FPS should be printed each frame. */
     PARAM_PREFIX bool m_fps_debug PARAM_DEFAULT(false);
 
+    /** True if the AI thinking in parallel should be compared with thinking
+     *  serially each frame. */
+    PARAM_PREFIX bool m_check_parallel_ai PARAM_DEFAULT(false);
+
     /** True if arena (battle/soccer) ai profiling. */
     PARAM_PREFIX bool m_arena_ai_stats PARAM_DEFAULT(false);
 
@@ -19,6 +19,7 @@
 
 #include "graphics/material_manager.hpp"
 
+#include <chrono>
 #include <stdexcept>
 #include <sstream>
 
@@ -31,6 +32,7 @@
 #include "io/xml_node.hpp"
 #include "modes/world.hpp"
 #include "tracks/track.hpp"
+#include "tracks/track_manager.hpp"
 #include "utils/string_utils.hpp"
 
 #include <IFileSystem.h>
@@ -45,6 +47,7 @@ MaterialManager::MaterialManager()
     /* Create list - and default material zero */
 
     m_materials.reserve(256);
+    m_use_index = true;
     // We can't call init/loadMaterial here, since the global variable
     // material_manager has not yet been initialised, and
     // material_manager is used in the Material constructor.
@@ -67,6 +70,8 @@ MaterialManager::~MaterialManager()
         delete m_materials[i];
     }
     m_materials.clear();
+    m_materials_by_name.clear();
+    m_materials_by_path.clear();
 
     for (std::map<std::string, Material*> ::iterator it =
          m_default_sp_materials.begin(); it != m_default_sp_materials.end();
@@ -100,48 +105,12 @@ Material* MaterialManager::getMaterialSPM(std::string lay_one_tex_lc,
     const bool is_full_path = !lay_one_tex_lc.empty() &&
         (lay_one_tex_lc.find('/') != std::string::npos ||
         lay_one_tex_lc.find('\\') != std::string::npos);
-    if (is_full_path)
+    if (!lay_one_tex_lc.empty())
     {
-        // Search backward so that temporary (track) textures are found first
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFullPath() == lay_one_tex_lc)
-            {
-                const std::string& mat_lay_two = m_materials[i]->getUVTwoTexture();
-                if (mat_lay_two.empty() && lay_two_tex_lc.empty())
-                {
-                    return m_materials[i];
-                }
-                else if (!mat_lay_two.empty() && !lay_two_tex_lc.empty())
-                {
-                    if (mat_lay_two == lay_two_tex_lc)
-                    {
-                        return m_materials[i];
-                    }
-                }
-            }
-        }
-    }
-    else if (!lay_one_tex_lc.empty())
-    {
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFname() == lay_one_tex_lc)
-            {
-                const std::string& mat_lay_two = m_materials[i]->getUVTwoTexture();
-                if (mat_lay_two.empty() && lay_two_tex_lc.empty())
-                {
-                    return m_materials[i];
-                }
-                else if (!mat_lay_two.empty() && !lay_two_tex_lc.empty())
-                {
-                    if (mat_lay_two == lay_two_tex_lc)
-                    {
-                        return m_materials[i];
-                    }
-                }
-            }
-        }   // for i
+        Material* m = findMaterial(lay_one_tex_lc, is_full_path,
+                                   &lay_two_tex_lc);
+        if (m)
+            return m;
     }
     Log::debug("MaterialManager", "Couldn't find cached SP material! Opening default %s!", original_layer_one.c_str());
     return getDefaultSPMaterial(def_shader_name,
@@ -156,30 +125,11 @@ Material* MaterialManager::getMaterialFor(video::ITexture* t)
     const io::path& img_path = t->getName().getInternalName();
 
     if (!img_path.empty() && (img_path.findFirst('/') != -1 || img_path.findFirst('\\') != -1))
-    {
-        // Search backward so that temporary (track) textures are found first
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFullPath() == img_path.c_str())
-            {
-                return m_materials[i];
-            }
-        }
-    }
-    else
-    {
-        core::stringc image(StringUtils::getBasename(img_path.c_str()).c_str());
-        image.make_lower();
+        return findMaterial(img_path.c_str(), /*is_full_path*/true);
 
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFname() == image.c_str())
-            {
-                return m_materials[i];
-            }
-        }   // for i
-    }
-    return NULL;
+    core::stringc image(StringUtils::getBasename(img_path.c_str()).c_str());
+    image.make_lower();
+    return findMaterial(image.c_str(), /*is_full_path*/false);
 }
 
 //-----------------------------------------------------------------------------
@@ -252,10 +202,109 @@ void MaterialManager::setAllUntexturedMaterialFlags(scene::IMeshBuffer *mb)
 //-----------------------------------------------------------------------------
 int MaterialManager::addEntity(Material *m)
 {
-    m_materials.push_back(m);
+    addMaterial(m);
     return (int)m_materials.size()-1;
 }
 
+//-----------------------------------------------------------------------------
+/** Returns the key of a texture name in m_materials_by_name: its lower case
+ *  basename. Installing a material strips the path of its texture name and
+ *  converts it to lower case, which doesn't change this key.
+ */
+std::string MaterialManager::getNameKey(const std::string& name)
+{
+    core::stringc key(StringUtils::getBasename(name).c_str());
+    key.make_lower();
+    return key.c_str();
+}   // getNameKey
+
+//-----------------------------------------------------------------------------
+/** Appends a material to the list of materials and adds it to the indices
+ *  used to find it.
+ */
+void MaterialManager::addMaterial(Material *m)
+{
+    const int index = (int)m_materials.size();
+    m_materials.push_back(m);
+    m_materials_by_name[getNameKey(m->getTexFname())].push_back(index);
+    if (!m->getTexFullPath().empty())
+        m_materials_by_path[m->getTexFullPath()].push_back(index);
+}   // addMaterial
+
+//-----------------------------------------------------------------------------
+/** Deletes the last material and removes it from the indices. Since
+ *  materials are always removed from the end, it is the last entry of its
+ *  index lists.
+ */
+void MaterialManager::removeLastMaterial()
+{
+    const int index = (int)m_materials.size() - 1;
+    Material *m = m_materials[index];
+
+    auto name = m_materials_by_name.find(getNameKey(m->getTexFname()));
+    assert(name != m_materials_by_name.end() &&
+           name->second.back() == index);
+    name->second.pop_back();
+    if (name->second.empty())
+        m_materials_by_name.erase(name);
+
+    if (!m->getTexFullPath().empty())
+    {
+        auto path = m_materials_by_path.find(m->getTexFullPath());
+        assert(path != m_materials_by_path.end() &&
+               path->second.back() == index);
+        path->second.pop_back();
+        if (path->second.empty())
+            m_materials_by_path.erase(path);
+    }
+
+    delete m;
+    m_materials.pop_back();
+}   // removeLastMaterial
+
+//-----------------------------------------------------------------------------
+/** Returns the last material with the given texture name or full path, so
+ *  that temporary (track) textures are found first.
+ *  \param name Texture name, or full path of the texture.
+ *  \param is_full_path True if name is a full path.
+ *  \param layer_two If not NULL, the material must also use this texture for
+ *         its second texture layer (empty for none).
+ *  \return The material, or NULL if there is none.
+ */
+Material* MaterialManager::findMaterial(const std::string& name,
+                                        bool is_full_path,
+                                        const std::string* layer_two) const
+{
+    auto matches = [&](const Material *m)
+    {
+        if ((is_full_path ? m->getTexFullPath() : m->getTexFname()) != name)
+            return false;
+        return layer_two == NULL || m->getUVTwoTexture() == *layer_two;
+    };
+
+    if (!m_use_index)
+    {
+        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
+        {
+            if (matches(m_materials[i]))
+                return m_materials[i];
+        }
+        return NULL;
+    }
+
+    const std::unordered_map<std::string, std::vector<int> >& index =
+        is_full_path ? m_materials_by_path : m_materials_by_name;
+    auto it = index.find(is_full_path ? name : getNameKey(name));
+    if (it == index.end())
+        return NULL;
+    for (auto i = it->second.rbegin(); i != it->second.rend(); i++)
+    {
+        if (matches(m_materials[*i]))
+            return m_materials[*i];
+    }
+    return NULL;
+}   // findMaterial
+
 //-----------------------------------------------------------------------------
 void MaterialManager::loadMaterial()
 {
@@ -323,7 +372,7 @@ bool MaterialManager::pushTempMaterial(const XMLNode *root,
         }
         try
         {
-            m_materials.push_back(new Material(node, deprecated));
+            addMaterial(new Material(node, deprecated));
         }
         catch(std::exception& e)
         {
@@ -340,8 +389,7 @@ void MaterialManager::popTempMaterial()
 {
     for(int i=(int)m_materials.size()-1; i>=this->m_shared_material_index; i--)
     {
-        delete m_materials[i];
-        m_materials.pop_back();
+        removeLastMaterial();
     }   // for i6
 }   // popTempMaterial
 
@@ -387,18 +435,16 @@ Material *MaterialManager::getMaterial(const std::string& fname,
     core::stringc basename_lower(basename.c_str());
     basename_lower.make_lower();
 
-    // Search backward so that temporary (track) textures are found first
-    for (int i = (int)m_materials.size()-1; i>=0; i-- )
-    {
-        if (m_materials[i]->getTexFname() == basename_lower.c_str())
-            return m_materials[i];
-    }
+    Material* found = findMaterial(basename_lower.c_str(),
+                                   /*is_full_path*/false);
+    if (found)
+        return found;
 
     if (!create_if_not_found)
         return NULL;
     // Add the new material
     Material* m = new Material(fname, is_full_path, complain_if_not_found, install);
-    m_materials.push_back(m);
+    addMaterial(m);
     if(make_permanent)
     {
         assert(m_shared_material_index==(int)m_materials.size()-1);
@@ -444,11 +490,127 @@ void MaterialManager::unloadAllTextures()
 bool MaterialManager::hasMaterial(const std::string& fname)
 {
     std::string basename=StringUtils::getBasename(fname);
+    return findMaterial(basename, /*is_full_path*/false) != NULL;
+}   // hasMaterial
 
-    // Search backward so that temporary (track) textures are found first
-    for(int i = (int)m_materials.size()-1; i>=0; i-- )
+// ----------------------------------------------------------------------------
+/** Checks that a material with a mixed case texture name is found after it
+ *  is installed, and that it can be removed again.
+ */
+void MaterialManager::unitTesting()
+{
+    MaterialManager* mm = material_manager;
+    const int shared_index = mm->m_shared_material_index;
+    const size_t count = mm->m_materials.size();
+    mm->makeMaterialsPermanent();
+
+    Material* m = new Material("Unit_Test_Mixed_Case.PNG",
+                               /*is_full_path*/false,
+                               /*complain_if_not_found*/false,
+                               /*load_texture*/false);
+    mm->addMaterial(m);
+    assert(mm->getMaterial("Unit_Test_Mixed_Case.PNG", false, false, false,
+                           true, false, /*create_if_not_found*/false) == m);
+    assert(mm->hasMaterial("unit_test_mixed_case.png"));
+
+    mm->popTempMaterial();
+    assert(mm->m_materials.size() == count);
+    assert(!mm->hasMaterial("unit_test_mixed_case.png"));
+    assert(mm->m_materials_by_name.find(
+        getNameKey("Unit_Test_Mixed_Case.PNG")) ==
+        mm->m_materials_by_name.end());
+    mm->m_shared_material_index = shared_index;
+}   // unitTesting
+
+// ----------------------------------------------------------------------------
+/** Loads the materials of all tracks and compares the time to find materials
+ *  with the indices to the time of a linear search. The lookups are the
+ *  ones done while loading a track: every material is searched by the full
+ *  path of its textures, as for each mesh buffer in convertTrackToBullet,
+ *  and by its name, plus a name which doesn't exist.
+ */
+void MaterialManager::benchmark()
+{
+    typedef std::chrono::steady_clock Clock;
+    MaterialManager* mm = material_manager;
+    double total_index = 0.0, total_scan = 0.0;
+    unsigned int total_lookups = 0, total_mismatches = 0;
+    for (unsigned int t = 0; t < track_manager->getNumberOfTracks(); t++)
     {
-        if(m_materials[i]->getTexFname()==basename) return true;
+        Track* track = track_manager->getTrack(t);
+        const std::string materials_file = track->getTrackFile("materials.xml");
+        if (track->isInternal() || !file_manager->fileExists(materials_file))
+            continue;
+        file_manager->pushTextureSearchPath(
+            StringUtils::getPath(track->getFilename()),
+            StringUtils::insertValues("tracks/%s", track->getIdent().c_str()));
+        mm->pushTempMaterial(materials_file);
+
+        // Copy the names, since finding a material can install it
+        std::vector<std::pair<std::string, std::string> > paths;
+        std::vector<std::string> names;
+        for (Material* m : mm->m_materials)
+        {
+            if (!m->getTexFullPath().empty())
+            {
+                paths.emplace_back(m->getTexFullPath(),
+                                   m->getUVTwoTexture());
+            }
+            names.push_back(m->getTexFname());
+            names.push_back(m->getTexFname() + "_missing");
+        }
+
+        // Run with the indices, then with a linear search
+        std::vector<Material*> results[2];
+        double seconds[2];
+        for (int use_index = 1; use_index >= 0; use_index--)
+        {
+            mm->m_use_index = use_index == 1;
+            std::vector<Material*>& result = results[use_index];
+            Clock::time_point start = Clock::now();
+            for (auto& path : paths)
+            {
+                result.push_back(mm->getMaterialSPM(path.first,
+                                                    path.second));
+            }
+            for (const std::string& name : names)
+            {
+                result.push_back(mm->getMaterial(name,
+                    /*is_full_path*/false, /*make_permanent*/false,
+                    /*complain_if_not_found*/false, /*strip_path*/true,
+                    /*install*/false, /*create_if_not_found*/false));
+            }
+            seconds[use_index] = std::chrono::duration<double>
+                (Clock::now() - start).count();
+        }
+        mm->m_use_index = true;
+
+        unsigned int mismatches = 0;
+        for (unsigned int i = 0; i < results[0].size(); i++)
+        {
+            if (results[0][i] != results[1][i])
+                mismatches++;
+        }
+        Log::info("MaterialManager", "%s: %d materials, %.0f lookups/s with "
+            "index, %.0f lookups/s with full search, %d mismatches.",
+            track->getIdent().c_str(), (int)mm->m_materials.size(),
+            results[1].size() / seconds[1], results[0].size() / seconds[0],
+            mismatches);
+        total_index += seconds[1];
+        total_scan += seconds[0];
+        total_lookups += (unsigned int)results[0].size();
+        total_mismatches += mismatches;
+
+        mm->popTempMaterial();
+        file_manager->popTextureSearchPath();
     }
-    return false;
-}
+    if (total_lookups == 0)
+    {
+        Log::warn("MaterialManager", "No track with materials found.");
+        return;
+    }
+    Log::info("MaterialManager", "All tracks: %.0f lookups/s with index, "
+        "%.0f lookups/s with full search, %d mismatches.",
+        total_lookups / total_index, total_lookups / total_scan,
+        total_mismatches);
+}   // benchmark
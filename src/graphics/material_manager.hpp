@@ -32,6 +32,7 @@ using namespace irr;
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <EMaterialTypes.h>
 
 class Material;
@@ -50,8 +51,28 @@ private:
 
     std::vector<Material*> m_materials;
 
+    /** Indices into m_materials of the materials with the same lower case
+     *  basename of their texture name (see getNameKey), in increasing order.
+     *  This avoids comparing against all materials for every mesh buffer
+     *  when loading a track. */
+    std::unordered_map<std::string, std::vector<int> > m_materials_by_name;
+
+    /** Indices into m_materials of the materials with the same (lower case)
+     *  full path of their texture, in increasing order. */
+    std::unordered_map<std::string, std::vector<int> > m_materials_by_path;
+
+    /** If false the materials are searched linearly instead of using the
+     *  indices above. Only used for benchmarking. */
+    bool m_use_index;
+
     std::map<std::string, Material*> m_default_sp_materials;
 
+    static std::string getNameKey(const std::string& name);
+    void      addMaterial(Material *m);
+    void      removeLastMaterial();
+    Material* findMaterial(const std::string& name, bool is_full_path,
+                           const std::string* layer_two = NULL) const;
+
 public:
               MaterialManager();
              ~MaterialManager();
@@ -87,6 +108,8 @@ public:
                                    const std::string& layer_one_lc = "",
                                    bool full_path = false);
     Material* getLatestMaterial() { return m_materials[m_materials.size()-1]; }
+    static void unitTesting();
+    static void benchmark();
 };   // MaterialManager
 
 extern MaterialManager *material_manager;
@@ -43,6 +43,7 @@
 #include <FindDirectory.h>
 #endif
 
+#include <atomic>
 #include <stdio.h>
 #include <stdexcept>
 #include <sstream>
@@ -266,6 +267,7 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedDataDir();
     checkAndCreateGPDir();
 
     redirectOutput();
@@ -841,6 +843,14 @@ std::string FileManager::getCachedTexturesDir() const
     return m_cached_textures_dir;
 }   // getCachedTexturesDir
 
+//-----------------------------------------------------------------------------
+/** Returns the directory in which data computed from assets is cached.
+*/
+std::string FileManager::getCachedDataDir() const
+{
+    return m_cached_data_dir;
+}   // getCachedDataDir
+
 //-----------------------------------------------------------------------------
 /** Returns the directory in which user-defined grand prix should be stored.
  */
@@ -1209,6 +1219,31 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates the directory for data computed from assets, e.g. the shortest
+*  paths of arena navmeshes. This will set m_cached_data_dir.
+*/
+void FileManager::checkAndCreateCachedDataDir()
+{
+#if defined(WIN32) || defined(__HAIKU__)
+    m_cached_data_dir = m_user_config_dir + "cached-data/";
+#elif defined(__APPLE__)
+    m_cached_data_dir = getenv("HOME");
+    m_cached_data_dir += "/Library/Application Support/SuperTuxKart/CachedData/";
+#else
+    m_cached_data_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_data_dir += "cached-data/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_data_dir))
+    {
+        Log::error("FileManager", "Can not create cached data directory '%s', "
+            "falling back to '.'.", m_cached_data_dir.c_str());
+        m_cached_data_dir = ".";
+    }
+
+}   // checkAndCreateCachedDataDir
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
@@ -1616,6 +1651,40 @@ bool FileManager::copyFile(const std::string &source, const std::string &dest)
     return true;
 }   // copyFile
 
+// ----------------------------------------------------------------------------
+/** Writes a file under a temporary name and then renames it, so that other
+ *  processes (e.g. several servers filling the same cache) never read a
+ *  partially written file. The temporary name contains the process id and a
+ *  counter, so concurrent writers never write into the same file.
+ *  \param name Name of the file to write.
+ *  \param write Function writing the content to the given file, returns
+ *         false if this failed.
+ *  \return True if the file was written successfully.
+ */
+bool FileManager::writeFileAtomically(const std::string &name,
+                                      std::function<bool(FILE*)> write) const
+{
+    static std::atomic<unsigned int> counter(0);
+#ifdef WIN32
+    const unsigned int pid = (unsigned int)GetCurrentProcessId();
+#else
+    const unsigned int pid = (unsigned int)getpid();
+#endif
+    const std::string tmp_name = name + StringUtils::insertValues(".%u.%u.tmp",
+                                                pid, counter.fetch_add(1));
+    FILE *f = FileUtils::fopenU8Path(tmp_name, "wb");
+    if (!f)
+        return false;
+    bool ok = write(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || FileUtils::renameU8Path(tmp_name, name) != 0)
+    {
+        removeFile(tmp_name);
+        return false;
+    }
+    return true;
+}   // writeFileAtomically
+
 // ----------------------------------------------------------------------------
 /** Returns true if the first file is newer than the second. The comparison is
 *   based on the modification time of the two files.
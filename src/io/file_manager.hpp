@@ -25,6 +25,8 @@
  * Contains generic utility classes for file I/O (especially XML handling).
  */
 
+#include <cstdio>
+#include <functional>
 #include <string>
 #include <vector>
 #include <set>
@@ -98,6 +100,10 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where data computed from assets (e.g. navmesh shortest
+     *  paths) is cached. */
+    std::string       m_cached_data_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -128,6 +134,7 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    void              checkAndCreateCachedDataDir();
     void              checkAndCreateGPDir();
     void              discoverPaths();
     void              addAssetsSearchPath();
@@ -154,6 +161,7 @@ public:
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    std::string       getCachedDataDir() const;
     std::string       getGPDir() const;
     std::string       getStdoutDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
@@ -168,6 +176,9 @@ public:
     bool moveDirectoryInto(std::string source, std::string target);
     // ------------------------------------------------------------------------
     bool copyFile(const std::string &source, const std::string &dest);
+    // ------------------------------------------------------------------------
+    bool writeFileAtomically(const std::string &name,
+                             std::function<bool(FILE*)> write) const;
     std::vector<std::string>getMusicDirs() const;
     std::string getAssetChecked(AssetType type, const std::string& name,
                                 bool abort_on_error=false) const;
@@ -664,12 +664,12 @@ void Flyable::moveToInfinity(bool set_moveable_trans)
 }   // moveToInfinity
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Flyable::saveState(std::vector<std::string>* ru)
+BareNetworkString* Flyable::saveState(std::vector<uint16_t>* ru)
 {
     if (m_has_hit_something)
         return NULL;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
 
     BareNetworkString* buffer = new BareNetworkString();
     uint16_t ticks_since_thrown_animation = (m_ticks_since_thrown & 32767) |
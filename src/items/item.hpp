@@ -172,6 +172,15 @@ public:
         return false;
     }   // hitKart
 
+    // -----------------------------------------------------------------------
+    /** Dummy implementation, causing an abort if it should be called to
+     *  catch any errors early. */
+    virtual float getCollectDistance2() const
+    {
+        Log::fatal("ItemState", "getCollectDistance2() called for ItemState.");
+        return 0;
+    }   // getCollectDistance2
+
     // -----------------------------------------------------------------------
     virtual int getGraphNode() const 
     {
@@ -410,6 +419,9 @@ public:
     }   // hitKart
     // ------------------------------------------------------------------------
     bool rotating() const               { return getType() != ITEM_BUBBLEGUM; }
+    // ------------------------------------------------------------------------
+    /** Returns the square distance at which this item is collected. */
+    virtual float getCollectDistance2() const OVERRIDE { return m_distance_2; }
 
 public:
     // ------------------------------------------------------------------------
@@ -41,6 +41,8 @@
 #include <IAnimatedMesh.h>
 
 #include <assert.h>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
 #include <sstream>
 #include <string>
@@ -171,6 +173,13 @@ void ItemManager::removeTextures()
 ItemManager::ItemManager()
 {
     m_switch_ticks = -1;
+    m_item_grid_min_x        = 0.0f;
+    m_item_grid_min_z        = 0.0f;
+    m_item_grid_cell_size    = 1.0f;
+    m_item_grid_width        = 0;
+    m_item_grid_height       = 0;
+    m_item_grid_hit_distance = 0.0f;
+    m_item_grid_dirty        = true;
     // The actual loading is done in loadDefaultItems
 
     // Prepare the switch to array, which stores which item should be
@@ -257,6 +266,7 @@ unsigned int ItemManager::insertItem(Item *item)
  */
 void ItemManager::insertItemInQuad(Item *item)
 {
+    m_item_grid_dirty = true;
     if(m_items_in_quads)
     {
         int graph_node = item->getGraphNode();
@@ -381,50 +391,185 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
     kart->collectedItem(item);
 }   // collectedItem
 
+//-----------------------------------------------------------------------------
+/** Sorts the indices of all items into m_item_grid_start/m_item_grid_items.
+ *  Each item is added to all cells which overlap the square around it with
+ *  a side length of twice the collection distance. A kart can only hit an
+ *  item if it is in one of these cells.
+ */
+void ItemManager::buildItemGrid()
+{
+    m_item_grid_dirty = false;
+    m_item_grid_start.clear();
+    m_item_grid_items.clear();
+    m_item_grid_width  = 0;
+    m_item_grid_height = 0;
+
+    float max_distance_2 = 0.0f;
+    float min_x =  std::numeric_limits<float>::max();
+    float min_z =  std::numeric_limits<float>::max();
+    float max_x = -std::numeric_limits<float>::max();
+    float max_z = -std::numeric_limits<float>::max();
+    for (ItemState *item : m_all_items)
+    {
+        if (!item) continue;
+        const Vec3 &xyz = item->getXYZ();
+        // An item at a non-finite position can never be hit (the distance
+        // test in hitKart is then always false), so it can be ignored
+        if (!std::isfinite(xyz.getX()) || !std::isfinite(xyz.getZ()))
+            continue;
+        min_x = std::min(min_x, xyz.getX());
+        min_z = std::min(min_z, xyz.getZ());
+        max_x = std::max(max_x, xyz.getX());
+        max_z = std::max(max_z, xyz.getZ());
+        max_distance_2 = std::max(max_distance_2, item->getCollectDistance2());
+    }
+    if (min_x > max_x) return;
+
+    // hitKart halves the Y component of the rotated distance vector, so an
+    // item can be hit from up to twice its collection distance away. Add a
+    // small margin for the rounding errors of the rotation.
+    m_item_grid_hit_distance = 2.0f * sqrtf(max_distance_2) * 1.01f + 0.01f;
+    const float r = m_item_grid_hit_distance;
+    m_item_grid_min_x = min_x - r;
+    m_item_grid_min_z = min_z - r;
+
+    // With a cell size of at least 2*r each item is in at most 4 cells.
+    // Limit the number of cells for very large tracks.
+    const int MAX_CELLS = 128;
+    const float extent = std::max(max_x - min_x, max_z - min_z) + 2.0f * r;
+    m_item_grid_cell_size = std::max(2.0f * r, extent / MAX_CELLS);
+    m_item_grid_width  = std::min(MAX_CELLS,
+        int((max_x - min_x + 2.0f * r) / m_item_grid_cell_size) + 1);
+    m_item_grid_height = std::min(MAX_CELLS,
+        int((max_z - min_z + 2.0f * r) / m_item_grid_cell_size) + 1);
+
+    // Counting sort: first count the items in each cell, then fill the
+    // cells. Items are added in index order, so each cell stays sorted.
+    const unsigned int num_cells = m_item_grid_width * m_item_grid_height;
+    m_item_grid_start.resize(num_cells + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned int i = 0; i < m_all_items.size(); i++)
+        {
+            const ItemState *item = m_all_items[i];
+            if (!item) continue;
+            const Vec3 &xyz = item->getXYZ();
+            if (!std::isfinite(xyz.getX()) || !std::isfinite(xyz.getZ()))
+                continue;
+            // Must use the same computation as findItemsNear, so that any
+            // kart position in [x-r, x+r] maps to one of these cells.
+            int x0 = (int)floorf((xyz.getX() - r - m_item_grid_min_x)
+                                 / m_item_grid_cell_size);
+            int x1 = (int)floorf((xyz.getX() + r - m_item_grid_min_x)
+                                 / m_item_grid_cell_size);
+            int z0 = (int)floorf((xyz.getZ() - r - m_item_grid_min_z)
+                                 / m_item_grid_cell_size);
+            int z1 = (int)floorf((xyz.getZ() + r - m_item_grid_min_z)
+                                 / m_item_grid_cell_size);
+            x0 = std::max(x0, 0);  x1 = std::min(x1, m_item_grid_width  - 1);
+            z0 = std::max(z0, 0);  z1 = std::min(z1, m_item_grid_height - 1);
+            for (int z = z0; z <= z1; z++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    const unsigned int cell = z * m_item_grid_width + x;
+                    if (pass == 0)
+                        m_item_grid_start[cell + 1]++;
+                    else
+                        m_item_grid_items[m_item_grid_start[cell]++] = i;
+                }   // for x
+            }   // for z
+        }   // for i < m_all_items.size()
+
+        if (pass == 0)
+        {
+            for (unsigned int cell = 0; cell < num_cells; cell++)
+                m_item_grid_start[cell + 1] += m_item_grid_start[cell];
+            m_item_grid_items.resize(m_item_grid_start[num_cells]);
+        }
+    }   // for pass
+
+    // The second pass moved each start index to the start of the next
+    // cell, shift them back.
+    for (unsigned int cell = num_cells; cell > 0; cell--)
+        m_item_grid_start[cell] = m_item_grid_start[cell - 1];
+    m_item_grid_start[0] = 0;
+}   // buildItemGrid
+
+//-----------------------------------------------------------------------------
+/** Returns the indices of all items, sorted by index, that might be hit by a
+ *  kart at the given position. It contains every item for which hitKart can
+ *  be true, but it might contain NULL entries or items that are too far
+ *  away.
+ *  \param xyz Position of the kart.
+ *  \param result On return contains the item indices.
+ */
+void ItemManager::findItemsNear(const Vec3 &xyz,
+                                std::vector<unsigned int> *result)
+{
+    result->clear();
+    if (m_item_grid_dirty)
+        buildItemGrid();
+    if (m_item_grid_width == 0)
+        return;
+
+    // Compare as float first so that huge or non-finite positions do not
+    // overflow the integer conversion.
+    const float fx = floorf((xyz.getX() - m_item_grid_min_x)
+                            / m_item_grid_cell_size);
+    const float fz = floorf((xyz.getZ() - m_item_grid_min_z)
+                            / m_item_grid_cell_size);
+    if (!(fx >= 0.0f && fx < (float)m_item_grid_width &&
+          fz >= 0.0f && fz < (float)m_item_grid_height))
+        return;
+
+    const unsigned int cell = (int)fz * m_item_grid_width + (int)fx;
+    result->insert(result->end(),
+                   m_item_grid_items.begin() + m_item_grid_start[cell],
+                   m_item_grid_items.begin() + m_item_grid_start[cell + 1]);
+}   // findItemsNear
+
 //-----------------------------------------------------------------------------
 /** Checks if any item was collected by the given kart. This function calls
- *  collectedItem if an item was collected.
+ *  collectedItem if an item was collected. Only the items in the grid cell
+ *  of the kart are tested, in the same order as all items would be tested,
+ *  so the result is identical to testing all items.
  *  \param kart Pointer to the kart.
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
-
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
 
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    // collectedItem might change the list of items, so copy the indices
+    findItemsNear(kart->getXYZ(), &m_item_candidates);
+    for (unsigned int index : m_item_candidates)
     {
+        if (index >= m_all_items.size()) continue;
+        ItemState *item = m_all_items[index];
+
         // Ignore items that have been collected or are not available atm
-        if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
+        if (!item || !item->isAvailable() || item->isUsedUp()) continue;
 
         // Shielded karts can simply drive over bubble gums without any effect
         if ( kart->isShielded() &&
-             ( (*i)->getType() == ItemState::ITEM_BUBBLEGUM      ||
-               (*i)->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
+             ( item->getType() == ItemState::ITEM_BUBBLEGUM      ||
+               item->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
         {
             continue;
         }
 
-
         // To allow inlining and avoid including kart.hpp in item.hpp,
         // we pass the kart and the position separately.
-        if((*i)->hitKart(kart->getXYZ(), kart))
+        if(item->hitKart(kart->getXYZ(), kart))
         {
-            collectedItem(*i, kart);
+            collectedItem(item, kart);
         }   // if hit
-    }   // for m_all_items
+    }   // for m_item_candidates
 }   // checkItemHit
 
 //-----------------------------------------------------------------------------
@@ -540,6 +685,7 @@ void ItemManager::deleteItem(ItemState *item)
  */
 void ItemManager::deleteItemInQuad(ItemState* item)
 {
+    m_item_grid_dirty = true;
     if(m_items_in_quads)
     {
         int sector = item->getGraphNode();
@@ -711,3 +857,110 @@ bool ItemManager::randomItemsForArena(const AlignedArray<btTransform>& pos)
 
     return true;
 }   // randomItemsForArena
+
+//-----------------------------------------------------------------------------
+/** Tests that the grid used in checkItemHit finds exactly the items, in the
+ *  same order, that are found when testing all items.
+ */
+void ItemManager::unitTesting()
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> offset(-3.0f, 3.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    ItemManager im;
+    auto add_items = [&](unsigned int count)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            Vec3 xyz(pos(random), offset(random), pos(random));
+            // Put some items into clusters
+            if (i % 3 == 0 && im.getNumberOfItems() > 0)
+            {
+                const ItemState *other =
+                    im.m_all_items[random() % im.getNumberOfItems()];
+                if (other)
+                    xyz = other->getXYZ() + Vec3(offset(random),
+                                                 offset(random),
+                                                 offset(random));
+            }
+            Vec3 normal(unit(random), 1.0f, unit(random));
+            normal.normalize();
+            ItemState::ItemType type = (ItemState::ItemType)
+                (ItemState::ITEM_FIRST + random() % ItemState::ITEM_COUNT);
+            im.insertItem(new Item(type, xyz, normal, NULL, NULL, "",
+                                   /*owner*/NULL));
+        }
+    };   // add_items
+
+    auto compare = [&](const Vec3 &xyz)
+    {
+        std::vector<unsigned int> all, near;
+        for (unsigned int i = 0; i < im.m_all_items.size(); i++)
+        {
+            if (im.m_all_items[i] && im.m_all_items[i]->hitKart(xyz))
+                all.push_back(i);
+        }
+        std::vector<unsigned int> candidates;
+        im.findItemsNear(xyz, &candidates);
+        assert(std::is_sorted(candidates.begin(), candidates.end()));
+        for (unsigned int i : candidates)
+        {
+            if (im.m_all_items[i] && im.m_all_items[i]->hitKart(xyz))
+                near.push_back(i);
+        }
+        assert(all == near);
+        return all.size();
+    };   // compare
+
+    auto compare_all = [&]()
+    {
+        unsigned int hits = 0;
+        for (unsigned int i = 0; i < 5000; i++)
+        {
+            Vec3 xyz(pos(random), offset(random), pos(random));
+            const ItemState *item =
+                im.m_all_items[random() % im.getNumberOfItems()];
+            if (i % 2 == 0 && item)
+            {
+                xyz = item->getXYZ() + Vec3(offset(random), offset(random),
+                                            offset(random));
+            }
+            hits += (unsigned int)compare(xyz);
+        }
+        // Make sure that the test actually tests hits
+        assert(hits > 0);
+        // Positions outside of the grid
+        compare(Vec3(1000.0f, 0.0f, 0.0f));
+        compare(Vec3(0.0f, 0.0f, -1e30f));
+        compare(Vec3(std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f));
+    };   // compare_all
+
+    // No items at all
+    std::vector<unsigned int> candidates;
+    im.findItemsNear(Vec3(0, 0, 0), &candidates);
+    assert(candidates.empty());
+
+    add_items(500);
+    compare_all();
+
+    // Deleting items leaves NULL entries which get reused
+    for (unsigned int i = 0; i < im.m_all_items.size(); i += 3)
+    {
+        if (im.m_all_items[i])
+            im.deleteItem(im.m_all_items[i]);
+    }
+    compare_all();
+    add_items(100);
+    compare_all();
+
+    // Items moved directly
+    for (unsigned int i = 0; i < im.m_all_items.size(); i += 5)
+    {
+        if (im.m_all_items[i])
+            im.m_all_items[i]->setXYZ(Vec3(pos(random), 0, pos(random)));
+    }
+    im.invalidateItemGrid();
+    compare_all();
+}   // unitTesting
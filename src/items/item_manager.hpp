@@ -113,6 +113,31 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** A uniform grid over the XZ plane with the indices of all items, used
+     *  in checkItemHit to only test items close to a kart. Each item is
+     *  stored in all cells its collection area overlaps, so only the cell
+     *  of the kart needs to be tested. Unlike m_items_in_quads it also
+     *  exists without a graph, and it does not need a search over adjacent
+     *  quads. The items of cell n are m_item_grid_items[m_item_grid_start[n]
+     *  ... m_item_grid_start[n+1]-1], sorted by index. */
+    std::vector<unsigned int> m_item_grid_start;
+    std::vector<unsigned int> m_item_grid_items;
+    float m_item_grid_min_x;
+    float m_item_grid_min_z;
+    float m_item_grid_cell_size;
+    int   m_item_grid_width;
+    int   m_item_grid_height;
+
+    /** Largest distance from an item at which a kart can hit it. */
+    float m_item_grid_hit_distance;
+
+    /** Set if items were added, removed or moved, the grid is then
+     *  rebuilt before it is used the next time. */
+    bool m_item_grid_dirty;
+
+    /** Items to test in checkItemHit, kept to avoid allocations. */
+    std::vector<unsigned int> m_item_candidates;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -132,7 +157,14 @@ protected:
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    // ------------------------------------------------------------------------
+    /** Must be called if item positions were changed directly. */
+    void invalidateItemGrid()                    { m_item_grid_dirty = true; }
+private:
+    void buildItemGrid();
+    void findItemsNear(const Vec3 &xyz, std::vector<unsigned int> *result);
 public:
+    static void unitTesting();
              ItemManager();
     virtual ~ItemManager();
 
@@ -884,7 +884,7 @@ bool RubberBall::hit(AbstractKart* kart, PhysicalObject* object)
 }   // hit
 
 // ----------------------------------------------------------------------------
-BareNetworkString* RubberBall::saveState(std::vector<std::string>* ru)
+BareNetworkString* RubberBall::saveState(std::vector<uint16_t>* ru)
 {
     BareNetworkString* buffer = Flyable::saveState(ru);
     if (!buffer)
@@ -81,6 +81,16 @@ public:
     virtual void  rewindTo(BareNetworkString *buffer) = 0;
     virtual void rumble(float strength_low, float strength_high, uint16_t duration) {}
     // ---------------------------------------------------------------------------
+    /** Called for all karts before they are updated, for several karts in
+     *  parallel. An AI can compute here what only needs to read the world,
+     *  and use the result in update(). It must not modify anything but the
+     *  controller itself. */
+    virtual void  think(int ticks) {}
+    // ---------------------------------------------------------------------------
+    /** Returns a checksum of the result of the last think(), used to check
+     *  that thinking in parallel gives the same result as serially. */
+    virtual uint32_t getThinkChecksum() const { return 0; }
+    // ---------------------------------------------------------------------------
     /** Sets the controller name for this controller. */
     virtual void setControllerName(const std::string &name)
                                                  { m_controller_name = name; }
@@ -74,6 +74,22 @@ void NetworkAIController::update(int ticks)
     PlayerController::update(ticks);
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Lets the AI think if it will be updated in this frame. */
+void NetworkAIController::think(int ticks)
+{
+    if (!RewindManager::get()->isRewinding() &&
+        (World::getWorld()->isStartPhase() ||
+        World::getWorld()->getTicksSinceStart() > m_prev_update_ticks))
+        m_ai_controller->think(m_ai_frequency);
+}   // think
+
+// ----------------------------------------------------------------------------
+uint32_t NetworkAIController::getThinkChecksum() const
+{
+    return m_ai_controller->getThinkChecksum();
+}   // getThinkChecksum
+
 // ----------------------------------------------------------------------------
 void NetworkAIController::reset()
 {
@@ -37,6 +37,8 @@ public:
                                      AIBaseController* ai);
     virtual     ~NetworkAIController();
     virtual void update(int ticks) OVERRIDE;
+    virtual void think(int ticks) OVERRIDE;
+    virtual uint32_t getThinkChecksum() const OVERRIDE;
     virtual void reset() OVERRIDE;
     // ------------------------------------------------------------------------
     virtual bool isLocalPlayerController() const OVERRIDE;
@@ -179,6 +179,10 @@ void SkiddingAI::reset()
     m_skid_probability_state     = SKID_PROBAB_NOT_YET;
     m_last_item_random           = NULL;
     m_burster                    = false;
+    m_think_ticks                = -1;
+    m_use_think_aim_point        = false;
+    m_think_aim_point            = Vec3(0,0,0);
+    m_think_last_node            = Graph::UNKNOWN_SECTOR;
 
     AIBaseLapController::reset();
     m_track_node               = Graph::UNKNOWN_SECTOR;
@@ -324,8 +328,13 @@ void SkiddingAI::update(int ticks)
         return;
     }
 
-    // Get information that is needed by more than 1 of the handling funcs
-    computeNearestKarts();
+    // Get information that is needed by more than 1 of the handling funcs,
+    // unless think() did it already
+    const bool has_thought =
+        m_think_ticks == m_world->getTicksSinceStart();
+    m_think_ticks = -1;
+    if (!has_thought)
+        computeNearestKarts();
 
     if (!m_enabled_network_ai)
     {
@@ -341,11 +350,15 @@ void SkiddingAI::update(int ticks)
     }
 
     //Detect if we are going to crash with the track and/or kart
-    checkCrashes(m_kart->getXYZ());
-    determineTrackDirection();
+    if (!has_thought)
+    {
+        checkCrashes(m_kart->getXYZ());
+        determineTrackDirection();
+    }
 
     /*Response handling functions*/
     handleAccelerationAndBraking(ticks);
+    m_use_think_aim_point = has_thought;
     handleSteering(dt);
     handleRescue(dt);
 
@@ -358,6 +371,83 @@ void SkiddingAI::update(int ticks)
     AIBaseLapController::update(ticks);
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Computes the information for the next update() which only needs to read
+ *  the world: the nearest karts, crashes, the direction of the track and the
+ *  point to aim at. This is called for several karts in parallel, so only
+ *  members of this AI are written.
+ *  \param ticks Number of physics time steps.
+ */
+void SkiddingAI::think(int ticks)
+{
+    m_think_ticks = -1;
+    // The same conditions in which update() doesn't need the information
+    if (m_kart->getKartAnimation() || isStuck() || m_world->isStartPhase())
+        return;
+
+    computeNearestKarts();
+    checkCrashes(m_kart->getXYZ());
+    determineTrackDirection();
+    computeAimPoint(&m_think_aim_point, &m_think_last_node);
+    m_think_ticks = m_world->getTicksSinceStart();
+}   // think
+
+//-----------------------------------------------------------------------------
+/** Returns a checksum of all values computed by think(). */
+uint32_t SkiddingAI::getThinkChecksum() const
+{
+    uint32_t checksum = 2166136261u;
+    auto add = [&checksum](const void* data, size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+            checksum = (checksum ^ bytes[i]) * 16777619u;
+    };
+    const int kart_ahead =
+        m_kart_ahead ? (int)m_kart_ahead->getWorldKartId() : -1;
+    const int kart_behind =
+        m_kart_behind ? (int)m_kart_behind->getWorldKartId() : -1;
+    add(&m_think_ticks, sizeof(m_think_ticks));
+    add(&kart_ahead, sizeof(kart_ahead));
+    add(&kart_behind, sizeof(kart_behind));
+    add(&m_distance_ahead, sizeof(m_distance_ahead));
+    add(&m_distance_behind, sizeof(m_distance_behind));
+    add(&m_distance_leader, sizeof(m_distance_leader));
+    add(&m_distance_to_player, sizeof(m_distance_to_player));
+    add(&m_num_players_ahead, sizeof(m_num_players_ahead));
+    add(&m_crashes.m_road, sizeof(m_crashes.m_road));
+    add(&m_crashes.m_kart, sizeof(m_crashes.m_kart));
+    add(&m_current_track_direction, sizeof(m_current_track_direction));
+    add(&m_last_direction_node, sizeof(m_last_direction_node));
+    add(&m_current_curve_radius, sizeof(m_current_curve_radius));
+    for (int i = 0; i < 3; i++)
+    {
+        float curve_center = m_curve_center[i];
+        float aim_point = m_think_aim_point[i];
+        add(&curve_center, sizeof(curve_center));
+        add(&aim_point, sizeof(aim_point));
+    }
+    add(&m_think_last_node, sizeof(m_think_last_node));
+    return checksum;
+}   // getThinkChecksum
+
+//-----------------------------------------------------------------------------
+/** Determines the point to aim at with the selected point selection
+ *  algorithm.
+ *  \param aim_point The point to aim at.
+ *  \param last_node The graph node index in which the aim_point is.
+ */
+void SkiddingAI::computeAimPoint(Vec3 *aim_point, int *last_node)
+{
+    switch(m_point_selection_algorithm)
+    {
+    case PSA_NEW:    findNonCrashingPointNew(aim_point, last_node);
+                     break;
+    case PSA_DEFAULT:findNonCrashingPoint(aim_point, last_node);
+                     break;
+    }
+}   // computeAimPoint
+
 //-----------------------------------------------------------------------------
 /** Decides in which direction to steer. If the kart is off track, it will
  *  steer towards the center of the track. Otherwise it will call one of
@@ -469,13 +559,13 @@ void SkiddingAI::handleSteering(float dt)
         Vec3 aim_point;
         int last_node = Graph::UNKNOWN_SECTOR;
 
-        switch(m_point_selection_algorithm)
+        if (m_use_think_aim_point)
         {
-        case PSA_NEW:    findNonCrashingPointNew(&aim_point, &last_node);
-                         break;
-        case PSA_DEFAULT:findNonCrashingPoint(&aim_point, &last_node);
-                         break;
+            aim_point = m_think_aim_point;
+            last_node = m_think_last_node;
         }
+        else
+            computeAimPoint(&aim_point, &last_node);
 #ifdef AI_DEBUG
         m_debug_sphere[m_point_selection_algorithm]->setPosition(aim_point.toIrrVector());
 #endif
@@ -191,6 +191,17 @@ private:
     /** Number of players ahead, used for rubber-banding. */
     int m_num_players_ahead;
 
+    /** World ticks at which think() computed the nearest karts, crashes,
+     *  track direction and aim point for the next update(), or -1. */
+    int m_think_ticks;
+
+    /** True if handleSteering() uses the aim point computed by think(). */
+    bool m_use_think_aim_point;
+
+    /** The point to aim at computed by think(), and its graph node. */
+    Vec3 m_think_aim_point;
+    int  m_think_last_node;
+
     /** This bool allows to make the AI use nitro by series of two bursts */
     bool m_burster;
 
@@ -289,6 +300,7 @@ private:
     void  checkCrashes(const Vec3& pos);
     void  findNonCrashingPointNew(Vec3 *result, int *last_node);
     void  findNonCrashingPoint(Vec3 *result, int *last_node);
+    void  computeAimPoint(Vec3 *aim_point, int *last_node);
 
     void  determineTrackDirection();
     virtual bool canSkid(float steer_fraction);
@@ -302,6 +314,8 @@ public:
                  SkiddingAI(AbstractKart *kart);
                 ~SkiddingAI();
     virtual void update      (int ticks);
+    virtual void think       (int ticks);
+    virtual uint32_t getThinkChecksum() const;
     virtual void reset       ();
     virtual const irr::core::stringw& getNamePostfix() const;
 };
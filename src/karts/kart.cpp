@@ -65,6 +65,7 @@
 #include "modes/capture_the_flag.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/overworld.hpp"
+#include "modes/profile_world.hpp"
 #include "modes/soccer_world.hpp"
 #include "network/compress_network_body.hpp"
 #include "network/network_config.hpp"
@@ -75,6 +76,7 @@
 #include "physics/btKart.hpp"
 #include "physics/btKartRaycast.hpp"
 #include "physics/physics.hpp"
+#include "physics/triangle_mesh.hpp"
 #include "race/history.hpp"
 #include "tracks/terrain_info.hpp"
 #include "tracks/drive_graph.hpp"
@@ -755,10 +757,13 @@ void Kart::createPhysics()
 
     // Create the actual vehicle
     // -------------------------
+    const TriangleMesh* track_mesh =
+        Track::getCurrentTrack()->getPtrTriangleMesh();
     m_vehicle_raycaster.reset(
         new btKartRaycaster(Physics::get()->getPhysicsWorld(),
                             stk_config->m_smooth_normals &&
-                            Track::getCurrentTrack()->smoothNormals()));
+                            Track::getCurrentTrack()->smoothNormals(),
+                            track_mesh ? track_mesh->getBody() : NULL));
     m_vehicle.reset(new btKart(m_body.get(), m_vehicle_raycaster.get(), this));
 
     // never deactivate the vehicle
@@ -1448,7 +1453,10 @@ void Kart::update(int ticks)
     // based on the collision speed.
     m_body->setRestitution(m_kart_properties->getRestitution(fabsf(m_speed)));
 
-    m_controller->update(ticks);
+    {
+        ProfileWorld::SectionTimer timer(ProfileWorld::PS_AI);
+        m_controller->update(ticks);
+    }
 
 #ifndef SERVER_ONLY
 #undef DEBUG_CAMERA_SHAKE
@@ -1651,9 +1659,8 @@ void Kart::update(int ticks)
         {
             if(!getKartAnimation()) {
                 beep();
-                std::string player_id = StringUtils::wideToUtf8(getController()->getName());
-                Log::info("Kart", "Player %s beeping!", 
-                    player_id.c_str());
+                STK_LOG_INFO("Kart", "Player %s beeping!",
+                    StringUtils::wideToUtf8(getController()->getName()).c_str());
             }
         }
         World::getWorld()->onFirePressed(getController());
@@ -1694,7 +1701,8 @@ void Kart::update(int ticks)
     PROFILER_PUSH_CPU_MARKER("Kart::Update (material)", 0x60, 0x34, 0x7F);
 if (!material)   // kart falling off the track
 {
-    Log::info("Kart", "[updatePhysics] No material detected for kart %d at (%.2f, %.2f, %.2f)", 
+    // Called every frame while falling, so limit the output
+    STK_LOG_EVERY(1000, info, "Kart", "[updatePhysics] No material detected for kart %d at (%.2f, %.2f, %.2f)",
             getWorldKartId(), getXYZ().getX(), getXYZ().getY(), getXYZ().getZ());
 
     // let kart fall a bit before rescuing
@@ -1702,7 +1710,7 @@ if (!material)   // kart falling off the track
     Track::getCurrentTrack()->getAABB(&min, &max);
 
     float height_diff = min->getY() - getXYZ().getY();
-    Log::info("Kart", "Height difference: %.2f (threshold: 17), dist_to_sector: %.2f (threshold: 25)", 
+    STK_LOG_DEBUG("Kart", "Height difference: %.2f (threshold: 17), dist_to_sector: %.2f (threshold: 25)",
               height_diff, dist_to_sector);
 
     if((min->getY() - getXYZ().getY() > 17 || dist_to_sector > 25) && !m_flying &&
@@ -1716,20 +1724,19 @@ if (!material)   // kart falling off the track
 
         if (NetworkConfig::get()->isServer())
         {
-            Log::info("Kart", "Server detected, checking analytics...");
+            STK_LOG_DEBUG("Kart", "Server detected, checking analytics...");
             if (NetworkConfig::get()->getServerAnalytics())
             {
 
-                Log::debug("Kart", "Analytics available, preparing event...");
-                std::string player_id = StringUtils::wideToUtf8(getController()->getName());
+                STK_LOG_DEBUG("Kart", "Analytics available, preparing event...");
                 auto* analytics = NetworkConfig::get()->getServerAnalytics().get();
                 if (analytics)
                 {
-                    Log::info("Kart", "Sending fall-off-track event to analytics for player %s", 
-                              player_id.c_str());
-                    analytics->queueAnalyticsEvent(
-                        player_id,
-                        7, // Using literal for ANALYTICS_EVENT_PLAYER_CRASHED
+                    STK_LOG_DEBUG("Kart", "Sending fall-off-track event to analytics for kart %d",
+                              getWorldKartId());
+                    // The player id is the cached name of the kart's player
+                    analytics->queueKartEvent(
+                        ANALYTICS_EVENT_PLAYER_CRASHED,
                         getWorldKartId(),
                         "rescue_fall_off_track"
                     );
@@ -1741,7 +1748,7 @@ if (!material)   // kart falling off the track
             }
             else
             {
-                Log::info("Kart", "Server analytics not available");
+                STK_LOG_DEBUG("Kart", "Server analytics not available");
             }
         }
     }
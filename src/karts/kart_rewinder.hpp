@@ -40,7 +40,7 @@ public:
     ~KartRewinder() {}
     virtual void saveTransform() OVERRIDE;
     virtual void computeError() OVERRIDE;
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
         OVERRIDE;
     void reset() OVERRIDE;
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
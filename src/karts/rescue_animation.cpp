@@ -40,27 +40,26 @@
 RescueAnimation* RescueAnimation::create(AbstractKart* kart,
                                          bool is_auto_rescue)
 {
-    Log::info("RescueAnimation", "Creating rescue animation for kart %d", kart->getWorldKartId());
+    STK_LOG_DEBUG("RescueAnimation", "Creating rescue animation for kart %d", kart->getWorldKartId());
 
     // Add analytics tracking
     if (NetworkConfig::get()->isServer() && NetworkConfig::get()->getServerAnalytics())
     {
-        Log::info("RescueAnimation", "Server analytics available for kart %d", 
+        STK_LOG_DEBUG("RescueAnimation", "Server analytics available for kart %d",
                   kart->getWorldKartId());
         
-        std::string player_id = StringUtils::wideToUtf8(kart->getController()->getName());
         ServerAnalytics* analytics = NetworkConfig::get()->getServerAnalytics().get();
         // auto* analytics = NetworkConfig::get()->getServerAnalytics().get();
         
         if (analytics)
         {
-            Log::info("RescueAnimation", 
-                     "Queueing rescue event for player %s (kart %d)", 
-                     player_id.c_str(), kart->getWorldKartId());
+            STK_LOG_DEBUG("RescueAnimation",
+                     "Queueing rescue event for kart %d",
+                     kart->getWorldKartId());
             
-            analytics->queueAnalyticsEvent(
-                player_id,
-                7, // ANALYTICS_EVENT_PLAYER_CRASHED
+            // The player id is the cached name of the kart's player
+            analytics->queueKartEvent(
+                ANALYTICS_EVENT_PLAYER_CRASHED,
                 kart->getWorldKartId(),
                 "rescue_animation_triggered"
             );
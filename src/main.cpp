@@ -246,7 +246,13 @@ extern "C" {
 #include "modes/demo_world.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/analytics_spool.hpp"
+#include "network/http_client.hpp"
+#include "network/ip_interval_table.hpp"
+#include "network/network_buffer_pool.hpp"
+#include "network/metrics_server.hpp"
 #include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
@@ -255,6 +261,7 @@ extern "C" {
 #include "network/protocols/server_lobby.hpp"
 #include "network/race_event_manager.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/rewind_info.hpp"
 #include "network/rewind_queue.hpp"
 #include "network/server.hpp"
 #include "network/server_config.hpp"
@@ -264,12 +271,14 @@ extern "C" {
 #include "network/stk_peer.hpp"
 #include "online/profile_manager.hpp"
 #include "online/request_manager.hpp"
+#include "physics/btKartRaycast.hpp"
 #include "race/grand_prix_manager.hpp"
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
 #include "race/race_manager.hpp"
 #include "replay/replay_play.hpp"
 #include "replay/replay_recorder.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "states_screens/main_menu_screen.hpp"
 #include "states_screens/online/networking_lobby.hpp"
 #include "states_screens/online/register_screen.hpp"
@@ -286,10 +295,12 @@ extern "C" {
 #include "utils/crash_reporting.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/log.hpp"
+#include "utils/metrics.hpp"
 #include "mini_glm.hpp"
 #include "utils/profiler.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 #include "utils/translation.hpp"
 #include "io/rich_presence.hpp"
 
@@ -297,7 +308,11 @@ extern "C" {
 
 static void cleanSuperTuxKart();
 static void cleanUserConfig();
+
+/** Serves the server metrics if enabled in the server config. */
+static std::unique_ptr<MetricsServer> g_metrics_server;
 void runUnitTests();
+void runBenchmarks();
 
 // ============================================================================
 //                        gamepad visualisation screen
@@ -592,6 +607,12 @@ void cmdLineHelp()
                               "laps.\n"
     "       --profile-time=n   Enable automatic driven profile mode for n "
                               "seconds.\n"
+    "       --profile-ticks=n  Enable automatic driven profile mode for n "
+                              "ticks, and report the time\n"
+    "                          spent per subsystem as JSON (runs as fast as "
+                              "possible with --no-graphics).\n"
+    "       --profile-output=file Write the JSON report of --profile-ticks "
+                              "to file.\n"
     "       --unlock-all       Permanently unlock all karts and tracks for testing.\n"
     "       --no-unlock-all    Disable unlock-all (i.e. base unlocking on player achievement).\n"
     "       --xmas=n           Toggle Xmas/Christmas mode. n=0 Use current date, n=1, Always enable,\n"
@@ -652,6 +673,7 @@ void cmdLineHelp()
     "       --log=N            Set the verbosity to a value between\n"
     "                          0 (Debug) and 5 (Only Fatal messages)\n"
     "       --logbuffer=N      Buffers up to N lines log lines before writing.\n"
+    "       --async-log        Write log messages in a separate thread.\n"
     "       --root=DIR         Path to add to the list of STK root directories.\n"
     "                          You can specify more than one by separating them\n"
     "                          with colons (:).\n"
@@ -725,6 +747,10 @@ void cmdDebugHelp()
     "       --gamepad-visuals           Debug gamepads by visualising their values.\n"
     "       --no-high-scores            Disable writing high scores.\n"
     "       --unit-testing              Run unit tests and exit.\n"
+    "       --run-benchmarks            Run micro benchmarks and exit.\n"
+    "       --cpu-profile               Record profiler markers (also for servers without\n"
+    "                                   graphics) and save them, including a Chrome trace\n"
+    "                                   file, when STK exits.\n"
     "       --gamepad-debug             Enable verbose logging of gamepad button presses.\n"
     "       --keyboard-debug            Enable verbose logging of keyboard key presses.\n"
     "       --wiimote-debug             Enable verbose logging of Wii Remote button presses.\n"
@@ -742,6 +768,8 @@ void cmdDebugHelp()
     "       --ai-debug                  Enable displaying of AI controllers as on-screen text.\n"
     "                                   Makes it easier to distinguish between different AI controllers.\n"
     "       --fps-debug                 Enable verbose logging of the FPS counter on every frame.\n"
+    "       --check-parallel-ai         Check each frame that the AI computed in parallel gives\n"
+    "                                   the same result as computed serially.\n"
     "       --rewind                    Enable the rewind manager.\n"
     "       --battle-ai-stats           Enable verbose logging of AI karts in battle modes.\n"
     "       --soccer-ai-stats           Enable verbose logging of AI karts in soccer mode.\n"
@@ -792,6 +820,8 @@ int handleCmdLineOutputModifier()
         Log::setLogLevel(n);
     if (CommandLine::has("--logbuffer", &n))
         Log::setBufferSize(n);
+    if (CommandLine::has("--async-log"))
+        Log::startAsyncWriter();
 
     if(CommandLine::has("--log=nocolor"))
     {
@@ -830,6 +860,8 @@ int handleCmdLinePreliminary()
         UserConfigParams::m_verbosity |= UserConfigParams::LOG_ALL;
     if(CommandLine::has("--online"))
         History::m_online_history_replay = true;
+    if(CommandLine::has("--cpu-profile"))
+        UserConfigParams::m_cpu_profile = true;
 #if !(defined(SERVER_ONLY) || defined(ANDROID))
     if(CommandLine::has("--apitrace"))
     {
@@ -1028,6 +1060,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         UserConfigParams::m_no_high_scores=true;
     if (CommandLine::has("--unit-testing"))
         UserConfigParams::m_unit_testing = true;
+    if (CommandLine::has("--run-benchmarks"))
+        UserConfigParams::m_run_benchmarks = true;
     if (CommandLine::has("--gamepad-debug"))
         UserConfigParams::m_gamepad_debug=true;
     if (CommandLine::has("--keyboard-debug"))
@@ -1054,6 +1088,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         AIBaseController::setTestAI(n);
     if (CommandLine::has("--fps-debug"))
         UserConfigParams::m_fps_debug = true;
+    if (CommandLine::has("--check-parallel-ai"))
+        UserConfigParams::m_check_parallel_ai = true;
     if (CommandLine::has("--rewind") )
         RewindManager::setEnable(true);
     if(CommandLine::has("--soccer-ai-stats"))
@@ -1497,6 +1533,15 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             NetworkConfig::get()->setServerAnalytics(analytics);
         }
 
+        if (ServerConfig::m_metrics_port > 0 &&
+            ServerConfig::m_metrics_port <= 65535 && !g_metrics_server)
+        {
+            g_metrics_server.reset(new MetricsServer());
+            if (!g_metrics_server->start(ServerConfig::m_metrics_address,
+                (uint16_t)ServerConfig::m_metrics_port))
+                g_metrics_server.reset();
+        }
+
         PlayerManager::get()->enforceCurrentPlayer();
         const std::string& server_name = ServerConfig::m_server_name;
         if (ServerConfig::m_wan_server)
@@ -1752,6 +1797,21 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         RaceManager::get()->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
+    if(CommandLine::has("--profile-ticks",  &n))
+    {
+        if (n <= 0)
+        {
+            Log::error("main", "Invalid number of profile-ticks: %i.", n);
+            return 0;
+        }
+        std::string output_file;
+        CommandLine::has("--profile-output", &output_file);
+        Log::verbose("main", "Profiling: %d ticks.", n);
+        UserConfigParams::m_no_start_screen = true;
+        ProfileWorld::setProfileModeTicks(n, output_file);
+        RaceManager::get()->setNumLaps(999999); // profile end depends on ticks
+    }   // --profile-ticks
+
     if(CommandLine::has("--history"))
     {
         history->setReplayHistory(true);
@@ -2281,8 +2341,13 @@ int main(int argc, char *argv[])
             ServerConfig::m_validating_player = false;
         }
 
-        if (!GUIEngine::isNoGraphics())
+        if (!GUIEngine::isNoGraphics() || UserConfigParams::m_cpu_profile)
             profiler.init();
+        if (UserConfigParams::m_cpu_profile)
+        {
+            profiler.setDrawing(false);
+            profiler.activate();
+        }
         // Create the story mode timer with empty setting first, it will
         // be reset later after story mode status and player manager is loaded
         story_mode_timer = new StoryModeTimer();
@@ -2398,6 +2463,12 @@ int main(int argc, char *argv[])
             exit(0);
         }
 
+        if(UserConfigParams::m_run_benchmarks)
+        {
+            runBenchmarks();
+            exit(0);
+        }
+
 #ifndef SERVER_ONLY
         if (!GUIEngine::isNoGraphics())
         {
@@ -2645,6 +2716,9 @@ int main(int argc, char *argv[])
         STKHost::get()->shutdown();
     ClientLobby::destroyBackgroundDownload();
 
+    if (UserConfigParams::m_cpu_profile)
+        profiler.writeToFile();
+
     cleanSuperTuxKart();
     NetworkConfig::destroy();
 
@@ -2702,6 +2776,7 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
  */
 static void cleanSuperTuxKart()
 {
+    g_metrics_server.reset();
 
     delete main_loop;
 
@@ -2836,8 +2911,13 @@ void runUnitTests()
     GraphicsRestrictions::unitTesting();
     Log::info("UnitTest", "NetworkString");
     NetworkString::unitTesting();
+    Log::info("UnitTest", "NetworkBufferPool");
+    NetworkBufferPool::unitTesting();
     Log::info("UnitTest", "SocketAddress");
     SocketAddress::unitTesting();
+    Log::info("UnitTest", "Log");
+    Log::unitTesting();
+
     Log::info("UnitTest", "StringUtils::versionToInt");
     StringUtils::unitTesting();
 
@@ -2878,16 +2958,86 @@ void runUnitTests()
     Log::info("UnitTest", "Kart characteristics");
     CombinedCharacteristic::unitTesting();
 
+    Log::info("UnitTest", "ItemManager hit test");
+    ItemManager::unitTesting();
+
     Log::info("UnitTest", "Arena Graph");
     ArenaGraph::unitTesting();
 
+    Log::info("UnitTest", "Graph spatial grid");
+    Graph::unitTesting();
+
     Log::info("UnitTest", "Fonts for translation");
     font_manager->unitTesting();
 
+    Log::info("UnitTest", "LobbyProtocol lookups");
+    LobbyProtocol::unitTesting();
+
+    Log::info("UnitTest", "ENet receive batches");
+    Network::unitTesting();
+
+    Log::info("UnitTest", "IPIntervalTable");
+    IPIntervalTable<uint32_t, std::string>::unitTesting();
+
     Log::info("UnitTest", "RewindQueue");
+    RewindInfo::unitTesting();
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "RewindManager rewinder ids");
+    RewindManager::unitTesting();
+
+    Log::info("UnitTest", "GameProtocol state delta");
+    GameProtocol::unitTesting();
+
+    Log::info("UnitTest", "Replay frame encoding");
+    ReplayBase::unitTesting();
+
+    Log::info("UnitTest", "Server analytics");
+    ServerAnalytics::unitTesting();
+
+    Log::info("UnitTest", "HTTPClient batching");
+    HTTPClient::unitTesting();
+
+    Log::info("UnitTest", "Analytics spool");
+    AnalyticsSpool::unitTesting();
+
+    Log::info("UnitTest", "Metrics");
+    Metrics::unitTesting();
+    MetricsServer::unitTesting();
+
+    Log::info("UnitTest", "ThreadPool");
+    ThreadPool::unitTesting();
+
+    Log::info("UnitTest", "ScriptEngine bytecode cache");
+    Scripting::ScriptEngine::unitTesting();
+
+    Log::info("UnitTest", "MaterialManager");
+    MaterialManager::unitTesting();
+
+    Log::info("UnitTest", "btKartRaycaster");
+    btKartRaycaster::unitTesting();
+
     Log::info("UnitTest", "=====================");
     Log::info("UnitTest", "Testing successful   ");
     Log::info("UnitTest", "=====================");
 }   // runUnitTests
+
+//=============================================================================
+void runBenchmarks()
+{
+    Log::info("Benchmark", "Starting benchmarks");
+    Log::info("Benchmark", "RewindQueue");
+    RewindQueue::benchmark();
+    Log::info("Benchmark", "Graph");
+    Graph::benchmark();
+    Log::info("Benchmark", "ENet socket batching");
+    Network::benchmark();
+    Log::info("Benchmark", "Broadcast encryption");
+    STKHost::benchmark();
+    Log::info("Benchmark", "Wheel raycasts");
+    btKartRaycaster::benchmark();
+    Log::info("Benchmark", "Material lookup");
+    MaterialManager::benchmark();
+    Log::info("Benchmark", "Server analytics telemetry");
+    ServerAnalytics::benchmark();
+}   // runBenchmarks
@@ -53,6 +53,7 @@
 #include "states_screens/online/server_selection.hpp"
 #include "states_screens/main_menu_screen.hpp"
 #include "states_screens/state_manager.hpp"
+#include "utils/metrics.hpp"
 #include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/time.hpp"
@@ -623,8 +624,12 @@ void MainLoop::run()
             bool fast_forward = NetworkConfig::get()->isNetworking() &&
                 NetworkConfig::get()->isClient() &&
                 num_steps > stk_config->time2Ticks(1.0f);
+            static Metrics::Histogram& tick_duration = Metrics::histogram(
+                "stk_tick_seconds", "Time to update the protocols and the "
+                "race for one tick.");
             for (int i = 0; i < num_steps; i++)
             {
+                auto tick_start = std::chrono::steady_clock::now();
                 if (World::getWorld() && history->replayHistory())
                 {
                     history->updateReplay(
@@ -645,6 +650,8 @@ void MainLoop::run()
                     updateRace(1, fast_forward);
                 }
                 PROFILER_POP_CPU_MARKER();
+                tick_duration.observe(std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - tick_start).count());
 
                 // We need to check again because update_race may have requested
                 // the main loop to abort; and it's not a good idea to continue
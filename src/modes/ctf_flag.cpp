@@ -32,9 +32,9 @@
 // Position offset to attach in kart model
 const Vec3 g_kart_flag_offset(0.0, 0.2f, -0.5f);
 // ============================================================================
-BareNetworkString* CTFFlag::saveState(std::vector<std::string>* ru)
+BareNetworkString* CTFFlag::saveState(std::vector<uint16_t>* ru)
 {
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     BareNetworkString* buffer = new BareNetworkString();
     int flag_status_unsigned = m_flag_status + 2;
     flag_status_unsigned &= 31;
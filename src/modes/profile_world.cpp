@@ -21,9 +21,16 @@
 #include "main_loop.hpp"
 #include "graphics/camera/camera.hpp"
 #include "graphics/irr_driver.hpp"
+#include "karts/kart_rewinder.hpp"
 #include "karts/kart_with_stats.hpp"
 #include "karts/controller/controller.hpp"
+#include "network/network_config.hpp"
+#include "network/network_string.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "network/rewind_manager.hpp"
 #include "tracks/track.hpp"
+#include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
 
 #include <ISceneManager.h>
 #include <IVideoDriver.h>
@@ -35,6 +42,9 @@
 ProfileWorld::ProfileType ProfileWorld::m_profile_mode=PROFILE_NONE;
 int   ProfileWorld::m_num_laps    = 0;
 float ProfileWorld::m_time        = 0.0f;
+int   ProfileWorld::m_ticks       = 0;
+std::string ProfileWorld::m_output_file;
+double ProfileWorld::m_section_time[PS_COUNT] = {};
 
 //-----------------------------------------------------------------------------
 /** The constructor sets the number of (local) players to 0, since only AI
@@ -57,6 +67,19 @@ ProfileWorld::ProfileWorld()
     m_num_transparent  = 0;
     m_num_trans_effect = 0;
     m_num_calls        = 0;
+    m_state_count      = 0;
+    m_state_bytes      = 0;
+    m_delta_state_bytes = 0;
+    for (int i = 0; i < PS_COUNT; i++)
+        m_section_time[i] = 0.0;
+    m_was_server = NetworkConfig::get()->isServer();
+    if (m_profile_mode == PROFILE_TICKS)
+    {
+        // Run as a server without clients, so that RewindManager and
+        // GameProtocol save and serialize the states as in a network game
+        NetworkConfig::get()->setIsServer(true);
+        RewindManager::setEnable(true);
+    }
 }   // ProfileWorld
 
 //-----------------------------------------------------------------------------
@@ -66,9 +89,25 @@ ProfileWorld::ProfileWorld()
  */
 ProfileWorld::~ProfileWorld()
 {
+    if (m_profile_mode == PROFILE_TICKS)
+    {
+        NetworkConfig::get()->setIsServer(m_was_server);
+        RewindManager::setEnable(false);
+    }
     m_profile_mode = PROFILE_NONE;
 }
 
+//-----------------------------------------------------------------------------
+/** In tick based profiling, creates the GameProtocol which the rewind
+ *  manager gives the states to. This needs the track to be loaded.
+ */
+void ProfileWorld::init()
+{
+    StandardRace::init();
+    if (m_profile_mode == PROFILE_TICKS)
+        m_game_protocol = GameProtocol::createInstance();
+}   // init
+
 //-----------------------------------------------------------------------------
 /** Enables profiling for a certain amount of time. It also sets the
  *  number of laps to a high number (so that the lap count will not finish
@@ -93,6 +132,25 @@ void ProfileWorld::setProfileModeLaps(int laps)
     m_num_laps     = laps;
 }   // setProfileModeLaps
 
+//-----------------------------------------------------------------------------
+/** Enables profiling for a certain number of ticks. Besides the usual
+ *  statistics, the time spent in physics, AI, items and in saving states
+ *  like a server does is measured, and reported in JSON. With --no-graphics
+ *  ticks are run as fast as possible, so this can be used to compare the
+ *  performance of builds and plan server capacity.
+ *  \param ticks The number of ticks.
+ *  \param output_file File to write the JSON report to, or empty to only
+ *         log it.
+ */
+void ProfileWorld::setProfileModeTicks(int ticks,
+                                       const std::string& output_file)
+{
+    m_profile_mode = PROFILE_TICKS;
+    m_num_laps     = 99999;
+    m_ticks        = ticks;
+    m_output_file  = output_file;
+}   // setProfileModeTicks
+
 //-----------------------------------------------------------------------------
 /** Creates a kart, having a certain position, starting location, and local
  *  and global player id (if applicable).
@@ -111,9 +169,22 @@ std::shared_ptr<AbstractKart> ProfileWorld::createKart
 {
     btTransform init_pos   = getStartTransform(index);
 
-    std::shared_ptr<KartWithStats> new_kart =
-        std::make_shared<KartWithStats>(kart_ident, /*world kart id*/ index,
-        /*position*/ index + 1, init_pos, handicap);
+    std::shared_ptr<Kart> new_kart;
+    if (m_profile_mode == PROFILE_TICKS)
+    {
+        // Karts which save their state, like on a server
+        auto kr = std::make_shared<KartRewinder>(kart_ident,
+            /*world kart id*/ index, /*position*/ index + 1, init_pos,
+            handicap, nullptr);
+        kr->rewinderAdd();
+        new_kart = kr;
+    }
+    else
+    {
+        new_kart = std::make_shared<KartWithStats>(kart_ident,
+            /*world kart id*/ index, /*position*/ index + 1, init_pos,
+            handicap);
+    }
     new_kart->init(RaceManager::KT_AI);
     Controller *controller = loadAIController(new_kart.get());
     new_kart->setController(controller);
@@ -138,6 +209,9 @@ bool ProfileWorld::isRaceOver()
     if(m_profile_mode==PROFILE_TIME)
         return getTime()>m_time;
 
+    if(m_profile_mode==PROFILE_TICKS)
+        return getTicksSinceStart()>=m_ticks;
+
     if(m_profile_mode == PROFILE_LAPS )
     {
         // Now it must be laps based profiling:
@@ -154,8 +228,16 @@ bool ProfileWorld::isRaceOver()
  */
 void ProfileWorld::update(int ticks)
 {
+    if (m_profile_mode == PROFILE_TICKS && m_frame_count == 0)
+        m_first_tick_time = std::chrono::steady_clock::now();
+
     StandardRace::update(ticks);
 
+    // The rewind manager saves and sends the states as on a server
+    if (m_profile_mode == PROFILE_TICKS && m_game_protocol &&
+        RewindManager::get()->shouldSaveState(getTicksSinceStart()))
+        measureNetworkState();
+
     m_frame_count++;
     video::IVideoDriver *driver = irr_driver->getVideoDriver();
     io::IAttributes   *attr = irr_driver->getSceneManager()->getParameters();
@@ -169,6 +251,81 @@ void ProfileWorld::update(int ticks)
 
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Adds the size of the state just saved by RewindManager::saveState, and
+ *  delta encodes it against the previous state like GameProtocol::sendState
+ *  does for a client which acknowledged it.
+ */
+void ProfileWorld::measureNetworkState()
+{
+    SectionTimer timer(PS_DELTA_ENCODING);
+    const int header_size = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/;
+    NetworkString* ns = m_game_protocol->getState();
+    const uint8_t* state = ns->getBuffer().data() + header_size;
+    const size_t state_size = ns->getTotalSize() - header_size;
+    if (!m_previous_state.empty())
+    {
+        BareNetworkString delta((int)state_size / 4);
+        GameProtocol::encodeStateDelta(m_previous_state, state, state_size,
+            &delta);
+        m_delta_state_bytes += delta.getTotalSize();
+    }
+    else
+        m_delta_state_bytes += state_size;
+    m_state_count++;
+    m_state_bytes += state_size;
+    m_previous_state.assign(state, state + state_size);
+}   // measureNetworkState
+
+//-----------------------------------------------------------------------------
+/** Logs the results of tick based profiling as JSON, and writes them to the
+ *  output file if one was given.
+ */
+void ProfileWorld::writeTickReport()
+{
+    std::chrono::duration<double> runtime =
+        std::chrono::steady_clock::now() - m_first_tick_time;
+    const double seconds = runtime.count();
+    const int ticks = getTicksSinceStart();
+    static const char* names[PS_COUNT] = { "physics", "ai", "items",
+        "rewind_save", "state_serialization", "delta_encoding" };
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "{\"version\": \"%s\", \"track\": "
+        "\"%s\", \"karts\": %d, \"ticks\": %d, \"seconds\": %.6f, "
+        "\"ticks_per_second\": %.2f, \"sections\": {", STK_VERSION,
+        RaceManager::get()->getTrackName().c_str(), (int)m_karts.size(),
+        ticks, seconds, seconds > 0.0 ? ticks / seconds : 0.0);
+    std::string json = buffer;
+    double other = seconds;
+    for (int i = 0; i < PS_COUNT; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "\"%s\": %.6f, ", names[i],
+            m_section_time[i]);
+        json += buffer;
+        other -= m_section_time[i];
+    }
+    snprintf(buffer, sizeof(buffer), "\"other\": %.6f}, \"states\": %d, "
+        "\"average_state_bytes\": %.1f, \"average_delta_state_bytes\": "
+        "%.1f}", other, m_state_count,
+        m_state_count > 0 ? (double)m_state_bytes / m_state_count : 0.0,
+        m_state_count > 0 ? (double)m_delta_state_bytes / m_state_count : 0.0);
+    json += buffer;
+
+    Log::info("profile", "%s", json.c_str());
+    if (m_output_file.empty())
+        return;
+    FILE* f = FileUtils::fopenU8Path(m_output_file, "w");
+    if (!f)
+    {
+        Log::error("profile", "Can't write '%s'.", m_output_file.c_str());
+        return;
+    }
+    fprintf(f, "%s\n", json.c_str());
+    fclose(f);
+}   // writeTickReport
+
 //-----------------------------------------------------------------------------
 /** This function is called when the race is finished, but end-of-race
  *  animations have still to be played. In the case of profiling,
@@ -180,7 +337,7 @@ void ProfileWorld::enterRaceOverState()
     // aborting too early). So in this case determine the maximum number
     // of laps and set this +1 as the number of laps to get more meaningful
     // time estimations.
-    if(m_profile_mode==PROFILE_TIME)
+    if(m_profile_mode==PROFILE_TIME || m_profile_mode==PROFILE_TICKS)
     {
         int max_laps = -2;
         for(unsigned int i=0; i<RaceManager::get()->getNumberOfKarts(); i++)
@@ -206,6 +363,15 @@ void ProfileWorld::enterRaceOverState()
     Log::verbose("profile", "Number of frames: %d time %f, Average FPS: %f",
                  m_frame_count, runtime, (float)m_frame_count/runtime);
 
+    // The karts have no statistics in tick based profiling
+    if (m_profile_mode == PROFILE_TICKS)
+    {
+        writeTickReport();
+        delete this;
+        main_loop->abort();
+        return;
+    }
+
     // Print geometry statistics if we're not in no-graphics mode
     if(!GUIEngine::isNoGraphics())
     {
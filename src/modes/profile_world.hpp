@@ -21,6 +21,12 @@
 
 #include "modes/standard_race.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class GameProtocol;
 class Kart;
 
 /**
@@ -29,9 +35,17 @@ class Kart;
  */
 class ProfileWorld : public StandardRace
 {
+public:
+    /** Parts of a tick which are timed in tick based profiling. The delta
+     *  encoding is only done by profiling, to measure the state sizes. */
+    enum ProfileSection { PS_PHYSICS, PS_AI, PS_ITEMS, PS_REWIND_SAVE,
+                          PS_STATE_SERIALIZATION, PS_DELTA_ENCODING,
+                          PS_COUNT };
+
 private:
     /** Profiling modes. */
-    enum        ProfileType {PROFILE_NONE, PROFILE_TIME, PROFILE_LAPS};
+    enum        ProfileType {PROFILE_NONE, PROFILE_TIME, PROFILE_LAPS,
+                             PROFILE_TICKS};
 
     /** If profiling is done, and if so, which mode. */
     static ProfileType m_profile_mode;
@@ -39,6 +53,36 @@ private:
     /** In time based profiling only: time to run. */
     static float m_time;
 
+    /** In tick based profiling only: number of ticks to run. */
+    static int m_ticks;
+
+    /** In tick based profiling only: file the JSON report is written to. */
+    static std::string m_output_file;
+
+    /** In tick based profiling only: seconds spent in each section. */
+    static double m_section_time[PS_COUNT];
+
+    /** In tick based profiling only: when the first tick started. */
+    std::chrono::steady_clock::time_point m_first_tick_time;
+
+    /** In tick based profiling only: the last state saved, used as baseline
+     *  to delta encode the next one. */
+    std::vector<uint8_t> m_previous_state;
+
+    /** In tick based profiling only: saves and serializes the states, like
+     *  the GameProtocol of a server. */
+    std::shared_ptr<GameProtocol> m_game_protocol;
+
+    /** In tick based profiling only: if this process was a server before the
+     *  race, which is restored afterwards. */
+    bool m_was_server;
+
+    /** In tick based profiling only: number and total size of the states
+     *  saved, with and without delta encoding. */
+    int m_state_count;
+    uint64_t m_state_bytes;
+    uint64_t m_delta_state_bytes;
+
     /** Return value of real time at start of race. */
     unsigned int m_start_time;
 
@@ -73,17 +117,49 @@ protected:
         int global_player_id, RaceManager::KartType type,
         HandicapLevel handicap);
 
+    void measureNetworkState();
+    void writeTickReport();
+
 public:
+    /** In tick based profiling, adds the time until its destruction to a
+     *  section, does nothing otherwise. */
+    class SectionTimer
+    {
+    private:
+        ProfileSection m_section;
+        bool m_active;
+        std::chrono::steady_clock::time_point m_start;
+    public:
+        SectionTimer(ProfileSection section)
+            : m_section(section), m_active(m_profile_mode == PROFILE_TICKS)
+        {
+            if (m_active)
+                m_start = std::chrono::steady_clock::now();
+        }
+        // --------------------------------------------------------------------
+        ~SectionTimer()
+        {
+            if (!m_active)
+                return;
+            std::chrono::duration<double> time =
+                std::chrono::steady_clock::now() - m_start;
+            m_section_time[m_section] += time.count();
+        }
+    };   // SectionTimer
+
                           ProfileWorld();
     virtual              ~ProfileWorld();
     /** Returns identifier for this world. */
     virtual  std::string getInternalCode() const {return "PROFILE"; }
+    virtual  void        init();
     virtual  void        update(int ticks);
     virtual  bool        isRaceOver();
     virtual  void        enterRaceOverState();
 
     static   void setProfileModeTime(float time);
     static   void setProfileModeLaps(int laps);
+    static   void setProfileModeTicks(int ticks,
+                                      const std::string& output_file);
     // ------------------------------------------------------------------------
     /** Returns true if profile mode was selected. */
     static   bool isProfileMode() {return m_profile_mode!=PROFILE_NONE; }
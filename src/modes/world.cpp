@@ -52,11 +52,13 @@
 #include "karts/kart_rewinder.hpp"
 #include "main_loop.hpp"
 #include "modes/overworld.hpp"
+#include "modes/profile_world.hpp"
 #include "modes/tutorial_utils.hpp"
 #include "network/child_loop.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/network_config.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_analytics.hpp"
 #include "network/stk_host.hpp"
 #include "physics/btKart.hpp"
 #include "physics/physics.hpp"
@@ -82,6 +84,7 @@
 #include "utils/profiler.hpp"
 #include "utils/translation.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 
 #include <IrrlichtDevice.h>
 #include <ISceneManager.h>
@@ -602,6 +605,70 @@ Controller* World::loadAIController(AbstractKart* kart)
     return controller;
 }   // loadAIController
 
+//-----------------------------------------------------------------------------
+/** Lets the controllers of all karts which are updated in this frame think,
+ *  before any kart is updated. Thinking only reads the world, so all
+ *  controllers see the same world, and they can think in parallel.
+ *  \param ticks Number of physics time steps.
+ */
+void World::thinkControllers(int ticks)
+{
+    m_thinking_controllers.clear();
+    for (unsigned i = 0; i < m_karts.size(); i++)
+    {
+        // The same karts which are updated in update()
+        SpareTireAI* sta =
+            dynamic_cast<SpareTireAI*>(m_karts[i]->getController());
+        if (!m_karts[i]->isEliminated() || (sta && sta->isMoving()))
+            m_thinking_controllers.push_back(m_karts[i]->getController());
+    }
+    const unsigned count = (unsigned)m_thinking_controllers.size();
+
+    // The game thread thinks too, so one core is kept for it
+    const int threads = std::min((int)UserConfigParams::m_ai_threads,
+        (int)std::thread::hardware_concurrency() - 1);
+    if (count < 2 || threads <= 0)
+    {
+        for (Controller* controller : m_thinking_controllers)
+            controller->think(ticks);
+        return;
+    }
+    if (!m_think_pool)
+        m_think_pool.reset(new ThreadPool(threads, "ThinkAI"));
+
+    std::vector<uint32_t> serial_checksums;
+    if (UserConfigParams::m_check_parallel_ai)
+    {
+        // Thinking again must give the same result, as it only depends on
+        // the world and the result is overwritten
+        for (Controller* controller : m_thinking_controllers)
+        {
+            controller->think(ticks);
+            serial_checksums.push_back(controller->getThinkChecksum());
+        }
+    }
+
+    m_think_pool->parallelFor(count, [this, ticks](unsigned i)
+        {
+            m_thinking_controllers[i]->think(ticks);
+        });
+
+    if (UserConfigParams::m_check_parallel_ai)
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            Controller* controller = m_thinking_controllers[i];
+            if (controller->getThinkChecksum() != serial_checksums[i])
+            {
+                Log::error("World", "Parallel thinking of %s differs from "
+                    "serial thinking at ticks %d.",
+                    controller->getKart()->getIdent().c_str(),
+                    getTicksSinceStart());
+            }
+        }
+    }
+}   // thinkControllers
+
 //-----------------------------------------------------------------------------
 World::~World()
 {
@@ -1168,6 +1235,13 @@ void World::update(int ticks)
     Track::getCurrentTrack()->getTrackObjectManager()->update(stk_config->ticks2Time(ticks));
     PROFILER_POP_CPU_MARKER();
 
+    PROFILER_PUSH_CPU_MARKER("World::update (think)", 0x40, 0x7F, 0x00);
+    {
+        ProfileWorld::SectionTimer timer(ProfileWorld::PS_AI);
+        thinkControllers(ticks);
+    }
+    PROFILER_POP_CPU_MARKER();
+
     PROFILER_PUSH_CPU_MARKER("World::update (Kart::upate)", 0x40, 0x7F, 0x00);
 
     // Update all the karts. This in turn will also update the controller,
@@ -1192,9 +1266,20 @@ void World::update(int ticks)
     PROFILER_POP_CPU_MARKER();
 
     PROFILER_PUSH_CPU_MARKER("World::update (physics)", 0xa0, 0x7F, 0x00);
-    Physics::get()->update(ticks);
+    {
+        ProfileWorld::SectionTimer timer(ProfileWorld::PS_PHYSICS);
+        Physics::get()->update(ticks);
+    }
     PROFILER_POP_CPU_MARKER();
 
+    if (NetworkConfig::get()->isServer())
+    {
+        ServerAnalytics* analytics =
+            NetworkConfig::get()->getServerAnalytics().get();
+        if (analytics)
+            analytics->sampleTelemetry(this, ticks);
+    }
+
     PROFILER_POP_CPU_MARKER();
     updateTimeTargetSound();
 
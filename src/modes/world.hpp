@@ -49,6 +49,7 @@ class Controller;
 class ItemState;
 class PhysicalObject;
 class STKPeer;
+class ThreadPool;
 
 namespace Scripting
 {
@@ -182,6 +183,14 @@ protected:
     /** Set when the world is online and counts network players. */
     bool m_is_network_world;
 
+    /** Workers used to let the controllers of karts think in parallel,
+     *  created when first needed. */
+    std::unique_ptr<ThreadPool> m_think_pool;
+
+    /** The controllers which think in the current frame, kept to avoid
+     *  allocations. */
+    std::vector<Controller*> m_thinking_controllers;
+
     bool m_ended_early;
 
     virtual void  onGo() OVERRIDE;
@@ -190,6 +199,7 @@ protected:
     virtual void  update(int ticks) OVERRIDE;
     virtual void  createRaceGUI();
             void  updateTrack(int ticks);
+            void  thinkControllers(int ticks);
     // ------------------------------------------------------------------------
     /** Used for AI karts that are still racing when all player kart finished.
      *  Generally it should estimate the arrival time for those karts, but as
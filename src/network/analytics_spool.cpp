@@ -0,0 +1,463 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/analytics_spool.hpp"
+#include "io/file_manager.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <sys/stat.h>
+#include <zlib.h>
+
+namespace
+{
+    /** Each body is stored with its size and crc32, so that a body
+     *  truncated by a crash is detected. */
+    const uint32_t HEADER_SIZE = 8;
+
+    void writeUInt32(uint8_t* buffer, uint32_t value)
+    {
+        buffer[0] = (uint8_t)(value);
+        buffer[1] = (uint8_t)(value >> 8);
+        buffer[2] = (uint8_t)(value >> 16);
+        buffer[3] = (uint8_t)(value >> 24);
+    }   // writeUInt32
+    // ------------------------------------------------------------------------
+    uint32_t readUInt32(const uint8_t* buffer)
+    {
+        return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+            ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+    }   // readUInt32
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+/** Opens the spool in the given directory, creating it if needed. Segments
+ *  left by a previous run are kept and replayed first.
+ */
+AnalyticsSpool::AnalyticsSpool(const std::string& directory,
+                               uint64_t max_segment_bytes,
+                               uint64_t max_total_bytes)
+              : m_directory(directory), m_write_file(NULL),
+                m_read_file(NULL), m_read_offset(0),
+                m_read_offset_saved(false), m_total_bytes(0),
+                m_max_segment_bytes(max_segment_bytes),
+                m_max_total_bytes(max_total_bytes)
+{
+    if (!m_directory.empty() && m_directory.back() != '/')
+        m_directory += "/";
+    file_manager->checkAndCreateDirectoryP(m_directory);
+
+    std::set<std::string> files;
+    file_manager->listFiles(files, m_directory);
+    std::vector<uint32_t> sequences;
+    for (const std::string& file : files)
+    {
+        unsigned sequence = 0;
+        char extension[8];
+        if (sscanf(file.c_str(), "segment-%u.%7s", &sequence, extension)
+            == 2 && std::string(extension) == "bin")
+            sequences.push_back(sequence);
+    }
+    std::sort(sequences.begin(), sequences.end());
+    for (uint32_t sequence : sequences)
+    {
+        struct stat st;
+        if (FileUtils::statU8Path(getSegmentName(sequence), &st) != 0 ||
+            st.st_size == 0)
+        {
+            file_manager->removeFile(getSegmentName(sequence));
+            continue;
+        }
+        m_segments.push_back({sequence, (uint64_t)st.st_size});
+        m_total_bytes += st.st_size;
+    }
+    loadReadOffset();
+    if (m_total_bytes > 0)
+    {
+        Log::info("AnalyticsSpool", "%d bytes of analytics left in '%s' "
+            "will be sent first.", (int)m_total_bytes, m_directory.c_str());
+    }
+}   // AnalyticsSpool
+
+// ----------------------------------------------------------------------------
+AnalyticsSpool::~AnalyticsSpool()
+{
+    if (m_write_file)
+        fclose(m_write_file);
+    if (m_read_file)
+        fclose(m_read_file);
+}   // ~AnalyticsSpool
+
+// ----------------------------------------------------------------------------
+std::string AnalyticsSpool::getSegmentName(uint32_t sequence) const
+{
+    char name[32];
+    snprintf(name, 32, "segment-%08u.bin", sequence);
+    return m_directory + name;
+}   // getSegmentName
+
+// ----------------------------------------------------------------------------
+std::string AnalyticsSpool::getReadOffsetName() const
+{
+    return m_directory + "read-offset.bin";
+}   // getReadOffsetName
+
+// ----------------------------------------------------------------------------
+/** Skips the bodies of the oldest segment which were removed before a
+ *  restart. The saved offset is ignored if it doesn't belong to the oldest
+ *  segment, then the whole segment is sent again.
+ */
+void AnalyticsSpool::loadReadOffset()
+{
+    FILE* f = FileUtils::fopenU8Path(getReadOffsetName(), "rb");
+    if (!f)
+        return;
+    uint8_t data[12];
+    bool ok = fread(data, sizeof(data), 1, f) == 1;
+    fclose(f);
+    if (!ok || m_segments.empty() ||
+        readUInt32(data) != m_segments.front().m_sequence)
+    {
+        file_manager->removeFile(getReadOffsetName());
+        return;
+    }
+    uint64_t offset = readUInt32(data + 4) |
+        ((uint64_t)readUInt32(data + 8) << 32);
+    if (offset >= m_segments.front().m_bytes)
+    {
+        file_manager->removeFile(getReadOffsetName());
+        return;
+    }
+    m_read_offset = offset;
+    m_read_offset_saved = true;
+    m_total_bytes -= offset;
+}   // loadReadOffset
+
+// ----------------------------------------------------------------------------
+/** Saves the sequence of the oldest segment and m_read_offset, so that the
+ *  removed bodies are not sent again after a restart. */
+void AnalyticsSpool::saveReadOffset()
+{
+    uint8_t data[12];
+    writeUInt32(data, m_segments.front().m_sequence);
+    writeUInt32(data + 4, (uint32_t)m_read_offset);
+    writeUInt32(data + 8, (uint32_t)(m_read_offset >> 32));
+    m_read_offset_saved = file_manager->writeFileAtomically(
+        getReadOffsetName(), [&data](FILE* f)
+        {
+            return fwrite(data, sizeof(data), 1, f) == 1;
+        });
+    if (!m_read_offset_saved)
+    {
+        Log::warn("AnalyticsSpool", "Can't save the read offset, sent "
+            "analytics might be sent again after a restart.");
+    }
+}   // saveReadOffset
+
+// ----------------------------------------------------------------------------
+/** Removes the oldest segment, including all bodies in it which were not
+ *  removed yet. */
+void AnalyticsSpool::removeOldestSegment()
+{
+    assert(!m_segments.empty());
+    if (m_read_file)
+    {
+        fclose(m_read_file);
+        m_read_file = NULL;
+    }
+    if (m_segments.size() == 1 && m_write_file)
+    {
+        fclose(m_write_file);
+        m_write_file = NULL;
+    }
+    m_total_bytes -= m_segments.front().m_bytes - m_read_offset;
+    file_manager->removeFile(getSegmentName(m_segments.front().m_sequence));
+    m_segments.pop_front();
+    m_read_offset = 0;
+    // Sequences start at 0 again once the spool is empty, so the offset
+    // must not be applied to a later segment
+    if (m_read_offset_saved)
+    {
+        file_manager->removeFile(getReadOffsetName());
+        m_read_offset_saved = false;
+    }
+    m_peeked_sizes.clear();
+}   // removeOldestSegment
+
+// ----------------------------------------------------------------------------
+/** Appends bodies at the end of the spool, and discards the oldest segments
+ *  if the spool became too big.
+ *  \return False if writing failed.
+ */
+bool AnalyticsSpool::append(const std::vector<std::string>& bodies)
+{
+    bool success = true;
+    for (const std::string& body : bodies)
+    {
+        // Never append to segments of a previous run, their end might be
+        // truncated
+        if (!m_write_file || m_segments.back().m_bytes >= m_max_segment_bytes)
+        {
+            if (m_write_file)
+                fclose(m_write_file);
+            uint32_t sequence =
+                m_segments.empty() ? 0 : m_segments.back().m_sequence + 1;
+            m_write_file =
+                FileUtils::fopenU8Path(getSegmentName(sequence), "wb");
+            if (!m_write_file)
+            {
+                Log::error("AnalyticsSpool", "Can't create '%s'.",
+                    getSegmentName(sequence).c_str());
+                return false;
+            }
+            m_segments.push_back({sequence, 0});
+        }
+        uint8_t header[HEADER_SIZE];
+        writeUInt32(header, (uint32_t)body.size());
+        writeUInt32(header + 4, (uint32_t)crc32(0, (const Bytef*)body.data(),
+            (uInt)body.size()));
+        if (fwrite(header, HEADER_SIZE, 1, m_write_file) != 1 ||
+            (!body.empty() &&
+            fwrite(body.data(), body.size(), 1, m_write_file) != 1))
+            success = false;
+        m_segments.back().m_bytes += HEADER_SIZE + body.size();
+        m_total_bytes += HEADER_SIZE + body.size();
+    }
+    if (m_write_file)
+        fflush(m_write_file);
+
+    uint64_t discarded = 0;
+    while (m_total_bytes > m_max_total_bytes && m_segments.size() > 1)
+    {
+        discarded += m_segments.front().m_bytes - m_read_offset;
+        removeOldestSegment();
+    }
+    if (discarded > 0)
+    {
+        Log::warn("AnalyticsSpool", "Spool is full, %d bytes of analytics "
+            "discarded.", (int)discarded);
+    }
+    if (!success)
+        Log::error("AnalyticsSpool", "Failed to write analytics to disk.");
+    return success;
+}   // append
+
+// ----------------------------------------------------------------------------
+/** Returns the oldest bodies without removing them, call pop after they were
+ *  sent successfully. At most max_count bodies are returned, all from the
+ *  same segment.
+ */
+void AnalyticsSpool::peek(std::vector<std::string>* bodies, size_t max_count)
+{
+    bodies->clear();
+    m_peeked_sizes.clear();
+    while (!m_segments.empty())
+    {
+        const Segment& segment = m_segments.front();
+        if (!m_read_file)
+        {
+            m_read_file = FileUtils::fopenU8Path(
+                getSegmentName(segment.m_sequence), "rb");
+        }
+        if (m_read_file && fseek(m_read_file, (long)m_read_offset,
+            SEEK_SET) == 0)
+        {
+            uint64_t offset = m_read_offset;
+            while (bodies->size() < max_count && offset < segment.m_bytes)
+            {
+                uint8_t header[HEADER_SIZE];
+                if (fread(header, HEADER_SIZE, 1, m_read_file) != 1)
+                    break;
+                uint32_t size = readUInt32(header);
+                if (offset + HEADER_SIZE + size > segment.m_bytes)
+                    break;
+                std::string body(size, 0);
+                if (size > 0 && fread(&body[0], size, 1, m_read_file) != 1)
+                    break;
+                if ((uint32_t)crc32(0, (const Bytef*)body.data(), size) !=
+                    readUInt32(header + 4))
+                    break;
+                bodies->push_back(std::move(body));
+                m_peeked_sizes.push_back(size);
+                offset += HEADER_SIZE + size;
+            }
+            if (!bodies->empty())
+                return;
+            if (offset >= segment.m_bytes)
+            {
+                // Only happens if nothing was left to read
+                removeOldestSegment();
+                continue;
+            }
+        }
+        // Unreadable or corrupted (truncated by a crash) segment
+        Log::warn("AnalyticsSpool", "Discarding corrupted analytics segment "
+            "'%s'.", getSegmentName(segment.m_sequence).c_str());
+        removeOldestSegment();
+    }
+}   // peek
+
+// ----------------------------------------------------------------------------
+/** Removes the first count bodies returned by the last peek call. */
+void AnalyticsSpool::pop(size_t count)
+{
+    assert(count <= m_peeked_sizes.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        m_read_offset += HEADER_SIZE + m_peeked_sizes[i];
+        m_total_bytes -= HEADER_SIZE + m_peeked_sizes[i];
+    }
+    m_peeked_sizes.clear();
+    if (!m_segments.empty() && m_read_offset >= m_segments.front().m_bytes)
+        removeOldestSegment();
+    else if (count > 0)
+        saveReadOffset();
+}   // pop
+
+// ----------------------------------------------------------------------------
+void AnalyticsSpool::unitTesting()
+{
+    const std::string dir = file_manager->getCachedDataDir() +
+        "analytics-spool-unit-test/";
+    std::vector<std::string> bodies;
+    {
+        // Segments are limited to 100 bytes, the spool to 1000
+        AnalyticsSpool spool(dir, 100, 1000);
+        assert(spool.empty());
+        for (unsigned i = 0; i < 20; i++)
+            bodies.push_back("[" + StringUtils::toString(i) + "]");
+        spool.append(bodies);
+        assert(!spool.empty());
+        assert(spool.m_segments.size() > 1);
+
+        // Bodies come back in order, and are only removed by pop
+        std::vector<std::string> peeked;
+        spool.peek(&peeked, 3);
+        assert(peeked.size() == 3 && peeked[0] == "[0]");
+        spool.peek(&peeked, 3);
+        assert(peeked.size() == 3 && peeked[0] == "[0]");
+        spool.pop(2);
+        spool.peek(&peeked, 100);
+        assert(peeked[0] == "[2]");
+        // Never more than one segment at a time
+        assert(peeked.size() < 18);
+        spool.pop(peeked.size());
+        spool.peek(&peeked, 1);
+        assert(!peeked.empty() && peeked[0] != "[2]");
+        // Left in the spool for the next run
+    }
+    {
+        AnalyticsSpool spool(dir, 100, 1000);
+        assert(!spool.empty());
+        std::vector<std::string> all;
+        std::vector<std::string> more = { "[20]", "[21]" };
+        spool.append(more);
+        std::vector<std::string> peeked;
+        while (!spool.empty())
+        {
+            spool.peek(&peeked, 4);
+            assert(!peeked.empty());
+            all.insert(all.end(), peeked.begin(), peeked.end());
+            spool.pop(peeked.size());
+        }
+        // Everything not removed before the restart, then the new bodies
+        assert(all.back() == "[21]" && all[all.size() - 2] == "[20]");
+        for (unsigned i = 1; i < all.size() - 2; i++)
+        {
+            assert(atoi(all[i].c_str() + 1) ==
+                atoi(all[i - 1].c_str() + 1) + 1);
+        }
+        assert(atoi(all[all.size() - 3].c_str() + 1) == 19);
+
+        // The oldest segments are discarded if the spool is too big
+        bodies.assign(100, std::string(30, 'x'));
+        bodies.back() = "last";
+        spool.append(bodies);
+        assert(spool.getTotalBytes() <= 1000);
+        while (!spool.empty())
+        {
+            spool.peek(&peeked, 100);
+            spool.pop(peeked.size());
+        }
+        assert(peeked.back() == "last");
+    }
+    {
+        // A truncated segment of a crashed run is discarded
+        AnalyticsSpool spool(dir, 100, 1000);
+        assert(spool.empty());
+        bodies = { "[1]", "[2]" };
+        spool.append(bodies);
+        std::string name = spool.getSegmentName(spool.m_segments[0]
+            .m_sequence);
+        fclose(spool.m_write_file);
+        spool.m_write_file = NULL;
+        FILE* f = FileUtils::fopenU8Path(name, "ab");
+        uint8_t header[HEADER_SIZE];
+        writeUInt32(header, 50);
+        writeUInt32(header + 4, 0);
+        fwrite(header, HEADER_SIZE, 1, f);
+        fwrite("[3", 2, 1, f);
+        fclose(f);
+    }
+    {
+        AnalyticsSpool spool(dir, 100, 1000);
+        std::vector<std::string> peeked;
+        spool.peek(&peeked, 10);
+        assert(peeked.size() == 2 && peeked[1] == "[2]");
+        spool.pop(2);
+        spool.peek(&peeked, 10);
+        assert(peeked.empty() && spool.empty());
+    }
+    {
+        // Bodies removed from a partly sent segment are not sent again
+        // after a restart
+        AnalyticsSpool spool(dir, 100, 1000);
+        bodies = { "[1]", "[2]", "[3]" };
+        spool.append(bodies);
+        std::vector<std::string> peeked;
+        spool.peek(&peeked, 1);
+        assert(peeked.size() == 1 && peeked[0] == "[1]");
+        spool.pop(1);
+    }
+    {
+        AnalyticsSpool spool(dir, 100, 1000);
+        assert(spool.getTotalBytes() == 2 * (HEADER_SIZE + 3));
+        std::vector<std::string> peeked;
+        spool.peek(&peeked, 10);
+        assert(peeked.size() == 2 && peeked[0] == "[2]");
+        spool.pop(2);
+        assert(spool.empty());
+        // The segment numbers start again at 0 in an empty spool, the
+        // offset of the removed segment must not be used for the new one
+        bodies = { "[4]" };
+        spool.append(bodies);
+    }
+    {
+        AnalyticsSpool spool(dir, 100, 1000);
+        std::vector<std::string> peeked;
+        spool.peek(&peeked, 10);
+        assert(peeked.size() == 1 && peeked[0] == "[4]");
+        spool.pop(1);
+        assert(spool.empty());
+    }
+    file_manager->removeDirectory(dir);
+}   // unitTesting
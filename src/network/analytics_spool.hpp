@@ -0,0 +1,97 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_ANALYTICS_SPOOL_HPP
+#define HEADER_ANALYTICS_SPOOL_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+/** An append-only queue of request bodies stored in segment files on disk.
+ *  HTTPClient writes to it while the analytics endpoint can't be reached,
+ *  and replays it in order once it is back, so no events are lost and the
+ *  memory usage stays bounded. Bodies are removed once they were
+ *  acknowledged, after a restart the remaining segments are replayed. The
+ *  read offset in the oldest segment is saved after each pop, so only
+ *  bodies acknowledged just before a crash can be sent again.
+ *  Not thread-safe, only used by the send thread of HTTPClient.
+ */
+class AnalyticsSpool
+{
+private:
+    std::string m_directory;
+
+    struct Segment
+    {
+        uint32_t m_sequence;
+        uint64_t m_bytes;
+    };
+    /** All segment files, oldest first. The last one is the one appended
+     *  to. */
+    std::deque<Segment> m_segments;
+
+    /** The segment file appended to, if open. */
+    FILE* m_write_file;
+
+    /** The oldest segment file, read from when replaying. */
+    FILE* m_read_file;
+
+    /** Offset in the oldest segment of the first body not yet removed. */
+    uint64_t m_read_offset;
+
+    /** If m_read_offset was saved for the oldest segment. */
+    bool m_read_offset_saved;
+
+    /** Size of each body returned by the last peek call. */
+    std::vector<uint32_t> m_peeked_sizes;
+
+    /** Size of all bodies which were not removed yet (with headers). */
+    uint64_t m_total_bytes;
+
+    /** A new segment is started once the current one is that big. */
+    const uint64_t m_max_segment_bytes;
+
+    /** The oldest segments are discarded if the spool is bigger. */
+    const uint64_t m_max_total_bytes;
+
+    std::string getSegmentName(uint32_t sequence) const;
+    std::string getReadOffsetName() const;
+    void loadReadOffset();
+    void saveReadOffset();
+    void removeOldestSegment();
+
+public:
+    AnalyticsSpool(const std::string& directory,
+                   uint64_t max_segment_bytes = 4 * 1024 * 1024,
+                   uint64_t max_total_bytes = 256 * 1024 * 1024);
+    ~AnalyticsSpool();
+    bool append(const std::vector<std::string>& bodies);
+    void peek(std::vector<std::string>* bodies, size_t max_count);
+    void pop(size_t count);
+    // ------------------------------------------------------------------------
+    bool empty() const                           { return m_total_bytes == 0; }
+    // ------------------------------------------------------------------------
+    uint64_t getTotalBytes() const                    { return m_total_bytes; }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // class AnalyticsSpool
+
+#endif   // HEADER_ANALYTICS_SPOOL_HPP
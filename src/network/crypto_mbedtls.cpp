@@ -19,6 +19,7 @@
 #ifdef ENABLE_CRYPTO_MBEDTLS
 
 #include "network/crypto_mbedtls.hpp"
+#include "network/network_buffer_pool.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 
@@ -102,8 +103,9 @@ bool Crypto::decryptConnectionRequest(BareNetworkString& ns)
 // ----------------------------------------------------------------------------
 ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 {
-    // 4 bytes counter and 4 bytes tag
-    ENetPacket* p = enet_packet_create(NULL, ns.m_buffer.size() + 8,
+    // 4 bytes counter and 4 bytes tag, encrypted directly into a pooled
+    // buffer adopted by the packet
+    ENetPacket* p = NetworkBufferPool::createPacket(ns.m_buffer.size() + 8,
         (reliable ? ENET_PACKET_FLAG_RELIABLE :
         (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT))
         );
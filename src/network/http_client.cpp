@@ -1,36 +1,56 @@
 // network/http_client.cpp
 
 #include "network/http_client.hpp"
+#include "io/file_manager.hpp"
+#include "network/analytics_spool.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/base64.hpp"
+#include "utils/metrics.hpp"
 #include "utils/time.hpp"
+#include <algorithm>
+#include <cassert>
 #include <sstream>
 #include <iostream>
 #include <cstring>
-// #include <base64.h> // Assuming base64.h is part of existing utils
+#include <zlib.h>
+
+#ifndef WIN32
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+constexpr uint64_t HTTPClient::MAX_RETRY_DELAY;
 
 HTTPClient::HTTPClient(const std::string& uri,
                        const std::string& auth_id,
                        const std::string& auth_pwd,
                        const std::string& table,
-                       const std::string& token)
+                       const std::string& token,
+                       const std::string& spool_dir)
     : m_uri(uri),
       m_auth_id(auth_id),
       m_auth_pwd(auth_pwd),
       m_table(table),
       m_token(token),
+      m_use_tls(true),
+      m_port(443),
       m_connected(false),
+      m_queued_bytes(0),
       m_stop_thread(false)
 {
+    if (!parseURI())
+        Log::error("HTTPClient", "Invalid URI format: %s", m_uri.c_str());
+    if (!spool_dir.empty())
+        m_spool.reset(new AnalyticsSpool(spool_dir));
     // Start the send thread immediately
     m_send_thread = std::thread(&HTTPClient::sendLoop, this);
 }
 
 HTTPClient::~HTTPClient()
 {
-    disconnect();
-
-    // Stop the send thread
+    // Stop the send thread, it sends all queued messages first
     {
         std::lock_guard<std::mutex> lock(m_queue_mutex);
         m_stop_thread = true;
@@ -39,61 +59,87 @@ HTTPClient::~HTTPClient()
     if (m_send_thread.joinable()) {
         m_send_thread.join();
     }
+
+    disconnect();
 }
 
+/** Splits the URI into host, port and path once, and prepares the request
+ *  line and headers which are the same for every request.
+ *  \return False if the URI is invalid.
+ */
+bool HTTPClient::parseURI()
+{
+    size_t pos = m_uri.find("://");
+    if (pos == std::string::npos)
+        return false;
+
+    std::string protocol = StringUtils::toLowerCase(m_uri.substr(0, pos));
+    m_use_tls = protocol != "http";
+    m_port = m_use_tls ? 443 : 80;
+
+    std::string path;
+    size_t host_start = pos + 3;
+    size_t path_start = m_uri.find('/', host_start);
+    if (path_start == std::string::npos) {
+        m_host = m_uri.substr(host_start);
+        path = "/";
+    } else {
+        m_host = m_uri.substr(host_start, path_start - host_start);
+        path = m_uri.substr(path_start);
+    }
+
+    // Check for port in host
+    std::string host_header = m_host;
+    size_t port_pos = m_host.find(':');
+    if (port_pos != std::string::npos) {
+        int port = atoi(m_host.substr(port_pos + 1).c_str());
+        if (port <= 0 || port > 65535)
+            return false;
+        m_port = (uint16_t)port;
+        m_host = m_host.substr(0, port_pos);
+    }
+
+    std::ostringstream prefix;
+    prefix << "POST " << path
+           << (path.find('?') == std::string::npos ? "?" : "&")
+           << "table=" << m_table << "&token=" << m_token << " HTTP/1.1\r\n";
+    prefix << "Host: " << host_header << "\r\n";
+    prefix << "Authorization: Basic " << constructAuthHeader() << "\r\n";
+    prefix << "Content-Type: application/json\r\n";
+    prefix << "Accept: application/json\r\n";
+    prefix << "Connection: keep-alive\r\n";
+    m_request_prefix = prefix.str();
+    return true;
+}   // parseURI
+
 bool HTTPClient::connect()
 {
     if (m_connected) {
         Log::debug("HTTPClient", "Already connected, skipping connect()");
         return true;
     }
+    if (m_host.empty())
+        return false;
 
     Log::info("HTTPClient", "Starting connection to URI: %s", m_uri.c_str());
-    
-    // Parse the URI to extract host and path
-    std::string protocol, host, path;
-    unsigned short port = 443; // Default HTTPS port
 
     try {
-        // Simple URI parsing
-        size_t pos = m_uri.find("://");
-        if (pos == std::string::npos) {
-            Log::error("HTTPClient", "Invalid URI format: %s", m_uri.c_str());
-            return false;
-        }
-        protocol = m_uri.substr(0, pos);
-        size_t host_start = pos + 3;
-        size_t path_start = m_uri.find('/', host_start);
-        if (path_start == std::string::npos) {
-            host = m_uri.substr(host_start);
-            path = "/";
-        } else {
-            host = m_uri.substr(host_start, path_start - host_start);
-            path = m_uri.substr(path_start);
-        }
-
-        // Check for port in host
-        size_t port_pos = host.find(':');
-        if (port_pos != std::string::npos) {
-            port = static_cast<unsigned short>(std::stoi(host.substr(port_pos + 1)));
-            host = host.substr(0, port_pos);
-        }
-
-        SocketAddress server_addr(host, port);
+        SocketAddress server_addr(m_host, m_port);
         if (server_addr.isUnset()) {
-            Log::warn("HTTPClient", "Failed to resolve address for %s - continuing without analytics", host.c_str());
+            Log::warn("HTTPClient", "Failed to resolve address for %s - continuing without analytics", m_host.c_str());
             return false;
         }
 
         // Try TLS connection but don't block
-        if (!m_tls_conn.connect(server_addr)) {
-            Log::warn("HTTPClient", "Failed to connect to %s:%d", host.c_str(), port);
+        if (!m_tls_conn.connect(server_addr, m_use_tls)) {
+            Log::warn("HTTPClient", "Failed to connect to %s:%d", m_host.c_str(), m_port);
             m_connected = false;
             return false;
         }
 
+        m_response_buffer.clear();
         m_connected = true;
-        Log::info("HTTPClient", "Successfully connected to %s:%d - m_connected now true", host.c_str(), port);
+        Log::info("HTTPClient", "Successfully connected to %s:%d", m_host.c_str(), m_port);
         return true;
 
     } catch (const std::exception& e) {
@@ -105,23 +151,26 @@ bool HTTPClient::connect()
 
 bool HTTPClient::sendJSON(const std::string& json_message)
 {
-    Log::info("HTTPClient", "sendJSON called with message length: %d, connected: %d", 
-              (int)json_message.length(), m_connected ? 1 : 0);
-
-    // Enqueue the message
+    bool notify = false;
     {
         std::lock_guard<std::mutex> lock(m_queue_mutex);
-        m_message_queue.push(json_message);
-        Log::info("HTTPClient", "Message queued. Queue size now: %d", (int)m_message_queue.size());
+        // Wake up the send thread to start the age timer of a new batch, or
+        // if the batch is full
+        notify = m_message_queue.empty() ||
+            (m_queued_bytes < MAX_BATCH_BYTES &&
+            m_queued_bytes + json_message.size() >= MAX_BATCH_BYTES);
+        m_message_queue.push_back({json_message, StkTime::getMonoTimeMs()});
+        m_queued_bytes += json_message.size();
     }
-    m_cond_var.notify_one();
+    if (notify)
+        m_cond_var.notify_one();
     return true;
 }
 
 void HTTPClient::disconnect()
 {
     if (m_connected) {
-        Log::info("HTTPClient", "Disconnecting from %s - setting m_connected to false", m_uri.c_str());
+        Log::info("HTTPClient", "Disconnecting from %s", m_uri.c_str());
         m_tls_conn.disconnect();
         m_connected = false;
     }
@@ -134,130 +183,690 @@ std::string HTTPClient::constructAuthHeader()
     return base64_encode(reinterpret_cast<const unsigned char*>(credentials.c_str()), credentials.length());
 }
 
-void HTTPClient::sendLoop()
+/** Compresses a request body in gzip format.
+ *  \return False if compression failed or did not make the body smaller.
+ */
+bool HTTPClient::gzipCompress(const std::string& in, std::string* out)
 {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 15 + 16 window bits writes a gzip header and trailer
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+        Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
 
-    Log::info("HTTPClient", "Send loop starting");
-
-    while (true) {
-        Log::info("HTTPClient", "Send loop iteration starting");
-
-        std::vector<std::string> messages_to_send;
+    out->resize(deflateBound(&stream, (uLong)in.size()));
+    stream.next_in = (Bytef*)in.data();
+    stream.avail_in = (uInt)in.size();
+    stream.next_out = (Bytef*)&(*out)[0];
+    stream.avail_out = (uInt)out->size();
+    int ret = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (ret != Z_STREAM_END || stream.total_out >= in.size())
+        return false;
+    out->resize(stream.total_out);
+    return true;
+}   // gzipCompress
+
+/** Merges queued messages into json arrays of at most MAX_BATCH_BYTES each
+ *  (a single bigger message is sent on its own). Messages which are arrays
+ *  themselves are spliced into the batch.
+ */
+void HTTPClient::buildBodies(std::deque<QueuedMessage>* messages,
+                             std::vector<std::string>* bodies)
+{
+    std::string body;
+    for (QueuedMessage& message : *messages)
+    {
+        const std::string& json = message.m_json;
+        size_t start = 0, end = json.size();
+        if (end >= 2 && json[0] == '[' && json[end - 1] == ']')
         {
-            std::unique_lock<std::mutex> lock(m_queue_mutex);
-            Log::info("HTTPClient", "Waiting for messages. Queue size: %d, Stop thread: %d", 
-                (int)m_message_queue.size(), m_stop_thread ? 1 : 0);
+            start++;
+            end--;
+        }
+        if (start == end)
+            continue;
+        if (!body.empty() && body.size() + end - start + 2 > MAX_BATCH_BYTES)
+        {
+            body += "]";
+            bodies->push_back(std::move(body));
+            body.clear();
+        }
+        body += body.empty() ? "[" : ",";
+        body.append(json, start, end - start);
+    }
+    if (!body.empty())
+    {
+        body += "]";
+        bodies->push_back(std::move(body));
+    }
+}   // buildBodies
 
-            m_cond_var.wait(lock, [this] { return !m_message_queue.empty() || m_stop_thread; });
+/** Prepends the headers to a request body, compressing it if worth it. */
+std::string HTTPClient::buildRequest(const std::string& body)
+{
+    std::string compressed;
+    const bool use_gzip = body.size() >= MIN_COMPRESS_BYTES &&
+        gzipCompress(body, &compressed);
+    const std::string& payload = use_gzip ? compressed : body;
+
+    std::string request;
+    request.reserve(m_request_prefix.size() + payload.size() + 64);
+    request += m_request_prefix;
+    if (use_gzip)
+        request += "Content-Encoding: gzip\r\n";
+    request += "Content-Length: ";
+    request += StringUtils::toString(payload.size());
+    request += "\r\n\r\n";
+    request += payload;
+    Log::debug("HTTPClient", "Request body of %d bytes (%d bytes sent): %s",
+        (int)body.size(), (int)payload.size(), body.c_str());
+    return request;
+}   // buildRequest
+
+/** Reads one complete response from the connection.
+ *  \param close_connection Set to true if the server will close the
+ *         connection after this response.
+ *  \param status Set to the status code of the response.
+ *  \return False if the connection failed.
+ */
+bool HTTPClient::readResponse(bool* close_connection, int* status)
+{
+    size_t header_end;
+    while ((header_end = m_response_buffer.find("\r\n\r\n")) ==
+        std::string::npos)
+    {
+        std::string data;
+        if (!m_tls_conn.receiveData(data, 4096))
+            return false;
+        m_response_buffer += data;
+    }
 
-            Log::info("HTTPClient", "Wait completed. Queue size: %d, Stop thread: %d",
-                (int)m_message_queue.size(), m_stop_thread ? 1 : 0);
+    std::string headers =
+        StringUtils::toLowerCase(m_response_buffer.substr(0, header_end));
+    size_t body_start = header_end + 4;
+    *status = 0;
+    size_t space = headers.find(' ');
+    if (space != std::string::npos)
+        *status = atoi(headers.c_str() + space + 1);
+    if (*status < 200 || *status >= 300)
+    {
+        Log::warn("HTTPClient", "Server responded: %s",
+            m_response_buffer.substr(0, m_response_buffer.find("\r\n"))
+            .c_str());
+    }
+    *close_connection =
+        headers.find("\r\nconnection: close") != std::string::npos;
 
-            if (m_stop_thread && m_message_queue.empty()) {
-                break;
+    size_t response_end;
+    if (headers.find("\r\ntransfer-encoding: chunked") != std::string::npos)
+    {
+        // Skip all chunks until the final empty one and its trailer
+        size_t pos = body_start;
+        while (true)
+        {
+            size_t line_end = m_response_buffer.find("\r\n", pos);
+            if (line_end != std::string::npos)
+            {
+                size_t chunk_size =
+                    strtoul(m_response_buffer.c_str() + pos, NULL, 16);
+                if (chunk_size == 0)
+                {
+                    // The last chunk is followed by optional trailers and
+                    // an empty line
+                    size_t end = m_response_buffer.find("\r\n\r\n",
+                        line_end);
+                    if (end != std::string::npos)
+                    {
+                        response_end = end + 4;
+                        break;
+                    }
+                }
+                else if (m_response_buffer.size() >=
+                    line_end + 2 + chunk_size + 2)
+                {
+                    pos = line_end + 2 + chunk_size + 2;
+                    continue;
+                }
             }
+            std::string data;
+            if (!m_tls_conn.receiveData(data, 4096))
+                return false;
+            m_response_buffer += data;
+        }
+    }
+    else
+    {
+        size_t length = 0;
+        size_t cl = headers.find("\r\ncontent-length:");
+        if (cl != std::string::npos)
+            length = strtoul(headers.c_str() + cl + 17, NULL, 10);
+        response_end = body_start + length;
+        while (m_response_buffer.size() < response_end)
+        {
+            std::string data;
+            if (!m_tls_conn.receiveData(data, 4096))
+                return false;
+            m_response_buffer += data;
+        }
+    }
+    Log::debug("HTTPClient", "Received response:\n%s",
+        m_response_buffer.substr(0, response_end).c_str());
+    m_response_buffer.erase(0, response_end);
+    return true;
+}   // readResponse
 
-            // Batch up to 10 messages at a time
-            while (!m_message_queue.empty() && messages_to_send.size() < 10) {
-                messages_to_send.push_back(m_message_queue.front());
-                m_message_queue.pop();
-            }
-        } // unlock here
+/** Returns true if a request answered with this status can succeed when it
+ *  is sent again: server errors, timeouts and rate limiting. Other client
+ *  errors mean the server will never accept the body.
+ */
+bool HTTPClient::isRetryableStatus(int status)
+{
+    return status < 400 || status >= 500 || status == 408 || status == 429;
+}   // isRetryableStatus
+
+/** Sends all request bodies, pipelining up to MAX_PIPELINED_REQUESTS
+ *  requests in a single write before reading their responses.
+ *  \return Number of bodies (from the first one) which are done, i.e. were
+ *          acknowledged with a 2xx status or permanently rejected (and
+ *          dropped). Less than the number of bodies if the connection
+ *          failed or the server rejected a body temporarily.
+ */
+size_t HTTPClient::sendRequests(const std::vector<std::string>& bodies)
+{
+    for (size_t first = 0; first < bodies.size();
+        first += MAX_PIPELINED_REQUESTS)
+    {
+        const size_t last = std::min(bodies.size(),
+            first + MAX_PIPELINED_REQUESTS);
+        std::string requests;
+        for (size_t i = first; i < last; i++)
+            requests += buildRequest(bodies[i]);
+        if (!m_tls_conn.sendData(requests))
+        {
+            Log::warn("HTTPClient", "Failed to send analytics data");
+            return first;
+        }
 
-        for (const std::string& message : messages_to_send) {
-            // Check connection state before sending
-            if (!m_connected) {
-                Log::info("HTTPClient", "Connection needed - waiting 1 second before retry");
-                StkTime::sleep(1);  // Add a delay before reconnect
-                if (!connect()) {
-                    Log::warn("HTTPClient", "Connection attempt failed - will try again later");
-                    break;  // Exit the message loop and try again next iteration
+        for (size_t i = first; i < last; i++)
+        {
+            bool close_connection = false;
+            int status = 0;
+            if (!readResponse(&close_connection, &status))
+            {
+                Log::info("HTTPClient", "No response received - marking as disconnected");
+                return i;
+            }
+            if ((status < 200 || status >= 300) && isRetryableStatus(status))
+            {
+                // Not stored by the server, so this and all following bodies
+                // are sent again later. The responses to the pipelined
+                // requests after it are discarded with the connection.
+                disconnect();
+                return i;
+            }
+            if (status < 200 || status >= 300)
+            {
+                // Sending it again would fail again and block all bodies
+                // after it, so it is dropped
+                static Metrics::Counter& rejected = Metrics::counter(
+                    "stk_analytics_rejected_batches_total", "Analytics "
+                    "batches dropped because the endpoint rejected them.");
+                rejected.increase();
+                Log::error("HTTPClient", "Analytics batch of %d bytes "
+                    "rejected with status %d, dropped.",
+                    (int)bodies[i].size(), status);
+            }
+            if (close_connection)
+            {
+                // Requests after this one were discarded by the server
+                Log::info("HTTPClient", "Server requested connection close");
+                disconnect();
+                if (i + 1 < bodies.size() && connect())
+                {
+                    std::vector<std::string> remaining(
+                        bodies.begin() + i + 1, bodies.end());
+                    return i + 1 + sendRequests(remaining);
                 }
+                return i + 1;
             }
+        }
+    }
+    return bodies.size();
+}   // sendRequests
 
-            // Construct HTTP POST request
-            std::ostringstream post_stream;
-            // Extract path and query from URI
-            std::string protocol, host, path;
-            size_t pos = m_uri.find("://");
-            if (pos == std::string::npos) {
-                Log::error("HTTPClient", "Invalid URI: %s", m_uri.c_str());
-                continue;
-            }
+void HTTPClient::sendLoop()
+{
+    Log::info("HTTPClient", "Send loop starting");
+    uint64_t retry_delay = MIN_RETRY_DELAY;
+    uint64_t next_retry = 0;
+
+    Metrics::Histogram& send_time = Metrics::histogram(
+        "stk_analytics_send_seconds", "Time to send a group of pipelined "
+        "analytics requests and receive their responses.");
+    Metrics::Gauge& spool_bytes = Metrics::gauge("stk_analytics_spool_bytes",
+        "Bytes of analytics stored on disk while the endpoint is down.");
+    auto timed_send = [this, &send_time](const std::vector<std::string>& b)
+    {
+        if (b.empty())
+            return (size_t)0;
+        auto start = std::chrono::steady_clock::now();
+        size_t sent = sendRequests(b);
+        send_time.observe(std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count());
+        return sent;
+    };
 
-            // Log the URI and message
-            Log::info("HTTPClient", "Preparing to send to URI: %s", m_uri.c_str());
-            Log::info("HTTPClient", "Message payload: %s", message.c_str());
-
-            protocol = m_uri.substr(0, pos);
-            size_t host_start = pos + 3;
-            size_t path_start = m_uri.find('/', host_start);
-            if (path_start == std::string::npos) {
-                host = m_uri.substr(host_start);
-                path = "/";
-            } else {
-                host = m_uri.substr(host_start, path_start - host_start);
-                path = m_uri.substr(path_start);
+    while (true) {
+        std::deque<QueuedMessage> messages;
+        bool stop = false;
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            auto has_work = [this]
+                { return !m_message_queue.empty() || m_stop_thread; };
+            uint64_t now = StkTime::getMonoTimeMs();
+            if (m_spool && !m_spool->empty()) {
+                // Wake up to replay the spool once the endpoint may be back
+                if (now < next_retry) {
+                    m_cond_var.wait_for(lock,
+                        std::chrono::milliseconds(next_retry - now),
+                        has_work);
+                }
             }
-
-            // Handle query parameters if any
-            std::ostringstream full_path;
-            full_path << path;
-            if (path.find('?') == std::string::npos) {
-                full_path << "?table=" << m_table << "&token=" << m_token;
-            } else {
-                full_path << "&table=" << m_table << "&token=" << m_token;
+            else
+                m_cond_var.wait(lock, has_work);
+
+            // Wait until the batch is big or old enough
+            while (!m_message_queue.empty() && !m_stop_thread &&
+                m_queued_bytes < MAX_BATCH_BYTES) {
+                uint64_t age = StkTime::getMonoTimeMs() -
+                    m_message_queue.front().m_queued_time;
+                if (age >= MAX_BATCH_AGE)
+                    break;
+                m_cond_var.wait_for(lock,
+                    std::chrono::milliseconds(MAX_BATCH_AGE - age));
             }
 
-            post_stream << "POST " << full_path.str() << " HTTP/1.1\r\n";
-            post_stream << "Host: " << host << "\r\n";
-            post_stream << "Authorization: Basic " << constructAuthHeader() << "\r\n";
-            post_stream << "Content-Type: application/json\r\n";
-            post_stream << "Content-Length: " << message.length() << "\r\n";
-            post_stream << "Accept: application/json\r\n";
-            post_stream << "Connection: keep-alive\r\n\r\n";
-            post_stream << message;
+            stop = m_stop_thread;
+            messages.swap(m_message_queue);
+            m_queued_bytes = 0;
+        } // unlock here
 
-            std::string post_request = post_stream.str();
+        std::vector<std::string> bodies;
+        buildBodies(&messages, &bodies);
+
+        // Reconnect with exponential backoff
+        if (!m_connected && (!bodies.empty() || (m_spool &&
+            !m_spool->empty())) && StkTime::getMonoTimeMs() >= next_retry) {
+            if (!connect()) {
+                Log::warn("HTTPClient", "Connection attempt failed - retrying "
+                    "in %d seconds", (int)(retry_delay / 1000));
+                next_retry = StkTime::getMonoTimeMs() + retry_delay;
+                retry_delay = std::min(retry_delay * 2, MAX_RETRY_DELAY);
+            }
+        }
 
-            // Log the full request (be careful with auth headers in production!)
-            Log::info("HTTPClient", "Sending HTTP request:\n%s", post_request.c_str());
+        try {
+            // Without spool bodies which can't be sent are discarded. With
+            // spool the order is kept by appending new bodies after the
+            // spooled ones
+            if (m_spool && (!m_connected || !m_spool->empty())) {
+                m_spool->append(bodies);
+                bodies.clear();
+            }
+            else if (!m_connected) {
+                if (!bodies.empty())
+                    Log::warn("HTTPClient", "Not connected - %d messages "
+                        "discarded", (int)messages.size());
+                bodies.clear();
+            }
 
+            // The delay is only reset once the endpoint accepted data, so
+            // that it also grows while the endpoint rejects all requests
+            size_t sent = timed_send(bodies);
+            if (sent > 0)
+                retry_delay = MIN_RETRY_DELAY;
+            if (sent < bodies.size()) {
+                disconnect();
+                next_retry = StkTime::getMonoTimeMs() + retry_delay;
+                retry_delay = std::min(retry_delay * 2, MAX_RETRY_DELAY);
+                if (m_spool) {
+                    std::vector<std::string> remaining(bodies.begin() + sent,
+                        bodies.end());
+                    m_spool->append(remaining);
+                }
+            }
 
-            try {
-                // Send the POST request with a short timeout
-                if (!m_tls_conn.sendData(post_request)) {
-                    Log::warn("HTTPClient", "Failed to send analytics data");
-                    continue;
+            // Replay the spool, but don't replay at exit and stop if new
+            // messages need to be spooled to keep the memory usage bounded
+            while (!stop && m_connected && m_spool && !m_spool->empty()) {
+                std::vector<std::string> spooled;
+                m_spool->peek(&spooled, MAX_PIPELINED_REQUESTS);
+                if (spooled.empty())
+                    break;
+                sent = timed_send(spooled);
+                m_spool->pop(sent);
+                if (sent > 0)
+                    retry_delay = MIN_RETRY_DELAY;
+                if (sent < spooled.size()) {
+                    disconnect();
+                    next_retry = StkTime::getMonoTimeMs() + retry_delay;
+                    retry_delay = std::min(retry_delay * 2, MAX_RETRY_DELAY);
+                    break;
                 }
+                std::lock_guard<std::mutex> lock(m_queue_mutex);
+                if (m_stop_thread || m_queued_bytes >= MAX_BATCH_BYTES)
+                    break;
+            }
+        }
+        catch (const std::exception& e) {
+            Log::warn("HTTPClient", "Error in analytics: %s", e.what());
+        }
+        catch (...) {
+            Log::warn("HTTPClient", "Unknown error in analytics");
+        }
+        if (m_spool)
+            spool_bytes.set(m_spool->getTotalBytes());
 
-                // Read response with a short timeout
-                std::string response;
-                if (!m_tls_conn.receiveData(response, 4096)) {
-                    Log::info("HTTPClient", "No response received - marking as disconnected");
-                    m_connected = false;
-                    // Don't try to reconnect immediately - wait for next send
-                    continue;
-                } else {
-                    Log::info("HTTPClient", "Received response:\n%s", response.c_str());
-
-                    // If server sent Connection: close, just mark as disconnected
-                    if (response.find("Connection: close") != std::string::npos) {
-                        Log::info("HTTPClient", "Server requested connection close - marking as disconnected");
-                        m_connected = false;
-                        m_tls_conn.disconnect();  // Ensure we clean up the connection
+        if (stop)
+            break;
+    }
+}
+
+void HTTPClient::unitTesting()
+{
+#ifndef WIN32
+    // A local http sink which records all requests it receives, and answers
+    // the first ones with the statuses in m_reject_statuses
+    struct Request
+    {
+        std::string m_headers;
+        std::string m_body;
+        bool m_accepted;
+        uint64_t m_time;
+    };
+    struct Sink
+    {
+        int m_listen_socket;
+        uint16_t m_port;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::vector<Request> m_requests;
+        unsigned m_connections = 0;
+        std::vector<int> m_reject_statuses;
+        // --------------------------------------------------------------------
+        Sink(uint16_t port)
+        {
+            m_listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+            assert(m_listen_socket >= 0);
+            int reuse = 1;
+            setsockopt(m_listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                sizeof(reuse));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            int ret = bind(m_listen_socket, (struct sockaddr*)&addr,
+                sizeof(addr));
+            assert(ret == 0);
+            ret = listen(m_listen_socket, 1);
+            assert(ret == 0);
+            socklen_t addr_len = sizeof(addr);
+            getsockname(m_listen_socket, (struct sockaddr*)&addr, &addr_len);
+            m_port = ntohs(addr.sin_port);
+            m_thread = std::thread(&Sink::run, this);
+        }
+        // --------------------------------------------------------------------
+        /** Stops accepting connections and waits until the client closed
+         *  the current one. */
+        void stop()
+        {
+            shutdown(m_listen_socket, SHUT_RDWR);
+            m_thread.join();
+            close(m_listen_socket);
+        }
+        // --------------------------------------------------------------------
+        void run()
+        {
+            int client;
+            while ((client = accept(m_listen_socket, NULL, NULL)) >= 0)
+                serve(client);
+        }
+        // --------------------------------------------------------------------
+        void serve(int client)
+        {
+            m_connections++;
+            std::string buffer;
+            char data[4096];
+            while (true)
+            {
+                size_t header_end = buffer.find("\r\n\r\n");
+                if (header_end != std::string::npos)
+                {
+                    Request r;
+                    r.m_headers = StringUtils::toLowerCase(
+                        buffer.substr(0, header_end));
+                    size_t cl = r.m_headers.find("\r\ncontent-length:");
+                    size_t length = cl == std::string::npos ? 0 :
+                        strtoul(r.m_headers.c_str() + cl + 17, NULL, 10);
+                    if (buffer.size() >= header_end + 4 + length)
+                    {
+                        r.m_body = buffer.substr(header_end + 4, length);
+                        buffer.erase(0, header_end + 4 + length);
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        // Alternate between fixed length and chunked
+                        // responses
+                        const char* response = m_requests.size() % 2 == 0 ?
+                            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok" :
+                            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked"
+                            "\r\n\r\n2\r\nok\r\n0\r\n\r\n";
+                        r.m_accepted =
+                            m_requests.size() >= m_reject_statuses.size();
+                        std::string rejection;
+                        if (!r.m_accepted)
+                        {
+                            rejection = "HTTP/1.1 " + StringUtils::toString(
+                                m_reject_statuses[m_requests.size()]) +
+                                " Rejected\r\nContent-Length: 0\r\n\r\n";
+                            response = rejection.c_str();
+                        }
+                        r.m_time = StkTime::getMonoTimeMs();
+                        m_requests.push_back(r);
+                        send(client, response, strlen(response), 0);
+                        continue;
                     }
                 }
+                ssize_t received = recv(client, data, sizeof(data), 0);
+                if (received <= 0)
+                    break;
+                buffer.append(data, received);
             }
-            catch (const std::exception& e) {
-                Log::warn("HTTPClient", "Error in analytics: %s", e.what());
+            close(client);
+        }
+    };
+
+    Sink* sink = new Sink(0);
+    const uint16_t port = sink->m_port;
+    const std::string uri =
+        "http://127.0.0.1:" + StringUtils::toString(port) + "/ingest";
+    const unsigned MESSAGE_AMOUNT = 500;
+    size_t total_bytes = 0;
+    {
+        HTTPClient client(uri, "uid", "pwd", "table", "token");
+        bool connected = client.connect();
+        assert(connected);
+        for (unsigned i = 0; i < MESSAGE_AMOUNT; i++)
+        {
+            std::string json = "[{\"i\":" + StringUtils::toString(i) +
+                ",\"pad\":\"" + std::string(200, 'a' + i % 26) + "\"}]";
+            total_bytes += json.size();
+            client.sendJSON(json);
+        }
+        // The destructor sends all queued messages
+    }
+    sink->stop();
+
+    assert(sink->m_connections == 1);
+    // Batched by size: more than one request, but far fewer than messages
+    std::vector<Request>& requests = sink->m_requests;
+    assert(requests.size() >= total_bytes / MAX_BATCH_BYTES);
+    assert(requests.size() <= total_bytes / MAX_BATCH_BYTES + 3);
+    unsigned found = 0;
+    size_t sent_bytes = 0;
+    int ret;
+    for (const Request& r : requests)
+    {
+        assert(r.m_headers.find("post /ingest?table=table&token=token "
+            "http/1.1\r\n") == 0);
+        // base64 of "uid:pwd"
+        assert(r.m_headers.find("\r\nauthorization: basic dwlkonb3za==")
+            != std::string::npos);
+        assert(r.m_headers.find("\r\ncontent-encoding: gzip") !=
+            std::string::npos);
+        sent_bytes += r.m_body.size();
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        ret = inflateInit2(&stream, 15 + 16);
+        assert(ret == Z_OK);
+        std::string body(MAX_BATCH_BYTES * 2, 0);
+        stream.next_in = (Bytef*)r.m_body.data();
+        stream.avail_in = (uInt)r.m_body.size();
+        stream.next_out = (Bytef*)&body[0];
+        stream.avail_out = (uInt)body.size();
+        ret = inflate(&stream, Z_FINISH);
+        assert(ret == Z_STREAM_END);
+        body.resize(stream.total_out);
+        inflateEnd(&stream);
+
+        assert(body.size() <= MAX_BATCH_BYTES);
+        assert(body.front() == '[' && body.back() == ']');
+        for (size_t pos = body.find("{\"i\":"); pos != std::string::npos;
+            pos = body.find("{\"i\":", pos + 1))
+        {
+            assert(atoi(body.c_str() + pos + 5) == (int)found);
+            found++;
+        }
+    }
+    assert(found == MESSAGE_AMOUNT);
+    assert(sent_bytes < total_bytes / 4);
+    delete sink;
+
+    // Endpoint outage: nothing listens on the port anymore, so messages are
+    // spooled on disk and sent in order once the endpoint is back
+    const std::string spool_dir = file_manager->getCachedDataDir() +
+        "http-client-unit-test/";
+    file_manager->removeDirectory(spool_dir);
+    {
+        HTTPClient client(uri, "uid", "pwd", "table", "token", spool_dir);
+        for (unsigned i = 0; i < 20; i++)
+            client.sendJSON("[{\"j\":" + StringUtils::toString(i) + "}]");
+    }
+    sink = new Sink(port);
+    {
+        HTTPClient client(uri, "uid", "pwd", "table", "token", spool_dir);
+        client.sendJSON("[{\"j\":20}]");
+        uint64_t start = StkTime::getMonoTimeMs();
+        while (StkTime::getMonoTimeMs() - start < 10000)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sink->m_mutex);
+                if (!sink->m_requests.empty() && sink->m_requests.back()
+                    .m_body.find("{\"j\":20}") != std::string::npos)
+                    break;
             }
-            catch (...) {
-                Log::warn("HTTPClient", "Unknown error in analytics");
+            StkTime::sleep(10);
+        }
+    }
+    sink->stop();
+    found = 0;
+    for (const Request& r : sink->m_requests)
+    {
+        for (size_t pos = r.m_body.find("{\"j\":");
+            pos != std::string::npos; pos = r.m_body.find("{\"j\":", pos + 1))
+        {
+            assert(atoi(r.m_body.c_str() + pos + 5) == (int)found);
+            found++;
+        }
+    }
+    assert(found == 21);
+    delete sink;
+    file_manager->removeDirectory(spool_dir);
+
+    // Endpoint overloaded: requests rejected with 429 or 503 stay spooled
+    // and are sent again, with a growing delay
+    sink = new Sink(port);
+    sink->m_reject_statuses = { 429, 503 };
+    {
+        HTTPClient client(uri, "uid", "pwd", "table", "token", spool_dir);
+        for (unsigned i = 0; i < 5; i++)
+            client.sendJSON("[{\"k\":" + StringUtils::toString(i) + "}]");
+        uint64_t start = StkTime::getMonoTimeMs();
+        while (StkTime::getMonoTimeMs() - start < 15000)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sink->m_mutex);
+                if (!sink->m_requests.empty() &&
+                    sink->m_requests.back().m_accepted)
+                    break;
             }
+            StkTime::sleep(10);
         }
-        
-        // Sleep outside the critical section
-        StkTime::sleep(1);
     }
-}
\ No newline at end of file
+    sink->stop();
+    assert(sink->m_requests.size() == 3);
+    assert(sink->m_connections == 3);
+    for (const Request& r : sink->m_requests)
+        assert(r.m_body == sink->m_requests[0].m_body);
+    assert(sink->m_requests[2].m_accepted);
+    assert(sink->m_requests[2].m_time - sink->m_requests[1].m_time >
+           sink->m_requests[1].m_time - sink->m_requests[0].m_time);
+    found = 0;
+    const std::string& accepted = sink->m_requests[2].m_body;
+    for (size_t pos = accepted.find("{\"k\":"); pos != std::string::npos;
+        pos = accepted.find("{\"k\":", pos + 1))
+    {
+        assert(atoi(accepted.c_str() + pos + 5) == (int)found);
+        found++;
+    }
+    assert(found == 5);
+    delete sink;
+    file_manager->removeDirectory(spool_dir);
+
+    // A batch rejected with another 4xx status would be rejected again, so
+    // it is dropped and the batches after it are still sent
+    sink = new Sink(port);
+    sink->m_reject_statuses = { 400 };
+    {
+        HTTPClient client(uri, "uid", "pwd", "table", "token", spool_dir);
+        client.sendJSON("[{\"m\":0}]");
+        auto wait_for = [sink](size_t amount)
+        {
+            uint64_t start = StkTime::getMonoTimeMs();
+            while (StkTime::getMonoTimeMs() - start < 10000)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(sink->m_mutex);
+                    if (sink->m_requests.size() >= amount)
+                        return;
+                }
+                StkTime::sleep(10);
+            }
+        };
+        wait_for(1);
+        client.sendJSON("[{\"m\":1}]");
+        wait_for(2);
+    }
+    sink->stop();
+    assert(sink->m_requests.size() == 2);
+    assert(sink->m_connections == 1);
+    assert(!sink->m_requests[0].m_accepted);
+    assert(sink->m_requests[0].m_body == "[{\"m\":0}]");
+    assert(sink->m_requests[1].m_accepted);
+    assert(sink->m_requests[1].m_body == "[{\"m\":1}]");
+    delete sink;
+    file_manager->removeDirectory(spool_dir);
+#endif
+}   // unitTesting
@@ -5,13 +5,18 @@
 
 #include "network/tls.hpp"
 #include "utils/log.hpp"
+#include <atomic>
 #include <string>
-#include <queue>
+#include <deque>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
 #include <future>
+#include <memory>
 #include <chrono>
+#include <vector>
+
+class AnalyticsSpool;
 
 class HTTPClient {
 public:
@@ -19,7 +24,8 @@ public:
                const std::string& auth_id,
                const std::string& auth_pwd,
                const std::string& table,
-               const std::string& token);
+               const std::string& token,
+               const std::string& spool_dir = "");
     ~HTTPClient();
 
     // Initialize and connect to the server
@@ -34,28 +40,68 @@ public:
     // Disconnect from the server
     void disconnect();
 
+    static void unitTesting();
+
 private:
+    /** A batch is sent once this many bytes of json are queued... */
+    static constexpr size_t MAX_BATCH_BYTES = 64 * 1024;
+    /** ... or the oldest queued message is that old. */
+    static constexpr uint64_t MAX_BATCH_AGE = 2000;
+    /** Maximum number of requests written before reading the responses. */
+    static constexpr unsigned MAX_PIPELINED_REQUESTS = 8;
+    /** Smaller request bodies are not compressed. */
+    static constexpr size_t MIN_COMPRESS_BYTES = 512;
+    /** Delay before reconnecting, doubled after each failed attempt. */
+    static constexpr uint64_t MIN_RETRY_DELAY = 1000;
+    static constexpr uint64_t MAX_RETRY_DELAY = 60000;
+
     std::string m_uri;
     std::string m_auth_id;
     std::string m_auth_pwd;
     std::string m_table;
     std::string m_token;
 
+    // Parsed once from m_uri
+    bool m_use_tls;
+    std::string m_host;
+    uint16_t m_port;
+    /** Request line and headers which are the same for every request. */
+    std::string m_request_prefix;
+
     // Networking components
     TLSConnection m_tls_conn;
-    bool m_connected;
+    std::atomic_bool m_connected;
+    /** Bytes received after the last complete response. */
+    std::string m_response_buffer;
+
+    /** Stores the bodies which can't be sent while the endpoint is down,
+     *  if enabled. */
+    std::unique_ptr<AnalyticsSpool> m_spool;
 
     // Threading for asynchronous sending
-    std::queue<std::string> m_message_queue;
+    struct QueuedMessage
+    {
+        std::string m_json;
+        uint64_t m_queued_time;
+    };
+    std::deque<QueuedMessage> m_message_queue;
+    size_t m_queued_bytes;
     std::mutex m_queue_mutex;
     std::condition_variable m_cond_var;
     std::thread m_send_thread;
     bool m_stop_thread;
 
     // Helper methods
-    std::string constructURI();
+    bool parseURI();
     std::string constructAuthHeader();
     void sendLoop();
+    void buildBodies(std::deque<QueuedMessage>* messages,
+                     std::vector<std::string>* bodies);
+    std::string buildRequest(const std::string& body);
+    size_t sendRequests(const std::vector<std::string>& bodies);
+    bool readResponse(bool* close_connection, int* status);
+    static bool isRetryableStatus(int status);
+    static bool gzipCompress(const std::string& in, std::string* out);
 };
 
 #endif // HTTP_CLIENT_HPP
@@ -0,0 +1,233 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_IP_INTERVAL_TABLE_HPP
+#define HEADER_IP_INTERVAL_TABLE_HPP
+
+#include "network/stk_ipv6.hpp"
+
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** \ingroup network
+ *  An in-memory copy of an IP range table (IP ban list or IP geolocation),
+ *  so that the server can look up connecting peers without running SQL.
+ *  Intervals are inclusive [start, end] and are kept sorted by start, with
+ *  the running maximum of end alongside, which allows overlapping intervals
+ *  while keeping lookups O(log n) for the usual non-overlapping data.
+ *  Key can be anything with operator< and operator==, like uint32_t for
+ *  IPv4 or a big-endian std::array<uint8_t, 16> for IPv6.
+ *  All functions are thread-safe, the table is swapped as a whole when it
+ *  is reloaded from the database.
+ */
+template <typename Key, typename Value>
+class IPIntervalTable
+{
+public:
+    struct Interval
+    {
+        Key m_start;
+        Key m_end;
+        Value m_value;
+    };
+
+private:
+    /** Intervals sorted by start. */
+    std::vector<Interval> m_intervals;
+
+    /** m_max_end[i] is the largest end of m_intervals[0..i]. */
+    std::vector<Key> m_max_end;
+
+    mutable std::mutex m_mutex;
+
+    // ------------------------------------------------------------------------
+    static bool compareStart(const Interval& a, const Interval& b)
+                                             { return a.m_start < b.m_start; }
+    // ------------------------------------------------------------------------
+    static void sortAndIndex(std::vector<Interval>* intervals,
+                             std::vector<Key>* max_end)
+    {
+        std::stable_sort(intervals->begin(), intervals->end(), compareStart);
+        max_end->resize(intervals->size());
+        for (unsigned i = 0; i < intervals->size(); i++)
+        {
+            const Key& end = (*intervals)[i].m_end;
+            (*max_end)[i] = i == 0 || (*max_end)[i - 1] < end ?
+                end : (*max_end)[i - 1];
+        }
+    }   // sortAndIndex
+
+public:
+    // ------------------------------------------------------------------------
+    /** Replaces the whole table, the content of intervals is taken. */
+    void reset(std::vector<Interval>* intervals)
+    {
+        std::vector<Key> max_end;
+        sortAndIndex(intervals, &max_end);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(m_intervals, *intervals);
+        std::swap(m_max_end, max_end);
+    }   // reset
+    // ------------------------------------------------------------------------
+    /** Adds a single interval, for changes made by the server itself
+     *  between two reloads. */
+    void add(const Key& start, const Key& end, const Value& value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Interval interval = { start, end, value };
+        m_intervals.insert(std::upper_bound(m_intervals.begin(),
+            m_intervals.end(), interval, compareStart), interval);
+        sortAndIndex(&m_intervals, &m_max_end);
+    }   // add
+    // ------------------------------------------------------------------------
+    /** Finds the interval containing key with the largest start.
+     *  \param key The IP to look up.
+     *  \param result Set to the interval found.
+     *  \return True if an interval was found. */
+    bool find(const Key& key, Interval* result) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Interval search;
+        search.m_start = key;
+        size_t idx = std::upper_bound(m_intervals.begin(), m_intervals.end(),
+            search, compareStart) - m_intervals.begin();
+        // Walk back only as long as some earlier interval can still reach
+        // key, which is a single step for non-overlapping intervals
+        while (idx > 0 && !(m_max_end[idx - 1] < key))
+        {
+            idx--;
+            if (!(m_intervals[idx].m_end < key))
+            {
+                *result = m_intervals[idx];
+                return true;
+            }
+        }
+        return false;
+    }   // find
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_intervals.clear();
+        m_max_end.clear();
+    }   // clear
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_intervals.size();
+    }   // size
+    // ------------------------------------------------------------------------
+    static void unitTesting()
+    {
+        typedef IPIntervalTable<uint32_t, std::string> IPv4Table;
+        IPv4Table t;
+        IPv4Table::Interval r;
+        assert(!t.find(0, &r));
+
+        std::vector<IPv4Table::Interval> data;
+        data.push_back({ 300, 399, "c" });
+        data.push_back({ 100, 199, "a" });
+        data.push_back({ 200, 249, "b" });
+        data.push_back({ 0xffffff00, 0xffffffff, "z" });
+        t.reset(&data);
+        assert(t.size() == 4);
+        assert(!t.find(0, &r));
+        assert(!t.find(99, &r));
+        assert(t.find(100, &r) && r.m_value == "a");
+        assert(t.find(199, &r) && r.m_value == "a");
+        assert(t.find(200, &r) && r.m_value == "b");
+        assert(!t.find(250, &r));
+        assert(!t.find(299, &r));
+        assert(t.find(350, &r) && r.m_value == "c");
+        assert(!t.find(400, &r));
+        assert(t.find(0xffffffff, &r) && r.m_value == "z");
+
+        // Overlapping intervals, the one with the largest start wins like
+        // ORDER BY ip_start DESC LIMIT 1 in SQL
+        t.add(150, 320, "o");
+        t.add(0, 1000, "w");
+        assert(t.find(120, &r) && r.m_value == "a");
+        assert(t.find(160, &r) && r.m_value == "o");
+        assert(t.find(260, &r) && r.m_value == "o");
+        assert(t.find(330, &r) && r.m_value == "c");
+        assert(t.find(50, &r) && r.m_value == "w");
+        assert(t.find(999, &r) && r.m_value == "w");
+        assert(!t.find(1001, &r));
+        t.add(500, 500, "s");
+        assert(t.find(500, &r) && r.m_value == "s");
+        assert(t.find(501, &r) && r.m_value == "w");
+
+        // Compare with a linear scan on random data
+        std::vector<IPv4Table::Interval> all;
+        unsigned seed = 12345;
+        for (unsigned i = 0; i < 500; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            uint32_t start = (seed >> 8) % 100000;
+            seed = seed * 1103515245 + 12345;
+            uint32_t len = (seed >> 8) % (i % 10 == 0 ? 5000 : 50);
+            all.push_back({ start, start + len, std::to_string(i) });
+        }
+        std::vector<IPv4Table::Interval> copy = all;
+        t.reset(&copy);
+        for (uint32_t ip = 0; ip < 106000; ip += 7)
+        {
+            const IPv4Table::Interval* expected = NULL;
+            for (const IPv4Table::Interval& i : all)
+            {
+                if (i.m_start <= ip && i.m_end >= ip &&
+                    (expected == NULL || expected->m_start <= i.m_start))
+                    expected = &i;
+            }
+            bool found = t.find(ip, &r);
+            assert(found == (expected != NULL));
+            if (found)
+                assert(r.m_start == expected->m_start);
+        }
+        t.clear();
+        assert(t.size() == 0 && !t.find(100, &r));
+
+        // IPv6 CIDR ranges
+        std::array<uint8_t, 16> start = {}, end = {};
+        assert(!getIPv6CIDRRange("2001:db8::", &start, &end));
+        assert(!getIPv6CIDRRange("2001:db8::/0", &start, &end));
+        assert(getIPv6CIDRRange("2001:db8:ffff::1/36", &start, &end));
+        assert(start[0] == 0x20 && start[1] == 0x01 && start[2] == 0x0d &&
+            start[3] == 0xb8 && start[4] == 0xf0 && start[5] == 0);
+        assert(end[4] == 0xff && end[5] == 0xff && end[15] == 0xff);
+        assert(start[15] == 0);
+        IPIntervalTable<std::array<uint8_t, 16>, std::string> t6;
+        t6.add(start, end, "a");
+        IPIntervalTable<std::array<uint8_t, 16>, std::string>::Interval r6;
+        std::array<uint8_t, 16> ip = start;
+        ip[15] = 1;
+        assert(t6.find(ip, &r6) && r6.m_value == "a");
+        ip[4] = 0xef;
+        assert(!t6.find(ip, &r6));
+        assert(getIPv6CIDRRange("::1/128", &start, &end));
+        assert(start == end && start[15] == 1);
+    }   // unitTesting
+
+};   // IPIntervalTable
+
+#endif
@@ -0,0 +1,228 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/metrics_server.hpp"
+#include "network/socket_address.hpp"
+#include "network/stk_ipv6.hpp"
+#include "utils/log.hpp"
+#include "utils/metrics.hpp"
+#include "utils/vs.hpp"
+
+#include <cassert>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+MetricsServer::MetricsServer()
+             : m_socket(ENET_SOCKET_NULL), m_port(0), m_stop(false)
+{
+}   // MetricsServer
+
+// ----------------------------------------------------------------------------
+MetricsServer::~MetricsServer()
+{
+    stop();
+}   // ~MetricsServer
+
+// ----------------------------------------------------------------------------
+/** Starts listening on the given address and port, and serving requests in a
+ *  separate thread.
+ *  \return False if the socket can't be opened.
+ */
+bool MetricsServer::start(const std::string& address, uint16_t port)
+{
+    assert(m_socket == ENET_SOCKET_NULL);
+    SocketAddress addr(address, port);
+    // An invalid address is parsed as 0.0.0.0, don't listen on all
+    // interfaces by mistake
+    if (addr.getFamily() == AF_INET && addr.getIP() == 0 &&
+        address != "0.0.0.0")
+    {
+        Log::error("MetricsServer", "Invalid address '%s'.", address.c_str());
+        return false;
+    }
+    addr.convertForIPv6Socket(isIPv6Socket() == 1);
+    ENetAddress ea = addr.toENetAddress();
+
+    m_socket = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+    if (m_socket == ENET_SOCKET_NULL)
+    {
+        Log::error("MetricsServer", "Can't create socket.");
+        return false;
+    }
+    enet_socket_set_option(m_socket, ENET_SOCKOPT_REUSEADDR, 1);
+    if (enet_socket_bind(m_socket, &ea) < 0 ||
+        enet_socket_listen(m_socket, 16) < 0)
+    {
+        Log::error("MetricsServer", "Can't listen on %s.",
+            addr.toString().c_str());
+        enet_socket_destroy(m_socket);
+        m_socket = ENET_SOCKET_NULL;
+        return false;
+    }
+    ENetAddress bound = {};
+    if (enet_socket_get_address(m_socket, &bound) == 0)
+        m_port = bound.port;
+    else
+        m_port = port;
+
+    m_stop.store(false);
+    m_thread = std::thread(&MetricsServer::serveLoop, this);
+    Log::info("MetricsServer", "Serving metrics at http://%s:%d/metrics",
+        address.c_str(), m_port);
+    return true;
+}   // start
+
+// ----------------------------------------------------------------------------
+void MetricsServer::stop()
+{
+    m_stop.store(true);
+    if (m_thread.joinable())
+        m_thread.join();
+    if (m_socket != ENET_SOCKET_NULL)
+    {
+        enet_socket_destroy(m_socket);
+        m_socket = ENET_SOCKET_NULL;
+    }
+}   // stop
+
+// ----------------------------------------------------------------------------
+void MetricsServer::serveLoop()
+{
+    VS::setThreadName("MetricsServer");
+    while (!m_stop.load())
+    {
+        // Wake up regularly to check if the server is stopped
+        enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+        if (enet_socket_wait(m_socket, &condition, 500) < 0 ||
+            !(condition & ENET_SOCKET_WAIT_RECEIVE))
+            continue;
+        ENetSocket connection = enet_socket_accept(m_socket, NULL);
+        if (connection == ENET_SOCKET_NULL)
+            continue;
+        handleConnection(connection);
+        enet_socket_destroy(connection);
+    }
+}   // serveLoop
+
+// ----------------------------------------------------------------------------
+/** Reads one request and answers it, the connection is closed afterwards. */
+void MetricsServer::handleConnection(ENetSocket connection)
+{
+    // Don't let a slow client block the metrics for long
+    enet_socket_set_option(connection, ENET_SOCKOPT_RCVTIMEO, 2000);
+    enet_socket_set_option(connection, ENET_SOCKOPT_SNDTIMEO, 2000);
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+        request.size() < 8192)
+    {
+        ENetBuffer eb;
+        eb.data = buffer;
+        eb.dataLength = sizeof(buffer);
+        int received = enet_socket_receive(connection, NULL, &eb, 1);
+        if (received <= 0)
+            break;
+        request.append(buffer, received);
+    }
+    if (request.find("\r\n") == std::string::npos)
+        return;
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 ||
+        request.compare(0, 14, "GET /metrics? ") == 0 ||
+        request.compare(0, 6, "GET / ") == 0)
+        body = Metrics::render();
+    else if (request.compare(0, 4, "GET ") == 0)
+    {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+    else
+    {
+        status = "405 Method Not Allowed";
+        body = "Method not allowed\n";
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        ENetBuffer eb;
+        eb.data = &response[sent];
+        eb.dataLength = response.size() - sent;
+        int result = enet_socket_send(connection, NULL, &eb, 1);
+        if (result <= 0)
+            break;
+        sent += result;
+    }
+}   // handleConnection
+
+// ----------------------------------------------------------------------------
+void MetricsServer::unitTesting()
+{
+    Metrics::counter("stk_metrics_server_unit_test_total", "Test.").increase(3);
+
+    MetricsServer server;
+    bool started = server.start("127.0.0.1", 0);
+    assert(started);
+    assert(server.getPort() != 0);
+
+    auto get = [&server](const std::string& request)
+    {
+        std::string response;
+        ENetSocket s = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+        SocketAddress addr("127.0.0.1", server.getPort());
+        addr.convertForIPv6Socket(isIPv6Socket() == 1);
+        ENetAddress ea = addr.toENetAddress();
+        if (enet_socket_connect(s, &ea) == 0)
+        {
+            ENetBuffer eb;
+            eb.data = (void*)request.data();
+            eb.dataLength = request.size();
+            enet_socket_send(s, NULL, &eb, 1);
+            enet_socket_set_option(s, ENET_SOCKOPT_RCVTIMEO, 5000);
+            char buffer[1024];
+            while (true)
+            {
+                eb.data = buffer;
+                eb.dataLength = sizeof(buffer);
+                int received = enet_socket_receive(s, NULL, &eb, 1);
+                if (received <= 0)
+                    break;
+                response.append(buffer, received);
+            }
+        }
+        enet_socket_destroy(s);
+        return response;
+    };
+
+    std::string response =
+        get("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    assert(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    assert(response.find("\nstk_metrics_server_unit_test_total 3\n") !=
+        std::string::npos);
+
+    response = get("GET /other HTTP/1.1\r\n\r\n");
+    assert(response.compare(0, 12, "HTTP/1.1 404") == 0);
+    server.stop();
+}   // unitTesting
@@ -0,0 +1,58 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_METRICS_SERVER_HPP
+#define HEADER_METRICS_SERVER_HPP
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+/** A minimal HTTP server which serves Metrics::render() at /metrics, so that
+ *  dedicated servers can be scraped by Prometheus. Requests are handled one
+ *  at a time by a separate thread, the game thread is never involved.
+ */
+class MetricsServer
+{
+private:
+    ENetSocket m_socket;
+
+    uint16_t m_port;
+
+    std::thread m_thread;
+
+    std::atomic_bool m_stop;
+
+    void serveLoop();
+    void handleConnection(ENetSocket connection);
+
+public:
+    MetricsServer();
+    ~MetricsServer();
+    bool start(const std::string& address, uint16_t port);
+    void stop();
+    // ------------------------------------------------------------------------
+    /** Returns the port listened on, useful if 0 was given to start(). */
+    uint16_t getPort() const                                { return m_port; }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // class MetricsServer
+
+#endif   // HEADER_METRICS_SERVER_HPP
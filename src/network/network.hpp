@@ -66,6 +66,8 @@ public:
     static void openLog();
     static void logPacket(const BareNetworkString &ns, bool incoming);
     static void closeLog();
+    static void unitTesting();
+    static void benchmark();
     ENetPeer *connectTo(const ENetAddress &address);
     void     sendRawPacket(const BareNetworkString &buffer,
                            const SocketAddress& dst);
@@ -0,0 +1,219 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/network_buffer_pool.hpp"
+#include "network/crypto.hpp"
+#include "network/network_string.hpp"
+
+#include <cassert>
+#include <thread>
+
+namespace
+{
+    /** Maximum number of buffers (and packet holders) kept in the pool. */
+    const size_t MAX_BUFFERS = 256;
+
+    /** Buffers are allocated with at least this capacity, so that they can
+     *  be reused for most messages without growing. */
+    const size_t MIN_CAPACITY = 512;
+
+    /** Bigger buffers are freed instead of being kept in the pool. */
+    const size_t MAX_CAPACITY = 16384;
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+NetworkBufferPool::Pool::Pool() : m_misses(0)
+{
+    m_buffers.reserve(MAX_BUFFERS);
+    m_holders.reserve(MAX_BUFFERS);
+}   // Pool
+
+// ----------------------------------------------------------------------------
+NetworkBufferPool::Pool& NetworkBufferPool::getPool()
+{
+    // Never destroyed, packets can still be freed during static destruction
+    static Pool* pool = new Pool();
+    return *pool;
+}   // getPool
+
+// ----------------------------------------------------------------------------
+/** Returns an empty buffer with at least the given capacity. */
+std::vector<uint8_t> NetworkBufferPool::get(size_t capacity)
+{
+    Pool& pool = getPool();
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        if (!pool.m_buffers.empty())
+        {
+            buffer.swap(pool.m_buffers.back());
+            pool.m_buffers.pop_back();
+        }
+    }
+    if (buffer.capacity() == 0 || buffer.capacity() < capacity)
+    {
+        pool.m_misses.fetch_add(1, std::memory_order_relaxed);
+        buffer.reserve(capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity);
+    }
+    return buffer;
+}   // get
+
+// ----------------------------------------------------------------------------
+/** Gives a buffer back to the pool. Buffers which are too big, or which
+ *  don't fit in the pool anymore, are left in the argument (and freed when
+ *  it is destroyed). */
+void NetworkBufferPool::release(std::vector<uint8_t>&& buffer)
+{
+    if (buffer.capacity() == 0 || buffer.capacity() > MAX_CAPACITY)
+        return;
+    buffer.clear();
+    Pool& pool = getPool();
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    if (pool.m_buffers.size() < MAX_BUFFERS)
+    {
+        pool.m_buffers.emplace_back();
+        pool.m_buffers.back().swap(buffer);
+    }
+}   // release
+
+// ----------------------------------------------------------------------------
+/** Creates an enet packet whose data is a buffer of the pool. The packet
+ *  adopts the buffer (ENET_PACKET_FLAG_NO_ALLOCATE), it is given back to the
+ *  pool when enet destroys the packet.
+ *  \param size Size of the packet data, which is left for the caller to fill.
+ */
+ENetPacket* NetworkBufferPool::createPacket(size_t size, enet_uint32 flags)
+{
+    Pool& pool = getPool();
+    std::vector<uint8_t>* holder = NULL;
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        if (!pool.m_holders.empty())
+        {
+            holder = pool.m_holders.back();
+            pool.m_holders.pop_back();
+        }
+    }
+    if (!holder)
+        holder = new std::vector<uint8_t>();
+    std::vector<uint8_t> buffer = get(size);
+    holder->swap(buffer);
+    holder->resize(size);
+
+    ENetPacket* packet = enet_packet_create(holder->data(), size,
+        flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+    if (!packet)
+    {
+        release(std::move(*holder));
+        delete holder;
+        return NULL;
+    }
+    packet->userData = holder;
+    packet->freeCallback = freePacket;
+    return packet;
+}   // createPacket
+
+// ----------------------------------------------------------------------------
+void NetworkBufferPool::freePacket(ENetPacket* packet)
+{
+    std::vector<uint8_t>* holder = (std::vector<uint8_t>*)packet->userData;
+    release(std::move(*holder));
+    // Frees the buffer if the pool didn't take it
+    std::vector<uint8_t>().swap(*holder);
+
+    Pool& pool = getPool();
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        if (pool.m_holders.size() < MAX_BUFFERS)
+        {
+            pool.m_holders.push_back(holder);
+            holder = NULL;
+        }
+    }
+    delete holder;
+}   // freePacket
+
+// ----------------------------------------------------------------------------
+void NetworkBufferPool::unitTesting()
+{
+    std::vector<uint8_t> key(16, 1), iv(12, 2);
+    Crypto crypto(key, iv);
+
+    // What a server does for each message: build it, encrypt it into a
+    // packet, and parse a received packet
+    auto send_and_receive = [&crypto](uint32_t i)
+    {
+        NetworkString ns(PROTOCOL_GAME_EVENTS);
+        ns.addUInt32(i).encodeString(std::string("kart")).addFloat(1.5f);
+        ENetPacket* p = crypto.encryptSend(ns, /*reliable*/true);
+        assert(p && p->dataLength == ns.getTotalSize() + 8);
+        enet_packet_destroy(p);
+
+        p = createPacket(ns.getTotalSize(), ENET_PACKET_FLAG_RELIABLE);
+        memcpy(p->data, ns.getData(), ns.getTotalSize());
+        NetworkString received(p->data, (int)p->dataLength);
+        enet_packet_destroy(p);
+        assert(received.getUInt32() == i);
+        NetworkStringView name;
+        received.decodeString(&name);
+        assert(name == "kart" && name.size() == 4);
+        assert(received.getFloat() == 1.5f);
+    };
+
+    // Once warmed up, all buffers come from the pool
+    for (uint32_t i = 0; i < 10; i++)
+        send_and_receive(i);
+    uint64_t misses = getMisses();
+    for (uint32_t i = 0; i < 1000; i++)
+        send_and_receive(i);
+    assert(getMisses() == misses);
+
+    // A released buffer is handed out again
+    std::vector<uint8_t> buffer = get(100);
+    const uint8_t* buffer_data = buffer.data();
+    release(std::move(buffer));
+    buffer = get(100);
+    assert(buffer.data() == buffer_data);
+    release(std::move(buffer));
+
+    // Packets created by one thread and destroyed by another
+    std::vector<ENetPacket*> packets;
+    for (unsigned i = 0; i < 16; i++)
+        packets.push_back(createPacket(100, 0));
+    std::thread destroy([&packets]()
+        {
+            for (ENetPacket* p : packets)
+                enet_packet_destroy(p);
+        });
+    destroy.join();
+    misses = getMisses();
+    for (unsigned i = 0; i < 16; i++)
+        packets[i] = createPacket(100, 0);
+    for (ENetPacket* p : packets)
+        enet_packet_destroy(p);
+    assert(getMisses() == misses);
+
+    // Copies get their own buffer, moves take it
+    BareNetworkString a;
+    a.addUInt32(42);
+    BareNetworkString b(a);
+    assert(b.getData() != a.getData() && b.getUInt32() == 42);
+    const char* data = a.getData();
+    BareNetworkString c(std::move(a));
+    assert(c.getData() == data && c.getUInt32() == 42);
+}   // unitTesting
@@ -0,0 +1,66 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_NETWORK_BUFFER_POOL_HPP
+#define HEADER_NETWORK_BUFFER_POOL_HPP
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/** A pool of byte buffers used by network strings and the packets given to
+ *  enet, so that once the pool is warmed up sending and receiving messages
+ *  reuses buffers instead of allocating a new one for each message (enet
+ *  still allocates the ENetPacket itself). Buffers are moved in and out of
+ *  the pool, they keep their capacity, and can be released by another
+ *  thread than the one which got them (e.g. packets are destroyed by the
+ *  listening thread).
+ */
+class NetworkBufferPool
+{
+private:
+    struct Pool
+    {
+        std::mutex m_mutex;
+        std::vector<std::vector<uint8_t> > m_buffers;
+        /** Keep the buffers adopted by enet packets (see createPacket). */
+        std::vector<std::vector<uint8_t>*> m_holders;
+        std::atomic<uint64_t> m_misses;
+        Pool();
+    };
+
+    static Pool& getPool();
+    static void freePacket(ENetPacket* packet);
+
+public:
+    static std::vector<uint8_t> get(size_t capacity);
+    static void release(std::vector<uint8_t>&& buffer);
+    static ENetPacket* createPacket(size_t size, enet_uint32 flags);
+    // ------------------------------------------------------------------------
+    /** Returns how many times get() had no pooled buffer big enough, so that
+     *  a buffer was allocated or grown. Allocations outside of the pool are
+     *  not counted. */
+    static uint64_t getMisses()            { return getPool().m_misses.load(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // class NetworkBufferPool
+
+#endif   // HEADER_NETWORK_BUFFER_POOL_HPP
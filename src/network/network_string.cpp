@@ -108,6 +108,19 @@ int BareNetworkString::decodeString(std::string *out) const
     return len+1;
 }    // decodeString
 
+// ----------------------------------------------------------------------------
+/** Returns a string encoded with encodeString without copying it, see
+ *  NetworkStringView.
+ *  \param[out] out The view of the decoded string.
+ *  \return number of bytes read = 1 + length of string
+ */
+int BareNetworkString::decodeString(NetworkStringView *out) const
+{
+    uint8_t len = get<uint8_t>();
+    *out = getStringView(len);
+    return len+1;
+}    // decodeString
+
 // ----------------------------------------------------------------------------
 /** Returns an irrlicht wide string from the utf8 encoded string at the 
  *  given position.
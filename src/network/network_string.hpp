@@ -23,6 +23,7 @@
 #ifndef NETWORK_STRING_HPP
 #define NETWORK_STRING_HPP
 
+#include "network/network_buffer_pool.hpp"
 #include "network/protocol.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/types.hpp"
@@ -41,6 +42,46 @@
 
 typedef unsigned char uchar;
 
+/** A read-only reference to bytes inside a network string, which avoids
+ *  copying them into a std::string (std::string_view needs C++17). It is
+ *  only valid as long as the network string is not changed or destroyed.
+ */
+class NetworkStringView
+{
+private:
+    const char* m_data;
+    unsigned m_size;
+public:
+    NetworkStringView() : m_data(NULL), m_size(0) {}
+    // ------------------------------------------------------------------------
+    NetworkStringView(const char* data, unsigned size)
+                    : m_data(data), m_size(size) {}
+    // ------------------------------------------------------------------------
+    const char* data() const                                { return m_data; }
+    // ------------------------------------------------------------------------
+    unsigned size() const                                   { return m_size; }
+    // ------------------------------------------------------------------------
+    bool empty() const                                 { return m_size == 0; }
+    // ------------------------------------------------------------------------
+    std::string str() const             { return std::string(m_data, m_size); }
+    // ------------------------------------------------------------------------
+    bool operator==(const std::string& s) const
+    {
+        return s.size() == m_size &&
+            (m_size == 0 || memcmp(s.data(), m_data, m_size) == 0);
+    }   // operator==
+    // ------------------------------------------------------------------------
+    bool operator!=(const std::string& s) const      { return !(*this == s); }
+    // ------------------------------------------------------------------------
+    bool operator==(const char* s) const
+    {
+        return strlen(s) == m_size &&
+            (m_size == 0 || memcmp(s, m_data, m_size) == 0);
+    }   // operator==
+    // ------------------------------------------------------------------------
+    bool operator!=(const char* s) const             { return !(*this == s); }
+};   // class NetworkStringView
+
 /** \class BareNetworkString
  *  \brief Describes a chain of 8-bit unsigned integers.
  *  This class allows you to easily create and parse 8-bit strings, has 
@@ -85,6 +126,19 @@ protected:
         return a;
     }   // getString
     // ------------------------------------------------------------------------
+    /** Returns a part of the network string without copying it. */
+    NetworkStringView getStringView(int len) const
+    {
+        if (m_current_offset > (int)m_buffer.size() ||
+            m_current_offset + len > (int)m_buffer.size())
+            throw std::out_of_range("getStringView out of range.");
+
+        NetworkStringView view((const char*)m_buffer.data() +
+            m_current_offset, len);
+        m_current_offset += len;
+        return view;
+    }   // getStringView
+    // ------------------------------------------------------------------------
     /** Adds a std::string. Internal use only. */
     BareNetworkString& addString(const std::string& value)
     {
@@ -120,15 +174,17 @@ protected:
 
 public:
 
-    /** Constructor, sets the protocol type of this message. */
+    /** Constructor, sets the protocol type of this message. The buffer is
+     *  taken from the NetworkBufferPool. */
     BareNetworkString(int capacity=16)
+        : m_buffer(NetworkBufferPool::get(capacity))
     {
-        m_buffer.reserve(capacity);
         m_current_offset = 0;
     }   // BareNetworkString
 
     // ------------------------------------------------------------------------
     BareNetworkString(const std::string &s)
+        : m_buffer(NetworkBufferPool::get(s.size() + 1))
     {
         m_current_offset = 0;
         encodeString(s);
@@ -136,11 +192,50 @@ public:
     // ------------------------------------------------------------------------
     /** Initialises the string with a sequence of characters. */
     BareNetworkString(const char *data, int len)
+        : m_buffer(NetworkBufferPool::get(len))
     {
         m_current_offset = 0;
         m_buffer.resize(len);
         memcpy(m_buffer.data(), data, len);
     }   // BareNetworkString
+    // ------------------------------------------------------------------------
+    BareNetworkString(const BareNetworkString& other)
+        : m_buffer(NetworkBufferPool::get(other.m_buffer.size()))
+    {
+        m_current_offset = other.m_current_offset;
+        m_buffer.insert(m_buffer.end(), other.m_buffer.begin(),
+            other.m_buffer.end());
+    }   // BareNetworkString
+    // ------------------------------------------------------------------------
+    BareNetworkString(BareNetworkString&& other)
+        : m_buffer(std::move(other.m_buffer))
+    {
+        m_current_offset = other.m_current_offset;
+        other.m_current_offset = 0;
+    }   // BareNetworkString
+    // ------------------------------------------------------------------------
+    ~BareNetworkString()
+    {
+        NetworkBufferPool::release(std::move(m_buffer));
+    }   // ~BareNetworkString
+    // ------------------------------------------------------------------------
+    BareNetworkString& operator=(const BareNetworkString& other)
+    {
+        if (this != &other)
+        {
+            m_buffer.assign(other.m_buffer.begin(), other.m_buffer.end());
+            m_current_offset = other.m_current_offset;
+        }
+        return *this;
+    }   // operator=
+    // ------------------------------------------------------------------------
+    BareNetworkString& operator=(BareNetworkString&& other)
+    {
+        // The old buffer goes back to the pool when other is destroyed
+        std::swap(m_buffer, other.m_buffer);
+        std::swap(m_current_offset, other.m_current_offset);
+        return *this;
+    }   // operator=
 
     // ------------------------------------------------------------------------
     /** Allows one to read a buffer from the beginning again. */
@@ -155,6 +250,7 @@ public:
     BareNetworkString& encodeString(const std::string &value);
     BareNetworkString& encodeString(const irr::core::stringw &value);
     int decodeString(std::string *out) const;
+    int decodeString(NetworkStringView *out) const;
     int decodeStringW(irr::core::stringw *out) const;
     std::string getLogMessage(const std::string &indent="") const;
     // ------------------------------------------------------------------------
@@ -31,6 +31,7 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_config.hpp"
 #include "network/socket_address.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
@@ -39,6 +40,8 @@
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <cinttypes>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol[PT_COUNT];
 // ============================================================================
@@ -60,14 +63,26 @@ std::shared_ptr<GameProtocol> GameProtocol::createInstance()
 GameProtocol::GameProtocol()
             : Protocol(PROTOCOL_CONTROLLER_EVENTS)
 {
-    m_network_item_manager = static_cast<NetworkItemManager*>
+    // NULL in a profile run, which has no network items
+    m_network_item_manager = dynamic_cast<NetworkItemManager*>
         (Track::getCurrentTrack()->getItemManager());
     m_data_to_send = getNetworkString();
+    m_state_bytes_full = 0;
+    m_state_bytes_sent = 0;
+    m_delta_states_sent = 0;
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
 GameProtocol::~GameProtocol()
 {
+    if (m_state_bytes_full > 0)
+    {
+        Log::info("GameProtocol", "State bytes sent: %" PRIu64 " (%" PRIu64
+            " with full states only, %" PRIu64 " delta states, %.1f%% saved).",
+            m_state_bytes_sent, m_state_bytes_full, m_delta_states_sent,
+            100.0 - double(m_state_bytes_sent) * 100.0 /
+            double(m_state_bytes_full));
+    }
     delete m_data_to_send;
 }   // ~GameProtocol
 
@@ -131,6 +146,9 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
+    case GP_STATE_DELTA:       handleDeltaState(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
+    case GP_REWINDER_IDS:      handleRewinderIds(event);      break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     case GP_ADJUST_TIME:
     case GP_ITEM_UPDATE:
@@ -304,10 +322,10 @@ void GameProtocol::addState(BareNetworkString *buffer)
 
 // ----------------------------------------------------------------------------
 /** Called by a server to finalize the current state, which add updated
- *  names of rewinder using to the beginning of state buffer
+ *  ids of rewinder using to the beginning of state buffer
  *  \param cur_rewinder List of current rewinder using.
  */
-void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
+void GameProtocol::finalizeState(std::vector<uint16_t>& cur_rewinder)
 {
     assert(NetworkConfig::get()->isServer());
     auto& buffer = m_data_to_send->getBuffer();
@@ -315,27 +333,212 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
         4/*time*/;
 
     m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
-    for (std::string& name : cur_rewinder)
+    std::vector<uint8_t> ids;
+    ids.reserve(1 + cur_rewinder.size() * 2);
+    ids.push_back((uint8_t)cur_rewinder.size());
+    for (uint16_t id : cur_rewinder)
     {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
+        ids.push_back((uint8_t)(id >> 8));
+        ids.push_back((uint8_t)(id & 0xff));
     }
-    buffer.insert(pos, names.begin(), names.end());
+    buffer.insert(pos, ids.begin(), ids.end());
+    std::swap(m_state_rewinder_ids, cur_rewinder);
 }   // finalizeState
 
 // ----------------------------------------------------------------------------
 /** Called when the last state information has been added and the message
- *  can be sent to the clients.
+ *  can be sent to the clients. If enabled in server config, clients which
+ *  support it receive the state delta encoded against the latest state they
+ *  have acknowledged, if that state is still in the history. Otherwise the
+ *  full state is sent.
  */
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    const int header_size = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/;
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    const uint8_t* state = m_data_to_send->getBuffer().data() + header_size;
+    const size_t state_size = m_data_to_send->getTotalSize() - header_size;
+    const bool use_delta = ServerConfig::m_delta_states;
+
+    std::map<uint32_t, int> peer_state_ack;
+    if (use_delta)
+    {
+        std::lock_guard<std::mutex> lock(m_state_ack_mutex);
+        peer_state_ack = m_peer_state_ack;
+    }
+
+    // Peers which acknowledged the same state share one delta state. The
+    // peers which get the same packet are collected, so that each packet
+    // is encrypted for all its peers in parallel by sendPacketToPeers
+    std::map<int, std::unique_ptr<NetworkString> > delta_states;
+    std::map<int, std::vector<STKPeer*> > delta_peers;
+    std::vector<STKPeer*> full_peers, name_peers;
+    // A profile run saves states without a host
+    std::vector<std::shared_ptr<STKPeer> > all_peers;
+    if (STKHost::existHost())
+        all_peers = STKHost::get()->getPeers();
+    for (auto& peer : all_peers)
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        const std::set<std::string>& caps = peer->getClientCapabilities();
+        if (caps.find("rewinder_ids") == caps.end())
+        {
+            // Delta states of old clients would need a baseline with
+            // unique identities, so they always get full states
+            name_peers.push_back(peer.get());
+            continue;
+        }
+        sendRewinderIds(peer.get());
+
+        auto ack = peer_state_ack.find(peer->getHostId());
+        if (use_delta && ack != peer_state_ack.end() &&
+            caps.find("delta_states") != caps.end())
+        {
+            auto it = delta_states.find(ack->second);
+            if (it == delta_states.end())
+            {
+                std::unique_ptr<NetworkString> delta;
+                const StateHistory* baseline = findStateHistory(ack->second);
+                if (baseline)
+                {
+                    delta.reset(getNetworkString(16 + state_size / 4));
+                    delta->addUInt8(GP_STATE_DELTA).addUInt32(ticks)
+                        .addUInt32(ack->second).addUInt32((uint32_t)state_size);
+                    encodeStateDelta(baseline->m_data, state, state_size,
+                        delta.get());
+                    // Not worth it if the state changed too much
+                    if (delta->getTotalSize() >=
+                        m_data_to_send->getTotalSize())
+                        delta.reset();
+                }
+                it = delta_states.emplace(ack->second, std::move(delta)).first;
+            }
+            if (it->second)
+            {
+                delta_peers[ack->second].push_back(peer.get());
+                continue;
+            }
+        }
+        full_peers.push_back(peer.get());
+    }
+
+    if (!name_peers.empty())
+    {
+        std::unique_ptr<NetworkString> state_with_names(
+            createStateWithNames());
+        STKHost::get()->sendPacketToPeers(name_peers,
+            state_with_names.get(), /*reliable*/false);
+        m_state_bytes_full +=
+            name_peers.size() * state_with_names->getTotalSize();
+        m_state_bytes_sent +=
+            name_peers.size() * state_with_names->getTotalSize();
+    }
+    if (!full_peers.empty())
+    {
+        STKHost::get()->sendPacketToPeers(full_peers, m_data_to_send,
+            /*reliable*/false);
+        m_state_bytes_full +=
+            full_peers.size() * m_data_to_send->getTotalSize();
+        m_state_bytes_sent +=
+            full_peers.size() * m_data_to_send->getTotalSize();
+    }
+    for (auto& group : delta_peers)
+    {
+        NetworkString* delta = delta_states[group.first].get();
+        STKHost::get()->sendPacketToPeers(group.second, delta,
+            /*reliable*/false);
+        m_delta_states_sent += group.second.size();
+        m_state_bytes_full +=
+            group.second.size() * m_data_to_send->getTotalSize();
+        m_state_bytes_sent += group.second.size() * delta->getTotalSize();
+    }
+
+    if (use_delta)
+        addStateHistory(ticks, state, state_size);
 }   // sendState
 
+// ----------------------------------------------------------------------------
+/** Creates the current state with the unique identities of rewinders instead
+ *  of their ids, for clients which don't support rewinder ids.
+ */
+NetworkString* GameProtocol::createStateWithNames() const
+{
+    const int header_size = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/;
+    const int ids_size = 1 + (int)m_state_rewinder_ids.size() * 2;
+    const auto& buffer = m_data_to_send->getBuffer();
+    NetworkString* ns = getNetworkString(m_data_to_send->getTotalSize() +
+        m_state_rewinder_ids.size() * 8);
+    ns->addUInt8(GP_STATE).addUInt32(World::getWorld()->getTicksSinceStart())
+        .addUInt8((uint8_t)m_state_rewinder_ids.size());
+    RewindManager* rm = RewindManager::get();
+    for (uint16_t id : m_state_rewinder_ids)
+    {
+        const std::string* name = rm->getRewinderName(id);
+        assert(name);
+        ns->encodeString(name ? *name : std::string());
+    }
+    ns->getBuffer().insert(ns->getBuffer().end(),
+        buffer.begin() + header_size + ids_size, buffer.end());
+    return ns;
+}   // createStateWithNames
+
+// ----------------------------------------------------------------------------
+/** Sends the rewinder ids which were not sent to a peer yet, before sending
+ *  it a state which may use them. Ids of rewinders which don't exist anymore
+ *  are skipped, so a peer which joins late gets only the ids still used.
+ *  \param peer The peer to send the ids to.
+ */
+void GameProtocol::sendRewinderIds(STKPeer* peer)
+{
+    RewindManager* rm = RewindManager::get();
+    const unsigned num_ids = rm->getNumRewinderIds();
+    unsigned& next_id = m_peer_rewinder_ids[peer->getHostId()];
+    if (next_id >= num_ids)
+        return;
+
+    std::vector<uint16_t> ids;
+    for (unsigned id = next_id; id < num_ids; id++)
+    {
+        if (rm->isRewinderIdUsed((uint16_t)id))
+            ids.push_back((uint16_t)id);
+    }
+    next_id = num_ids;
+    if (ids.empty())
+        return;
+
+    NetworkString* ns = getNetworkString(3 + ids.size() * 8);
+    ns->addUInt8(GP_REWINDER_IDS).addUInt16((uint16_t)ids.size());
+    for (uint16_t id : ids)
+        ns->addUInt16(id).encodeString(*rm->getRewinderName(id));
+    peer->sendPacket(ns, /*reliable*/true);
+    delete ns;
+}   // sendRewinderIds
+
+// ----------------------------------------------------------------------------
+/** Called when the server announces the ids of new rewinders.
+ */
+void GameProtocol::handleRewinderIds(Event *event)
+{
+    if (!NetworkConfig::get()->isClient() || !checkDataSize(event, 2))
+        return;
+    NetworkString &data = event->data();
+    unsigned count = data.getUInt16();
+    std::vector<std::pair<uint16_t, std::string> > rewinder_ids;
+    rewinder_ids.reserve(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        uint16_t id = data.getUInt16();
+        std::string name;
+        data.decodeString(&name);
+        rewinder_ids.emplace_back(id, name);
+    }
+    RewindManager::get()->addNetworkRewinderIds(rewinder_ids);
+}   // handleRewinderIds
+
 // ----------------------------------------------------------------------------
 /** Called when a new full state is received form the server.
  */
@@ -346,21 +549,292 @@ void GameProtocol::handleState(Event *event)
     NetworkString &data = event->data();
     int ticks          = data.getUInt32();
 
-    // Check for updated rewinder using
-    unsigned rewinder_size = data.getUInt8();
-    std::vector<std::string> rewinder_using;
-    for (unsigned i = 0; i < rewinder_size; i++)
+    if (NetworkConfig::get()->getServerCapabilities().find("delta_states") !=
+        NetworkConfig::get()->getServerCapabilities().end())
     {
-        std::string name;
-        data.decodeString(&name);
-        rewinder_using.push_back(name);
+        addStateHistory(ticks, (const uint8_t*)data.getCurrentData(),
+            data.size());
+        sendStateAck(ticks);
+    }
+    addRewindInfoState(ticks, &data);
+}   // handleState
+
+// ----------------------------------------------------------------------------
+/** Called when a delta state is received from the server. It is decoded
+ *  using the previously received state as baseline, if the baseline is
+ *  missing a full state is requested from the server.
+ */
+void GameProtocol::handleDeltaState(Event *event)
+{
+    if (!NetworkConfig::get()->isClient())
+        return;
+    NetworkString &data = event->data();
+    int ticks          = data.getUInt32();
+    int baseline_ticks = data.getUInt32();
+    uint32_t size      = data.getUInt32();
+
+    BareNetworkString state;
+    const StateHistory* baseline = findStateHistory(baseline_ticks);
+    if (!baseline ||
+        !decodeStateDelta(baseline->m_data, data, size, &state.getBuffer()))
+    {
+        Log::warn("GameProtocol", "Cannot decode delta state at %d with "
+            "baseline %d, requesting full state.", ticks, baseline_ticks);
+        sendStateAck(STATE_ACK_RESET);
+        return;
     }
+    addStateHistory(ticks, (const uint8_t*)state.getData(),
+        state.getTotalSize());
+    sendStateAck(ticks);
+    addRewindInfoState(ticks, &state);
+}   // handleDeltaState
 
-    // The memory for bns will be handled in the RewindInfoState object
-    RewindInfoState* ris = new RewindInfoState(ticks, data.getCurrentOffset(),
-        rewinder_using, data.getBuffer());
+// ----------------------------------------------------------------------------
+/** Reads the list of rewinders used in a (decoded) state and sorts the
+ *  state into the RewindManager's network queue.
+ *  \param ticks Time of the state.
+ *  \param data The state, the read offset pointing at the rewinder list.
+ */
+void GameProtocol::addRewindInfoState(int ticks, BareNetworkString* data)
+{
+    // Check for updated rewinder using
+    unsigned rewinder_size = data->getUInt8();
+    RewindInfoState* ris;
+    if (NetworkConfig::get()->getServerCapabilities().find("rewinder_ids") !=
+        NetworkConfig::get()->getServerCapabilities().end())
+    {
+        std::vector<uint16_t> rewinder_using(rewinder_size);
+        for (unsigned i = 0; i < rewinder_size; i++)
+            rewinder_using[i] = data->getUInt16();
+        // The memory for bns will be handled in the RewindInfoState object
+        ris = new RewindInfoState(ticks, data->getCurrentOffset(),
+            rewinder_using, data->getBuffer());
+    }
+    else
+    {
+        std::vector<std::string> rewinder_using;
+        for (unsigned i = 0; i < rewinder_size; i++)
+        {
+            std::string name;
+            data->decodeString(&name);
+            rewinder_using.push_back(name);
+        }
+        ris = new RewindInfoState(ticks, data->getCurrentOffset(),
+            rewinder_using, data->getBuffer());
+    }
     RewindManager::get()->addNetworkRewindInfo(ris);
-}   // handleState
+}   // addRewindInfoState
+
+// ----------------------------------------------------------------------------
+/** Handles the acknowledgement of a state from a client, the state will be
+ *  used as baseline for delta states sent to this client.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    if (!NetworkConfig::get()->isServer() || !checkDataSize(event, 4))
+        return;
+    uint32_t ticks = event->data().getUInt32();
+    uint32_t host_id = event->getPeer()->getHostId();
+    std::lock_guard<std::mutex> lock(m_state_ack_mutex);
+    auto it = m_peer_state_ack.find(host_id);
+    if (ticks == STATE_ACK_RESET)
+    {
+        if (it != m_peer_state_ack.end())
+            m_peer_state_ack.erase(it);
+    }
+    else if (it == m_peer_state_ack.end())
+        m_peer_state_ack[host_id] = (int)ticks;
+    // Unreliable acknowledgements can arrive out of order
+    else if ((int)ticks > it->second)
+        it->second = (int)ticks;
+}   // handleStateAck
+
+// ----------------------------------------------------------------------------
+/** Sends the time of the latest state received to the server.
+ *  \param ticks Time of the state or STATE_ACK_RESET.
+ */
+void GameProtocol::sendStateAck(uint32_t ticks)
+{
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    // Lost acknowledgements only make the baseline of delta states older
+    sendToServer(ns, /*reliable*/false);
+    delete ns;
+}   // sendStateAck
+
+// ----------------------------------------------------------------------------
+/** Saves a state (without protocol header) as a possible baseline for delta
+ *  states, dropping the oldest one if the history is full.
+ */
+void GameProtocol::addStateHistory(int ticks, const uint8_t* data,
+                                   size_t size)
+{
+    if (m_state_history.size() >= STATE_HISTORY_SIZE)
+        m_state_history.pop_front();
+    m_state_history.emplace_back();
+    m_state_history.back().m_ticks = ticks;
+    m_state_history.back().m_data.assign(data, data + size);
+}   // addStateHistory
+
+// ----------------------------------------------------------------------------
+/** Returns the saved state at the given time, or NULL if it is not in the
+ *  history (anymore).
+ */
+const GameProtocol::StateHistory* GameProtocol::findStateHistory(int ticks)
+                                                                         const
+{
+    for (auto it = m_state_history.rbegin(); it != m_state_history.rend();
+         it++)
+    {
+        if (it->m_ticks == ticks)
+            return &(*it);
+    }
+    return NULL;
+}   // findStateHistory
+
+// ----------------------------------------------------------------------------
+/** Encodes a state against a baseline state. The result is a sequence of
+ *  (number of bytes same as baseline, number of literal bytes, literal bytes)
+ *  with each count stored in one byte. Short runs of same bytes between
+ *  changed bytes are stored as literals, since a new run costs two bytes.
+ *  \param baseline The baseline state.
+ *  \param data The state to encode.
+ *  \param size Size of the state.
+ *  \param out The delta is appended to this string.
+ */
+void GameProtocol::encodeStateDelta(const std::vector<uint8_t>& baseline,
+                                    const uint8_t* data, size_t size,
+                                    BareNetworkString* out)
+{
+    auto same_at = [&baseline, data, size](size_t i) -> bool
+    {
+        // Check at most 3 bytes ahead
+        for (size_t j = i; j < size && j < i + 3; j++)
+        {
+            if (j >= baseline.size() || data[j] != baseline[j])
+                return false;
+        }
+        return true;
+    };
+    size_t i = 0;
+    while (i < size)
+    {
+        unsigned same = 0;
+        while (i < size && same < 255 && i < baseline.size() &&
+               data[i] == baseline[i])
+        {
+            same++;
+            i++;
+        }
+        size_t literal_start = i;
+        unsigned literal = 0;
+        while (i < size && literal < 255 && (literal == 0 ?
+               (i >= baseline.size() || data[i] != baseline[i]) : !same_at(i)))
+        {
+            literal++;
+            i++;
+        }
+        out->addUInt8((uint8_t)same).addUInt8((uint8_t)literal);
+        for (unsigned j = 0; j < literal; j++)
+            out->addUInt8(data[literal_start + j]);
+    }
+}   // encodeStateDelta
+
+// ----------------------------------------------------------------------------
+/** Decodes a state encoded by encodeStateDelta.
+ *  \param baseline The baseline state.
+ *  \param in The delta, read from its current offset.
+ *  \param size Size of the decoded state.
+ *  \param out The decoded state.
+ *  \return False if the delta is invalid for this baseline.
+ */
+bool GameProtocol::decodeStateDelta(const std::vector<uint8_t>& baseline,
+                                    const BareNetworkString& in, size_t size,
+                                    std::vector<uint8_t>* out)
+{
+    out->clear();
+    out->reserve(size);
+    try
+    {
+        while (out->size() < size)
+        {
+            const size_t pos = out->size();
+            const unsigned same = in.getUInt8();
+            const unsigned literal = in.getUInt8();
+            // Past the end of the baseline only literal bytes can follow
+            if ((same == 0 && literal == 0) ||
+                (same > 0 && pos + same > baseline.size()) ||
+                pos + same + literal > size)
+                return false;
+            out->insert(out->end(), baseline.begin() + pos,
+                baseline.begin() + pos + same);
+            for (unsigned i = 0; i < literal; i++)
+                out->push_back(in.getUInt8());
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        return false;
+    }
+    return true;
+}   // decodeStateDelta
+
+// ----------------------------------------------------------------------------
+/** Unit tests for the delta encoding of states.
+ */
+void GameProtocol::unitTesting()
+{
+    auto check = [](const std::vector<uint8_t>& baseline,
+                    const std::vector<uint8_t>& state) -> unsigned
+    {
+        BareNetworkString delta;
+        encodeStateDelta(baseline, state.data(), state.size(), &delta);
+        std::vector<uint8_t> decoded;
+        bool ok = decodeStateDelta(baseline, delta, state.size(), &decoded);
+        assert(ok);
+        assert(decoded == state);
+        assert(delta.size() == 0);
+        return delta.getTotalSize();
+    };
+
+    std::vector<uint8_t> baseline;
+    for (unsigned i = 0; i < 1000; i++)
+        baseline.push_back((uint8_t)(i * 7));
+
+    // Unchanged state only needs 2 bytes per 255 bytes
+    assert(check(baseline, baseline) == 8);
+    // Empty baseline and state
+    check(std::vector<uint8_t>(), baseline);
+    check(baseline, std::vector<uint8_t>());
+
+    std::vector<uint8_t> state = baseline;
+    state[0] = 1;
+    state[10] = 2;
+    state[11] = 3;
+    state[13] = 4;
+    state[999] = 5;
+    check(baseline, state);
+    // Shrinking and growing states
+    state.resize(600);
+    check(baseline, state);
+    state.resize(1500, 9);
+    check(baseline, state);
+    // Completely changed state
+    for (unsigned i = 0; i < state.size(); i++)
+        state[i] = (uint8_t)(i * 3 + 1);
+    check(baseline, state);
+
+    // Invalid delta for a different baseline
+    BareNetworkString delta;
+    encodeStateDelta(baseline, baseline.data(), baseline.size(), &delta);
+    std::vector<uint8_t> decoded;
+    assert(!decodeStateDelta(std::vector<uint8_t>(10), delta,
+        baseline.size(), &decoded));
+    // Truncated delta
+    delta.reset();
+    assert(!decodeStateDelta(baseline, delta, baseline.size() + 1,
+        &decoded));
+}   // unitTesting
 
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
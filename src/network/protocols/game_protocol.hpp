@@ -27,6 +27,8 @@
 #include "utils/stk_process.hpp"
 
 #include <cstdlib>
+#include <deque>
+#include <map>
 #include <mutex>
 #include <vector>
 #include <tuple>
@@ -49,9 +51,28 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_STATE_DELTA,
+           GP_STATE_ACK,
+           GP_REWINDER_IDS
     };
 
+    /** Number of previous states kept by server and client which can be used
+     *  as a baseline for delta compressed states. */
+    static const unsigned STATE_HISTORY_SIZE = 16;
+
+    /** Sent as acknowledged ticks by a client which is missing the baseline
+     *  of a delta state, so the server will send a full state next. */
+    static const uint32_t STATE_ACK_RESET = 0xffffffff;
+
+    /** A previously sent (server) or received (client) state, stored without
+     *  the protocol header, used as baseline for delta states. */
+    struct StateHistory
+    {
+        int                  m_ticks;
+        std::vector<uint8_t> m_data;
+    };   // struct StateHistory
+
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
@@ -74,8 +95,43 @@ private:
     // List of all kart actions to send to the server
     std::vector<Action> m_all_actions;
 
+    /** The last states sent (server) or received (client). */
+    std::deque<StateHistory> m_state_history;
+
+    /** Protects m_peer_state_ack, which is written by the network thread. */
+    std::mutex m_state_ack_mutex;
+
+    /** Latest state ticks acknowledged by each peer (key is host id). */
+    std::map<uint32_t, int> m_peer_state_ack;
+
+    /** Bytes of states that would have been sent using full states only. */
+    uint64_t m_state_bytes_full;
+
+    /** Bytes of states that were actually sent. */
+    uint64_t m_state_bytes_sent;
+
+    /** Number of delta states sent. */
+    uint64_t m_delta_states_sent;
+
+    /** Rewinder ids used in the current state, to create the state with
+     *  unique identities for clients which don't support rewinder ids. */
+    std::vector<uint16_t> m_state_rewinder_ids;
+
+    /** The next rewinder id to be announced to each peer (key is host id).
+     */
+    std::map<uint32_t, unsigned> m_peer_rewinder_ids;
+
     void handleControllerAction(Event *event);
     void handleState(Event *event);
+    void handleDeltaState(Event *event);
+    void handleStateAck(Event *event);
+    void handleRewinderIds(Event *event);
+    void sendRewinderIds(STKPeer* peer);
+    NetworkString* createStateWithNames() const;
+    void addRewindInfoState(int ticks, BareNetworkString* data);
+    void addStateHistory(int ticks, const uint8_t* data, size_t size);
+    void sendStateAck(uint32_t ticks);
+    const StateHistory* findStateHistory(int ticks) const;
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
     static std::weak_ptr<GameProtocol> m_game_protocol[PT_COUNT];
@@ -103,6 +159,14 @@ private:
         return std::make_tuple(a, b, c, d);
     }
 public:
+    static void encodeStateDelta(const std::vector<uint8_t>& baseline,
+                                 const uint8_t* data, size_t size,
+                                 BareNetworkString* out);
+    static bool decodeStateDelta(const std::vector<uint8_t>& baseline,
+                                 const BareNetworkString& in, size_t size,
+                                 std::vector<uint8_t>* out);
+    static void unitTesting();
+
              GameProtocol();
     virtual ~GameProtocol();
 
@@ -114,7 +178,7 @@ public:
     void startNewState();
     void addState(BareNetworkString *buffer);
     void sendState();
-    void finalizeState(std::vector<std::string>& cur_rewinder);
+    void finalizeState(std::vector<uint16_t>& cur_rewinder);
     void sendItemEventConfirmation(int ticks);
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
@@ -141,6 +205,13 @@ public:
     /** Returns the NetworkString in which a state was saved. */
     NetworkString* getState() const { return m_data_to_send;  }
     // ------------------------------------------------------------------------
+    /** Returns the number of bytes which would have been sent for states
+     *  without delta compression. */
+    uint64_t getStateBytesFull() const          { return m_state_bytes_full; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of bytes actually sent for states. */
+    uint64_t getStateBytesSent() const          { return m_state_bytes_sent; }
+    // ------------------------------------------------------------------------
     std::unique_lock<std::mutex> acquireWorldDeletingMutex() const
                { return std::unique_lock<std::mutex>(m_world_deleting_mutex); }
 };   // class GameProtocol
@@ -27,6 +27,7 @@
 #include "network/network_config.hpp"
 #include "network/protocols/game_events_protocol.hpp"
 #include "network/protocols/game_protocol.hpp"
+#include "network/protocols/server_lobby.hpp"
 #include "network/race_event_manager.hpp"
 #include "network/server_analytics.hpp"
 #include "states_screens/state_manager.hpp"
@@ -312,3 +313,39 @@ void LobbyProtocol::exitGameState()
             NetworkConfig::get()->getResetScreens(true/*lobby*/).data());
     }
 }   // exitGameState
+
+// ----------------------------------------------------------------------------
+namespace
+{
+/** A lobby without any network handling, used as the lobby of a client. */
+class TestLobby : public LobbyProtocol
+{
+public:
+    virtual void setup()                                                    {}
+    virtual void update(int ticks)                                          {}
+    virtual void asynchronousUpdate()                                       {}
+    virtual void finishedLoadingWorld()                                     {}
+    virtual bool allPlayersReady() const                    { return false; }
+    virtual bool isRacing() const                           { return false; }
+};   // TestLobby
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+/** Checks the lobby lookups done by a client which doesn't run a server in
+ *  a child process (see ClientLobby::connectionAccepted), including an
+ *  invalid process type.
+ */
+void LobbyProtocol::unitTesting()
+{
+    assert(STKProcess::getType() == PT_MAIN);
+    assert(!get<LobbyProtocol>());
+    std::shared_ptr<TestLobby> lobby = create<TestLobby>();
+    assert(get<LobbyProtocol>() == lobby);
+    assert(getByType<LobbyProtocol>(PT_MAIN) == lobby);
+    assert(!getByType<ServerLobby>(PT_MAIN));
+    assert(!getByType<LobbyProtocol>(PT_CHILD));
+    assert(!getByType<ServerLobby>(PT_CHILD));
+    assert(!getByType<LobbyProtocol>(PT_COUNT));
+    lobby.reset();
+    assert(!getByType<LobbyProtocol>(PT_MAIN));
+}   // unitTesting
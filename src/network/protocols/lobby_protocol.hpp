@@ -183,9 +183,12 @@ public:
     }   // get
 
     // ------------------------------------------------------------------------
-    /** Returns specific singleton client or server lobby protocol. */
+    /** Returns specific singleton client or server lobby protocol, or
+     *  nullptr if pt is not a valid process type. */
     template<class T> static std::shared_ptr<T> getByType(ProcessType pt)
     {
+        if (pt >= PT_COUNT)
+            return nullptr;
         if (std::shared_ptr<LobbyProtocol> lp = m_lobby[pt].lock())
         {
             std::shared_ptr<T> new_type = std::dynamic_pointer_cast<T>(lp);
@@ -205,6 +208,7 @@ public:
     virtual void loadWorld();
     virtual bool allPlayersReady() const = 0;
     virtual bool isRacing() const = 0;
+    static void unitTesting();
     void startVotingPeriod(float max_time);
     float getRemainingVotingTime();
     bool isVotingOver();
@@ -54,6 +54,7 @@
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
+#include "utils/metrics.hpp"
 #include "utils/random_generator.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/time.hpp"
@@ -143,6 +144,16 @@ void insideIPv6CIDRSQL(sqlite3_context* context, int argc,
     sqlite3_result_int(context, insideIPv6CIDR(ipv6_cidr, ipv6_in));
 }   // insideIPv6CIDRSQL
 
+// ----------------------------------------------------------------------------
+/** Returns the IPv6 address in big endian for the in-memory IPv6 ban list. */
+static std::array<uint8_t, 16> getIPv6Key(const SocketAddress& addr)
+{
+    std::array<uint8_t, 16> result;
+    memcpy(result.data(),
+        ((sockaddr_in6*)addr.getSockaddr())->sin6_addr.s6_addr, 16);
+    return result;
+}   // getIPv6Key
+
 // ----------------------------------------------------------------------------
 /*
 Copy below code so it can be use as loadable extension to be used in sqlite3
@@ -283,6 +294,7 @@ void ServerLobby::initDatabase()
     m_online_id_ban_table_exists = false;
     m_ip_geolocation_table_exists = false;
     m_ipv6_geolocation_table_exists = false;
+    m_geolocation_data_version = -1;
     if (!ServerConfig::m_sql_management)
         return;
     const std::string& path = ServerConfig::getConfigDirectory() + "/" +
@@ -324,6 +336,8 @@ void ServerLobby::initDatabase()
         m_ip_geolocation_table_exists);
     checkTableExists(ServerConfig::m_ipv6_geolocation_table,
         m_ipv6_geolocation_table_exists);
+    loadIPBanTables();
+    loadIPGeolocationTables(true/*force*/);
 #endif
 }   // initDatabase
 
@@ -544,6 +558,7 @@ void ServerLobby::destroyDatabase()
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
         writeDisconnectInfoTable(peer.get());
+    writeIPBanTriggers();
     if (m_db != NULL)
         sqlite3_close(m_db);
 #endif
@@ -962,7 +977,7 @@ bool ServerLobby::notifyEventAsynchronous(Event* event)
 /* Every 1 minute STK will poll database:
  * 1. Set disconnected time to now for non-exists host.
  * 2. Clear expired player reports if necessary
- * 3. Kick active peer from ban list
+ * 3. Reload the in-memory IP ban lists and kick active peer from ban list
  */
 void ServerLobby::pollDatabase()
 {
@@ -974,80 +989,45 @@ void ServerLobby::pollDatabase()
 
     m_last_poll_db_time = StkTime::getMonoTimeMs();
 
-    if (m_ip_ban_table_exists)
+    writeIPBanTriggers();
+    loadIPBanTables();
+    loadIPGeolocationTables(false/*force*/);
+
+    if (m_ip_ban_table_exists || m_ipv6_ban_table_exists)
     {
-        std::string query =
-            "SELECT ip_start, ip_end, reason, description FROM ";
-        query += ServerConfig::m_ip_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
         auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
+        for (std::shared_ptr<STKPeer>& p : peers)
+        {
+            if (p->isAIPeer())
+                continue;
+            const SocketAddress& addr = p->getAddress();
+            if (addr.isIPv6())
             {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
+                IPIntervalTable<std::array<uint8_t, 16>, IPBanInfo>::Interval
+                    ban;
+                if (m_ipv6_ban_list.find(getIPv6Key(addr), &ban))
                 {
-                    // IPv4 ban list atm
-                    if (p->isAIPeer() || p->getAddress().isIPv6())
-                        continue;
-
-                    uint32_t ip_start = 0;
-                    uint32_t ip_end = 0;
-                    if (!StringUtils::fromString(data[0], ip_start))
-                        continue;
-                    if (!StringUtils::fromString(data[1], ip_end))
-                        continue;
-                    uint32_t peer_addr = p->getAddress().getIP();
-                    if (ip_start <= peer_addr && ip_end >= peer_addr)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[2], data[3]);
-                        p->kick();
-                    }
+                    Log::info("ServerLobby",
+                        "Kick %s, reason: %s, description: %s",
+                        addr.toString(false).c_str(),
+                        ban.m_value.m_reason.c_str(),
+                        ban.m_value.m_description.c_str());
+                    p->kick();
                 }
-                return 0;
-            }, &peers, NULL);
-    }
-
-    if (m_ipv6_ban_table_exists)
-    {
-        std::string query =
-            "SELECT ipv6_cidr, reason, description FROM ";
-        query += ServerConfig::m_ipv6_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
+            }
+            else
             {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
+                IPIntervalTable<uint32_t, IPBanInfo>::Interval ban;
+                if (m_ip_ban_list.find(addr.getIP(), &ban))
                 {
-                    std::string ipv6;
-                    if (p->getAddress().isIPv6())
-                        ipv6 = p->getAddress().toString(false);
-                    // IPv6 ban list atm
-                    if (p->isAIPeer() || ipv6.empty())
-                        continue;
-
-                    char* ipv6_cidr = data[0];
-                    if (insideIPv6CIDR(ipv6_cidr, ipv6.c_str()) == 1)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            ipv6.c_str(), data[1], data[2]);
-                        p->kick();
-                    }
+                    Log::info("ServerLobby",
+                        "Kick %s, reason: %s, description: %s",
+                        addr.toString().c_str(), ban.m_value.m_reason.c_str(),
+                        ban.m_value.m_description.c_str());
+                    p->kick();
                 }
-                return 0;
-            }, &peers, NULL);
+            }
+        }
     }
 
     if (m_online_id_ban_table_exists)
@@ -1173,6 +1153,42 @@ bool ServerLobby::easySQLQuery(const std::string& query,
     return true;
 }   // easySQLQuery
 
+//-----------------------------------------------------------------------------
+/** Run a select query and call row_function for each row returned.
+ *  Return true if no error occurs
+ */
+bool ServerLobby::selectSQLRows(const std::string& query,
+                    std::function<void(sqlite3_stmt* stmt)> row_function) const
+{
+    if (!m_db)
+        return false;
+    sqlite3_stmt* stmt = NULL;
+    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("ServerLobby", "Error preparing database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+        row_function(stmt);
+    bool success = ret == SQLITE_DONE;
+    if (!success)
+    {
+        Log::error("ServerLobby", "Error running query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+    }
+    ret = sqlite3_finalize(stmt);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("ServerLobby",
+            "Error finalize database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+    return success;
+}   // selectSQLRows
+
 //-----------------------------------------------------------------------------
 /* Write true to result if table name exists in database. */
 void ServerLobby::checkTableExists(const std::string& table, bool& result)
@@ -1217,44 +1233,181 @@ void ServerLobby::checkTableExists(const std::string& table, bool& result)
 }   // checkTableExists
 
 //-----------------------------------------------------------------------------
-std::string ServerLobby::ip2Country(const SocketAddress& addr) const
+/** Reloads the currently valid IPv4 / IPv6 bans into memory, so peers can be
+ *  checked in connectionRequested without database access. A failed query
+ *  keeps the previous list.
+ */
+void ServerLobby::loadIPBanTables()
 {
-    if (!m_db || !m_ip_geolocation_table_exists || addr.isLAN())
-        return "";
+    const char* valid_ban =
+        " WHERE datetime('now') > datetime(starting_time) AND "
+        "(expired_days is NULL OR datetime"
+        "(starting_time, '+'||expired_days||' days') > datetime('now'));";
+    if (m_ip_ban_table_exists)
+    {
+        std::vector<IPIntervalTable<uint32_t, IPBanInfo>::Interval> bans;
+        std::string query =
+            "SELECT rowid, ip_start, ip_end, reason, description FROM ";
+        query += ServerConfig::m_ip_ban_table;
+        query += valid_ban;
+        if (selectSQLRows(query, [&bans](sqlite3_stmt* stmt)
+            {
+                IPIntervalTable<uint32_t, IPBanInfo>::Interval ban;
+                ban.m_value.m_row_id = sqlite3_column_int64(stmt, 0);
+                ban.m_start = (uint32_t)sqlite3_column_int64(stmt, 1);
+                ban.m_end = (uint32_t)sqlite3_column_int64(stmt, 2);
+                const char* reason = (char*)sqlite3_column_text(stmt, 3);
+                const char* desc = (char*)sqlite3_column_text(stmt, 4);
+                ban.m_value.m_reason = reason ? reason : "";
+                ban.m_value.m_description = desc ? desc : "";
+                bans.push_back(ban);
+            }))
+            m_ip_ban_list.reset(&bans);
+    }
 
-    std::string cc_code;
-    std::string query = StringUtils::insertValues(
-        "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= %d AND `ip_end` >= %d "
-        "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ip_geolocation_table.c_str(), addr.getIP(),
-        addr.getIP());
+    if (m_ipv6_ban_table_exists)
+    {
+        std::vector<IPIntervalTable<std::array<uint8_t, 16>,
+            IPBanInfo>::Interval> bans;
+        std::string query =
+            "SELECT rowid, ipv6_cidr, reason, description FROM ";
+        query += ServerConfig::m_ipv6_ban_table;
+        query += valid_ban;
+        if (selectSQLRows(query, [&bans](sqlite3_stmt* stmt)
+            {
+                IPIntervalTable<std::array<uint8_t, 16>, IPBanInfo>::Interval
+                    ban;
+                const char* cidr = (char*)sqlite3_column_text(stmt, 1);
+                if (cidr == NULL ||
+                    !getIPv6CIDRRange(cidr, &ban.m_start, &ban.m_end))
+                    return;
+                ban.m_value.m_row_id = sqlite3_column_int64(stmt, 0);
+                ban.m_value.m_ipv6_cidr = cidr;
+                const char* reason = (char*)sqlite3_column_text(stmt, 2);
+                const char* desc = (char*)sqlite3_column_text(stmt, 3);
+                ban.m_value.m_reason = reason ? reason : "";
+                ban.m_value.m_description = desc ? desc : "";
+                bans.push_back(ban);
+            }))
+            m_ipv6_ban_list.reset(&bans);
+    }
+}   // loadIPBanTables
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
+//-----------------------------------------------------------------------------
+/** Loads the IPv4 / IPv6 geolocation tables into memory. As they are large
+ *  and rarely change, they are only reloaded when the database was modified
+ *  by another connection (like an external tool updating geolocation data).
+ *  \param force Load even if the database seems unchanged.
+ */
+void ServerLobby::loadIPGeolocationTables(bool force)
+{
+    if (!m_ip_geolocation_table_exists && !m_ipv6_geolocation_table_exists)
+        return;
+
+    int64_t data_version = -1;
+    selectSQLRows("PRAGMA data_version;", [&data_version](sqlite3_stmt* stmt)
+        {
+            data_version = sqlite3_column_int64(stmt, 0);
+        });
+    if (!force && data_version == m_geolocation_data_version)
+        return;
+    m_geolocation_data_version = data_version;
+
+    if (m_ip_geolocation_table_exists)
     {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        std::vector<IPIntervalTable<uint32_t, std::string>::Interval> rows;
+        std::string query = "SELECT ip_start, ip_end, country_code FROM ";
+        query += ServerConfig::m_ip_geolocation_table;
+        query += ";";
+        if (selectSQLRows(query, [&rows](sqlite3_stmt* stmt)
+            {
+                const char* country_code =
+                    (char*)sqlite3_column_text(stmt, 2);
+                if (country_code == NULL)
+                    return;
+                rows.push_back({ (uint32_t)sqlite3_column_int64(stmt, 0),
+                    (uint32_t)sqlite3_column_int64(stmt, 1), country_code });
+            }))
         {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
+            Log::info("ServerLobby", "Loaded %d IPv4 geolocation entries.",
+                (int)rows.size());
+            m_ip_geolocation.reset(&rows);
         }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+    }
+
+    if (m_ipv6_geolocation_table_exists)
+    {
+        std::vector<IPIntervalTable<int64_t, std::string>::Interval> rows;
+        std::string query = "SELECT ip_start, ip_end, country_code FROM ";
+        query += ServerConfig::m_ipv6_geolocation_table;
+        query += ";";
+        if (selectSQLRows(query, [&rows](sqlite3_stmt* stmt)
+            {
+                const char* country_code =
+                    (char*)sqlite3_column_text(stmt, 2);
+                if (country_code == NULL)
+                    return;
+                rows.push_back({ (int64_t)sqlite3_column_int64(stmt, 0),
+                    (int64_t)sqlite3_column_int64(stmt, 1), country_code });
+            }))
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
+            Log::info("ServerLobby", "Loaded %d IPv6 geolocation entries.",
+                (int)rows.size());
+            m_ipv6_geolocation.reset(&rows);
         }
     }
-    else
+}   // loadIPGeolocationTables
+
+//-----------------------------------------------------------------------------
+/** Writes the trigger count and last trigger time of IP bans hit since last
+ *  call, which is deferred to here to keep connectionRequested free of
+ *  database writes.
+ */
+void ServerLobby::writeIPBanTriggers()
+{
+    for (auto& trigger : m_ip_ban_triggers)
     {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return "";
+        std::string query = StringUtils::insertValues(
+            "UPDATE %s SET trigger_count = trigger_count + %u, "
+            "last_trigger = datetime('now') "
+            "WHERE ip_start = %u AND ip_end = %u;",
+            ServerConfig::m_ip_ban_table.c_str(), trigger.second,
+            trigger.first.first, trigger.first.second);
+        easySQLQuery(query);
     }
-    return cc_code;
+    m_ip_ban_triggers.clear();
+
+    for (auto& trigger : m_ipv6_ban_triggers)
+    {
+        std::string query = StringUtils::insertValues(
+            "UPDATE %s SET trigger_count = trigger_count + %u, "
+            "last_trigger = datetime('now') "
+            "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str(),
+            trigger.second);
+        const std::string& ipv6_cidr = trigger.first;
+        easySQLQuery(query, [ipv6_cidr](sqlite3_stmt* stmt)
+            {
+                if (sqlite3_bind_text(stmt, 1, ipv6_cidr.c_str(),
+                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
+                {
+                    Log::error("easySQLQuery", "Failed to bind %s.",
+                        ipv6_cidr.c_str());
+                }
+            });
+    }
+    m_ipv6_ban_triggers.clear();
+}   // writeIPBanTriggers
+
+//-----------------------------------------------------------------------------
+std::string ServerLobby::ip2Country(const SocketAddress& addr) const
+{
+    if (!m_db || !m_ip_geolocation_table_exists || addr.isLAN())
+        return "";
+
+    IPIntervalTable<uint32_t, std::string>::Interval result;
+    if (m_ip_geolocation.find(addr.getIP(), &result))
+        return result.m_value;
+    return "";
 }   // ip2Country
 
 //-----------------------------------------------------------------------------
@@ -1263,40 +1416,11 @@ std::string ServerLobby::ipv62Country(const SocketAddress& addr) const
     if (!m_db || !m_ipv6_geolocation_table_exists)
         return "";
 
-    std::string cc_code;
     const std::string& ipv6 = addr.toString(false/*show_port*/);
-    std::string query = StringUtils::insertValues(
-        "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= upperIPv6(\"%s\") AND `ip_end` >= upperIPv6(\"%s\") "
-        "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ipv6_geolocation_table.c_str(), ipv6.c_str(),
-        ipv6.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return "";
-    }
-    return cc_code;
+    IPIntervalTable<int64_t, std::string>::Interval result;
+    if (m_ipv6_geolocation.find(upperIPv6(ipv6.c_str()), &result))
+        return result.m_value;
+    return "";
 }   // ipv62Country
 
 #endif
@@ -1398,6 +1522,11 @@ void ServerLobby::writePlayerReport(Event* event)
 /** Find out the public IP server or poll STK server asynchronously. */
 void ServerLobby::asynchronousUpdate()
 {
+    static Metrics::Gauge& state = Metrics::gauge("stk_server_lobby_state",
+        "Current ServerLobby::ServerState (2 = waiting for players, "
+        "7 = racing).");
+    state.set(m_state.load());
+
     if (m_rs_state.load() == RS_ASYNC_RESET)
     {
         resetVotingTime();
@@ -3411,7 +3540,12 @@ void ServerLobby::saveIPBanTable(const SocketAddress& addr)
         "INSERT INTO %s (ip_start, ip_end) "
         "VALUES (%u, %u);",
         ServerConfig::m_ip_ban_table.c_str(), addr.getIP(), addr.getIP());
-    easySQLQuery(query);
+    if (easySQLQuery(query))
+    {
+        IPBanInfo info;
+        info.m_row_id = sqlite3_last_insert_rowid(m_db);
+        m_ip_ban_list.add(addr.getIP(), addr.getIP(), info);
+    }
 #endif
 }   // saveIPBanTable
 
@@ -4795,7 +4929,7 @@ void ServerLobby::resetServer()
 }   // resetServer
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIP(STKPeer* peer) const
+void ServerLobby::testBannedForIP(STKPeer* peer)
 {
 #ifdef ENABLE_SQLITE3
     if (!m_db || !m_ip_ban_table_exists)
@@ -4805,64 +4939,21 @@ void ServerLobby::testBannedForIP(STKPeer* peer) const
     if (peer->getAddress().isIPv6())
         return;
 
-    int row_id = -1;
-    unsigned ip_start = 0;
-    unsigned ip_end = 0;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
-        "WHERE ip_start <= %u AND ip_end >= %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ip_ban_table.c_str(),
-        peer->getAddress().getIP(), peer->getAddress().getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
-            ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
-            const char* reason = (char*)sqlite3_column_text(stmt, 3);
-            const char* desc = (char*)sqlite3_column_text(stmt, 4);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+    IPIntervalTable<uint32_t, IPBanInfo>::Interval ban;
+    if (!m_ip_ban_list.find(peer->getAddress().getIP(), &ban))
         return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ip_start = %u AND ip_end = %u;",
-            ServerConfig::m_ip_ban_table.c_str(), ip_start, ip_end);
-        easySQLQuery(query);
-    }
+
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban.m_value.m_reason.c_str(),
+        (int)ban.m_value.m_row_id, ban.m_value.m_description.c_str());
+    kickPlayerWithReason(peer, ban.m_value.m_reason.c_str());
+    m_ip_ban_triggers[std::make_pair(ban.m_start, ban.m_end)]++;
 #endif
 }   // testBannedForIP
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIPv6(STKPeer* peer) const
+void ServerLobby::testBannedForIPv6(STKPeer* peer)
 {
 #ifdef ENABLE_SQLITE3
     if (!m_db || !m_ipv6_ban_table_exists)
@@ -4872,71 +4963,16 @@ void ServerLobby::testBannedForIPv6(STKPeer* peer) const
     if (!peer->getAddress().isIPv6())
         return;
 
-    int row_id = -1;
-    std::string ipv6_cidr;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ipv6_cidr, reason, description FROM %s "
-        "WHERE insideIPv6CIDR(ipv6_cidr, ?) = 1 "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ipv6_ban_table.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (sqlite3_bind_text(stmt, 1,
-            peer->getAddress().toString(false).c_str(), -1, SQLITE_TRANSIENT)
-            != SQLITE_OK)
-        {
-            Log::error("ServerLobby", "Error binding ipv6 addr for query: %s",
-                sqlite3_errmsg(m_db));
-        }
-
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ipv6_cidr = (char*)sqlite3_column_text(stmt, 1);
-            const char* reason = (char*)sqlite3_column_text(stmt, 2);
-            const char* desc = (char*)sqlite3_column_text(stmt, 3);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+    IPIntervalTable<std::array<uint8_t, 16>, IPBanInfo>::Interval ban;
+    if (!m_ipv6_ban_list.find(getIPv6Key(peer->getAddress()), &ban))
         return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str());
-        easySQLQuery(query, [ipv6_cidr](sqlite3_stmt* stmt)
-            {
-                if (sqlite3_bind_text(stmt, 1, ipv6_cidr.c_str(),
-                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery", "Failed to bind %s.",
-                        ipv6_cidr.c_str());
-                }
-            });
-    }
+
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban.m_value.m_reason.c_str(),
+        (int)ban.m_value.m_row_id, ban.m_value.m_description.c_str());
+    kickPlayerWithReason(peer, ban.m_value.m_reason.c_str());
+    m_ipv6_ban_triggers[ban.m_value.m_ipv6_cidr]++;
 #endif
 }   // testBannedForIPv6
 
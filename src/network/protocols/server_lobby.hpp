@@ -36,6 +36,7 @@
 #include <set>
 
 #ifdef ENABLE_SQLITE3
+#include "network/ip_interval_table.hpp"
 #include <sqlite3.h>
 #endif
 
@@ -98,13 +99,51 @@ private:
 
     uint64_t m_last_poll_db_time;
 
+    struct IPBanInfo
+    {
+        int64_t m_row_id;
+        std::string m_reason;
+        std::string m_description;
+        std::string m_ipv6_cidr;
+    };
+
+    /** In-memory copies of the IP ban and geolocation tables, so no SQL is
+     *  run when a peer connects. Ban lists are reloaded in pollDatabase,
+     *  geolocation only when another connection changed the database. */
+    IPIntervalTable<uint32_t, IPBanInfo> m_ip_ban_list;
+
+    IPIntervalTable<std::array<uint8_t, 16>, IPBanInfo> m_ipv6_ban_list;
+
+    IPIntervalTable<uint32_t, std::string> m_ip_geolocation;
+
+    /** Keyed by upperIPv6, like the ip_start and ip_end in database. */
+    IPIntervalTable<int64_t, std::string> m_ipv6_geolocation;
+
+    int64_t m_geolocation_data_version;
+
+    /** Ban hits not written to database yet, they are flushed together in
+     *  pollDatabase. */
+    std::map<std::pair<uint32_t, uint32_t>, unsigned> m_ip_ban_triggers;
+
+    std::map<std::string, unsigned> m_ipv6_ban_triggers;
+
     void pollDatabase();
 
     bool easySQLQuery(const std::string& query,
         std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr) const;
 
+    bool selectSQLRows(const std::string& query,
+                       std::function<void(sqlite3_stmt* stmt)> row_function)
+                       const;
+
     void checkTableExists(const std::string& table, bool& result);
 
+    void loadIPBanTables();
+
+    void loadIPGeolocationTables(bool force);
+
+    void writeIPBanTriggers();
+
     std::string ip2Country(const SocketAddress& addr) const;
 
     std::string ipv62Country(const SocketAddress& addr) const;
@@ -379,8 +418,8 @@ private:
     void clientSelectingAssetsWantsToBackLobby(Event* event);
     std::set<std::shared_ptr<STKPeer>> getSpectatorsByLimit();
     void kickPlayerWithReason(STKPeer* peer, const char* reason) const;
-    void testBannedForIP(STKPeer* peer) const;
-    void testBannedForIPv6(STKPeer* peer) const;
+    void testBannedForIP(STKPeer* peer);
+    void testBannedForIPv6(STKPeer* peer);
     void testBannedForOnlineId(STKPeer* peer, uint32_t online_id) const;
     void writeDisconnectInfoTable(STKPeer* peer);
     void writePlayerReport(Event* event);
@@ -24,6 +24,46 @@
 #include "items/projectile_manager.hpp"
 #include "utils/log.hpp"
 
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+/** All RewindInfo objects are allocated from a pool of blocks big enough for
+ *  any of the subclasses, so the many states and events created every
+ *  second on a client don't go through the heap. Events are created by the
+ *  network thread and deleted by the main thread, so the pool is locked.
+ */
+struct RewindInfoPool
+{
+    std::mutex m_mutex;
+    std::vector<void*> m_free_blocks;
+    // ------------------------------------------------------------------------
+    ~RewindInfoPool()
+    {
+        for (void* p : m_free_blocks)
+            ::operator delete(p);
+    }   // ~RewindInfoPool
+};   // RewindInfoPool
+
+/** Size of a block in the pool. */
+const size_t BLOCK_SIZE = std::max(std::max(sizeof(RewindInfoState),
+                                            sizeof(RewindInfoEvent)),
+                                   sizeof(RewindInfoEventFunction));
+
+/** The pool keeps at most this many free blocks, more than a client with
+ *  a high ping keeps in its rewind queue. */
+const size_t MAX_FREE_BLOCKS = 16384;
+
+RewindInfoPool& getPool()
+{
+    static RewindInfoPool pool;
+    return pool;
+}   // getPool
+}   // anonymous namespace
+
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
  *  \param size Necessary buffer size for a state.
@@ -34,6 +74,72 @@ RewindInfo::RewindInfo(int ticks, bool is_confirmed)
     m_is_confirmed = is_confirmed;
 }   // RewindInfo
 
+// ----------------------------------------------------------------------------
+/** Takes a block from the pool, or allocates a new one if the pool is empty.
+ */
+void* RewindInfo::operator new(size_t size)
+{
+    if (size > BLOCK_SIZE)
+        return ::operator new(size);
+    RewindInfoPool& pool = getPool();
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    if (pool.m_free_blocks.empty())
+        return ::operator new(BLOCK_SIZE);
+    void* p = pool.m_free_blocks.back();
+    pool.m_free_blocks.pop_back();
+    return p;
+}   // operator new
+
+// ----------------------------------------------------------------------------
+/** Returns a block to the pool.
+ */
+void RewindInfo::operator delete(void* p, size_t size)
+{
+    if (!p)
+        return;
+    if (size > BLOCK_SIZE)
+    {
+        ::operator delete(p);
+        return;
+    }
+    RewindInfoPool& pool = getPool();
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    if (pool.m_free_blocks.size() >= MAX_FREE_BLOCKS)
+        ::operator delete(p);
+    else
+        pool.m_free_blocks.push_back(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+/** Returns the number of free blocks in the pool. */
+size_t RewindInfo::getPoolSize()
+{
+    RewindInfoPool& pool = getPool();
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    return pool.m_free_blocks.size();
+}   // getPoolSize
+
+// ----------------------------------------------------------------------------
+/** Tests that deleted RewindInfo objects are reused, independent of their
+ *  type.
+ */
+void RewindInfo::unitTesting()
+{
+    RewindInfo* state = new RewindInfoState(0, NULL, true);
+    RewindInfo* event = new RewindInfoEvent(0, NULL, NULL, true);
+    void* event_block = event;
+    const size_t free_blocks = getPoolSize();
+    delete event;
+    assert(getPoolSize() == free_blocks + 1);
+    RewindInfo* function = new RewindInfoEventFunction(1);
+    // The block of the deleted event is used for the function
+    assert((void*)function == event_block);
+    assert(getPoolSize() == free_blocks);
+    delete state;
+    delete function;
+    assert(getPoolSize() == free_blocks + 2);
+}   // unitTesting
+
 // ----------------------------------------------------------------------------
 /** Adjusts the time of this RewindInfo. This is only called on the server
  *  in case that an event is received in the past - in this case the server
@@ -48,11 +154,26 @@ void RewindInfo::setTicks(int ticks)
 
 // ============================================================================
 RewindInfoState::RewindInfoState(int ticks, int start_offset,
-                                 std::vector<std::string>& rewinder_using,
+                                 std::vector<uint16_t>& rewinder_ids,
                                  std::vector<uint8_t>& buffer)
                : RewindInfo(ticks, true/*is_confirmed*/)
 {
-    std::swap(m_rewinder_using, rewinder_using);
+    std::swap(m_rewinder_ids, rewinder_ids);
+    m_start_offset = start_offset;
+    m_buffer = new BareNetworkString();
+    std::swap(m_buffer->getBuffer(), buffer);
+}   // RewindInfoState
+
+// ------------------------------------------------------------------------
+/** Constructor used for states of servers which send the unique identity of
+ *  rewinders instead of their ids.
+ */
+RewindInfoState::RewindInfoState(int ticks, int start_offset,
+                                 std::vector<std::string>& rewinder_names,
+                                 std::vector<uint8_t>& buffer)
+               : RewindInfo(ticks, true/*is_confirmed*/)
+{
+    std::swap(m_rewinder_names, rewinder_names);
     m_start_offset = start_offset;
     m_buffer = new BareNetworkString();
     std::swap(m_buffer->getBuffer(), buffer);
@@ -78,26 +199,43 @@ void RewindInfoState::restore()
 {
     m_buffer->reset();
     m_buffer->skip(m_start_offset);
-    for (const std::string& name : m_rewinder_using)
+    RewindManager* rm = RewindManager::get();
+    const bool use_names = !m_rewinder_names.empty();
+    const size_t count =
+        use_names ? m_rewinder_names.size() : m_rewinder_ids.size();
+    for (size_t i = 0; i < count; i++)
     {
         const uint16_t data_size = m_buffer->getUInt16();
         const unsigned current_offset_now = m_buffer->getCurrentOffset();
-        std::shared_ptr<Rewinder> r =
-            RewindManager::get()->getRewinder(name);
+        std::shared_ptr<Rewinder> r;
+        const std::string* name = NULL;
+        if (use_names)
+        {
+            name = &m_rewinder_names[i];
+            r = rm->getRewinder(*name);
+        }
+        else
+        {
+            r = rm->getRewinder(m_rewinder_ids[i]);
+            if (!r)
+                name = rm->getRewinderName(m_rewinder_ids[i]);
+        }
 
-        if (!r)
+        if (!r && name)
         {
             // For now we only need to get missing rewinder from
             // projectile_manager
-            r = ProjectileManager::get()->addRewinderFromNetworkState(name);
+            r = ProjectileManager::get()->addRewinderFromNetworkState(*name);
         }
         if (!r)
         {
-            if (!RewindManager::get()->hasMissingRewinder(name))
+            // An unknown id can happen if the state arrived before the id,
+            // it will be known in later states
+            if (name && !rm->hasMissingRewinder(*name))
             {
                 Log::error("RewindInfoState", "Missing rewinder %s",
-                    name.c_str());
-                RewindManager::get()->addMissingRewinder(name);
+                    name->c_str());
+                rm->addMissingRewinder(*name);
             }
             m_buffer->skip(data_size);
             continue;
@@ -59,6 +59,11 @@ public:
 
     void setTicks(int ticks);
 
+    static void* operator new(size_t size);
+    static void  operator delete(void* p, size_t size);
+    static size_t getPoolSize();
+    static void unitTesting();
+
     /** Called when going back in time to undo any rewind information. */
     virtual void undo() = 0;
     /** This is called to restore a state before replaying the events. */
@@ -92,7 +97,12 @@ public:
 class RewindInfoState: public RewindInfo
 {
 private:
-    std::vector<std::string> m_rewinder_using;
+    /** Ids of the rewinders in this state, in order. */
+    std::vector<uint16_t> m_rewinder_ids;
+
+    /** Unique identities of the rewinders in this state, used instead of
+     *  the ids with servers which don't send rewinder ids. */
+    std::vector<std::string> m_rewinder_names;
 
     int m_start_offset;
 
@@ -102,7 +112,11 @@ private:
 public:
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
-                    std::vector<std::string>& rewinder_using,
+                    std::vector<uint16_t>& rewinder_ids,
+                    std::vector<uint8_t>& buffer);
+    // ------------------------------------------------------------------------
+    RewindInfoState(int ticks, int start_offset,
+                    std::vector<std::string>& rewinder_names,
                     std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
@@ -19,6 +19,7 @@
 #include "network/rewind_manager.hpp"
 
 #include "graphics/irr_driver.hpp"
+#include "modes/profile_world.hpp"
 #include "modes/soccer_world.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
@@ -33,6 +34,7 @@
 #include "tracks/track_object.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "utils/log.hpp"
+#include "utils/metrics.hpp"
 #include "utils/profiler.hpp"
 
 #include <algorithm>
@@ -161,7 +163,7 @@ void RewindManager::saveState()
     gp->startNewState();
 
     m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
+    std::vector<uint16_t> rewinder_using;
 
     for (auto& p : m_all_rewinder)
     {
@@ -213,8 +215,12 @@ void RewindManager::update(int ticks_not_used)
     }
     else
     {
-        saveState();
+        {
+            ProfileWorld::SectionTimer timer(ProfileWorld::PS_REWIND_SAVE);
+            saveState();
+        }
         PROFILER_PUSH_CPU_MARKER("RewindManager - send state", 0x20, 0x7F, 0x40);
+        ProfileWorld::SectionTimer timer(ProfileWorld::PS_STATE_SERIALIZATION);
         if (auto gp = GameProtocol::lock())
             gp->sendState();
     }
@@ -233,6 +239,9 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // possible rewind, some RewindInfoEventFunction can be created during
     // rewind
     mergeRewindInfoEventFunction();
+    // Rewinder ids are received before the states using them, so merge them
+    // first
+    mergeNetworkRewinderIds();
     bool needs_rewind;
     int rewind_ticks;
 
@@ -276,10 +285,92 @@ bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
     // Maximum 1 bit to store no of rewinder used
     if (m_all_rewinder.size() == 255)
         return false;
-    m_all_rewinder[rewinder->getUniqueIdentity()] = rewinder;
+    const std::string& name = rewinder->getUniqueIdentity();
+    auto it = m_rewinder_ids.find(name);
+    if (it != m_rewinder_ids.end())
+    {
+        m_rewinder_by_id[it->second] = rewinder;
+        rewinder->setRewinderId(it->second);
+    }
+    else if (!NetworkConfig::get()->isClient())
+    {
+        // Client gets the id from server later
+        if (m_rewinder_names.size() == Rewinder::NO_REWINDER_ID)
+        {
+            Log::error("RewindManager", "Too many rewinder ids.");
+            return false;
+        }
+        uint16_t id = (uint16_t)m_rewinder_names.size();
+        setRewinderId(id, name);
+        m_rewinder_by_id[id] = rewinder;
+        rewinder->setRewinderId(id);
+    }
+    m_all_rewinder[name] = rewinder;
     return true;
 }   // addRewinder
 
+// ----------------------------------------------------------------------------
+void RewindManager::setRewinderId(uint16_t id, const std::string& name)
+{
+    if (id >= m_rewinder_names.size())
+    {
+        m_rewinder_names.resize(id + 1);
+        m_rewinder_by_id.resize(id + 1);
+    }
+    m_rewinder_names[id] = name;
+    m_rewinder_ids[name] = id;
+}   // setRewinderId
+
+// ----------------------------------------------------------------------------
+/** Adds rewinder ids received from the server. This function is threadsafe
+ *  so can be called by the network thread, the ids are merged by the main
+ *  thread before states are merged.
+ *  \param rewinder_ids Pairs of rewinder id and unique identity, the vector
+ *         is cleared.
+ */
+void RewindManager::addNetworkRewinderIds(
+                    std::vector<std::pair<uint16_t, std::string> >& rewinder_ids)
+{
+    std::lock_guard<std::mutex> lock(m_pending_rewinder_ids_mutex);
+    if (m_pending_rewinder_ids.empty())
+        std::swap(m_pending_rewinder_ids, rewinder_ids);
+    else
+    {
+        m_pending_rewinder_ids.insert(m_pending_rewinder_ids.end(),
+            rewinder_ids.begin(), rewinder_ids.end());
+    }
+    rewinder_ids.clear();
+}   // addNetworkRewinderIds
+
+// ----------------------------------------------------------------------------
+/** Sets the rewinder ids received from the server, and links them to the
+ *  existing rewinders. Rewinders created later are linked in addRewinder.
+ */
+void RewindManager::mergeNetworkRewinderIds()
+{
+    std::vector<std::pair<uint16_t, std::string> > rewinder_ids;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_rewinder_ids_mutex);
+        if (m_pending_rewinder_ids.empty())
+            return;
+        std::swap(rewinder_ids, m_pending_rewinder_ids);
+    }
+    for (auto& p : rewinder_ids)
+    {
+        if (p.first == Rewinder::NO_REWINDER_ID)
+            continue;
+        setRewinderId(p.first, p.second);
+        auto it = m_all_rewinder.find(p.second);
+        if (it == m_all_rewinder.end())
+            continue;
+        if (auto r = it->second.lock())
+        {
+            m_rewinder_by_id[p.first] = r;
+            r->setRewinderId(p.first);
+        }
+    }
+}   // mergeNetworkRewinderIds
+
 // ----------------------------------------------------------------------------
 /** Rewinds to the specified time, then goes forward till the current
  *  World::getTime() is reached again: it will replay everything before
@@ -405,6 +496,14 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     history->setReplayHistory(is_history);
     m_is_rewinding = false;
     mergeRewindInfoEventFunction();
+
+    static Metrics::Counter& rewinds = Metrics::counter("stk_rewinds_total",
+        "Number of rewinds.");
+    static Metrics::Counter& rewound_ticks = Metrics::counter(
+        "stk_rewound_ticks_total", "Number of ticks simulated again after "
+        "rewinds.");
+    rewinds.increase();
+    rewound_ticks.increase(now_ticks - exact_rewind_ticks);
 }   // rewindTo
 
 // ----------------------------------------------------------------------------
@@ -447,3 +546,146 @@ void RewindManager::handleResetSmoothNetworkBody()
             sw->getBall()->setEnabled(true);
     }
 }   // handleResetSmoothNetworkBody
+
+// ----------------------------------------------------------------------------
+namespace
+{
+/** A rewinder which records the value of each state it restores. */
+class StateRecorder : public Rewinder
+{
+private:
+    std::vector<uint32_t>* m_restored;
+
+public:
+    StateRecorder(const std::string& ui, std::vector<uint32_t>* restored)
+        : Rewinder(ui), m_restored(restored)                                {}
+    // ------------------------------------------------------------------------
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
+                                                                { return NULL; }
+    // ------------------------------------------------------------------------
+    virtual void undoEvent(BareNetworkString* s)                            {}
+    // ------------------------------------------------------------------------
+    virtual void rewindToEvent(BareNetworkString* s)                        {}
+    // ------------------------------------------------------------------------
+    virtual void restoreState(BareNetworkString* s, int count)
+                                        { m_restored->push_back(s->getUInt32()); }
+    // ------------------------------------------------------------------------
+    virtual void undoState(BareNetworkString* s)                            {}
+    // ------------------------------------------------------------------------
+    virtual void saveTransform()                                            {}
+    // ------------------------------------------------------------------------
+    virtual void computeError()                                             {}
+};   // StateRecorder
+
+// ----------------------------------------------------------------------------
+/** Returns the data of a state with one uint32_t value for each rewinder. */
+std::vector<uint8_t> createStateData(const std::vector<uint32_t>& values)
+{
+    BareNetworkString s;
+    for (uint32_t value : values)
+        s.addUInt16(4).addUInt32(value);
+    return s.getBuffer();
+}   // createStateData
+
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+/** Tests the rewinder ids: how the server assigns them, and how a client
+ *  resolves them in states when the GP_REWINDER_IDS message arrives before
+ *  or after a state, when it joins late, and with states of servers which
+ *  send unique identities instead of ids.
+ */
+void RewindManager::unitTesting()
+{
+    const bool was_enabled = m_enable_rewind_manager;
+    const bool was_server = NetworkConfig::get()->isServer();
+    const bool existed = exists();
+    if (existed)
+        destroy();
+    setEnable(true);
+    std::vector<uint32_t> restored;
+    typedef std::vector<std::pair<uint16_t, std::string> > IdList;
+
+    // The server assigns ids in order and never reuses them
+    NetworkConfig::get()->setIsServer(true);
+    RewindManager* rm = create();
+    auto a = std::make_shared<StateRecorder>("a", &restored);
+    auto b = std::make_shared<StateRecorder>("b", &restored);
+    assert(rm->addRewinder(a));
+    assert(rm->addRewinder(b));
+    assert(a->getRewinderId() == 0);
+    assert(b->getRewinderId() == 1);
+    assert(rm->getRewinder(1) == b);
+    assert(*rm->getRewinderName(0) == "a");
+    b.reset();
+    assert(!rm->isRewinderIdUsed(1));
+    auto c = std::make_shared<StateRecorder>("c", &restored);
+    assert(rm->addRewinder(c));
+    assert(c->getRewinderId() == 2);
+    assert(rm->getNumRewinderIds() == 3);
+    destroy();
+
+    // A client gets the state before the ids it uses
+    NetworkConfig::get()->setIsServer(false);
+    rm = create();
+    a = std::make_shared<StateRecorder>("a", &restored);
+    b = std::make_shared<StateRecorder>("b", &restored);
+    rm->addRewinder(a);
+    rm->addRewinder(b);
+    assert(a->getRewinderId() == Rewinder::NO_REWINDER_ID);
+    std::vector<uint16_t> ids = { 0, 1 };
+    std::vector<uint8_t> data = createStateData({ 10, 11 });
+    RewindInfoState* state = new RewindInfoState(0, 0, ids, data);
+    state->restore();
+    // Unknown ids are skipped, not reported as missing rewinders
+    assert(restored.empty());
+    assert(!rm->hasMissingRewinder("a"));
+
+    IdList id_list = { { 0, "a" }, { 1, "b" } };
+    rm->addNetworkRewinderIds(id_list);
+    assert(id_list.empty());
+    // Ids are only used after the main thread merged them
+    state->restore();
+    assert(restored.empty());
+    rm->mergeNetworkRewinderIds();
+    state->restore();
+    assert(restored == std::vector<uint32_t>({ 10, 11 }));
+    assert(b->getRewinderId() == 1);
+    delete state;
+    destroy();
+
+    // A late joining client gets the ids of existing rewinders only, and
+    // before some of the rewinders are created
+    restored.clear();
+    rm = create();
+    a = std::make_shared<StateRecorder>("a", &restored);
+    rm->addRewinder(a);
+    id_list = { { 0, "a" }, { 2, "c" } };
+    rm->addNetworkRewinderIds(id_list);
+    rm->mergeNetworkRewinderIds();
+    c = std::make_shared<StateRecorder>("c", &restored);
+    rm->addRewinder(c);
+    assert(c->getRewinderId() == 2);
+    assert(rm->getRewinderName(1) == NULL);
+    ids = { 2, 1, 0 };
+    data = createStateData({ 12, 11, 10 });
+    state = new RewindInfoState(0, 0, ids, data);
+    state->restore();
+    assert(restored == std::vector<uint32_t>({ 12, 10 }));
+    delete state;
+
+    // Servers without rewinder ids send unique identities
+    restored.clear();
+    std::vector<std::string> names = { "c", "a" };
+    data = createStateData({ 22, 20 });
+    state = new RewindInfoState(0, 0, names, data);
+    state->restore();
+    assert(restored == std::vector<uint32_t>({ 22, 20 }));
+    delete state;
+    destroy();
+
+    NetworkConfig::get()->setIsServer(was_server);
+    setEnable(was_enabled);
+    if (existed)
+        create();
+}   // unitTesting
@@ -27,6 +27,7 @@
 #include <functional>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
@@ -96,6 +97,26 @@ private:
     /** A list of all objects that can be rewound. */
     std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
 
+    /** The rewinders indexed by their rewinder id, so that states received
+     *  can find them without string lookups. */
+    std::vector<std::weak_ptr<Rewinder> > m_rewinder_by_id;
+
+    /** The unique identity of each rewinder id. Ids are assigned by the
+     *  server and never reused during a race, a client learns them from
+     *  the server with addNetworkRewinderIds. */
+    std::vector<std::string> m_rewinder_names;
+
+    /** Maps unique identities to rewinder ids. */
+    std::map<std::string, uint16_t> m_rewinder_ids;
+
+    /** Protects m_pending_rewinder_ids, which is written by the network
+     *  thread. */
+    std::mutex m_pending_rewinder_ids_mutex;
+
+    /** Rewinder ids received from the server, which are not merged by the
+     *  main thread yet. */
+    std::vector<std::pair<uint16_t, std::string> > m_pending_rewinder_ids;
+
     /** The queue that stores all rewind infos. */
     RewindQueue m_rewind_queue;
 
@@ -136,12 +157,15 @@ private:
     }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    void mergeNetworkRewinderIds();
+    void setRewinderId(uint16_t id, const std::string& name);
 
 public:
     // First static functions to manage rewinding.
     // ===========================================
     static RewindManager *create();
     static void destroy();
+    static void unitTesting();
     // ------------------------------------------------------------------------
     /** En- or disables rewinding. */
     static void setEnable(bool m) { m_enable_rewind_manager = m; }
@@ -188,6 +212,35 @@ public:
         return nullptr;
     }
     // ------------------------------------------------------------------------
+    std::shared_ptr<Rewinder> getRewinder(uint16_t id)
+    {
+        if (id < m_rewinder_by_id.size())
+            return m_rewinder_by_id[id].lock();
+        return nullptr;
+    }
+    // ------------------------------------------------------------------------
+    /** Returns the unique identity of a rewinder id, or NULL if the id is
+     *  not known (yet). */
+    const std::string* getRewinderName(uint16_t id) const
+    {
+        if (id < m_rewinder_names.size() && !m_rewinder_names[id].empty())
+            return &m_rewinder_names[id];
+        return NULL;
+    }
+    // ------------------------------------------------------------------------
+    /** Returns the number of rewinder ids assigned so far. */
+    unsigned getNumRewinderIds() const
+                                   { return (unsigned)m_rewinder_names.size(); }
+    // ------------------------------------------------------------------------
+    /** Returns true if the rewinder with the given id still exists. */
+    bool isRewinderIdUsed(uint16_t id) const
+    {
+        return id < m_rewinder_by_id.size() && !m_rewinder_by_id[id].expired();
+    }
+    // ------------------------------------------------------------------------
+    void addNetworkRewinderIds(
+                   std::vector<std::pair<uint16_t, std::string> >& rewinder_ids);
+    // ------------------------------------------------------------------------
     bool addRewinder(std::shared_ptr<Rewinder> rewinder);
     // ------------------------------------------------------------------------
     /** Returns true if currently a rewind is happening. */
@@ -28,6 +28,9 @@
 #include "network/rewind_manager.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <deque>
+#include <list>
 
 /** The RewindQueue stores one TimeStepInfo for each time step done.
  *  The TimeStepInfo stores all states and events to be used at the
@@ -42,9 +45,17 @@
  *  the state is restored from the TimeStepInfo object (see replayAllStates)
  *  then the rewind manager re-executes the time steps (using the events
  *  stored at each timestep).
+ *  The RewindInfo of all time steps are stored in a ring buffer indexed by
+ *  time, so finding a time step, and the latest confirmed state before it,
+ *  does not need to go through all stored RewindInfo.
  */
 RewindQueue::RewindQueue()
 {
+    // About 2 seconds at 120 physics updates per second, it grows if needed
+    m_all_tick_info.resize(256);
+    for (TickInfo& ti : m_all_tick_info)
+        ti.m_latest_confirmed_state = -1;
+    m_first_ticks = m_end_ticks = 0;
     reset();
 }   // RewindQueue
 
@@ -74,15 +85,103 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    for (int t = m_first_ticks; t < m_end_ticks; t++)
+        clearTickInfo(&getTickInfo(t));
 
-    m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_first_ticks = m_end_ticks = 0;
+    m_current_ticks = END_TICKS;
+    m_current_index = 0;
     m_latest_confirmed_state_time = -1;
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Deletes all RewindInfo of a time step.
+ */
+void RewindQueue::clearTickInfo(TickInfo* ti)
+{
+    for (RewindInfo* ri : ti->m_rewind_info)
+        delete ri;
+    ti->m_rewind_info.clear();
+    ti->m_latest_confirmed_state = -1;
+}   // clearTickInfo
+
+// ----------------------------------------------------------------------------
+/** Makes sure that the ring buffer contains the given time step, growing it
+ *  if necessary.
+ *  \param ticks The time step.
+ */
+void RewindQueue::ensureTicks(int ticks)
+{
+    if (m_first_ticks == m_end_ticks)
+    {
+        m_first_ticks = ticks;
+        m_end_ticks = ticks + 1;
+        getTickInfo(ticks).m_latest_confirmed_state = -1;
+        return;
+    }
+    if (ticks >= m_first_ticks && ticks < m_end_ticks)
+        return;
+
+    const int first_ticks = std::min(m_first_ticks, ticks);
+    const int end_ticks = std::max(m_end_ticks, ticks + 1);
+    size_t size = m_all_tick_info.size();
+    if ((size_t)(end_ticks - first_ticks) > size)
+    {
+        while ((size_t)(end_ticks - first_ticks) > size)
+            size *= 2;
+        std::vector<TickInfo> all_tick_info(size);
+        for (TickInfo& ti : all_tick_info)
+            ti.m_latest_confirmed_state = -1;
+        for (int t = m_first_ticks; t < m_end_ticks; t++)
+        {
+            std::swap(all_tick_info[t & (size - 1)], getTickInfo(t));
+        }
+        std::swap(m_all_tick_info, all_tick_info);
+    }
+
+    // Time steps before the first one have no confirmed state, the later
+    // ones have the latest confirmed state of the previous last time step.
+    for (int t = first_ticks; t < m_first_ticks; t++)
+        getTickInfo(t).m_latest_confirmed_state = -1;
+    const int latest = getTickInfo(m_end_ticks - 1).m_latest_confirmed_state;
+    for (int t = m_end_ticks; t < end_ticks; t++)
+        getTickInfo(t).m_latest_confirmed_state = latest;
+    m_first_ticks = first_ticks;
+    m_end_ticks = end_ticks;
+}   // ensureTicks
+
+// ----------------------------------------------------------------------------
+/** Makes sure the current pointer points to an existing RewindInfo, moving it
+ *  to following time steps if necessary (or to the end).
+ */
+void RewindQueue::skipEmptyTicks()
+{
+    while (m_current_ticks != END_TICKS &&
+        m_current_index >= getTickInfo(m_current_ticks).m_rewind_info.size())
+    {
+        m_current_ticks++;
+        m_current_index = 0;
+        if (m_current_ticks >= m_end_ticks)
+            m_current_ticks = END_TICKS;
+    }
+}   // skipEmptyTicks
+
+// ----------------------------------------------------------------------------
+/** Returns all RewindInfo in the order they are handled, used in unit
+ *  testing only.
+ */
+std::vector<RewindInfo*> RewindQueue::getAllRewindInfo()
+{
+    std::vector<RewindInfo*> all;
+    for (int t = m_first_ticks; t < m_end_ticks; t++)
+    {
+        TickInfo& ti = getTickInfo(t);
+        all.insert(all.end(), ti.m_rewind_info.begin(),
+            ti.m_rewind_info.end());
+    }
+    return all;
+}   // getAllRewindInfo
+
 // ----------------------------------------------------------------------------
 /** Inserts a RewindInfo object in the list of all events at the correct time.
  *  If there are several RewindInfo at the exact same time, state RewindInfo
@@ -94,23 +193,36 @@ void RewindQueue::reset()
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
-
-    while (i != m_all_rewind_info.begin())
+    const int ticks = ri->getTicks();
+    ensureTicks(ticks);
+    TickInfo& ti = getTickInfo(ticks);
+    unsigned index = 0;
+    if (ri->isEvent())
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
-        // Now test if 'ri' needs to be inserted after the
-        // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        index = (unsigned)ti.m_rewind_info.size();
+        ti.m_rewind_info.push_back(ri);
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
     else
-        m_all_rewind_info.insert(i, ri);  
+    {
+        ti.m_rewind_info.insert(ti.m_rewind_info.begin(), ri);
+        // Keep the current pointer at the same RewindInfo
+        if (m_current_ticks == ticks)
+            m_current_index++;
+        if (ri->isConfirmed())
+        {
+            for (int t = ticks; t < m_end_ticks; t++)
+            {
+                TickInfo& later = getTickInfo(t);
+                if (later.m_latest_confirmed_state < ticks)
+                    later.m_latest_confirmed_state = ticks;
+            }
+        }
+    }
+    if (m_current_ticks == END_TICKS)
+    {
+        m_current_ticks = ticks;
+        m_current_index = index;
+    }
 }   // insertRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -327,25 +439,35 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
+    if (m_first_ticks == m_end_ticks || ticks <= m_first_ticks)
+        return;
 
-    while (!m_all_rewind_info.empty() &&
-        (*i)->getTicks() < ticks)
+    if (m_current_ticks != END_TICKS && m_current_ticks < ticks)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        if (ticks >= m_end_ticks)
+            m_current_ticks = END_TICKS;
+        else
+        {
+            m_current_ticks = ticks;
+            m_current_index = 0;
+            skipEmptyTicks();
+        }
     }
 
-    if (m_all_rewind_info.empty())
-        m_current = m_all_rewind_info.end();
+    const int last_ticks = std::min(ticks, m_end_ticks);
+    for (int t = m_first_ticks; t < last_ticks; t++)
+        clearTickInfo(&getTickInfo(t));
 
+    if (ticks >= m_end_ticks)
+        m_first_ticks = m_end_ticks = 0;
+    else
+        m_first_ticks = ticks;
 }   // cleanupOldRewindInfo
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return m_current_ticks == END_TICKS;
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -353,7 +475,7 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current_ticks != END_TICKS;
 }   // hasMoreRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -367,27 +489,44 @@ int RewindQueue::undoUntil(int undo_ticks)
 {
     // A rewind is done after a state in the past is inserted. This function
     // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
-    assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    assert(m_first_ticks != m_end_ticks);
+
+    // Each time step stores the latest confirmed state before it
+    const int ticks = std::min(undo_ticks, m_end_ticks - 1);
+    int state_ticks = ticks >= m_first_ticks ?
+        getTickInfo(ticks).m_latest_confirmed_state : -1;
+    if (state_ticks < m_first_ticks)
     {
-        // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
-        {
-            // This shouldn't happen, but add some debug info just in case
-            Log::error("undoUntil",
-                       "At %d rewinding to %d current = %d = begin",
-                       World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
-        }
-        m_current--;
+        // This shouldn't happen, but add some debug info just in case
+        Log::error("undoUntil", "At %d rewinding to %d no confirmed state "
+            "found, first = %d", World::getWorld()->getTicksSinceStart(),
+            undo_ticks, m_first_ticks);
+        state_ticks = m_first_ticks;
+    }
+
+    // If there are several states at that time, the last one is used
+    TickInfo& state_ti = getTickInfo(state_ticks);
+    unsigned state_index = 0;
+    for (unsigned i = 0; i < state_ti.m_rewind_info.size() &&
+         !state_ti.m_rewind_info[i]->isEvent(); i++)
+    {
+        if (state_ti.m_rewind_info[i]->isConfirmed())
+            state_index = i;
     }
 
-    return (*m_current)->getTicks();
+    // Undo all events and states after that state, going backwards in time
+    for (int t = m_end_ticks - 1; t >= state_ticks; t--)
+    {
+        std::vector<RewindInfo*>& all_ri = getTickInfo(t).m_rewind_info;
+        const unsigned stop = t == state_ticks ? state_index + 1 : 0;
+        for (unsigned i = (unsigned)all_ri.size(); i > stop; i--)
+            all_ri[i - 1]->undo();
+    }
+
+    m_current_ticks = state_ticks;
+    m_current_index = state_index;
+    skipEmptyTicks();
+    return state_ticks;
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -397,15 +536,110 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    while ( hasMoreRewindInfo() && m_current_ticks == ticks )
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
-        m_current++;
+        RewindInfo* ri = getCurrent();
+        if (ri->isEvent())
+            ri->replay();
+        next();
     }   // while current->getTIcks == ticks
 
 }   // replayAllEvents
 
+namespace
+{
+/** The previous list based implementation of the RewindQueue. It is the
+ *  reference the ring buffer is compared with, both for the order in which
+ *  events are replayed (in unitTesting) and for performance (in benchmark).
+ */
+class ListRewindQueue
+{
+public:
+    std::list<RewindInfo*> m_all_rewind_info;
+    std::list<RewindInfo*>::iterator m_current;
+    // ------------------------------------------------------------------------
+    ListRewindQueue() { m_current = m_all_rewind_info.end(); }
+    // ------------------------------------------------------------------------
+    ~ListRewindQueue()
+    {
+        for (RewindInfo* ri : m_all_rewind_info)
+            delete ri;
+    }   // ~ListRewindQueue
+    // ------------------------------------------------------------------------
+    void insertRewindInfo(RewindInfo *ri)
+    {
+        std::list<RewindInfo*>::iterator i = m_all_rewind_info.end();
+        while (i != m_all_rewind_info.begin())
+        {
+            std::list<RewindInfo*>::iterator i_prev = i;
+            i_prev--;
+            if ((*i_prev)->getTicks() < ri->getTicks()) break;
+            if ((*i_prev)->getTicks() == ri->getTicks() &&
+                ri->isEvent()                              ) break;
+            i = i_prev;
+        }
+        if (m_current == m_all_rewind_info.end())
+            m_current = m_all_rewind_info.insert(i, ri);
+        else
+            m_all_rewind_info.insert(i, ri);
+    }   // insertRewindInfo
+    // ------------------------------------------------------------------------
+    void cleanupOldRewindInfo(int ticks)
+    {
+        auto i = m_all_rewind_info.begin();
+        while (!m_all_rewind_info.empty() && (*i)->getTicks() < ticks)
+        {
+            if (m_current == i) m_current++;
+            delete *i;
+            i = m_all_rewind_info.erase(i);
+        }
+        if (m_all_rewind_info.empty())
+            m_current = m_all_rewind_info.end();
+    }   // cleanupOldRewindInfo
+    // ------------------------------------------------------------------------
+    int undoUntil(int undo_ticks)
+    {
+        m_current = m_all_rewind_info.end();
+        m_current--;
+        while ((*m_current)->getTicks() > undo_ticks ||
+            (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+        {
+            (*m_current)->undo();
+            m_current--;
+        }
+        return (*m_current)->getTicks();
+    }   // undoUntil
+    // ------------------------------------------------------------------------
+    void replayAllEvents(int ticks)
+    {
+        while (m_current != m_all_rewind_info.end() &&
+               (*m_current)->getTicks() == ticks)
+        {
+            if ((*m_current)->isEvent())
+                (*m_current)->replay();
+            m_current++;
+        }
+    }   // replayAllEvents
+};   // ListRewindQueue
+
+// ============================================================================
+/** An event rewinder which records the time step stored in each event it
+ *  replays. */
+class RecordingRewinder : public EventRewinder
+{
+public:
+    std::vector<int> m_replayed;
+    // ------------------------------------------------------------------------
+    virtual void undo(BareNetworkString *buffer) {}
+    // ------------------------------------------------------------------------
+    virtual void rewind(BareNetworkString *buffer)
+    {
+        m_replayed.push_back(buffer->getUInt32());
+    }   // rewind
+};   // RecordingRewinder
+
+}   // anonymous namespace
+
 // ----------------------------------------------------------------------------
 /** Unit tests for RewindQueue. It tests:
  *  - Sorting order of RewindInfos at the same time (i.e. state before time
@@ -427,57 +661,51 @@ void RewindQueue::unitTesting()
     assert(!q0.hasMoreRewindInfo());
 
     q0.addLocalState(NULL, /*confirmed*/true, 0);
-    assert(q0.m_all_rewind_info.front()->isState());
-    assert(!q0.m_all_rewind_info.front()->isEvent());
+    assert(q0.getAllRewindInfo().front()->isState());
+    assert(!q0.getAllRewindInfo().front()->isEvent());
     assert(q0.hasMoreRewindInfo());
     assert(q0.undoUntil(0) == 0);
 
     q0.addNetworkEvent(dummy_rewinder.get(), NULL, 0);
     // Network events are not immediately merged
-    assert(q0.m_all_rewind_info.size() == 1);
+    assert(q0.getAllRewindInfo().size() == 1);
 
     bool needs_rewind;
     int rewind_ticks;
     int world_ticks = 0;
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
-    assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    std::vector<RewindInfo*> all = q0.getAllRewindInfo();
+    assert(all.size() == 2);
+    assert(all[0]->isState());
+    assert(all[1]->isEvent());
 
     // Another state must be sorted before the event:
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
-    assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all = q0.getAllRewindInfo();
+    assert(all.size() == 3);
+    assert(all[0]->isState());
+    assert(all[1]->isState());
+    assert(all[2]->isEvent());
 
     // Test time base comparisons: adding an event to the end
     q0.addLocalEvent(dummy_rewinder.get(), NULL, true, 4);
     // Then adding an earlier event
     q0.addLocalEvent(dummy_rewinder.get(), NULL, false, 1);
-    // rii points to the 3rd element, the ones added just now
-    // should be elements4 and 5:
-    rii++;
-    assert((*rii)->getTicks()==1);
-    rii++;
-    assert((*rii)->getTicks()==4);
+    // The ones added just now should be elements 4 and 5:
+    all = q0.getAllRewindInfo();
+    assert(all[3]->getTicks()==1);
+    assert(all[4]->getTicks()==4);
 
     // Now test inserting an event first, then the state
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all = q1.getAllRewindInfo();
+    assert(all[0]->isState());
+    assert(all[1]->isEvent());
 
     // Bugs seen before
     // ----------------
@@ -496,12 +724,12 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
+    RewindInfo* current_old = b1.getCurrent();
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
-    if (current_old != b1.m_current)
-        Log::fatal("RewindQueue", "current_old != b1.m_current");
+    if (current_old != b1.getCurrent())
+        Log::fatal("RewindQueue", "current_old != b1.getCurrent()");
 
     // This should not trigger an exception, now current points to the
     // second event at the same time:
@@ -509,7 +737,7 @@ void RewindQueue::unitTesting()
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(!b1.hasMoreRewindInfo());
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -518,7 +746,140 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
+    assert(b2.getCurrent()->getTicks() == 3);
+
+    // 4) A state inserted at the time of the current pointer is sorted
+    //    before it, the current pointer must still point to the same event.
+    RewindQueue b3;
+    b3.addLocalEvent(NULL, NULL, true, 1);
+    ri = b3.getCurrent();
+    b3.addLocalState(NULL, true, 1);
+    assert(b3.getCurrent() == ri);
+
+    // Ring buffer
+    // -----------
+    // Time steps far apart make the ring buffer grow, and undoUntil finds
+    // the latest confirmed state before the rewind time. Adding a confirmed
+    // state removes all older time steps, so the states are added latest
+    // first, which makes the ring buffer grow towards earlier time steps.
+    RewindQueue r1;
+    r1.addLocalState(NULL, true, 2000);
+    r1.addLocalState(NULL, true, 1000);
+    r1.addLocalState(NULL, false, 500);
+    r1.addLocalState(NULL, true, 10);
+    r1.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(), true, 1500);
+    assert(r1.getAllRewindInfo().size() == 5);
+    assert(r1.undoUntil(1999) == 1000);
+    assert(r1.getCurrent()->getTicks() == 1000);
+    assert(r1.undoUntil(999) == 10);
+    assert(r1.undoUntil(5000) == 2000);
+    // Inserting before the first time step
+    r1.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(), true, 5);
+    assert(r1.getAllRewindInfo().front()->getTicks() == 5);
+    r1.cleanupOldRewindInfo(1000);
+    assert(r1.getAllRewindInfo().size() == 3);
+    r1.cleanupOldRewindInfo(3000);
+    assert(r1.getAllRewindInfo().empty());
+    assert(!r1.hasMoreRewindInfo());
+
+    // Simulated game
+    // --------------
+    // The ring buffer replays the same events in the same order as the list.
+    RecordingRewinder ring_rewinder, list_rewinder;
+    RewindQueue ring_queue;
+    simulateRewinds(&ring_queue, 1200, &ring_rewinder);
+    ListRewindQueue list_queue;
+    simulateRewinds(&list_queue, 1200, &list_rewinder);
+    assert(!ring_rewinder.m_replayed.empty());
+    assert(ring_rewinder.m_replayed == list_rewinder.m_replayed);
+}   // unitTesting
 
 
-}   // unitTesting
+// ----------------------------------------------------------------------------
+/** Simulates the use of a rewind queue on a client with 16 karts and 200ms
+ *  round trip time: every 6 ticks each kart sends an input event, and every
+ *  12 ticks the server sends a state. All of them are received 200ms later,
+ *  and each state triggers a rewind and replay to the current time.
+ *  \param queue The rewind queue to use.
+ *  \param total_ticks Number of time steps to simulate.
+ *  \param rewinder The event rewinder of all events, each event contains
+ *         the time step at which it was created.
+ *  \return Time needed in seconds.
+ */
+template<typename Queue>
+double RewindQueue::simulateRewinds(Queue* queue, int total_ticks,
+                                    EventRewinder* rewinder)
+{
+    const int rtt_ticks = 24;
+    const int state_ticks = 12;
+    const int num_karts = 16;
+    std::deque<std::pair<int, RewindInfo*> > in_flight;
+    auto create_event = [rewinder](int t)
+    {
+        BareNetworkString* buffer = new BareNetworkString(4);
+        buffer->addUInt32(t);
+        return new RewindInfoEvent(t, rewinder, buffer, true);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < total_ticks; t++)
+    {
+        // Local input, which is added to the queue immediately
+        if (t % 6 == 0)
+        {
+            queue->insertRewindInfo(create_event(t));
+        }
+        // Inputs of the other karts and states from the server
+        for (int k = 1; k < num_karts; k++)
+        {
+            if ((t + k) % 6 != 0)
+                continue;
+            in_flight.emplace_back(t + rtt_ticks, create_event(t));
+        }
+        if (t % state_ticks == 0)
+        {
+            in_flight.emplace_back(t + rtt_ticks,
+                new RewindInfoState(t, new BareNetworkString(), true));
+        }
+
+        int rewind_ticks = -1;
+        while (!in_flight.empty() && in_flight.front().first <= t)
+        {
+            RewindInfo* ri = in_flight.front().second;
+            in_flight.pop_front();
+            if (ri->isState())
+                rewind_ticks = ri->getTicks();
+            queue->insertRewindInfo(ri);
+        }
+        if (rewind_ticks >= 0)
+        {
+            queue->cleanupOldRewindInfo(rewind_ticks);
+            int exact_ticks = queue->undoUntil(rewind_ticks);
+            for (int r = exact_ticks; r < t; r++)
+                queue->replayAllEvents(r);
+        }
+        queue->replayAllEvents(t);
+    }
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+
+    for (auto& p : in_flight)
+        delete p.second;
+    return time.count();
+}   // simulateRewinds
+
+// ----------------------------------------------------------------------------
+/** Compares the performance of the ring buffer based queue with the previous
+ *  list based implementation.
+ */
+void RewindQueue::benchmark()
+{
+    DummyRewinder dummy_rewinder;
+    RewindQueue q;
+    double ring_time = simulateRewinds(&q, 120 * 600, &dummy_rewinder);
+    ListRewindQueue l;
+    double list_time = simulateRewinds(&l, 120 * 600, &dummy_rewinder);
+    Log::info("RewindQueue", "Simulated 10 minutes with 200ms RTT: ring "
+        "buffer %.2f ms, list %.2f ms.", ring_time * 1000.0,
+        list_time * 1000.0);
+}   // benchmark
@@ -22,7 +22,6 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
@@ -36,10 +35,28 @@ class TimeStepInfo;
 class RewindQueue
 {
 private:
+    /** All RewindInfo at one time step, states are stored before events. */
+    struct TickInfo
+    {
+        std::vector<RewindInfo*> m_rewind_info;
+
+        /** Time of the latest confirmed state at or before this time step,
+         *  or -1 if there is none. */
+        int m_latest_confirmed_state;
+    };
+
+    /** Ring buffer with one TickInfo for each time step between
+     *  m_first_ticks (inclusive) and m_end_ticks (exclusive), indexed by
+     *  ticks modulo its size (which is a power of 2). The vectors in each
+     *  TickInfo keep their capacity when reused, so adding RewindInfo does
+     *  not need to allocate. */
+    std::vector<TickInfo> m_all_tick_info;
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** First time step stored in the ring buffer. */
+    int m_first_ticks;
 
-    AllRewindInfo m_all_rewind_info;
+    /** One after the last time step stored in the ring buffer. */
+    int m_end_ticks;
 
     /** The list of all events received from the network. They are stored
      *  in a separate thread (so this data structure is thread-save), and
@@ -49,17 +66,33 @@ private:
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Time step and index in it of the current RewindInfo to be handled,
+     *  m_current_ticks is END_TICKS if there is no current RewindInfo. */
+    int m_current_ticks;
+    unsigned m_current_index;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
 
+    static const int END_TICKS = -1;
 
     void cleanupOldRewindInfo(int ticks);
+    void ensureTicks(int ticks);
+    void clearTickInfo(TickInfo* ti);
+    void skipEmptyTicks();
+    std::vector<RewindInfo*> getAllRewindInfo();
+    template<typename Queue>
+    static double simulateRewinds(Queue* queue, int total_ticks,
+                                  EventRewinder* rewinder);
+    // ------------------------------------------------------------------------
+    TickInfo& getTickInfo(int ticks)
+    {
+        return m_all_tick_info[ticks & (m_all_tick_info.size() - 1)];
+    }   // getTickInfo
 
 public:
         static void unitTesting();
+        static void benchmark();
 
          RewindQueue();
         ~RewindQueue();
@@ -95,9 +128,9 @@ public:
      *  RewindInfo element. */
     void next()
     {
-        assert(m_current != m_all_rewind_info.end());
-        m_current++;
-        return;
+        assert(m_current_ticks != END_TICKS);
+        m_current_index++;
+        skipEmptyTicks();
     }   // operator++
 
     // ------------------------------------------------------------------------
@@ -105,7 +138,9 @@ public:
      *  least one more RewindInfo (see hasMoreRewindInfo()). */
     RewindInfo* getCurrent()
     {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
+        if (m_current_ticks == END_TICKS)
+            return NULL;
+        return getTickInfo(m_current_ticks).m_rewind_info[m_current_index];
     }   // getNext
 
 };   // RewindQueue
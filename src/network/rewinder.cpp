@@ -20,6 +20,8 @@
 
 #include "network/rewind_manager.hpp"
 
+const uint16_t Rewinder::NO_REWINDER_ID;
+
 // ----------------------------------------------------------------------------
 /** Add this object to the list of all rewindable
  *  objects in the rewind manager.
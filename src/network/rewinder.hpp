@@ -20,6 +20,7 @@
 #define HEADER_REWINDER_HPP
 
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <memory>
@@ -56,8 +57,19 @@ private:
     */
     std::string m_unique_identity;
 
+    /** Numeric id used for this rewinder in network states, assigned by the
+     *  server's RewindManager and announced to clients. */
+    uint16_t m_rewinder_id;
+
 public:
-    Rewinder(const std::string& ui = "")             { m_unique_identity = ui; }
+    /** Id of a rewinder which has no id (yet). */
+    static const uint16_t NO_REWINDER_ID = 0xffff;
+
+    Rewinder(const std::string& ui = "")
+    {
+        m_unique_identity = ui;
+        m_rewinder_id = NO_REWINDER_ID;
+    }
 
     virtual ~Rewinder() {}
 
@@ -72,10 +84,10 @@ public:
 
     /** Provides a copy of the state of the object in one memory buffer.
      *  The memory is managed by the RewindManager.
-     *  \param[out] ru The unique identity of rewinder writing to.
+     *  \param[out] ru The rewinder id of rewinder writing to.
      *  \return The address of the memory buffer with the state.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru) = 0;
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -112,6 +124,10 @@ public:
         return m_unique_identity;
     }
     // -------------------------------------------------------------------------
+    uint16_t getRewinderId() const                     { return m_rewinder_id; }
+    // -------------------------------------------------------------------------
+    void setRewinderId(uint16_t id)                      { m_rewinder_id = id; }
+    // -------------------------------------------------------------------------
     bool rewinderAdd();
     // -------------------------------------------------------------------------
     template<typename T> std::shared_ptr<T> getShared()
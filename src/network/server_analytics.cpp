@@ -1,6 +1,9 @@
 #include "network/server_analytics.hpp"
+#include "network/crypto.hpp"
 #include "network/http_client.hpp"
 #include "network/server_config.hpp"
+#include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/controller.hpp"  
 #include "modes/world.hpp"
@@ -8,19 +11,49 @@
 #include "tracks/track.hpp"
 #include "utils/time.hpp"
 #include "utils/log.hpp"
+#include "utils/metrics.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+constexpr uint64_t ServerAnalytics::SEND_INTERVAL;
 
 ServerAnalytics::ServerAnalytics(const std::string& endpoint_uri,
                                const std::string& auth_id,
                                const std::string& auth_pwd)
-    : m_http_client(new HTTPClient(endpoint_uri, 
-                                 auth_id, 
-                                 auth_pwd, 
-                                 ServerConfig::m_tpk_table.c_str(),
-                                 ServerConfig::m_tpk_token.c_str())),
+    : m_ring_head(0),
+      m_ring_tail(0),
+      m_dropped_events(0),
       m_stop_thread(false),
       m_race_in_progress(false),
-      m_last_send_time(0)
+      m_ticks_to_next_sample(0),
+      m_reset_telemetry(true)
 {
+    static_assert((RING_SIZE & (RING_SIZE - 1)) == 0,
+        "RING_SIZE must be a power of two");
+    // Without endpoint events are only queued (used by unit testing)
+    if (endpoint_uri.empty())
+        return;
+    std::string spool_dir;
+    if (ServerConfig::m_tpk_spool)
+    {
+        // One spool per server and endpoint, so that several servers can
+        // run on the same machine
+        std::array<uint8_t, 32> hash = Crypto::sha256(endpoint_uri + "\n" +
+            ServerConfig::m_tpk_table.c_str() + "\n" +
+            ServerConfig::m_server_name.c_str());
+        char hex[17];
+        for (unsigned i = 0; i < 8; i++)
+            snprintf(hex + i * 2, 3, "%02x", hash[i]);
+        spool_dir = file_manager->getCachedDataDir() + "analytics-spool/" +
+            hex + "/";
+    }
+    m_http_client.reset(new HTTPClient(endpoint_uri, auth_id, auth_pwd,
+        ServerConfig::m_tpk_table.c_str(), ServerConfig::m_tpk_token.c_str(),
+        spool_dir));
+
     // Don't block on connection - just log and continue
     Log::info("ServerAnalytics", "Initializing analytics in background");
 
@@ -31,26 +64,27 @@ ServerAnalytics::ServerAnalytics(const std::string& endpoint_uri,
 
 ServerAnalytics::~ServerAnalytics()
 {
-    disconnect();
-    
-    // Stop the send thread
+    // Stop the send thread first, it flushes the remaining events
     {
-        std::lock_guard<std::mutex> lock(m_queue_mutex);
-        m_stop_thread = true;
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_stop_thread.store(true);
     }
     m_cond_var.notify_all();
     if (m_send_thread.joinable()) {
         m_send_thread.join();
     }
+    disconnect();
 }
 
 bool ServerAnalytics::isConnected() const 
 { 
-    return m_http_client->isConnected(); 
+    return m_http_client && m_http_client->isConnected();
 }
 
 bool ServerAnalytics::connect()
 {
+    if (!m_http_client)
+        return false;
     Log::debug("ServerAnalytics", "Attempting to connect to analytics server");
     // Try to connect but don't block
     try {
@@ -65,236 +99,327 @@ bool ServerAnalytics::connect()
 
 void ServerAnalytics::disconnect()
 {
-    m_http_client->disconnect();
-}
-
-bool ServerAnalytics::sendAnalytics(const std::string& json_data)
-{
-    /*if (!m_http_client->isConnected()) {
-        Log::warn("ServerAnalytics", "Attempted to send analytics while not connected");
-        return false;
-    }*/
-
-    {
-        std::lock_guard<std::mutex> lock(m_queue_mutex);
-        if (!m_race_in_progress) {
-            Log::debug("ServerAnalytics", "Ignoring analytics data - race not in progress");
-            return false;
-        }
-        m_message_queue.push(json_data);
-    }
-    
-    // Only notify if we've reached the batch size
-    if (m_message_queue.size() >= MAX_QUEUE_SIZE)
-        m_cond_var.notify_one();
-        
-    return true;
+    if (m_http_client)
+        m_http_client->disconnect();
 }
 
 void ServerAnalytics::startRace()
 {
-    std::lock_guard<std::mutex> lock(m_queue_mutex);
     Log::info("ServerAnalytics", "Starting race with analytics - Connected: %d", 
             isConnected() ? 1 : 0);
-    m_race_in_progress = true;
-    m_last_send_time = StkTime::getMonoTimeMs();
+    m_reset_telemetry.store(true);
+    m_race_in_progress.store(true);
 }
 
 void ServerAnalytics::endRace()
 {
-    std::lock_guard<std::mutex> lock(m_queue_mutex);
-    m_race_in_progress = false;
+    m_race_in_progress.store(false);
     // Trigger one final send of remaining data
     m_cond_var.notify_one();
 }
 
-/*void ServerAnalytics::sendLoop()
+/** Copies events into the ring buffer, called only from the game thread.
+ *  The events are published together with a single atomic store.
+ *  \return False if the ring was full and some events were dropped.
+ */
+bool ServerAnalytics::pushEvents(const AnalyticsEvent* events, size_t count)
 {
+    const uint64_t head = m_ring_head.load(std::memory_order_relaxed);
+    const uint64_t tail = m_ring_tail.load(std::memory_order_acquire);
+    const uint64_t queued = head - tail;
+    size_t accepted = count;
+    if (queued + count > RING_SIZE)
+    {
+        accepted = (size_t)(RING_SIZE - queued);
+        m_dropped_events.fetch_add(count - accepted,
+            std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < accepted; i++)
+        m_ring[(head + i) & (RING_SIZE - 1)] = events[i];
+    m_ring_head.store(head + accepted, std::memory_order_release);
+    // Wake up the send thread once per full batch, otherwise it will pick
+    // up the events after SEND_INTERVAL
+    if (queued < MAX_QUEUE_SIZE && queued + accepted >= MAX_QUEUE_SIZE)
+        m_cond_var.notify_one();
+    return accepted == count;
+}
 
+/** Removes all queued events from the ring buffer and formats them as a json
+ *  array, called only from the send thread.
+ *  \return The json array, or an empty string if no event was queued.
+ */
+std::string ServerAnalytics::popBatch()
+{
+    uint64_t tail = m_ring_tail.load(std::memory_order_relaxed);
+    const uint64_t head = m_ring_head.load(std::memory_order_acquire);
+    if (head == tail)
+        return "";
+
+    std::string batch_message = "[";
+    for (; tail != head; tail++)
+    {
+        if (batch_message.size() > 1)
+            batch_message += ",";
+        m_ring[tail & (RING_SIZE - 1)].appendJson(&batch_message);
+        // Free the slot as soon as it was formatted
+        m_ring_tail.store(tail + 1, std::memory_order_release);
+    }
+    batch_message += "]";
+    return batch_message;
+}
+
+void ServerAnalytics::sendLoop()
+{
     Log::info("ServerAnalytics", "Analytics send thread started");
+    uint64_t reported_dropped = 0;
+    Metrics::Gauge& queue_depth = Metrics::gauge(
+        "stk_analytics_queued_events", "Analytics events waiting to be "
+        "sent.");
+    Metrics::Counter& dropped_events = Metrics::counter(
+        "stk_analytics_dropped_events_total", "Analytics events dropped "
+        "because the queue was full.");
 
     while (true) {
-        std::unique_lock<std::mutex> lock(m_queue_mutex);
-
-        // Log initial state
-        uint64_t current_time = StkTime::getMonoTimeMs();
-        Log::info("ServerAnalytics", "Initial state - Last send time: %lu, Current time: %lu", 
-                 m_last_send_time, current_time);
-
-        // Log before wait
-        Log::info("ServerAnalytics", "About to wait - Queue size: %d, Race in progress: %d", 
-                 m_message_queue.size(), m_race_in_progress ? 1 : 0);
-
-        // Wait until we should send data
-        m_cond_var.wait(lock, [this] {
-            uint64_t current_time = StkTime::getMonoTimeMs();
-            bool time_to_send = (current_time - m_last_send_time) >= SEND_INTERVAL;
-            bool enough_data = m_message_queue.size() >= MAX_QUEUE_SIZE;
-            
-            // Allow time-based sending even with empty queue
-            bool should_send = time_to_send || 
-                            (!m_message_queue.empty() && enough_data) || 
-                            (m_stop_thread && !m_message_queue.empty()) ||
-                            (!m_race_in_progress && !m_message_queue.empty());
-            
-            Log::debug("ServerAnalytics", "Wait condition check - Time since last: %lu, Queue size: %d, Race in progress: %d, Should send: %d",
-                    current_time - m_last_send_time, m_message_queue.size(), 
-                    m_race_in_progress ? 1 : 0, should_send ? 1 : 0);
-            
-            return should_send;
-        });
-
-        // Log after wait
-        Log::info("ServerAnalytics", "Wait condition satisfied - preparing to send batch");
-
-        if (m_stop_thread && m_message_queue.empty()) {
-            break;
+        {
+            std::unique_lock<std::mutex> lock(m_wait_mutex);
+            m_cond_var.wait_for(lock,
+                std::chrono::milliseconds(SEND_INTERVAL),
+                [this] {
+                    const uint64_t queued = m_ring_head.load() -
+                        m_ring_tail.load();
+                    return m_stop_thread.load() ||
+                        queued >= MAX_QUEUE_SIZE ||
+                        (!m_race_in_progress.load() && queued > 0);
+                });
         }
 
-        // Prepare batch of messages
-        std::string batch_message = "[";
-        bool first = true;
-        while (!m_message_queue.empty()) {
-            if (!first) batch_message += ",";
-            batch_message += m_message_queue.front();
-            m_message_queue.pop();
-            first = false;
+        uint64_t dropped = m_dropped_events.load();
+        if (dropped != reported_dropped)
+        {
+            Log::warn("ServerAnalytics", "%lu analytics events dropped "
+                "because the queue was full (%lu in total).",
+                (unsigned long)(dropped - reported_dropped),
+                (unsigned long)dropped);
+            dropped_events.increase(dropped - reported_dropped);
+            reported_dropped = dropped;
         }
-        batch_message += "]";
-        
-        m_last_send_time = StkTime::getMonoTimeMs();
-        lock.unlock();
-
-        // Send batch
-        if (!batch_message.empty()) {
-            Log::info("ServerAnalytics", "Sending batch of %d analytics events to endpoint",
-              m_message_queue.size());
-            m_http_client->sendJSON(batch_message);
+
+        queue_depth.set(m_ring_head.load() - m_ring_tail.load());
+        std::string batch_message = popBatch();
+        if (!batch_message.empty())
+        {
+            Log::debug("ServerAnalytics", "Preparing to send batch: %s",
+                batch_message.c_str());
+            if (!m_http_client->sendJSON(batch_message))
+                Log::warn("ServerAnalytics", "Failed to send analytics batch");
         }
 
-        lock.lock();
+        if (m_stop_thread.load() &&
+            m_ring_head.load() == m_ring_tail.load())
+            break;
     }
 }
-*/
 
-void ServerAnalytics::sendLoop()
+namespace
 {
-    Log::info("ServerAnalytics", "Analytics send thread started");
-
-    while (true) {
-        std::unique_lock<std::mutex> lock(m_queue_mutex);
-        
-        // Log initial state
-        uint64_t current_time = StkTime::getMonoTimeMs();
-        Log::info("ServerAnalytics", "Initial state - Last send time: %lu, Current time: %lu", 
-                 m_last_send_time, current_time);
-
-        // Log before wait
-        Log::info("ServerAnalytics", "About to wait - Queue size: %d, Race in progress: %d", 
-                 m_message_queue.size(), m_race_in_progress ? 1 : 0);
-        
-        // Wait for either timeout or condition
-        bool predicate_satisfied = m_cond_var.wait_for(lock, 
-            std::chrono::milliseconds(SEND_INTERVAL),
-            [this] {
-                bool enough_data = m_message_queue.size() >= MAX_QUEUE_SIZE;
-                bool should_send = (!m_message_queue.empty() && enough_data) || 
-                                 (m_stop_thread && !m_message_queue.empty()) ||
-                                 (!m_race_in_progress && !m_message_queue.empty());
-                
-                Log::debug("ServerAnalytics", "Wait condition check - Queue size: %d, Race in progress: %d, Should send: %d",
-                          m_message_queue.size(), m_race_in_progress ? 1 : 0, should_send ? 1 : 0);
-                
-                return should_send;
-            });
-
-        // Log after wait - either timeout occurred or condition was met
-        Log::info("ServerAnalytics", "Wait ended - predicate satisfied: %d", 
-                 predicate_satisfied ? 1 : 0);
-
-        // Process queue if not empty
-        if (!m_message_queue.empty()) {
-            std::string batch_message = "[";
-            bool first = true;
-            while (!m_message_queue.empty()) {
-                if (!first) batch_message += ",";
-                batch_message += m_message_queue.front();
-                m_message_queue.pop();
-                first = false;
+    void appendJsonString(std::string* out, const char* str)
+    {
+        *out += '"';
+        for (const char* c = str; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                *out += '\\';
+                *out += *c;
             }
-            batch_message += "]";
-            
-            if (!batch_message.empty()) {
-                Log::info("ServerAnalytics", "Sending batch of analytics events");
-                Log::info("ServerAnalytics", "Preparing to send batch: %s", batch_message.c_str());
-                Log::info("ServerAnalytics", "HTTP Client connected: %d", m_http_client->isConnected() ? 1 : 0);
-
-                bool send_result = m_http_client->sendJSON(batch_message);
-                Log::info("ServerAnalytics", "Send result: %d", send_result ? 1 : 0);
-
-                if (!send_result) {
-                    Log::warn("ServerAnalytics", "Failed to send analytics batch");
-                }
-
+            else if ((unsigned char)*c < 0x20)
+            {
+                char buffer[8];
+                snprintf(buffer, 8, "\\u%04x", (unsigned)(unsigned char)*c);
+                *out += buffer;
             }
+            else
+                *out += *c;
         }
-        
-        // Update last send time
-        m_last_send_time = StkTime::getMonoTimeMs();
-    }
-}
+        *out += '"';
+    }   // appendJsonString
 
-std::string AnalyticsEvent::toJson() const {
-    std::stringstream ss;
-    ss << "{";
-    ss << "\"player-id\":\"" << player_id << "\",";
-    ss << "\"match-id\":\"" << match_id << "\",";
-    ss << "\"track\":" << track << ",";
-    ss << "\"kart\":" << kart << ",";
-    ss << "\"timestamp\":\"" << timestamp << "\",";
-    ss << "\"loc-x\":" << loc_x << ",";
-    ss << "\"loc-y\":" << loc_y << ",";
-    ss << "\"loc-z\":" << loc_z << ",";
-    ss << "\"face-x\":" << face_x << ",";
-    ss << "\"face-y\":" << face_y << ",";
-    ss << "\"face-z\":" << face_z << ",";
-    ss << "\"speed\":" << speed << ",";
-    ss << "\"gas\":" << (gas ? "true" : "false") << ",";
-    ss << "\"brake\":" << (brake ? "true" : "false") << ",";
-    ss << "\"nitro\":" << (nitro ? "true" : "false") << ",";
-    ss << "\"skid\":" << (skid ? "true" : "false") << ",";
-    ss << "\"back\":" << (back ? "true" : "false") << ",";
-    ss << "\"event\":" << event;
-    if (!metadata.empty())
-        ss << ",\"metadata\":\"" << metadata << "\"";
-    ss << "}";
-    return ss.str();
+    /** Wall clock time in ms since epoch. */
+    uint64_t getTimeMs()
+    {
+        return (uint64_t)std::chrono::duration_cast<
+            std::chrono::milliseconds>(std::chrono::system_clock::now()
+            .time_since_epoch()).count();
+    }   // getTimeMs
+    // ------------------------------------------------------------------------
+    /** Copies a string into a fixed size buffer, truncating if needed. */
+    void copyString(char* dst, const char* src)
+    {
+        size_t len = src ? strlen(src) : 0;
+        if (len >= AnalyticsEvent::MAX_STRING_LENGTH)
+            len = AnalyticsEvent::MAX_STRING_LENGTH - 1;
+        if (len > 0)
+            memcpy(dst, src, len);
+        dst[len] = 0;
+    }   // copyString
+}   // anonymous namespace
+
+void AnalyticsEvent::appendJson(std::string* out) const
+{
+    // Timestamp in local time with milliseconds
+    time_t seconds = (time_t)(timestamp_ms / 1000);
+    struct tm tm_info;
+#ifdef WIN32
+    localtime_s(&tm_info, &seconds);
+#else
+    localtime_r(&seconds, &tm_info);
+#endif
+    char time_buffer[32];
+    strftime(time_buffer, 32, "%Y-%m-%d %H:%M:%S", &tm_info);
+    char timestamp[40];
+    snprintf(timestamp, 40, "%s.%03u", time_buffer,
+        (unsigned)(timestamp_ms % 1000));
+
+    *out += "{\"player-id\":";
+    appendJsonString(out, player_id);
+    char buffer[512];
+    snprintf(buffer, 512, ",\"match-id\":\"%d\",\"track\":%u,\"kart\":%u,"
+        "\"timestamp\":\"%s\",\"loc-x\":%g,\"loc-y\":%g,\"loc-z\":%g,"
+        "\"face-x\":%g,\"face-y\":%g,\"face-z\":%g,\"speed\":%g,"
+        "\"gas\":%s,\"brake\":%s,\"nitro\":%s,\"skid\":%s,\"back\":%s,"
+        "\"event\":%u", match_id, track, kart, timestamp, loc_x, loc_y, loc_z,
+        face_x, face_y, face_z, speed, gas ? "true" : "false",
+        brake ? "true" : "false", nitro ? "true" : "false",
+        skid ? "true" : "false", back ? "true" : "false", event);
+    *out += buffer;
+    if (metadata[0] != 0)
+    {
+        *out += ",\"metadata\":";
+        appendJsonString(out, metadata);
+    }
+    *out += "}";
 }
 
-void ServerAnalytics::queueAnalyticsEvent(const std::string& player_id, 
-                                        uint16_t event_id,
-                                        int kart_id,
-                                        const std::string& metadata)
+/** Converts the player names of all karts to UTF-8 once per race (or when
+ *  the number of karts changed), and resets the telemetry state at the
+ *  start of a race. Only called on the game thread.
+ */
+template<typename W> void ServerAnalytics::updateKartNames(W* world)
+{
+    if (m_reset_telemetry.exchange(false))
+    {
+        m_kart_names.clear();
+        m_ticks_to_next_sample = 0;
+    }
+    const unsigned kart_amount = world->getNumKarts();
+    if (m_kart_names.size() == kart_amount)
+        return;
+    m_kart_names.resize(kart_amount);
+    for (unsigned i = 0; i < kart_amount; i++)
+    {
+        const auto* controller = world->getKart(i)->getController();
+        std::string name = controller ?
+            StringUtils::wideToUtf8(controller->getName()) : "";
+        copyString(m_kart_names[i].data(), name.c_str());
+    }
+}   // updateKartNames
+
+/** Fills the kart dependent fields of an analytics event, i.e. the same
+ *  transform, velocity and controls which are saved for rewinding.
+ */
+template<typename K>
+void ServerAnalytics::fillKartState(AnalyticsEvent* event, const K* kart,
+                                    int match_id, uint16_t track,
+                                    uint64_t timestamp_ms)
 {
+    event->match_id = match_id;
+    event->track = track;
+    event->kart = (uint16_t)kart->getIdent().length();
+    event->timestamp_ms = timestamp_ms;
 
-        // Add debug logging for analytics state
-    Log::debug("ServerAnalytics", "Analytics state - Race in progress: %d, Connected: %d",
-               m_race_in_progress ? 1 : 0, isConnected() ? 1 : 0);
+    const Vec3& pos = kart->getXYZ();
+    event->loc_x = pos.getX();
+    event->loc_y = pos.getY();
+    event->loc_z = pos.getZ();
+
+    const btTransform& trans = kart->getSmoothedTrans();
+    btVector3 fwd = quatRotate(trans.getRotation(), btVector3(0, 0, 1));
+    event->face_x = fwd.x();
+    event->face_y = fwd.y();
+    event->face_z = fwd.z();
+
+    event->speed = kart->getSpeed();
+
+    // Same controls as saved by the controller of the kart
+    const KartControl& controls = kart->getControls();
+    event->gas = controls.getAccel() > 0;
+    event->brake = controls.getBrake();
+    event->nitro = controls.getNitro();
+    event->skid = controls.getSkidControl() != KartControl::SC_NONE;
+    event->back = controls.getLookBack();
+}   // fillKartState
+
+/** Samples the state of all karts at the rate given by tpk-telemetry-rate,
+ *  called once per world tick on the server. All karts are sampled at the
+ *  same tick and queued in one batch. This is a template so that the unit
+ *  test and benchmark can use it without a world and real karts.
+ */
+template<typename W> void ServerAnalytics::sampleKarts(W* world, int ticks)
+{
+    const int rate = ServerConfig::m_tpk_telemetry_rate;
+    if (rate <= 0 || !m_race_in_progress.load(std::memory_order_relaxed))
+        return;
 
-    if (!m_race_in_progress) 
+    updateKartNames(world);
+    if (m_ticks_to_next_sample > 0)
     {
-        Log::warn("ServerAnalytics", "Skipping event - race not in progress or not connected");
+        m_ticks_to_next_sample -= ticks;
         return;
     }
-
-    // Queue event even if disconnected
-    if (!isConnected()) {
-        Log::info("ServerAnalytics", "HTTP client disconnected but queueing event anyway");
+    const int interval = std::max(stk_config->time2Ticks(1.0f / rate), 1);
+    m_ticks_to_next_sample += interval;
+    // Don't try to catch up if the server was stalled
+    if (m_ticks_to_next_sample <= 0)
+        m_ticks_to_next_sample = interval;
+    m_ticks_to_next_sample -= ticks;
+
+    const unsigned kart_amount = world->getNumKarts();
+    m_telemetry_events.resize(kart_amount);
+    const int match_id = world->getTicksSinceStart();
+    const uint16_t track =
+        (uint16_t)RaceManager::get()->getTrackName().length();
+    const uint64_t timestamp_ms = getTimeMs();
+    size_t count = 0;
+    for (unsigned i = 0; i < kart_amount; i++)
+    {
+        const auto* kart = world->getKart(i);
+        if (kart->isEliminated())
+            continue;
+        AnalyticsEvent* event = &m_telemetry_events[count++];
+        memcpy(event->player_id, m_kart_names[i].data(),
+            AnalyticsEvent::MAX_STRING_LENGTH);
+        event->metadata[0] = 0;
+        event->event = ANALYTICS_EVENT_TELEMETRY_SAMPLE;
+        fillKartState(event, kart, match_id, track, timestamp_ms);
     }
+    pushEvents(m_telemetry_events.data(), count);
+}   // sampleKarts
+
+void ServerAnalytics::sampleTelemetry(World* world, int ticks)
+{
+    sampleKarts(world, ticks);
+}   // sampleTelemetry
+
+void ServerAnalytics::queueAnalyticsEvent(const char* player_id,
+                                          uint16_t event_id,
+                                          int kart_id,
+                                          const char* metadata)
+{
+    // This is called on the game thread, so no allocation, formatting or
+    // locking is done here
+    if (!m_race_in_progress.load(std::memory_order_relaxed))
+        return;
 
-    Log::info("ServerAnalytics", "Queueing analytics event %d for player %s (kart %d): %s",
-              event_id, player_id.c_str(), kart_id, metadata.c_str());
-    
     World* world = World::getWorld();
     if (!world) return;
 
@@ -302,69 +427,198 @@ void ServerAnalytics::queueAnalyticsEvent(const std::string& player_id,
     if (!kart) return;
 
     AnalyticsEvent event;
-    event.player_id = player_id;
-    event.match_id = StringUtils::toString(world->getTicksSinceStart());
-    
-    event.track = (uint16_t)RaceManager::get()->getTrackName().length();
-    event.kart = (uint16_t)kart->getIdent().length();
-    
-    // Get current time
-    time_t now = std::time(nullptr);
-    struct tm* tm_info = std::localtime(&now);  // Use localtime instead of gmtime
-    char buffer[32];
-    strftime(buffer, 32, "%Y-%m-%d %H:%M:%S", tm_info);
-
-    // Add milliseconds from STK time
-    uint64_t ms = StkTime::getMonoTimeMs() % 1000;
-        event.timestamp = StringUtils::toString(buffer) + "." + 
-        (ms < 10 ? "00" : ms < 100 ? "0" : "") + StringUtils::toString(ms);
-
-
-    /*uint64_t now = StkTime::getTimeSinceEpoch();
-    uint64_t ms = now % 1000;
-    time_t seconds = now / 1000;
-    struct tm* tm_info = gmtime(&seconds);
-    char buffer[32];
-    strftime(buffer, 32, "%Y-%m-%d %H:%M:%S", tm_info);
-    event.timestamp = StringUtils::toString(buffer) + "." + 
-        StringUtils::toString(ms).substr(0,3); */
+    copyString(event.player_id, player_id);
+    copyString(event.metadata, metadata);
+    fillKartState(&event, kart, world->getTicksSinceStart(),
+        (uint16_t)RaceManager::get()->getTrackName().length(), getTimeMs());
+    event.event = event_id;
+    pushEvent(event);
+}
 
-    const Vec3& pos = kart->getXYZ();
-    event.loc_x = pos.getX();
-    event.loc_y = pos.getY();
-    event.loc_z = pos.getZ();
+/** Queues an event of a kart, using the cached name of its player as player
+ *  id. Like queueAnalyticsEvent this is called on the game thread.
+ */
+void ServerAnalytics::queueKartEvent(uint16_t event_id, int kart_id,
+                                     const char* metadata)
+{
+    if (!m_race_in_progress.load(std::memory_order_relaxed))
+        return;
 
-    const btTransform& trans = kart->getSmoothedTrans();
-    const btQuaternion& q = trans.getRotation();
-    btVector3 fwd = btVector3(0, 0, 1).rotate(q.getAxis(), q.getAngle());
-    event.face_x = fwd.x();
-    event.face_y = fwd.y();
-    event.face_z = fwd.z();
-
-    event.speed = kart->getSpeed();
-    
-    Controller* controller = kart->getController();
-    if (controller)
+    World* world = World::getWorld();
+    if (!world || kart_id < 0 || kart_id >= (int)world->getNumKarts())
+        return;
+    updateKartNames(world);
+    queueAnalyticsEvent(m_kart_names[kart_id].data(), event_id, kart_id,
+                        metadata);
+}   // queueKartEvent
+
+namespace
+{
+    /** A world with karts which only have the functions used for telemetry,
+     *  so that sampleKarts can be tested and benchmarked without a track. */
+    struct TelemetryTestWorld
     {
-        const KartControl* controls = controller->getControls();
-        event.gas = controls->getAccel() > 0;
-        event.brake = controls->getBrake();
-        event.nitro = controls->getNitro();
-        event.skid = controls->getSkidControl() != KartControl::SC_NONE;
-        event.back = controls->getLookBack();
+        struct Controller
+        {
+            core::stringw m_name;
+            core::stringw getName() const                  { return m_name; }
+        };
+        struct Kart
+        {
+            Controller  m_controller;
+            std::string m_ident;
+            Vec3        m_xyz;
+            btTransform m_trans;
+            float       m_speed;
+            KartControl m_controls;
+            bool        m_eliminated;
+            // ----------------------------------------------------------------
+            const Controller* getController() const  { return &m_controller; }
+            const std::string& getIdent() const             { return m_ident; }
+            const Vec3& getXYZ() const                        { return m_xyz; }
+            const btTransform& getSmoothedTrans() const     { return m_trans; }
+            float getSpeed() const                          { return m_speed; }
+            const KartControl& getControls() const       { return m_controls; }
+            bool isEliminated() const                  { return m_eliminated; }
+        };
+        std::vector<Kart> m_karts;
+        int m_ticks;
+        // --------------------------------------------------------------------
+        TelemetryTestWorld(unsigned kart_amount) : m_ticks(0)
+        {
+            m_karts.resize(kart_amount);
+            for (unsigned i = 0; i < kart_amount; i++)
+            {
+                Kart& kart = m_karts[i];
+                kart.m_controller.m_name =
+                    StringUtils::utf8ToWide("player " + StringUtils::toString(i));
+                kart.m_ident = "tux";
+                kart.m_xyz = Vec3((float)i, 0, 1);
+                kart.m_trans.setIdentity();
+                kart.m_speed = (float)i;
+                kart.m_eliminated = false;
+            }
+        }
+        // --------------------------------------------------------------------
+        unsigned getNumKarts() const      { return (unsigned)m_karts.size(); }
+        Kart* getKart(unsigned i)                      { return &m_karts[i]; }
+        int getTicksSinceStart() const                      { return m_ticks; }
+    };   // TelemetryTestWorld
+}   // anonymous namespace
+
+void ServerAnalytics::unitTesting()
+{
+    ServerAnalytics sa("");
+    sa.startRace();
+
+    // Json output of a single event
+    AnalyticsEvent event;
+    memset(&event, 0, sizeof(event));
+    copyString(event.player_id, "a\"b\\c");
+    copyString(event.metadata, "rescue");
+    event.event = ANALYTICS_EVENT_PLAYER_CRASHED;
+    event.speed = 1.5f;
+    event.gas = true;
+    sa.pushEvent(event);
+    std::string json = sa.popBatch();
+    assert(json.find("[{\"player-id\":\"a\\\"b\\\\c\",") == 0);
+    assert(json.find("\"speed\":1.5,\"gas\":true,\"brake\":false") !=
+        std::string::npos);
+    assert(json.find("\"event\":7,\"metadata\":\"rescue\"}]") !=
+        std::string::npos);
+    assert(sa.popBatch().empty());
+
+    // Long strings are truncated
+    std::string long_name(100, 'x');
+    copyString(event.player_id, long_name.c_str());
+    assert(strlen(event.player_id) == AnalyticsEvent::MAX_STRING_LENGTH - 1);
+
+    // Events which don't fit in the ring are dropped and counted
+    std::vector<AnalyticsEvent> events(RING_SIZE + 10, event);
+    assert(!sa.pushEvents(events.data(), events.size()));
+    assert(sa.getDroppedEvents() == 10);
+    sa.popBatch();
+    assert(sa.pushEvents(events.data(), 10));
+    sa.popBatch();
+
+    // Telemetry of 4 karts sampled at 20 Hz for one second, the eliminated
+    // kart is not sampled
+    const int old_rate = ServerConfig::m_tpk_telemetry_rate;
+    ServerConfig::m_tpk_telemetry_rate = 20;
+    TelemetryTestWorld world(4);
+    world.m_karts[2].m_eliminated = true;
+    world.m_karts[1].m_controls.setNitro(true);
+    const int interval = stk_config->time2Ticks(1.0f / 20);
+    const int fps = stk_config->getPhysicsFPS();
+    unsigned samples = 0;
+    for (world.m_ticks = 0; world.m_ticks < fps; world.m_ticks++)
+    {
+        sa.sampleKarts(&world, 1);
+        json = sa.popBatch();
+        if (json.empty())
+            continue;
+        assert(world.m_ticks == (int)samples * interval);
+        samples++;
+        size_t count = 0;
+        for (size_t i = json.find("\"event\":9"); i != std::string::npos;
+             i = json.find("\"event\":9", i + 1))
+            count++;
+        assert(count == 3);
+        assert(json.find("\"player-id\":\"player 0\",") != std::string::npos);
+        assert(json.find("player 2") == std::string::npos);
+        assert(json.find("\"loc-x\":3,\"loc-y\":0,\"loc-z\":1,")
+            != std::string::npos);
+        assert(json.find("\"face-z\":1,\"speed\":3,\"gas\":false,"
+            "\"brake\":false,\"nitro\":false") != std::string::npos);
+        assert(json.find("\"speed\":1,\"gas\":false,\"brake\":false,"
+            "\"nitro\":true") != std::string::npos);
     }
-    else
+    assert(samples == (unsigned)((fps + interval - 1) / interval));
+
+    // Names are converted once per race
+    world.m_karts[0].m_controller.m_name = L"renamed";
+    sa.sampleKarts(&world, interval);
+    assert(sa.popBatch().find("renamed") == std::string::npos);
+    sa.startRace();
+    sa.sampleKarts(&world, interval);
+    assert(sa.popBatch().find("\"player-id\":\"renamed\"") !=
+        std::string::npos);
+
+    ServerConfig::m_tpk_telemetry_rate = old_rate;
+    assert(sa.getDroppedEvents() == 10);
+}   // unitTesting
+
+/** Measures the game thread cost of sampling the telemetry of 16 karts,
+ *  which should stay below 50us per sample. The events are drained like the
+ *  send thread would do, which is not timed.
+ */
+void ServerAnalytics::benchmark()
+{
+    const unsigned KART_AMOUNT = 16;
+    const unsigned SAMPLE_AMOUNT = 20 * 60;
+    const int old_rate = ServerConfig::m_tpk_telemetry_rate;
+    ServerConfig::m_tpk_telemetry_rate = 20;
+    const int interval = stk_config->time2Ticks(1.0f / 20);
+
+    ServerAnalytics sa("");
+    sa.startRace();
+    TelemetryTestWorld world(KART_AMOUNT);
+    uint64_t total_ns = 0;
+    for (unsigned sample = 0; sample < SAMPLE_AMOUNT; sample++)
     {
-        event.gas = false;
-        event.brake = false;
-        event.nitro = false;
-        event.skid = false;
-        event.back = false;
+        world.m_ticks += interval;
+        for (auto& kart : world.m_karts)
+            kart.m_xyz.setZ(kart.m_xyz.getZ() + 0.1f);
+        auto start = std::chrono::steady_clock::now();
+        sa.sampleKarts(&world, interval);
+        total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now() - start).count();
+        if (sample % 5 == 4)
+            sa.popBatch();
     }
-    
-    event.event = event_id;
-    event.metadata = metadata;
-
-    std::string json = event.toJson();
-    sendAnalytics(json);
-}
+    ServerConfig::m_tpk_telemetry_rate = old_rate;
+    Log::info("ServerAnalytics", "Telemetry sample of %u karts: %.2f us on "
+        "average (budget 50 us), %lu events dropped.", KART_AMOUNT,
+        total_ns / 1000.0 / SAMPLE_AMOUNT,
+        (unsigned long)sa.getDroppedEvents());
+}   // benchmark
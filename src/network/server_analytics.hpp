@@ -4,24 +4,32 @@
 #include "utils/string_utils.hpp"
 #include "utils/log.hpp"
 
-#include <queue>
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <string>
 #include <memory>
+#include <vector>
 
 class HTTPClient;  // Forward declaration
 class AbstractKart;  // Forward declaration
 class World;  // Forward declaration
 class Controller;  // Forward declaration
 
+/** A fixed size analytics record. It is filled in on the game thread without
+ *  any allocation, and only converted to json in the send thread. */
 struct AnalyticsEvent {
-    std::string player_id;
-    std::string match_id;
+    static constexpr size_t MAX_STRING_LENGTH = 64;
+
+    char player_id[MAX_STRING_LENGTH];
+    char metadata[MAX_STRING_LENGTH];
+    /** Wall clock time in ms since epoch when the event was queued. */
+    uint64_t timestamp_ms;
+    int32_t match_id;
     uint16_t track;
     uint16_t kart;
-    std::string timestamp;
     float loc_x;
     float loc_y;
     float loc_z;
@@ -35,27 +43,63 @@ struct AnalyticsEvent {
     bool skid;
     bool back;
     uint16_t event;
-    std::string metadata;
 
-    std::string toJson() const;
+    void appendJson(std::string* out) const;
 };
 
 class ServerAnalytics {
 private:
     std::unique_ptr<HTTPClient> m_http_client;
-    std::queue<std::string> m_message_queue;
-    std::mutex m_queue_mutex;
-    std::condition_variable m_cond_var;
-    std::thread m_send_thread;
-    bool m_stop_thread;
-    
-    // New variables for batching
-    bool m_race_in_progress;
-    uint64_t m_last_send_time;
+
+    /** Must be a power of two. */
+    static constexpr size_t RING_SIZE = 2048;
     static constexpr uint64_t SEND_INTERVAL = 5000; // 5 seconds in ms
     static constexpr size_t MAX_QUEUE_SIZE = 100;
-    
+
+    /** Single producer (game thread) / single consumer (send thread) ring
+     *  buffer of events. m_ring_head is only written by the producer,
+     *  m_ring_tail only by the consumer. */
+    std::array<AnalyticsEvent, RING_SIZE> m_ring;
+    std::atomic<uint64_t> m_ring_head;
+    std::atomic<uint64_t> m_ring_tail;
+
+    /** Number of events discarded because the ring buffer was full. */
+    std::atomic<uint64_t> m_dropped_events;
+
+    /** Only used to let the send thread sleep, never locked by the game
+     *  thread when queueing events. */
+    std::mutex m_wait_mutex;
+    std::condition_variable m_cond_var;
+    std::thread m_send_thread;
+    std::atomic_bool m_stop_thread;
+    std::atomic_bool m_race_in_progress;
+
+    /** Ticks left before the next telemetry sample, only used on the game
+     *  thread. */
+    int m_ticks_to_next_sample;
+
+    /** Set when a new race starts to reset the telemetry state. */
+    std::atomic_bool m_reset_telemetry;
+
+    /** UTF-8 player name of each kart, cached on the first event or
+     *  telemetry sample of a race to avoid converting it for every event. */
+    std::vector<std::array<char, AnalyticsEvent::MAX_STRING_LENGTH> >
+        m_kart_names;
+
+    /** Events of one telemetry sample, kept to avoid reallocations. */
+    std::vector<AnalyticsEvent> m_telemetry_events;
+
     void sendLoop();
+    bool pushEvent(const AnalyticsEvent& event)
+                                              { return pushEvents(&event, 1); }
+    bool pushEvents(const AnalyticsEvent* events, size_t count);
+    std::string popBatch();
+    template<typename W> void updateKartNames(W* world);
+    template<typename W> void sampleKarts(W* world, int ticks);
+    template<typename K>
+    static void fillKartState(AnalyticsEvent* event, const K* kart,
+                              int match_id, uint16_t track,
+                              uint64_t timestamp_ms);
 
 public:
     ServerAnalytics(const std::string& endpoint_uri,
@@ -65,16 +109,20 @@ public:
     
     bool connect();
     void disconnect();
-    bool sendAnalytics(const std::string& json_data);
     bool isConnected() const;  // Declaration only
     
-    // Add new methods
     void startRace();
     void endRace();
-    void queueAnalyticsEvent(const std::string& player_id, 
-                            uint16_t event_id,
-                            int kart_id,
-                            const std::string& metadata = "");
+    void queueAnalyticsEvent(const char* player_id,
+                             uint16_t event_id,
+                             int kart_id,
+                             const char* metadata = "");
+    void queueKartEvent(uint16_t event_id, int kart_id,
+                        const char* metadata = "");
+    void sampleTelemetry(World* world, int ticks);
+    uint64_t getDroppedEvents() const       { return m_dropped_events.load(); }
+    static void unitTesting();
+    static void benchmark();
 };
 
 static const uint16_t ANALYTICS_EVENT_RACE_START = 1;
@@ -85,5 +133,6 @@ static const uint16_t ANALYTICS_EVENT_PLAYER_DOWNRANKED = 5;
 static const uint16_t ANALYTICS_EVENT_PLAYER_COLLISION = 6;
 static const uint16_t ANALYTICS_EVENT_PLAYER_CRASHED = 7;
 static const uint16_t ANALYTICS_EVENT_PLAYER_USED_ITEM = 8;
+static const uint16_t ANALYTICS_EVENT_TELEMETRY_SAMPLE = 9;
 
 #endif
\ No newline at end of file
@@ -357,6 +357,12 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_delta_states
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true, "delta-states",
+        "Send states to clients encoded against the latest state they have "
+        "received, which reduces the upload bandwidth of the server. Clients "
+        "without support for it always receive full states."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
@@ -476,6 +482,39 @@ namespace ServerConfig
         "tpk-pwd",
         "Basic Auth PWD for TPK endpoint, required for analytics to function."));
 
+    SERVER_CFG_PREFIX IntServerConfigParam m_tpk_telemetry_rate
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0, "tpk-telemetry-rate",
+        "Number of times per second the position, speed and controls of "
+        "every kart are sent to the analytics endpoint during a race, "
+        "0 to disable."));
+
+    SERVER_CFG_PREFIX BoolServerConfigParam m_tpk_spool
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true, "tpk-spool",
+        "Store analytics on disk while the endpoint can't be reached, and "
+        "send them once it is back (also after a restart)."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_socket_batch_size
+        SERVER_CFG_DEFAULT(IntServerConfigParam(32, "socket-batch-size",
+        "Maximum number of UDP packets received or sent with one system "
+        "call (if supported by the system, up to 64), 1 to disable "
+        "batching."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_send_threads
+        SERVER_CFG_DEFAULT(IntServerConfigParam(2, "send-threads",
+        "Number of extra threads which encrypt the packets sent to all "
+        "players in parallel (at most the number of CPU cores minus one), "
+        "0 to encrypt them in the game thread only."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_metrics_port
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0, "metrics-port",
+        "Port of the HTTP endpoint serving server metrics in the Prometheus "
+        "text format at /metrics, 0 to disable it."));
+
+    SERVER_CFG_PREFIX StringServerConfigParam m_metrics_address
+        SERVER_CFG_DEFAULT(StringServerConfigParam("127.0.0.1",
+        "metrics-address", "Address the metrics endpoint listens on, use "
+        "0.0.0.0 to allow scraping from other hosts."));
+
     // ========================================================================
     /** Server version, will be advanced if there are protocol changes. */
     static const uint32_t m_server_version = 6;
@@ -34,11 +34,14 @@
 #include "network/protocol_manager.hpp"
 #include "network/server_config.hpp"
 #include "network/child_loop.hpp"
+#include "network/crypto.hpp"
 #include "network/server.hpp"
 #include "network/stk_ipv6.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
+#include "utils/metrics.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 
@@ -66,6 +69,7 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <limits>
 #include <random>
@@ -305,6 +309,19 @@ STKHost::STKHost(bool server)
     }
     if (server)
         Log::info("STKHost", "Server port is %d", getPrivatePort());
+#ifdef ENET_HAS_SOCKET_BATCH
+    if (server && ServerConfig::m_socket_batch_size > 1 &&
+        enet_host_socket_batch(m_network->getENetHost(),
+        ServerConfig::m_socket_batch_size) < 0)
+    {
+        Log::warn("STKHost", "Failed to enable batched socket I/O.");
+    }
+#endif
+    // The game thread works on the packets too, so one core is kept for it
+    int send_threads = std::min((int)ServerConfig::m_send_threads,
+        (int)std::thread::hardware_concurrency() - 1);
+    if (server && send_threads > 0)
+        m_send_pool.reset(new ThreadPool(send_threads, "SendPackets"));
 }   // STKHost
 
 // ----------------------------------------------------------------------------
@@ -809,6 +826,29 @@ void STKHost::mainLoop(ProcessType pt)
     ENetHost* host = m_network->getENetHost();
     const bool is_server = NetworkConfig::get()->isServer();
 
+    Metrics::Counter& sent_bytes = Metrics::counter(
+        "stk_network_sent_bytes_total", "Bytes sent by enet.");
+    Metrics::Counter& received_bytes = Metrics::counter(
+        "stk_network_received_bytes_total", "Bytes received by enet.");
+    Metrics::Counter& sent_packets = Metrics::counter(
+        "stk_network_sent_packets_total", "UDP packets sent by enet.");
+    Metrics::Counter& received_packets = Metrics::counter(
+        "stk_network_received_packets_total",
+        "UDP packets received by enet.");
+    Metrics::Histogram& service_time = Metrics::histogram(
+        "stk_network_service_seconds", "Time spent in enet_host_service, "
+        "including waiting for events.");
+    Metrics::Gauge& peers_gauge = Metrics::gauge("stk_network_peers",
+        "Number of connected peers.");
+    auto service = [host, &service_time](ENetEvent* event)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int result = enet_host_service(host, event, 10);
+        service_time.observe(std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count());
+        return result;
+    };
+
     // A separate network connection (socket) to handle LAN requests.
     Network* direct_socket = NULL;
     if ((NetworkConfig::get()->isLAN() && is_server) ||
@@ -848,8 +888,14 @@ void STKHost::mainLoop(ProcessType pt)
             m_upload_speed.store(getNetwork()->getENetHost()->totalSentData);
             m_download_speed.store(
                 getNetwork()->getENetHost()->totalReceivedData);
+            sent_bytes.increase(host->totalSentData);
+            received_bytes.increase(host->totalReceivedData);
+            sent_packets.increase(host->totalSentPackets);
+            received_packets.increase(host->totalReceivedPackets);
             getNetwork()->getENetHost()->totalSentData = 0;
             getNetwork()->getENetHost()->totalReceivedData = 0;
+            host->totalSentPackets = 0;
+            host->totalReceivedPackets = 0;
         }
 
         auto sl = LobbyProtocol::get<ServerLobby>();
@@ -1054,7 +1100,7 @@ void STKHost::mainLoop(ProcessType pt)
         }
 
         bool need_ping_update = false;
-        while (enet_host_service(host, &event, 10) != 0)
+        while (service(&event) != 0)
         {
             auto lp = LobbyProtocol::get<LobbyProtocol>();
             if (!is_server &&
@@ -1088,6 +1134,7 @@ void STKHost::mainLoop(ProcessType pt)
                 m_peers[event.peer] = stk_peer;
                 size_t new_peer_count = m_peers.size();
                 lock.unlock();
+                peers_gauge.set(new_peer_count);
                 stk_event = new Event(&event, stk_peer);
                 Log::info("STKHost", "%s has just connected. There are "
                     "now %u peers.", stk_peer->getAddress().toString().c_str(),
@@ -1120,6 +1167,7 @@ void STKHost::mainLoop(ProcessType pt)
                     m_peers.erase(event.peer);
                     new_peer_count = m_peers.size();
                 }
+                peers_gauge.set(new_peer_count);
                 Log::info("STKHost", "%s has just disconnected. There are "
                     "now %u peers.", addr.c_str(), new_peer_count);
             }   // ENET_EVENT_TYPE_DISCONNECT
@@ -1249,7 +1297,7 @@ void STKHost::handleDirectSocketRequest(Network* direct_socket,
     int len = direct_socket->receiveRawPacket(buffer, LEN, &sender, 1);
     if(len<=0) return;
     BareNetworkString message(buffer, len);
-    std::string command;
+    NetworkStringView command;
     message.decodeString(&command);
     const std::string connection_cmd = std::string("connection-request") +
         StringUtils::toString(getPrivatePort());
@@ -1338,6 +1386,64 @@ std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
     return m_peers.begin()->second;
 }   // getServerPeerForClient
 
+//-----------------------------------------------------------------------------
+/** Creates the packets of a message sent to several peers. Encryption is
+ *  done per peer, so it is split between the threads of the pool if one is
+ *  given.
+ *  \param packets Receives the packet of each peer, NULL for peers which
+ *  are disconnected.
+ */
+void STKHost::createPackets(ThreadPool* pool,
+                            const std::vector<STKPeer*>& peers,
+                            NetworkString* data, bool reliable,
+                            std::vector<ENetPacket*>* packets)
+{
+    packets->resize(peers.size());
+    auto create = [&peers, data, reliable, packets](unsigned i)
+    {
+        (*packets)[i] = peers[i]->createPacket(data, reliable,
+            /*encrypted*/true);
+    };
+    if (pool)
+        pool->parallelFor((unsigned)peers.size(), create);
+    else
+    {
+        for (unsigned i = 0; i < peers.size(); i++)
+            create(i);
+    }
+}   // createPackets
+
+//-----------------------------------------------------------------------------
+/** Sends the same data to several peers. The packets are created in
+ *  parallel and then given to the listening thread all at once. The caller
+ *  must make sure that the peers are not deleted during this call, either
+ *  by locking m_peers_mutex or by holding shared pointers to them.
+ */
+void STKHost::sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                                NetworkString* data, bool reliable)
+{
+    // Waking up the pool costs several microseconds, more than encrypting
+    // a few KB with AES-NI
+    if (!m_send_pool ||
+        peers.size() * data->getTotalSize() < PARALLEL_SEND_MIN_BYTES)
+    {
+        for (STKPeer* peer : peers)
+            peer->sendPacket(data, reliable);
+        return;
+    }
+    std::vector<ENetPacket*> packets;
+    createPackets(m_send_pool.get(), peers, data, reliable, &packets);
+    std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        if (!packets[i])
+            continue;
+        m_enet_cmd.emplace_back(peers[i]->getENetPeer(), packets[i],
+            EVENT_CHANNEL_NORMAL, ECT_SEND_PACKET,
+            peers[i]->getENetAddress());
+    }
+}   // sendPacketToPeers
+
 //-----------------------------------------------------------------------------
 /** Sends data to all validated peers currently in server
  *  \param data Data to sent.
@@ -1346,11 +1452,13 @@ std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1361,11 +1469,13 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1378,15 +1488,17 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
         }
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1399,14 +1511,16 @@ void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersWith
 
 //-----------------------------------------------------------------------------
@@ -1638,3 +1752,87 @@ uint16_t STKHost::getPrivatePort() const
 {
     return m_network->getPort();
 }  // getPrivatePort
+
+// ----------------------------------------------------------------------------
+/** Measures how long it takes to create the encrypted packets of game states
+ *  of different sizes for different numbers of peers, on the calling thread
+ *  only and with a pool of send threads. From this it estimates the total
+ *  broadcast size above which the pool is faster, which is what
+ *  PARALLEL_SEND_MIN_BYTES should be set to: the time spent in the pool which
+ *  the serial loop doesn't spend is the cost of waking it up, and the pool
+ *  saves the part of the serial encryption time done by the send threads.
+ */
+void STKHost::benchmark()
+{
+    const int broadcasts = 2000;
+    ThreadPool pool(2, "SendPackets");
+    std::mt19937 random(42);
+    double total_overhead = 0.0, total_bytes = 0.0, total_serial = 0.0;
+    int measurements = 0;
+
+    for (unsigned state_size : { 256, 1024, 4096 })
+    {
+        NetworkString state(PROTOCOL_GAME_EVENTS, state_size);
+        for (unsigned i = 0; i < state_size; i++)
+            state.addUInt8((uint8_t)random());
+
+        for (unsigned peer_count : { 1, 2, 4, 8, 16, 32, 64 })
+        {
+            std::vector<ENetPeer> enet_peers(peer_count);
+            memset(enet_peers.data(), 0, sizeof(ENetPeer) * peer_count);
+            std::vector<std::unique_ptr<STKPeer> > stk_peers;
+            std::vector<STKPeer*> peers;
+            for (unsigned i = 0; i < peer_count; i++)
+            {
+                std::vector<uint8_t> key(16), iv(12);
+                for (uint8_t& k : key)
+                    k = (uint8_t)random();
+                for (uint8_t& v : iv)
+                    v = (uint8_t)random();
+                stk_peers.emplace_back(new STKPeer(&enet_peers[i], NULL, i));
+                stk_peers.back()->setCrypto(
+                    std::unique_ptr<Crypto>(new Crypto(key, iv)));
+                peers.push_back(stk_peers.back().get());
+            }
+
+            double times[2];
+            for (int parallel = 0; parallel < 2; parallel++)
+            {
+                std::vector<ENetPacket*> packets;
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < broadcasts; i++)
+                {
+                    createPackets(parallel ? &pool : NULL, peers, &state,
+                        /*reliable*/false, &packets);
+                    for (ENetPacket* packet : packets)
+                        enet_packet_destroy(packet);
+                }
+                std::chrono::duration<double> time =
+                    std::chrono::steady_clock::now() - start;
+                times[parallel] = time.count() * 1e6 / broadcasts;
+            }
+            const unsigned bytes = peer_count * state.getTotalSize();
+            Log::info("STKHost", "%5d bytes to %2d peers (%6d total): "
+                "%7.1f us per broadcast in the game thread, %7.1f us with "
+                "%d send threads.", state.getTotalSize(), peer_count, bytes,
+                times[0], times[1], pool.getThreadCount());
+            total_serial += times[0];
+            total_bytes += bytes;
+            // With a single core the pool does the same work as the game
+            // thread, so the difference is its overhead. With more cores
+            // the overhead is hidden by the parallel work and estimated low
+            total_overhead += std::max(times[1] - times[0], 0.0);
+            measurements++;
+        }
+    }
+    // The pool saves the share of the serial time done by the send threads,
+    // so it is faster once that share is bigger than the overhead
+    const double us_per_byte = total_serial / total_bytes;
+    const double overhead = total_overhead / measurements;
+    const unsigned threads = pool.getThreadCount();
+    const double share = (double)threads / (threads + 1);
+    Log::info("STKHost", "Encryption costs %.4f us per byte, waking up the "
+        "pool %.1f us: broadcasts are faster with the pool above about %.0f "
+        "bytes, PARALLEL_SEND_MIN_BYTES is %d.", us_per_byte, overhead,
+        overhead / (us_per_byte * share), (int)PARALLEL_SEND_MIN_BYTES);
+}   // benchmark
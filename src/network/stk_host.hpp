@@ -59,6 +59,7 @@ class ServerLobby;
 class ChildLoop;
 class SocketAddress;
 class STKPeer;
+class ThreadPool;
 
 using namespace irr;
 
@@ -157,6 +158,13 @@ private:
 
     std::unique_ptr<NetworkTimerSynchronizer> m_nts;
 
+    /** Encrypts packets sent to several peers in parallel (server only). */
+    std::unique_ptr<ThreadPool> m_send_pool;
+
+    /** Broadcasts with less data than this in total (peers x packet size)
+     *  are encrypted in the calling thread, see STKHost::benchmark(). */
+    static constexpr size_t PARALLEL_SEND_MIN_BYTES = 16384;
+
     // ------------------------------------------------------------------------
     STKHost(bool server);
     // ------------------------------------------------------------------------
@@ -164,6 +172,11 @@ private:
     // ------------------------------------------------------------------------
     void init();
     // ------------------------------------------------------------------------
+    static void createPackets(ThreadPool* pool,
+                              const std::vector<STKPeer*>& peers,
+                              NetworkString* data, bool reliable,
+                              std::vector<ENetPacket*>* packets);
+    // ------------------------------------------------------------------------
     void handleDirectSocketRequest(Network* direct_socket,
                                    std::shared_ptr<ServerLobby> sl,
                                    std::map<std::string, uint64_t>& ctp);
@@ -272,6 +285,11 @@ public:
     void sendPacketExcept(STKPeer* peer, NetworkString *data,
                           bool reliable = true);
     // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                           NetworkString* data, bool reliable = true);
+    // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
     void setupClient(int peer_count, int channel_limit,
                      uint32_t max_incoming_bandwidth,
                      uint32_t max_outgoing_bandwidth);
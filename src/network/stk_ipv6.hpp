@@ -16,6 +16,7 @@
 //  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <enet/enet.h>
+#include <array>
 #include <string>
 
 #ifdef __cplusplus
@@ -34,3 +35,5 @@ std::string getIPV6ReadableFromIn6(const struct sockaddr_in6* in);
 bool sameIPV6(const struct sockaddr_in6* in_1,
               const struct sockaddr_in6* in_2);
 bool isIPv4MappedAddress(const struct sockaddr_in6* in6);
+bool getIPv6CIDRRange(const char* ipv6_cidr, std::array<uint8_t, 16>* start,
+                      std::array<uint8_t, 16>* end);
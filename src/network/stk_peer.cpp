@@ -22,6 +22,7 @@
 #include "network/crypto.hpp"
 #include "network/event.hpp"
 #include "network/network.hpp"
+#include "network/network_buffer_pool.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/socket_address.hpp"
@@ -95,15 +96,20 @@ void STKPeer::reset()
 }   // reset
 
 //-----------------------------------------------------------------------------
-/** Sends a packet to this host.
+/** Creates the packet sent by sendPacket, and encrypts it if needed. It
+ *  doesn't change the peer, so it can be called for different peers in
+ *  parallel (see STKHost::sendPacketToPeers).
  *  \param data The data to send.
  *  \param reliable If the data is sent reliable or not.
  *  \param encrypted If the data is sent encrypted or not.
+ *  \return The packet, or NULL if the peer is disconnected or encryption
+ *  failed.
  */
-void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+ENetPacket* STKPeer::createPacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
 {
     if (m_disconnected.load())
-        return;
+        return NULL;
 
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
@@ -112,21 +118,34 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
     }
     else
     {
-        packet = enet_packet_create(data->getData(),
-            data->getTotalSize(), (reliable ?
-            ENET_PACKET_FLAG_RELIABLE :
+        packet = NetworkBufferPool::createPacket(data->getTotalSize(),
+            (reliable ? ENET_PACKET_FLAG_RELIABLE :
             (ENET_PACKET_FLAG_UNSEQUENCED |
             ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+        if (packet)
+            memcpy(packet->data, data->getData(), data->getTotalSize());
+    }
+
+    if (packet && Network::m_connection_debug)
+    {
+        Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
+            packet->dataLength, getAddress().toString().c_str(),
+            StkTime::getRealTime());
     }
+    return packet;
+}   // createPacket
 
+//-----------------------------------------------------------------------------
+/** Sends a packet to this host.
+ *  \param data The data to send.
+ *  \param reliable If the data is sent reliable or not.
+ *  \param encrypted If the data is sent encrypted or not.
+ */
+void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+{
+    ENetPacket* packet = createPacket(data, reliable, encrypted);
     if (packet)
     {
-        if (Network::m_connection_debug)
-        {
-            Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
-                packet->dataLength, getAddress().toString().c_str(),
-                StkTime::getRealTime());
-        }
         m_host->addEnetCommand(m_enet_peer, packet,
                 encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
                 ECT_SEND_PACKET, m_address);
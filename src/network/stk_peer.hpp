@@ -136,6 +136,9 @@ public:
     // ------------------------------------------------------------------------
     ~STKPeer();
     // ------------------------------------------------------------------------
+    ENetPacket* createPacket(NetworkString *data, bool reliable,
+                             bool encrypted);
+    // ------------------------------------------------------------------------
     void sendPacket(NetworkString *data, bool reliable = true,
                     bool encrypted = true);
     // ------------------------------------------------------------------------
@@ -221,6 +224,8 @@ public:
     // ------------------------------------------------------------------------
     ENetPeer* getENetPeer() const                       { return m_enet_peer; }
     // ------------------------------------------------------------------------
+    const ENetAddress& getENetAddress() const             { return m_address; }
+    // ------------------------------------------------------------------------
     void setWaitingForGame(bool val)         { m_waiting_for_game.store(val); }
     // ------------------------------------------------------------------------
     bool isWaitingForGame() const         { return m_waiting_for_game.load(); }
@@ -1,9 +1,11 @@
 #include "network/tls.hpp"
 #include "io/file_manager.hpp"
 
-TLSConnection::TLSConnection() : m_initialized(false)
+TLSConnection::TLSConnection() : m_initialized(false), m_use_tls(true)
 {
 #ifdef ENABLE_CRYPTO_OPENSSL
+    m_ssl = nullptr;
+    m_socket = -1;
     SSL_library_init();
     SSL_load_error_strings();
     OpenSSL_add_all_algorithms();
@@ -84,8 +86,9 @@ TLSConnection::~TLSConnection()
 #endif
 }
 
-bool TLSConnection::connect(const SocketAddress& addr)
+bool TLSConnection::connect(const SocketAddress& addr, bool use_tls)
 {
+    m_use_tls = use_tls;
 #ifdef ENABLE_CRYPTO_OPENSSL
     // Get string representation of IP address without port
     std::string ip_str = addr.toString(false);
@@ -121,6 +124,20 @@ bool TLSConnection::connect(const SocketAddress& addr)
                    addr.toString().c_str(), strerror(errno));
         return false;
     }
+    // Don't block the sending thread forever on a stalled endpoint
+    struct timeval timeout;
+    timeout.tv_sec = 10;
+    timeout.tv_usec = 0;
+    setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int set = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+#endif
+    if (!m_use_tls) {
+        m_initialized = true;
+        return true;
+    }
 
     m_ssl = SSL_new(m_ctx);
     if (!m_ssl) {
@@ -168,6 +185,10 @@ bool TLSConnection::connect(const SocketAddress& addr)
         Log::error("TLSConnection", "Failed to connect socket");
         return false;
     }
+    if (!m_use_tls) {
+        m_initialized = true;
+        return true;
+    }
     
     mbedtls_ssl_set_bio(&m_ssl, &m_server_fd,
         mbedtls_net_send, mbedtls_net_recv, nullptr);
@@ -201,7 +222,8 @@ void TLSConnection::disconnect()
         m_socket = -1;
     }
 #elif defined(ENABLE_CRYPTO_MBEDTLS)
-    mbedtls_ssl_close_notify(&m_ssl);
+    if (m_use_tls)
+        mbedtls_ssl_close_notify(&m_ssl);
     mbedtls_net_free(&m_server_fd);
 #endif
 
@@ -213,8 +235,37 @@ bool TLSConnection::sendData(const std::string& data)
     if (!m_initialized) return false;
     
 #ifdef ENABLE_CRYPTO_OPENSSL
+    if (!m_use_tls) {
+        size_t sent = 0;
+        while (sent < data.length()) {
+#ifdef MSG_NOSIGNAL
+            int flags = MSG_NOSIGNAL;
+#else
+            int flags = 0;
+#endif
+            ssize_t ret = ::send(m_socket, data.c_str() + sent,
+                data.length() - sent, flags);
+            if (ret <= 0)
+                return false;
+            sent += (size_t)ret;
+        }
+        return true;
+    }
     return SSL_write(m_ssl, data.c_str(), data.length()) > 0;
 #elif defined(ENABLE_CRYPTO_MBEDTLS)
+    if (!m_use_tls) {
+        size_t sent = 0;
+        while (sent < data.length()) {
+            int ret = mbedtls_net_send(&m_server_fd,
+                (const unsigned char*)data.c_str() + sent,
+                data.length() - sent);
+            if (ret <= 0 && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+                return false;
+            if (ret > 0)
+                sent += (size_t)ret;
+        }
+        return true;
+    }
     int ret;
     while ((ret = mbedtls_ssl_write(&m_ssl, 
         (const unsigned char*)data.c_str(), data.length())) <= 0) {
@@ -233,11 +284,24 @@ bool TLSConnection::receiveData(std::string& data, size_t length)
     
     std::vector<char> buffer(length);
 #ifdef ENABLE_CRYPTO_OPENSSL
+    if (!m_use_tls) {
+        ssize_t received = ::recv(m_socket, buffer.data(), length, 0);
+        if (received <= 0) return false;
+        data.assign(buffer.data(), received);
+        return true;
+    }
     int received = SSL_read(m_ssl, buffer.data(), length);
     if (received <= 0) return false;
     data.assign(buffer.data(), received);
 #elif defined(ENABLE_CRYPTO_MBEDTLS)
     int ret;
+    if (!m_use_tls) {
+        ret = mbedtls_net_recv(&m_server_fd,
+            (unsigned char*)buffer.data(), length);
+        if (ret <= 0) return false;
+        data.assign(buffer.data(), ret);
+        return true;
+    }
     while ((ret = mbedtls_ssl_read(&m_ssl, 
         (unsigned char*)buffer.data(), length)) <= 0) {
         if (ret != MBEDTLS_ERR_SSL_WANT_READ && 
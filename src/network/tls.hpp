@@ -1,5 +1,5 @@
-#ifndef HEADER_TLS_HPP
-#define HEADER_TLS_HPP
+#ifndef HEADER_NETWORK_TLS_HPP
+#define HEADER_NETWORK_TLS_HPP
 
 #include "network/socket_address.hpp"
 #include "utils/log.hpp"
@@ -32,12 +32,14 @@ private:
     mbedtls_net_context m_server_fd;
 #endif
     bool m_initialized;
+    /** False for plain TCP connections (http:// endpoints). */
+    bool m_use_tls;
 
 public:
     TLSConnection();
     ~TLSConnection();
     
-    bool connect(const SocketAddress& addr);
+    bool connect(const SocketAddress& addr, bool use_tls = true);
     void disconnect();
     bool sendData(const std::string& data);
     bool receiveData(std::string& data, size_t length);
@@ -33,7 +33,7 @@
 #define ROLLING_INFLUENCE_FIX
 
 // ============================================================================
-btKart::btKart(btRigidBody* chassis, btVehicleRaycaster* raycaster,
+btKart::btKart(btRigidBody* chassis, btKartRaycaster* raycaster,
                Kart *kart)
       : m_vehicleRaycaster(raycaster), m_fixed_body(0, 0, 0)
 {
@@ -224,31 +224,40 @@ void btKart::updateAllWheelTransformsWS()
 
     m_num_wheels_on_ground       = 0;
     m_visual_wheels_touch_ground = true;
+    unsigned int missed = 0;
+    rayCast((1 << m_wheelInfo.size()) - 1);
     for (int i=0;i<m_wheelInfo.size();i++)
     {
-        rayCast( i);
         if(m_wheelInfo[i].m_raycastInfo.m_isInContact)
             m_num_wheels_on_ground++;
         else
-        {
-            // If the original raycast did not hit the ground,
-            // try a little bit (5%) closer to the centre of the chassis.
-            // Some tracks have very minor gaps that would otherwise
-            // trigger odd physical behaviour.
-            rayCast(i, 0.95f);
-            if (m_wheelInfo[i].m_raycastInfo.m_isInContact)
-                m_num_wheels_on_ground++;
-        }
+            missed |= 1 << i;
+    }
+    if (missed == 0)
+        return;
+
+    // If the original raycast did not hit the ground,
+    // try a little bit (5%) closer to the centre of the chassis.
+    // Some tracks have very minor gaps that would otherwise
+    // trigger odd physical behaviour.
+    rayCast(missed, 0.95f);
+    for (int i=0;i<m_wheelInfo.size();i++)
+    {
+        if ((missed & (1 << i)) && m_wheelInfo[i].m_raycastInfo.m_isInContact)
+            m_num_wheels_on_ground++;
     }
 }   // updateAllWheelTransformsWS
 
 // ----------------------------------------------------------------------------
-/**
+/** Casts the suspension rays of some wheels. The rays are cast together with
+ *  btKartRaycaster::castRays, which tests them against the track mesh as a
+ *  packet.
+ *  \param wheels Bit mask of the wheels to cast the rays of.
+ *  \param fraction Moves the start of the rays towards the centre of the
+ *         chassis if less than 1.
  */
-btScalar btKart::rayCast(unsigned int index, float fraction)
+void btKart::rayCast(unsigned int wheels, float fraction)
 {
-    btWheelInfo &wheel = m_wheelInfo[index];
-
     // Work around a bullet problem: when using a convex hull the raycast
     // would sometimes hit the chassis (which does not happen when using a
     // box shape). Therefore set the collision mask in the chassis body so
@@ -261,26 +270,72 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
     }
 
-    updateWheelTransformsWS(wheel, getChassisWorldTransform(), false, fraction);
-
-    btScalar max_susp_len = wheel.getSuspensionRestLength()
-                          + wheel.m_maxSuspensionTravel;
+    btAssert(m_vehicleRaycaster);
 
-    // Do a slightly longer raycast to see if the kart might soon hit the 
-    // ground and some 'cushioning' is needed to avoid that the chassis
-    // hits the ground.
-    btScalar raylen = max_susp_len + 0.5f;
+    // Karts have four wheels, so one batch is usually enough. The rays of
+    // all karts are not cast together: each kart must skip its own chassis,
+    // and the rays of missed wheels are cast again depending on the results.
+    const unsigned int batch_size = 4;
+    int index[batch_size];
+    btVector3 source[batch_size], target[batch_size];
+    btVehicleRaycaster::btVehicleRaycasterResult ray_results[batch_size];
+    void* objects[batch_size];
+    unsigned int count = 0;
+    for (int i = 0; i < m_wheelInfo.size(); i++)
+    {
+        if (wheels & (1 << i))
+        {
+            btWheelInfo &wheel = m_wheelInfo[i];
+            updateWheelTransformsWS(wheel, getChassisWorldTransform(), false,
+                                    fraction);
+
+            // Do a slightly longer raycast to see if the kart might soon hit
+            // the ground and some 'cushioning' is needed to avoid that the
+            // chassis hits the ground.
+            btScalar raylen = wheel.getSuspensionRestLength()
+                            + wheel.m_maxSuspensionTravel + 0.5f;
+            btVector3 rayvector =
+                wheel.m_raycastInfo.m_wheelDirectionWS * raylen;
+            source[count] = wheel.m_raycastInfo.m_hardPointWS;
+            target[count] = source[count] + rayvector;
+            wheel.m_raycastInfo.m_contactPointWS = target[count];
+            ray_results[count] = btVehicleRaycaster::btVehicleRaycasterResult();
+            index[count++] = i;
+        }
+        if (count < batch_size && i + 1 < m_wheelInfo.size())
+            continue;
 
-    btVector3 rayvector = wheel.m_raycastInfo.m_wheelDirectionWS * (raylen);
-    const btVector3& source = wheel.m_raycastInfo.m_hardPointWS;
-    wheel.m_raycastInfo.m_contactPointWS = source + rayvector;
-    const btVector3& target = wheel.m_raycastInfo.m_contactPointWS;
+        m_vehicleRaycaster->castRays(count, source, target, ray_results,
+                                     objects);
+        for (unsigned int j = 0; j < count; j++)
+            updateWheelContact(index[j], objects[j], ray_results[j]);
+        count = 0;
+    }
 
-    btVehicleRaycaster::btVehicleRaycasterResult rayResults;
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
+            = old_group;
+    }
+}   // rayCast
 
-    btAssert(m_vehicleRaycaster);
+// ----------------------------------------------------------------------------
+/** Updates the suspension and contact information of a wheel from the
+ *  result of its raycast.
+ *  \param index Index of the wheel.
+ *  \param object The object hit by the ray, or NULL.
+ *  \param rayResults The result of the raycast.
+ *  \return The distance from the wheel to the ground, or -1 if the ground
+ *          is too far away.
+ */
+btScalar btKart::updateWheelContact(unsigned int index, void* object,
+                  const btVehicleRaycaster::btVehicleRaycasterResult& rayResults)
+{
+    btWheelInfo &wheel = m_wheelInfo[index];
 
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+    btScalar max_susp_len = wheel.getSuspensionRestLength()
+                          + wheel.m_maxSuspensionTravel;
+    btScalar raylen = max_susp_len + 0.5f;
 
     wheel.m_raycastInfo.m_groundObject = 0;
 
@@ -348,15 +403,9 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         wheel.m_clippedInvContactDotSuspension = btScalar(1.0);
     }
 
-    if(m_chassisBody->getBroadphaseHandle())
-    {
-        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
-            = old_group;
-    }
-
     return depth;
 
-}   // rayCast
+}   // updateWheelContact
 
 // ----------------------------------------------------------------------------
 /** Returns the contact point of a visual wheel.
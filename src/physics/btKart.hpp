@@ -69,7 +69,7 @@ private:
     btScalar calcRollingFriction(btWheelContactPoint& contactPoint);
 
     btScalar            m_damping;
-    btVehicleRaycaster *m_vehicleRaycaster;
+    btKartRaycaster    *m_vehicleRaycaster;
 
     /** Sliding (skidding) will only be permited when this is true. Also check
      *  the friction parameter in the wheels since friction directly affects
@@ -126,6 +126,8 @@ private:
 
     void     defaultInit();
     btScalar rayCast(btWheelInfo& wheel, const btVector3& ray);
+    btScalar updateWheelContact(unsigned int index, void* object,
+                const btVehicleRaycaster::btVehicleRaycasterResult& rayResults);
     void     updateWheelTransformsWS(btWheelInfo& wheel,
                                      btTransform chassis_trans,
                                      bool interpolatedTransform=true,
@@ -140,13 +142,13 @@ public:
      *         (this is used to get access to the kart properties).
      */
                        btKart(btRigidBody* chassis,
-                              btVehicleRaycaster* raycaster,
+                              btKartRaycaster* raycaster,
                               Kart *kart);
      virtual          ~btKart();
     void               reset();
     void               debugDraw(btIDebugDraw* debugDrawer);
     const btTransform& getChassisWorldTransform() const;
-    btScalar           rayCast(unsigned int index, float fraction=1.0f);
+    void               rayCast(unsigned int wheels, float fraction=1.0f);
     virtual void       updateVehicle(btScalar step);
     void               resetSuspension();
     btScalar           getSteeringValue(int wheel) const;
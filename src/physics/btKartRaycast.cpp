@@ -13,54 +13,442 @@
 #include "btKartRaycast.hpp"
 
 #include "BulletCollision/CollisionDispatch/btCollisionWorld.h"
+#include "BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
 #include "BulletDynamics/Dynamics/btDynamicsWorld.h"
+#include "btBulletDynamicsCommon.h"
 
 #include "modes/world.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
+#include "utils/log.hpp"
 
-void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
-                               btVehicleRaycasterResult& result)
+#include <simd_wrapper.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+// ============================================================================
+class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
 {
-    // ========================================================================
-    class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
-    {
-    private:
-        int m_triangle_index;
-    public:
-        /** Constructor, initialises the triangle index. */
-        ClosestWithNormal(const btVector3 &from,
-                          const btVector3 &to)
-                          : btCollisionWorld::ClosestRayResultCallback(from,to)
-        {
-            m_triangle_index = -1;
-        }   // CloestWithNormal
-        // --------------------------------------------------------------------
-        /** Stores the index of the triangle hit. */
-        virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
-                                         bool normalInWorldSpace)
-        {
-            // We don't always get a triangle index, sometimes (e.g. ray hits
-            // other kart) we get shapePart=-1, or no localShapeInfo at all
-            if(rayResult.m_localShapeInfo &&
-                rayResult.m_localShapeInfo->m_shapePart>-1)
-                m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
-            return
-                btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
-                normalInWorldSpace);
-        }
-        // --------------------------------------------------------------------
-        /** Returns the index of the triangle which was hit, or -1 if
-         *  no triangle was hit. */
-        int getTriangleIndex() const { return m_triangle_index; }
-
-    };   // CloestWithNormal
-    // ========================================================================
+private:
+    int m_triangle_index;
+    /** An object that the broadphase should not test anymore, because its
+     *  hits were already added by castRays. */
+    const btCollisionObject *m_skip_object;
+public:
+    /** Constructor, initialises the triangle index. */
+    ClosestWithNormal(const btVector3 &from, const btVector3 &to)
+                     : btCollisionWorld::ClosestRayResultCallback(from,to)
+    {
+        m_triangle_index = -1;
+        m_skip_object    = NULL;
+    }   // CloestWithNormal
+    // ------------------------------------------------------------------------
+    /** Constructor for arrays of callbacks, init() must be called before
+     *  using it. */
+    ClosestWithNormal()
+        : btCollisionWorld::ClosestRayResultCallback(btVector3(0, 0, 0),
+                                                     btVector3(0, 0, 0))
+    {
+        m_triangle_index = -1;
+        m_skip_object    = NULL;
+    }   // CloestWithNormal
+    // ------------------------------------------------------------------------
+    /** Resets this callback for a new ray. */
+    void init(const btVector3 &from, const btVector3 &to)
+    {
+        m_rayFromWorld       = from;
+        m_rayToWorld         = to;
+        m_closestHitFraction = btScalar(1.);
+        m_collisionObject    = NULL;
+        m_triangle_index     = -1;
+        m_skip_object        = NULL;
+    }   // init
+    // ------------------------------------------------------------------------
+    void setSkipObject(const btCollisionObject *o)     { m_skip_object = o; }
+    // ------------------------------------------------------------------------
+    virtual bool needsCollision(btBroadphaseProxy* proxy) const
+    {
+        if (proxy->m_clientObject == m_skip_object)
+            return false;
+        return
+            btCollisionWorld::ClosestRayResultCallback::needsCollision(proxy);
+    }   // needsCollision
+    // ------------------------------------------------------------------------
+    /** Stores the index of the triangle hit. */
+    virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
+                                     bool normalInWorldSpace)
+    {
+        // We don't always get a triangle index, sometimes (e.g. ray hits
+        // other kart) we get shapePart=-1, or no localShapeInfo at all
+        if(rayResult.m_localShapeInfo &&
+            rayResult.m_localShapeInfo->m_shapePart>-1)
+            m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
+        return
+            btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
+            normalInWorldSpace);
+    }
+    // ------------------------------------------------------------------------
+    /** Returns the index of the triangle which was hit, or -1 if
+     *  no triangle was hit. */
+    int getTriangleIndex() const { return m_triangle_index; }
 
-    ClosestWithNormal rayCallback(from,to);
+};   // CloestWithNormal
 
-    m_dynamicsWorld->rayTest(from, to, rayCallback);
+// ============================================================================
+/** Passes the triangle hits of one ray of a packet to its result callback,
+ *  the same way as the callback in btCollisionWorld::rayTestSingle.
+ */
+class PacketTriangleCallback : public btTriangleRaycastCallback
+{
+public:
+    ClosestWithNormal *m_result;
+    btCollisionObject *m_object;
+    btMatrix3x3        m_basis;
+
+    PacketTriangleCallback()
+        : btTriangleRaycastCallback(btVector3(0, 0, 0), btVector3(0, 0, 0))
+    {
+        m_result = NULL;
+        m_object = NULL;
+    }   // PacketTriangleCallback
+    // ------------------------------------------------------------------------
+    virtual btScalar reportHit(const btVector3& hitNormalLocal,
+                               btScalar hitFraction, int partId,
+                               int triangleIndex)
+    {
+        btCollisionWorld::LocalShapeInfo shape_info;
+        shape_info.m_shapePart     = partId;
+        shape_info.m_triangleIndex = triangleIndex;
+        btVector3 normal = m_basis * hitNormalLocal;
+        btCollisionWorld::LocalRayResult result(m_object, &shape_info, normal,
+                                                hitFraction);
+        return m_result->addSingleResult(result, /*normalInWorldSpace*/true);
+    }   // reportHit
+};   // PacketTriangleCallback
+
+// ----------------------------------------------------------------------------
+/** Fetches a triangle of a mesh like btBvhTriangleMeshShape::performRaycast
+ *  does, and tests it against a ray.
+ */
+void processTriangle(btStridingMeshInterface *mesh, int part, int index,
+                     PacketTriangleCallback *callback)
+{
+    const unsigned char *vertex_base;
+    const unsigned char *index_base;
+    int num_verts, stride, index_stride, num_faces;
+    PHY_ScalarType type, indices_type;
+    mesh->getLockedReadOnlyVertexIndexBase(&vertex_base, num_verts, type,
+                                           stride, &index_base, index_stride,
+                                           num_faces, indices_type, part);
+
+    const unsigned int *gfx_base =
+        (const unsigned int*)(index_base + index * index_stride);
+    const btVector3 &scaling = mesh->getScaling();
+    btVector3 triangle[3];
+    for (int j = 2; j >= 0; j--)
+    {
+        int graphics_index = indices_type == PHY_SHORT ?
+            ((const unsigned short*)gfx_base)[j] : gfx_base[j];
+        if (type == PHY_FLOAT)
+        {
+            const float *v =
+                (const float*)(vertex_base + graphics_index * stride);
+            triangle[j] = btVector3(v[0] * scaling.getX(),
+                                    v[1] * scaling.getY(),
+                                    v[2] * scaling.getZ());
+        }
+        else
+        {
+            const double *v =
+                (const double*)(vertex_base + graphics_index * stride);
+            triangle[j] = btVector3(btScalar(v[0]) * scaling.getX(),
+                                    btScalar(v[1]) * scaling.getY(),
+                                    btScalar(v[2]) * scaling.getZ());
+        }
+    }
+    callback->processTriangle(triangle, part, index);
+    mesh->unLockReadOnlyVertexBase(part);
+}   // processTriangle
+
+// ----------------------------------------------------------------------------
+/** Casts up to four rays against the quantized BVH of a triangle mesh.
+ *  Every ray tests the same triangles in the same order as it would in
+ *  btQuantizedBvh::walkStacklessQuantizedTreeAgainstRay, so the hits are
+ *  identical to bullet's. The packet always continues with the lowest node
+ *  index any of its rays is waiting for. The wheel rays of a kart are close
+ *  to each other, so they mostly walk the tree together and share loading
+ *  each node, and its box tests are done for all rays at once.
+ *  Unlike bullet, inner nodes are only tested with the quantized box of
+ *  the ray. This visits a few more nodes, but avoids unquantizing and the
+ *  slab test, which make up most of the time per node. The result does not
+ *  change: a box contains the boxes of its children, and the slab test of
+ *  btRayAabb2 is monotonic in the bounds even with rounding, so a ray which
+ *  passes the test of a leaf would have passed the tests of all its
+ *  parents.
+ *  \param object The collision object of the mesh.
+ *  \param results The result callbacks of the rays.
+ *  \param num_rays Number of rays, at most 4.
+ */
+void castPacket(btCollisionObject *object, ClosestWithNormal *results,
+                unsigned int num_rays)
+{
+    btBvhTriangleMeshShape *shape =
+        (btBvhTriangleMeshShape*)object->getCollisionShape();
+    const btQuantizedBvh *bvh = shape->getOptimizedBvh();
+    btStridingMeshInterface *mesh = shape->getMeshInterface();
+    const btQuantizedBvhNode *nodes =
+        &shape->getOptimizedBvh()->getQuantizedNodeArray()[0];
+    // The escape index of the root is the number of nodes in the tree
+    const int num_nodes = nodes[0].isLeafNode() ? 1
+                                                : nodes[0].getEscapeIndex();
+
+    const btTransform &transform = object->getWorldTransform();
+    btTransform world_to_object  = transform.inverse();
+
+    PacketTriangleCallback callbacks[4];
+    float from[3][4], inv_dir[3][4], lambda_max[4];
+    int sign[3][4], quantized_min[3][4], quantized_max[3][4];
+
+    for (unsigned int i = 0; i < num_rays; i++)
+    {
+        ClosestWithNormal &result = results[i];
+        btVector3 ray_from = world_to_object * result.m_rayFromWorld;
+        btVector3 ray_to   = world_to_object * result.m_rayToWorld;
+        PacketTriangleCallback &callback = callbacks[i];
+        callback.m_from        = ray_from;
+        callback.m_to          = ray_to;
+        callback.m_flags       = result.m_flags;
+        callback.m_hitFraction = result.m_closestHitFraction;
+        callback.m_result      = &result;
+        callback.m_object      = object;
+        callback.m_basis       = transform.getBasis();
+
+        // Same setup as in walkStacklessQuantizedTreeAgainstRay
+        btVector3 direction = ray_to - ray_from;
+        direction.normalize();
+        lambda_max[i] = direction.dot(ray_to - ray_from);
+        btVector3 ray_min = ray_from;
+        btVector3 ray_max = ray_from;
+        ray_min.setMin(ray_to);
+        ray_max.setMax(ray_to);
+        unsigned short q_min[3], q_max[3];
+        bvh->quantizeWithClamp(q_min, ray_min, 0);
+        bvh->quantizeWithClamp(q_max, ray_max, 1);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            from[axis][i]    = ray_from[axis];
+            inv_dir[axis][i] = direction[axis] == btScalar(0.0) ?
+                btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / direction[axis];
+            sign[axis][i]    = inv_dir[axis][i] < 0.0 ? -1 : 0;
+            quantized_min[axis][i] = q_min[axis];
+            quantized_max[axis][i] = q_max[axis];
+        }
+    }
+    // Unused lanes copy the first ray, but never visit a node
+    for (unsigned int i = num_rays; i < 4; i++)
+    {
+        lambda_max[i] = lambda_max[0];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            from[axis][i]          = from[axis][0];
+            inv_dir[axis][i]       = inv_dir[axis][0];
+            sign[axis][i]          = sign[axis][0];
+            quantized_min[axis][i] = quantized_min[axis][0];
+            quantized_max[axis][i] = quantized_max[axis][0];
+        }
+    }
+
+#ifdef CPU_SSE2_SUPPORT
+    __m128  v_from[3], v_inv_dir[3], v_sign[3];
+    __m128i v_q_min[3], v_q_max[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        v_from[axis]    = _mm_loadu_ps(from[axis]);
+        v_inv_dir[axis] = _mm_loadu_ps(inv_dir[axis]);
+        v_sign[axis]    = _mm_castsi128_ps(
+            _mm_loadu_si128((const __m128i*)sign[axis]));
+        v_q_min[axis]   = _mm_loadu_si128((const __m128i*)quantized_min[axis]);
+        v_q_max[axis]   = _mm_loadu_si128((const __m128i*)quantized_max[axis]);
+    }
+    const __m128 v_lambda_max = _mm_loadu_ps(lambda_max);
+    const __m128 v_zero       = _mm_setzero_ps();
+    const __m128i v_one       = _mm_set1_epi32(1);
+
+    // The next node of each ray
+    __m128i v_next = _mm_set_epi32(num_rays > 3 ? 0 : num_nodes,
+                                   num_rays > 2 ? 0 : num_nodes,
+                                   num_rays > 1 ? 0 : num_nodes, 0);
+    int current = 0;
+    while (current < num_nodes)
+    {
+        const __m128i v_current = _mm_set1_epi32(current);
+        const __m128i lanes     = _mm_cmpeq_epi32(v_next, v_current);
+        const __m128i v_current_plus_one = _mm_add_epi32(v_current, v_one);
+
+        // testQuantizedAabbAgainstQuantizedAabb
+        const btQuantizedBvhNode *node = nodes + current;
+        __m128i separated = _mm_setzero_si128();
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m128i node_min = _mm_set1_epi32(node->m_quantizedAabbMin[axis]);
+            __m128i node_max = _mm_set1_epi32(node->m_quantizedAabbMax[axis]);
+            separated = _mm_or_si128(separated, _mm_or_si128(
+                _mm_cmpgt_epi32(v_q_min[axis], node_max),
+                _mm_cmpgt_epi32(node_min, v_q_max[axis])));
+        }
+        const __m128i overlap = _mm_andnot_si128(separated, lanes);
+
+        if (node->isLeafNode())
+        {
+            unsigned int hits = (unsigned int)_mm_movemask_ps(
+                                                  _mm_castsi128_ps(overlap));
+            if (hits)
+            {
+                // btRayAabb2, with the same operations in the same order so
+                // that the results are bitwise identical
+                btVector3 bounds[2];
+                bounds[0] = bvh->unQuantize(node->m_quantizedAabbMin);
+                bounds[1] = bvh->unQuantize(node->m_quantizedAabbMax);
+                __m128 t_min[3], t_max[3];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    __m128 t_low = _mm_mul_ps(_mm_sub_ps(
+                        _mm_set1_ps(bounds[0][axis]), v_from[axis]),
+                        v_inv_dir[axis]);
+                    __m128 t_high = _mm_mul_ps(_mm_sub_ps(
+                        _mm_set1_ps(bounds[1][axis]), v_from[axis]),
+                        v_inv_dir[axis]);
+                    t_min[axis] = _mm_or_ps(_mm_and_ps(v_sign[axis], t_high),
+                                            _mm_andnot_ps(v_sign[axis], t_low));
+                    t_max[axis] = _mm_or_ps(_mm_and_ps(v_sign[axis], t_low),
+                                            _mm_andnot_ps(v_sign[axis], t_high));
+                }
+                __m128 tmin = t_min[0];
+                __m128 tmax = t_max[0];
+                __m128 miss = _mm_or_ps(_mm_cmpgt_ps(tmin, t_max[1]),
+                                        _mm_cmpgt_ps(t_min[1], tmax));
+                // _mm_max_ps(a, b) is a > b ? a : b like the branches in
+                // btRayAabb2
+                tmin = _mm_max_ps(t_min[1], tmin);
+                tmax = _mm_min_ps(t_max[1], tmax);
+                miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmpgt_ps(tmin, t_max[2]),
+                                                 _mm_cmpgt_ps(t_min[2], tmax)));
+                tmin = _mm_max_ps(t_min[2], tmin);
+                tmax = _mm_min_ps(t_max[2], tmax);
+                __m128 hit = _mm_andnot_ps(miss,
+                    _mm_and_ps(_mm_cmplt_ps(tmin, v_lambda_max),
+                               _mm_cmpgt_ps(tmax, v_zero)));
+                hits &= (unsigned int)_mm_movemask_ps(hit);
+            }
+            for (unsigned int i = 0; hits; i++, hits >>= 1)
+            {
+                if (hits & 1)
+                {
+                    processTriangle(mesh, node->getPartId(),
+                                    node->getTriangleIndex(), &callbacks[i]);
+                }
+            }
+            // All rays at a leaf continue with the next node, and the other
+            // rays are waiting for later nodes
+            v_next = _mm_or_si128(_mm_and_si128(lanes, v_current_plus_one),
+                                  _mm_andnot_si128(lanes, v_next));
+            current++;
+            continue;
+        }
+
+        // Rays which overlap the node continue with the next node, the others
+        // skip its subtree
+        const __m128i next = _mm_or_si128(
+            _mm_and_si128(overlap, v_current_plus_one),
+            _mm_andnot_si128(overlap, _mm_add_epi32(v_current,
+                _mm_set1_epi32(node->getEscapeIndex()))));
+        v_next = _mm_or_si128(_mm_and_si128(lanes, next),
+                              _mm_andnot_si128(lanes, v_next));
+
+        // If any ray continues with the next node, the packet does too. Using
+        // a branch instead of always computing the minimum lets the CPU load
+        // the next node before the tests of this one are finished, like in
+        // bullet's walk.
+        if (_mm_movemask_ps(_mm_castsi128_ps(overlap)))
+        {
+            current++;
+            continue;
+        }
+        int next_node[4];
+        _mm_storeu_si128((__m128i*)next_node, v_next);
+        current = std::min(std::min(next_node[0], next_node[1]),
+                           std::min(next_node[2], next_node[3]));
+    }
+#else
+    int next_node[4];
+    for (unsigned int i = 0; i < 4; i++)
+        next_node[i] = i < num_rays ? 0 : num_nodes;
+    while (true)
+    {
+        int current = std::min(std::min(next_node[0], next_node[1]),
+                               std::min(next_node[2], next_node[3]));
+        if (current >= num_nodes)
+            break;
 
+        const btQuantizedBvhNode *node = nodes + current;
+        const bool is_leaf = node->isLeafNode();
+        btVector3 bounds[2];
+        bool unquantized = false;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            if (next_node[i] != current)
+                continue;
+            unsigned short q_min[3], q_max[3];
+            unsigned int ray_sign[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                q_min[axis]    = (unsigned short)quantized_min[axis][i];
+                q_max[axis]    = (unsigned short)quantized_max[axis][i];
+                ray_sign[axis] = sign[axis][i] != 0;
+            }
+            bool overlap = testQuantizedAabbAgainstQuantizedAabb(q_min,
+                q_max, node->m_quantizedAabbMin, node->m_quantizedAabbMax);
+            if (overlap && is_leaf)
+            {
+                if (!unquantized)
+                {
+                    bounds[0] = bvh->unQuantize(node->m_quantizedAabbMin);
+                    bounds[1] = bvh->unQuantize(node->m_quantizedAabbMax);
+                    unquantized = true;
+                }
+                btScalar param = 1.0f;
+                if (btRayAabb2(btVector3(from[0][i], from[1][i], from[2][i]),
+                               btVector3(inv_dir[0][i], inv_dir[1][i],
+                                         inv_dir[2][i]),
+                               ray_sign, bounds, param, 0.0f, lambda_max[i]))
+                {
+                    processTriangle(mesh, node->getPartId(),
+                                    node->getTriangleIndex(), &callbacks[i]);
+                }
+            }
+            next_node[i] = overlap || is_leaf ? current + 1
+                                              : current + node->getEscapeIndex();
+        }
+    }
+#endif
+}   // castPacket
+
+// ----------------------------------------------------------------------------
+/** Converts the closest hit of a ray into the result of a vehicle raycast.
+ *  \return The rigid body that was hit, or NULL.
+ */
+void* getRayResult(const ClosestWithNormal &rayCallback, bool smooth_normals,
+                   btVehicleRaycaster::btVehicleRaycasterResult& result)
+{
     if (rayCallback.hasHit())
     {
         btRigidBody* body = btRigidBody::upcast(rayCallback.m_collisionObject);
@@ -81,7 +469,7 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
             // the right triangle mesh for smoothing
             TriangleMesh::RigidBodyTriangleMesh *rbtm =
                 dynamic_cast<TriangleMesh::RigidBodyTriangleMesh*>(body);
-            if(m_smooth_normals &&
+            if(smooth_normals &&
                 rayCallback.getTriangleIndex()>-1 &&
                 rbtm != NULL                         )
             {
@@ -105,5 +493,393 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
         }
     }
     return 0;
-}
+}   // getRayResult
+
+}   // namespace
+
+// ----------------------------------------------------------------------------
+void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
+                               btVehicleRaycasterResult& result)
+{
+    ClosestWithNormal rayCallback(from,to);
+
+    m_dynamicsWorld->rayTest(from, to, rayCallback);
+
+    return getRayResult(rayCallback, m_smooth_normals, result);
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Returns the track object if castRays can traverse its BVH with packets
+ *  of rays, which needs a quantized BVH. Otherwise NULL is returned, and
+ *  the track is tested one ray at a time like all other objects.
+ */
+btCollisionObject* btKartRaycaster::getPacketObject() const
+{
+    if (!m_track_object || !m_track_object->getBroadphaseHandle())
+        return NULL;
+    // Bullet reports hits with non-const objects
+    btCollisionObject *track = const_cast<btCollisionObject*>(m_track_object);
+    btCollisionShape *shape = track->getCollisionShape();
+    if (shape->getShapeType() != TRIANGLE_MESH_SHAPE_PROXYTYPE)
+        return NULL;
+    btBvhTriangleMeshShape *mesh = (btBvhTriangleMeshShape*)shape;
+    if (!mesh->getOptimizedBvh() || !mesh->getOptimizedBvh()->isQuantized() ||
+        mesh->getOptimizedBvh()->getQuantizedNodeArray().size() == 0)
+        return NULL;
+    // The filter of the rays must accept the track, as in rayTest
+    ClosestWithNormal filter;
+    if (!filter.needsCollision(track->getBroadphaseHandle()))
+        return NULL;
+    return track;
+}   // getPacketObject
+
+// ----------------------------------------------------------------------------
+/** Casts several rays, with the same results as calling castRay for each of
+ *  them. The rays are tested against the track mesh in packets of four, and
+ *  then against all other objects one at a time. Rays that are close to
+ *  each other (like the wheel rays of one kart) should be next to each other
+ *  in the arrays.
+ *  \param num_rays Number of rays.
+ *  \param from, to Start and end points of the rays.
+ *  \param results On return the results of the rays that hit an object.
+ *  \param objects On return the objects hit by the rays, or NULL.
+ */
+void btKartRaycaster::castRays(unsigned int num_rays, const btVector3* from,
+                               const btVector3* to,
+                               btVehicleRaycasterResult* results,
+                               void** objects)
+{
+    btCollisionObject *track = getPacketObject();
+    ClosestWithNormal callbacks[4];
+    for (unsigned int first = 0; first < num_rays; first += 4)
+    {
+        unsigned int count = std::min(num_rays - first, 4u);
+        for (unsigned int i = 0; i < count; i++)
+            callbacks[i].init(from[first + i], to[first + i]);
+
+        // Ties between objects are won by the track, since later objects
+        // need to be strictly closer. In bullet's rayTest they are won by
+        // the object the broadphase returns first.
+        if (track)
+        {
+            castPacket(track, callbacks, count);
+            for (unsigned int i = 0; i < count; i++)
+                callbacks[i].setSkipObject(track);
+        }
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            // Like btSingleRayCallback, don't test more objects once the
+            // closest hit is at the start of the ray
+            if (callbacks[i].m_closestHitFraction != btScalar(0.f))
+            {
+                m_dynamicsWorld->rayTest(from[first + i], to[first + i],
+                                         callbacks[i]);
+            }
+            objects[first + i] = getRayResult(callbacks[i], m_smooth_normals,
+                                              results[first + i]);
+        }
+    }
+}   // castRays
+
+// ============================================================================
+namespace
+{
+/** A bumpy terrain mesh with some boxes standing on it, used to compare
+ *  castRays with castRay and to benchmark them.
+ */
+class RaycastTestWorld
+{
+public:
+    btDefaultCollisionConfiguration         m_configuration;
+    btCollisionDispatcher                   m_dispatcher;
+    btDbvtBroadphase                        m_broadphase;
+    btSequentialImpulseConstraintSolver     m_solver;
+    btDiscreteDynamicsWorld                 m_world;
+    btTriangleMesh                          m_mesh;
+    std::unique_ptr<btBvhTriangleMeshShape> m_mesh_shape;
+    btBoxShape                              m_box_shape;
+    std::vector<std::unique_ptr<btRigidBody> > m_bodies;
+    /** Size of the terrain in x and z. */
+    static const int SIZE = 64;
+
+    // ------------------------------------------------------------------------
+    RaycastTestWorld(std::mt19937 *random)
+        : m_dispatcher(&m_configuration),
+          m_world(&m_dispatcher, &m_broadphase, &m_solver, &m_configuration),
+          m_box_shape(btVector3(0.5f, 0.4f, 0.8f))
+    {
+        std::uniform_real_distribution<float> noise(-0.3f, 0.3f);
+        std::vector<btVector3> vertices;
+        for (int x = 0; x <= SIZE; x++)
+        {
+            for (int z = 0; z <= SIZE; z++)
+            {
+                vertices.push_back(btVector3((float)x, getHeight((float)x,
+                    (float)z) + noise(*random), (float)z));
+            }
+        }
+        for (int x = 0; x < SIZE; x++)
+        {
+            for (int z = 0; z < SIZE; z++)
+            {
+                const btVector3 &v0 = vertices[ x      * (SIZE + 1) + z    ];
+                const btVector3 &v1 = vertices[(x + 1) * (SIZE + 1) + z    ];
+                const btVector3 &v2 = vertices[ x      * (SIZE + 1) + z + 1];
+                const btVector3 &v3 = vertices[(x + 1) * (SIZE + 1) + z + 1];
+                m_mesh.addTriangle(v0, v1, v2);
+                m_mesh.addTriangle(v1, v3, v2);
+            }
+        }
+        m_mesh_shape.reset(new btBvhTriangleMeshShape(&m_mesh,
+            /*useQuantizedAabbCompression*/true));
+        addBody(m_mesh_shape.get(), btVector3(0, 0, 0));
+
+        std::uniform_real_distribution<float> position(4.0f, SIZE - 4.0f);
+        for (int i = 0; i < 16; i++)
+        {
+            float x = position(*random), z = position(*random);
+            addBody(&m_box_shape, btVector3(x, getHeight(x, z) + 0.5f, z));
+        }
+    }   // RaycastTestWorld
+    // ------------------------------------------------------------------------
+    ~RaycastTestWorld()
+    {
+        for (auto &body : m_bodies)
+            m_world.removeRigidBody(body.get());
+    }   // ~RaycastTestWorld
+    // ------------------------------------------------------------------------
+    void addBody(btCollisionShape *shape, const btVector3 &position)
+    {
+        btRigidBody::btRigidBodyConstructionInfo info(0.0f, NULL, shape);
+        info.m_startWorldTransform.setIdentity();
+        info.m_startWorldTransform.setOrigin(position);
+        m_bodies.emplace_back(new btRigidBody(info));
+        m_world.addRigidBody(m_bodies.back().get());
+    }   // addBody
+    // ------------------------------------------------------------------------
+    btCollisionObject* getTrackObject() const   { return m_bodies[0].get(); }
+    // ------------------------------------------------------------------------
+    static float getHeight(float x, float z)
+    {
+        return 2.0f * sinf(x * 0.3f) * cosf(z * 0.2f);
+    }   // getHeight
+    // ------------------------------------------------------------------------
+    /** Creates the four wheel rays of a kart at a random position.
+     *  \param exact If true, the rays are vertical and start at integer
+     *         coordinates, i.e. on the edges and vertices of the terrain.
+     */
+    static void createWheelRays(std::mt19937 *random, bool exact,
+                                btVector3 *from, btVector3 *to)
+    {
+        std::uniform_real_distribution<float> position(2.0f, SIZE - 2.0f);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        float x = position(*random), z = position(*random);
+        float angle = unit(*random) * 3.1415926f;
+        btVector3 forward(sinf(angle), 0, cosf(angle));
+        btVector3 right(forward.getZ(), 0, -forward.getX());
+        btVector3 down(0.2f * unit(*random), -1.0f, 0.2f * unit(*random));
+        if (exact)
+        {
+            x = floorf(x);
+            z = floorf(z);
+            forward = btVector3(0, 0, 1);
+            right   = btVector3(1, 0, 0);
+            down    = btVector3(0, -1, 0);
+        }
+        btVector3 center(x, getHeight(x, z) + 0.7f + unit(*random), z);
+        float length = 2.0f + unit(*random);
+        for (int i = 0; i < 4; i++)
+        {
+            from[i] = center + right * (i % 2 ? 1.0f : -1.0f)
+                             + forward * (i / 2 ? 1.0f : -1.0f);
+            to[i] = from[i] + down * length;
+        }
+    }   // createWheelRays
+};   // RaycastTestWorld
+
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Checks that castRays gives exactly the same results as castRay.
+ */
+void btKartRaycaster::unitTesting()
+{
+    // Compares x, y and z bitwise. The w component of hit points is not
+    // initialised by bullet.
+    auto isSame = [](const btVector3 &a, const btVector3 &b)
+    {
+        return a.getX() == b.getX() && a.getY() == b.getY() &&
+               a.getZ() == b.getZ();
+    };
+    std::mt19937 random(42);
+    RaycastTestWorld world(&random);
+    btKartRaycaster raycaster(&world.m_world, /*smooth_normals*/false,
+                              world.getTrackObject());
+    assert(raycaster.getPacketObject() == world.getTrackObject());
+
+    int hits = 0, misses = 0;
+    for (int packet = 0; packet < 4000; packet++)
+    {
+        // Include partial packets
+        unsigned int num_rays = packet % 5 == 4 ? packet % 4 + 1 : 8;
+        btVector3 from[8], to[8];
+        for (unsigned int i = 0; i < num_rays; i += 4)
+        {
+            RaycastTestWorld::createWheelRays(&random, packet % 7 == 0,
+                                              from + i, to + i);
+        }
+        btVehicleRaycasterResult results[8];
+        void *objects[8];
+        raycaster.castRays(num_rays, from, to, results, objects);
+        for (unsigned int i = 0; i < num_rays; i++)
+        {
+            btVehicleRaycasterResult expected;
+            void *object = raycaster.castRay(from[i], to[i], expected);
+            assert(objects[i] == object);
+            // Results of misses are not set
+            if (!object)
+            {
+                misses++;
+                continue;
+            }
+            hits++;
+            assert(isSame(results[i].m_hitPointInWorld,
+                          expected.m_hitPointInWorld));
+            assert(isSame(results[i].m_hitNormalInWorld,
+                          expected.m_hitNormalInWorld));
+            assert(results[i].m_distFraction == expected.m_distFraction);
+            assert(results[i].m_triangle_index == expected.m_triangle_index);
+        }
+    }
+    // Make sure that the test covers hits and misses
+    assert(hits > 0 && misses > 0);
+
+    // Ties at exactly the same fraction: a second object with the same
+    // triangles as the track. castRay returns the object which bullet's
+    // broadphase reports first, castRays always returns the track.
+    {
+        btDefaultCollisionConfiguration configuration;
+        btCollisionDispatcher dispatcher(&configuration);
+        btDbvtBroadphase broadphase;
+        btSequentialImpulseConstraintSolver solver;
+        btDiscreteDynamicsWorld tie_world(&dispatcher, &broadphase, &solver,
+                                          &configuration);
+        btTriangleMesh mesh;
+        mesh.addTriangle(btVector3(0, 0, 0), btVector3(8, 0, 0),
+                         btVector3(0, 0, 8));
+        mesh.addTriangle(btVector3(8, 0, 0), btVector3(8, 0, 8),
+                         btVector3(0, 0, 8));
+        btBvhTriangleMeshShape track_shape(&mesh,
+            /*useQuantizedAabbCompression*/true);
+        btBvhTriangleMeshShape other_shape(&mesh,
+            /*useQuantizedAabbCompression*/true);
+        btRigidBody::btRigidBodyConstructionInfo other_info(0.0f, NULL,
+                                                            &other_shape);
+        btRigidBody::btRigidBodyConstructionInfo track_info(0.0f, NULL,
+                                                            &track_shape);
+        btRigidBody other(other_info), track(track_info);
+        // The other object is added first, so that it comes first in the
+        // broadphase
+        tie_world.addRigidBody(&other);
+        tie_world.addRigidBody(&track);
+        btKartRaycaster tie_raycaster(&tie_world, /*smooth_normals*/false,
+                                      &track);
+        assert(tie_raycaster.getPacketObject() == &track);
+        std::uniform_real_distribution<float> position(0.5f, 7.5f);
+        for (int packet = 0; packet < 100; packet++)
+        {
+            btVector3 from[4], to[4];
+            for (int i = 0; i < 4; i++)
+            {
+                from[i] = btVector3(position(random), 1.0f,
+                                    position(random));
+                to[i] = from[i] - btVector3(0, 2.0f, 0);
+            }
+            btVehicleRaycasterResult results[4];
+            void *objects[4];
+            tie_raycaster.castRays(4, from, to, results, objects);
+            for (int i = 0; i < 4; i++)
+            {
+                btVehicleRaycasterResult expected;
+                void *object = tie_raycaster.castRay(from[i], to[i],
+                                                     expected);
+                assert(object == &track || object == &other);
+                assert(objects[i] == &track);
+                assert(results[i].m_distFraction == 0.5f);
+                assert(results[i].m_distFraction == expected.m_distFraction);
+                assert(isSame(results[i].m_hitPointInWorld,
+                              expected.m_hitPointInWorld));
+                assert(results[i].m_triangle_index ==
+                       expected.m_triangle_index);
+                (void)object;
+            }
+        }
+        tie_world.removeRigidBody(&track);
+        tie_world.removeRigidBody(&other);
+    }
+    (void)hits;
+    (void)misses;
+    (void)isSame;
+}   // unitTesting
 
+// ----------------------------------------------------------------------------
+/** Compares the time of casting the wheel rays of 16 karts one at a time
+ *  with casting them as packets, once per kart as btKart does and once for
+ *  all karts of a physics step at once.
+ */
+void btKartRaycaster::benchmark()
+{
+    const int num_karts = 16;
+    const int steps     = 2000;
+    std::mt19937 random(42);
+    RaycastTestWorld world(&random);
+    btKartRaycaster raycaster(&world.m_world, /*smooth_normals*/false,
+                              world.getTrackObject());
+    std::vector<btVector3> from(num_karts * 4), to(num_karts * 4);
+    for (int kart = 0; kart < num_karts; kart++)
+    {
+        RaycastTestWorld::createWheelRays(&random, /*exact*/false,
+                                          &from[kart * 4], &to[kart * 4]);
+    }
+
+    double times[3];
+    for (int batched = 0; batched < 3; batched++)
+    {
+        btVehicleRaycasterResult results[num_karts * 4];
+        void *objects[num_karts * 4];
+        auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; step++)
+        {
+            if (batched == 2)
+            {
+                raycaster.castRays(num_karts * 4, from.data(), to.data(),
+                                   results, objects);
+                continue;
+            }
+            for (int kart = 0; kart < num_karts; kart++)
+            {
+                if (batched)
+                {
+                    raycaster.castRays(4, &from[kart * 4], &to[kart * 4],
+                                       results, objects);
+                    continue;
+                }
+                for (int i = 0; i < 4; i++)
+                {
+                    objects[i] = raycaster.castRay(from[kart * 4 + i],
+                                                   to[kart * 4 + i],
+                                                   results[i]);
+                }
+            }
+        }
+        std::chrono::duration<double> time =
+            std::chrono::steady_clock::now() - start;
+        times[batched] = time.count() * 1e9 / (steps * num_karts * 4);
+    }
+    Log::info("btKartRaycaster", "%6.1f ns per wheel ray with castRay, "
+              "%6.1f ns with castRays per kart (%.1f%% faster), %6.1f ns "
+              "with castRays for all karts of a step (%.1f%% faster).",
+              times[0], times[1], 100.0 * (1.0 - times[1] / times[0]),
+              times[2], 100.0 * (1.0 - times[2] / times[0]));
+}   // benchmark
@@ -27,14 +27,26 @@ private:
     /** True if the normals should be smoothed. Not all tracks support this,
     *  so this flag is set depending on track when constructing this object. */
     bool                m_smooth_normals;
+    /** The object of the main track mesh. castRays traverses its BVH with
+     *  packets of rays instead of one ray at a time. Can be NULL. */
+    const btCollisionObject* m_track_object;
+
+    btCollisionObject* getPacketObject() const;
 public:
-    btKartRaycaster(btDynamicsWorld* world, bool smooth_normals=false)
-        :m_dynamicsWorld(world), m_smooth_normals(smooth_normals)
+    btKartRaycaster(btDynamicsWorld* world, bool smooth_normals=false,
+                    const btCollisionObject* track_object=NULL)
+        :m_dynamicsWorld(world), m_smooth_normals(smooth_normals),
+         m_track_object(track_object)
     {
     }
 
     virtual void* castRay(const btVector3& from,const btVector3& to,
                           btVehicleRaycasterResult& result);
+    void castRays(unsigned int num_rays, const btVector3* from,
+                  const btVector3* to, btVehicleRaycasterResult* results,
+                  void** objects);
+    static void unitTesting();
+    static void benchmark();
 
 };
 
@@ -838,7 +838,7 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+BareNetworkString* PhysicalObject::saveState(std::vector<uint16_t>* ru)
 {
     bool has_live_join = false;
 
@@ -863,7 +863,7 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         return nullptr;
     }
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     m_last_transform = cur_transform;
     m_last_lv = current_lv;
     m_last_av = current_av;
@@ -19,15 +19,17 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
 
-#include <fstream>
+#include <cstring>
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -38,6 +40,8 @@ TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
     m_free_body          = true;
     m_motion_state       = NULL;
     m_can_be_transformed = can_be_transformed;
+    m_cache_bvh          = false;
+    m_serialized_bvh     = NULL;
     // FIXME: on VS in release mode this statement actually overwrites
     // part of the data of m_mesh, causing a crash later. Debugging
     // shows that apparently m_collision_shape is at the same address
@@ -103,56 +107,39 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         m_collision_object = NULL;
         return;
     }
-    // Now convert the triangle mesh into a static rigid body
+    // Now convert the triangle mesh into a static rigid body. Quantized
+    // AABBs make the BVH about a quarter of the size, which also makes
+    // traversing it more cache friendly.
     btBvhTriangleMeshShape* bhv_triangle_mesh;
+    btOptimizedBvh* bhv = NULL;
+    std::string cache_file;
 
     if (serialized_bhv != NULL)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
+        bhv = loadSerializedBvh(serialized_bhv, !IS_LITTLE_ENDIAN);
         if (bhv == NULL)
-        {
             Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
-        }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
+    }
+    else if (m_cache_bvh)
+    {
+        cache_file = getBvhCacheFilename();
+        bhv = loadSerializedBvh(cache_file, /*swap_endian*/false);
+    }
 
+    if (bhv != NULL)
+    {
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh,
+            bhv->isQuantized() /* useQuantizedAabbCompression */,
+            false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh(bhv);
     }
     else
     {
-        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh,
+                                    true /* useQuantizedAabbCompression */);
+        if (!cache_file.empty())
+            saveSerializedBvh(bhv_triangle_mesh->getOptimizedBvh(),
+                              cache_file);
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -233,8 +220,122 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    freeSerializedBvh();
 }   // removeAll
 
+// ----------------------------------------------------------------------------
+/** Frees the memory of a BVH that was deserialized in place. The collision
+ *  shape using it must have been deleted already.
+ */
+void TriangleMesh::freeSerializedBvh()
+{
+    if (!m_serialized_bvh)
+        return;
+    ((btOptimizedBvh*)m_serialized_bvh)->~btOptimizedBvh();
+    btAlignedFree(m_serialized_bvh);
+    m_serialized_bvh = NULL;
+}   // freeSerializedBvh
+
+// ----------------------------------------------------------------------------
+/** Loads a BVH which was serialized with btOptimizedBvh::serialize. The BVH
+ *  is created in place in m_serialized_bvh.
+ *  \return The BVH, or NULL if the file does not exist or is invalid.
+ */
+btOptimizedBvh* TriangleMesh::loadSerializedBvh(const std::string &filename,
+                                                bool swap_endian)
+{
+    FILE *f = FileUtils::fopenU8Path(filename, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long pos = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (pos <= 0)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    void* bytes = btAlignedAlloc(pos, 16);
+    bool ok = fread(bytes, pos, 1, f) == 1;
+    fclose(f);
+
+    // The BVH object is constructed directly at this memory location, so
+    // it must be kept until the collision shape is deleted
+    btOptimizedBvh* bvh = ok ? btOptimizedBvh::deSerializeInPlace(bytes,
+                                   (unsigned)pos, swap_endian) : NULL;
+    if (bvh == NULL)
+    {
+        btAlignedFree(bytes);
+        return NULL;
+    }
+    assert(m_serialized_bvh == NULL);
+    m_serialized_bvh = bytes;
+    return bvh;
+}   // loadSerializedBvh
+
+// ----------------------------------------------------------------------------
+/** Saves the BVH in native byte order, so that loadSerializedBvh can use it
+ *  the next time the same mesh is loaded.
+ */
+void TriangleMesh::saveSerializedBvh(btOptimizedBvh *bvh,
+                                     const std::string &filename) const
+{
+    if (!bvh)
+        return;
+    unsigned int size = bvh->calculateSerializeBufferSize();
+    void* buffer = btAlignedAlloc(size, 16);
+    bool ok = bvh->serialize(buffer, size, /*swap_endian*/false) &&
+        file_manager->writeFileAtomically(filename, [buffer, size](FILE* f)
+        {
+            return fwrite(buffer, size, 1, f) == 1;
+        });
+    btAlignedFree(buffer);
+
+    if (!ok)
+    {
+        Log::warn("TriangleMesh", "Can't write BVH cache '%s'.",
+                  filename.c_str());
+    }
+}   // saveSerializedBvh
+
+// ----------------------------------------------------------------------------
+/** Returns the name of the BVH cache file for this mesh. It contains a hash
+ *  of all triangles, so any change to the track (or the objects merged into
+ *  its mesh) results in a different file.
+ */
+std::string TriangleMesh::getBvhCacheFilename() const
+{
+    // 64-bit FNV-1a, processing 8 bytes at a time
+    uint64_t hash = 14695981039346656037ULL;
+    auto add_bytes = [&hash](const unsigned char* data, size_t len)
+    {
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; i < len; i++)
+            hash = (hash ^ data[i]) * 1099511628211ULL;
+    };
+
+    const IndexedMeshArray &meshes = m_mesh.getIndexedMeshArray();
+    for (int i = 0; i < meshes.size(); i++)
+    {
+        const btIndexedMesh &m = meshes[i];
+        add_bytes(m.m_vertexBase, (size_t)m.m_numVertices * m.m_vertexStride);
+        add_bytes(m.m_triangleIndexBase,
+                  (size_t)m.m_numTriangles * m.m_triangleIndexStride);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "bvh-%016llx-%d.bvh",
+             (unsigned long long)hash, m_mesh.getNumTriangles());
+    return file_manager->getCachedDataDir() + name;
+}   // getBvhCacheFilename
+
 // -----------------------------------------------------------------------------
 /** Interpolates the normal at the given position for the triangle with
  *  a given index. The position must be inside of the given triangle.
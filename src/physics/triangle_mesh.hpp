@@ -19,6 +19,7 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
@@ -57,6 +58,25 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    /** If the BVH of the collision shape should be loaded from and saved
+     *  to the cached-data directory. */
+    bool m_cache_bvh;
+
+    /** Memory of a BVH that was deserialized in place, which is not freed
+     *  by bullet. */
+    void *m_serialized_bvh;
+
+    // ------------------------------------------------------------------------
+    btOptimizedBvh* loadSerializedBvh(const std::string &filename,
+                                      bool swap_endian);
+    // ------------------------------------------------------------------------
+    void saveSerializedBvh(btOptimizedBvh *bvh,
+                           const std::string &filename) const;
+    // ------------------------------------------------------------------------
+    std::string getBvhCacheFilename() const;
+    // ------------------------------------------------------------------------
+    void freeSerializedBvh();
+
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -83,6 +103,11 @@ public:
                             const char* serializedBhv = NULL);
     void removeAll();
     void removeCollisionObject();
+    // ------------------------------------------------------------------------
+    /** Loads the BVH of this mesh from the cached-data directory when the
+     *  collision shape is created, or saves it there after building it.
+     *  Used for the large static track meshes. */
+    void enableBvhCache()                               { m_cache_bvh = true; }
     btVector3 getInterpolatedNormal(unsigned int index,
                                     const btVector3 &position) const;
     // ------------------------------------------------------------------------
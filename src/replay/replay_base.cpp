@@ -18,7 +18,46 @@
 #include "replay/replay_base.hpp"
 
 #include "io/file_manager.hpp"
+#include "network/network_string.hpp"
 #include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+
+#include "mini_glm.hpp"
+
+#include <cmath>
+#include <zlib.h>
+
+const char ReplayBase::BINARY_MAGIC[4] = { 'S', 'T', 'K', 'R' };
+
+namespace
+{
+    /** Writes a signed value as zig-zag encoded variable length integer,
+     *  so that the small deltas between frames only take one byte. */
+    void addVarInt(BareNetworkString *out, int32_t value)
+    {
+        uint32_t v = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        while (v >= 0x80)
+        {
+            out->addUInt8((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out->addUInt8((uint8_t)v);
+    }   // addVarInt
+    // ------------------------------------------------------------------------
+    int32_t getVarInt(const BareNetworkString &in)
+    {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t byte = in.getUInt8();
+            v |= (uint32_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }   // getVarInt
+}   // anonymous namespace
+
 
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
@@ -34,7 +73,7 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
 {
     FILE* fd = FileUtils::fopenU8Path(full_path ? getReplayFilename(replay_file_number) :
         file_manager->getReplayDir() + getReplayFilename(replay_file_number),
-        writeable ? "w" : "r");
+        writeable ? "wb" : "rb");
     if (!fd)
     {
         return NULL;
@@ -42,3 +81,186 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
     return fd;
 
 }   // openReplayFile
+
+// -----------------------------------------------------------------------------
+/** Appends one frame of a kart to the body of a binary replay file. The
+ *  position is quantized to POSITION_PRECISION and stored as difference to
+ *  the previous frame, the rotation is packed into 32 bits.
+ *  \param out The buffer to append to.
+ *  \param state Codec state of this kart, updated by this call.
+ */
+void ReplayBase::encodeFrame(BareNetworkString *out, FrameCodecState *state,
+                             const TransformEvent &te, const PhysicInfo &pi,
+                             const BonusInfo &bi, const KartReplayEvent &kre)
+{
+    out->addFloat(te.m_time);
+    const btVector3 &xyz = te.m_transform.getOrigin();
+    for (int i = 0; i < 3; i++)
+    {
+        int32_t q = (int32_t)lrintf(xyz[i] / POSITION_PRECISION);
+        addVarInt(out, q - state->m_xyz[i]);
+        state->m_xyz[i] = q;
+    }
+    out->addUInt32(MiniGLM::compressQuaternion(te.m_transform.getRotation()));
+
+    out->addFloat(pi.m_speed).addFloat(pi.m_steer);
+    for (int i = 0; i < 4; i++)
+        out->addFloat(pi.m_suspension_length[i]);
+    addVarInt(out, pi.m_skidding_state);
+
+    addVarInt(out, bi.m_attachment);
+    out->addFloat(bi.m_nitro_amount);
+    addVarInt(out, bi.m_item_amount);
+    addVarInt(out, bi.m_item_type);
+    addVarInt(out, bi.m_special_value);
+
+    out->addFloat(kre.m_distance);
+    addVarInt(out, kre.m_nitro_usage);
+    addVarInt(out, kre.m_skidding_effect);
+    out->addUInt8((kre.m_zipper_usage ? 1 : 0) |
+                  (kre.m_red_skidding ? 2 : 0) |
+                  (kre.m_jumping      ? 4 : 0));
+}   // encodeFrame
+
+// -----------------------------------------------------------------------------
+/** Reads one frame written by encodeFrame. Throws std::out_of_range if the
+ *  buffer is truncated.
+ */
+void ReplayBase::decodeFrame(const BareNetworkString &in,
+                             FrameCodecState *state, TransformEvent *te,
+                             PhysicInfo *pi, BonusInfo *bi,
+                             KartReplayEvent *kre)
+{
+    te->m_time = in.getFloat();
+    btVector3 xyz;
+    for (int i = 0; i < 3; i++)
+    {
+        state->m_xyz[i] += getVarInt(in);
+        xyz[i] = state->m_xyz[i] * POSITION_PRECISION;
+    }
+    te->m_transform.setOrigin(xyz);
+    te->m_transform.setRotation(
+        MiniGLM::decompressbtQuaternion(in.getUInt32()));
+
+    pi->m_speed = in.getFloat();
+    pi->m_steer = in.getFloat();
+    for (int i = 0; i < 4; i++)
+        pi->m_suspension_length[i] = in.getFloat();
+    pi->m_skidding_state = getVarInt(in);
+
+    bi->m_attachment    = getVarInt(in);
+    bi->m_nitro_amount  = in.getFloat();
+    bi->m_item_amount   = getVarInt(in);
+    bi->m_item_type     = getVarInt(in);
+    bi->m_special_value = getVarInt(in);
+
+    kre->m_distance        = in.getFloat();
+    kre->m_nitro_usage     = getVarInt(in);
+    kre->m_skidding_effect = getVarInt(in);
+    uint8_t flags = in.getUInt8();
+    kre->m_zipper_usage = (flags & 1) != 0;
+    kre->m_red_skidding = (flags & 2) != 0;
+    kre->m_jumping      = (flags & 4) != 0;
+}   // decodeFrame
+
+// -----------------------------------------------------------------------------
+/** Compresses the body of a binary replay with zlib.
+ *  \return False if compression failed or did not reduce the size, in
+ *          which case the body should be stored uncompressed.
+ */
+bool ReplayBase::compressBody(const BareNetworkString &body,
+                              std::vector<uint8_t> *out)
+{
+    uLongf size = compressBound(body.getTotalSize());
+    out->resize(size);
+    if (compress2(out->data(), &size, (const Bytef*)body.getData(),
+                  body.getTotalSize(), Z_BEST_COMPRESSION) != Z_OK ||
+        size >= body.getTotalSize())
+    {
+        out->clear();
+        return false;
+    }
+    out->resize(size);
+    return true;
+}   // compressBody
+
+// -----------------------------------------------------------------------------
+/** Inflates a body compressed with compressBody.
+ *  \param raw_size Uncompressed size as stored in the file.
+ */
+bool ReplayBase::uncompressBody(const std::vector<uint8_t> &in,
+                                uint32_t raw_size, BareNetworkString *out)
+{
+    std::vector<char> raw(raw_size);
+    uLongf size = raw_size;
+    if (uncompress((Bytef*)raw.data(), &size, in.data(), in.size()) != Z_OK ||
+        size != raw_size)
+        return false;
+    *out = BareNetworkString(raw.data(), (int)raw_size);
+    return true;
+}   // uncompressBody
+
+// -----------------------------------------------------------------------------
+/** Round trips some frames through the binary replay encoding. */
+void ReplayBase::unitTesting()
+{
+    const int num_frames = 200;
+    std::vector<TransformEvent> frames(num_frames);
+    BareNetworkString body;
+    FrameCodecState encoder;
+    for (int i = 0; i < num_frames; i++)
+    {
+        TransformEvent &te = frames[i];
+        te.m_time = i / 60.0f;
+        te.m_transform = btTransform(
+            btQuaternion(btVector3(0, 1, 0), i * 0.05f),
+            btVector3(100.0f * sinf(i * 0.02f), -3.5f + i * 0.01f,
+                      -250.0f + i * 0.7f));
+        PhysicInfo pi = {0};
+        pi.m_speed = i * 0.25f;
+        pi.m_suspension_length[2] = 0.125f;
+        pi.m_skidding_state = i % 3;
+        BonusInfo bi = {0};
+        bi.m_attachment = (i % 7) - 1;
+        bi.m_special_value = -i;
+        KartReplayEvent kre = {0};
+        kre.m_distance = i * 1.5f;
+        kre.m_jumping = i % 2 == 1;
+        encodeFrame(&body, &encoder, te, pi, bi, kre);
+    }
+
+    std::vector<uint8_t> compressed;
+    BareNetworkString in;
+    if (compressBody(body, &compressed))
+    {
+        bool ok = uncompressBody(compressed, body.getTotalSize(), &in);
+        assert(ok);
+    }
+    else
+        in = BareNetworkString(body.getData(), body.getTotalSize());
+    assert(in.getTotalSize() == body.getTotalSize());
+
+    FrameCodecState decoder;
+    for (int i = 0; i < num_frames; i++)
+    {
+        TransformEvent te;
+        PhysicInfo pi;
+        BonusInfo bi;
+        KartReplayEvent kre;
+        decodeFrame(in, &decoder, &te, &pi, &bi, &kre);
+        assert(te.m_time == frames[i].m_time);
+        assert((te.m_transform.getOrigin() - frames[i].m_transform.getOrigin())
+               .length() < POSITION_PRECISION);
+        assert(fabsf(te.m_transform.getRotation()
+               .dot(frames[i].m_transform.getRotation())) > 0.999f);
+        assert(pi.m_speed == i * 0.25f);
+        assert(pi.m_suspension_length[2] == 0.125f);
+        assert(pi.m_skidding_state == i % 3);
+        assert(bi.m_attachment == (i % 7) - 1);
+        assert(bi.m_special_value == -i);
+        assert(kre.m_distance == i * 1.5f);
+        assert(kre.m_jumping == (i % 2 == 1));
+        assert(!kre.m_zipper_usage);
+    }
+    assert(in.size() == 0);
+}   // unitTesting
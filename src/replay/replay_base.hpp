@@ -22,10 +22,13 @@
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <vector>
 
+class BareNetworkString;
+
 /**
   * \ingroup race
   */
@@ -97,6 +100,48 @@ protected:
         bool        m_jumping;
     };   // KartReplayEvent
 
+    // ------------------------------------------------------------------------
+    /** Running state of the frame encoder / decoder of binary replays:
+     *  positions are stored as deltas of quantized integer coordinates. */
+    struct FrameCodecState
+    {
+        int32_t m_xyz[3];
+        FrameCodecState() { m_xyz[0] = m_xyz[1] = m_xyz[2] = 0; }
+    };   // FrameCodecState
+
+    /** The first bytes of a binary replay file, old text replays start
+     *  with "version: ". */
+    static const char BINARY_MAGIC[4];
+
+    /** First replay version which is stored in the binary format. */
+    static const unsigned int FIRST_BINARY_VERSION = 5;
+
+    /** Maximum size of the header block of a binary replay. */
+    static const uint32_t MAX_HEADER_SIZE = 1024 * 1024;
+
+    /** Maximum size of the (uncompressed) kart data of a binary replay,
+     *  much more than an hour long race with the maximum number of karts
+     *  needs. Anything bigger is treated as a corrupted file. */
+    static const uint32_t MAX_BODY_SIZE = 256 * 1024 * 1024;
+
+    /** Precision of the stored kart positions (in meters). */
+    static constexpr float POSITION_PRECISION = 0.001f;
+
+    // ------------------------------------------------------------------------
+    static void encodeFrame(BareNetworkString *out, FrameCodecState *state,
+                            const TransformEvent &te, const PhysicInfo &pi,
+                            const BonusInfo &bi, const KartReplayEvent &kre);
+    // ------------------------------------------------------------------------
+    static void decodeFrame(const BareNetworkString &in,
+                            FrameCodecState *state, TransformEvent *te,
+                            PhysicInfo *pi, BonusInfo *bi,
+                            KartReplayEvent *kre);
+    // ------------------------------------------------------------------------
+    static bool compressBody(const BareNetworkString &body,
+                             std::vector<uint8_t> *out);
+    // ------------------------------------------------------------------------
+    static bool uncompressBody(const std::vector<uint8_t> &in,
+                               uint32_t raw_size, BareNetworkString *out);
     // ------------------------------------------------------------------------
     FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
     // ------------------------------------------------------------------------
@@ -105,7 +150,7 @@ protected:
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
      *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+    unsigned int getCurrentReplayVersion() const { return 5; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
@@ -115,6 +160,7 @@ protected:
 public:
              ReplayBase();
     virtual ~ReplayBase() {};
+    static void unitTesting();
 };   // ReplayBase
 
 #endif
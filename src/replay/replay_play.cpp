@@ -23,6 +23,7 @@
 #include "karts/ghost_kart.hpp"
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
@@ -30,9 +31,11 @@
 #include "utils/mem_utils.hpp"
 #include "utils/string_utils.hpp"
 
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
 #include <stdio.h>
 #include <string>
-#include <cinttypes>
 
 ReplayPlay::SortOrder ReplayPlay::m_sort_order = ReplayPlay::SO_DEFAULT;
 ReplayPlay *ReplayPlay::m_replay_play = NULL;
@@ -106,11 +109,9 @@ void ReplayPlay::loadAllReplayFile()
 //-----------------------------------------------------------------------------
 bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int call_index)
 {
-
-    char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
     FILE* fd = FileUtils::fopenU8Path(custom_replay ? fn :
-        file_manager->getReplayDir() + fn, "r");
+        file_manager->getReplayDir() + fn, "rb");
     if (fd == NULL) return false;
     auto scoped = [&]() { fclose(fd); };
     MemUtils::deref<decltype(scoped)> cls(scoped); 
@@ -120,6 +121,57 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
 
+    char magic[sizeof(BINARY_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), fd) == sizeof(magic) &&
+        memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0)
+    {
+        if (!readBinaryHeader(fd, &rd))
+            return false;
+    }
+    else
+    {
+        rewind(fd);
+        if (!readTextHeader(fd, &rd, call_index))
+            return false;
+    }
+
+    // If former official tracks are present as addons, show the matching replays.
+    if (rd.m_track_name.compare("greenvalley") == 0)
+        rd.m_track_name = std::string("addon_green-valley");
+    if (rd.m_track_name.compare("mansion") == 0)
+        rd.m_track_name = std::string("addon_blackhill-mansion");
+
+    Track* t = track_manager->getTrack(rd.m_track_name);
+    if (t == NULL)
+    {
+        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
+        rd.m_track_name.c_str(), fn.c_str());
+        return false;
+    }
+
+    rd.m_track = t;
+
+    m_replay_file_list.push_back(rd);
+
+    assert(m_replay_file_list.size() > 0);
+    // Force to use custom replay file immediately
+    if (custom_replay)
+        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+
+    return true;
+
+}   // addReplayFile
+
+//-----------------------------------------------------------------------------
+/** Reads the header of a replay file in the text format used up to
+ *  replay version 4.
+ *  \param fd The file, positioned at its start.
+ *  \param rd The replay data to fill in.
+ *  \param call_index Used as UID for old replays which have none.
+ */
+bool ReplayPlay::readTextHeader(FILE *fd, ReplayData *rd, int call_index)
+{
+    char s[1024], s1[1024];
     fgets(s, 1023, fd);
     unsigned int version;
     if (sscanf(s,"version: %u", &version) != 1)
@@ -131,30 +183,30 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     if ( version < getMinSupportedReplayVersion() )
     {
         Log::warn("Replay", "Replay is version '%d', Minimum supported replay version is '%d', skipped '%s'",
-                  version, getMinSupportedReplayVersion(), fn.c_str());
+                  version, getMinSupportedReplayVersion(), rd->m_filename.c_str());
         return false;
     }
     else if (version > getCurrentReplayVersion())
     {
         Log::warn("Replay", "Replay is version '%d', STK replay version is '%d', skipped '%s'",
-                  version, getCurrentReplayVersion(), fn.c_str());
+                  version, getCurrentReplayVersion(), rd->m_filename.c_str());
         return false;
     }
 
-    rd.m_replay_version = version;
+    rd->m_replay_version = version;
 
     if (version >= 4)
     {
         fgets(s, 1023, fd);
         if(sscanf(s, "stk_version: %1023s", s1) != 1)
         {
-            Log::warn("Replay", "No STK release version found in replay file, '%s'.", fn.c_str());
+            Log::warn("Replay", "No STK release version found in replay file, '%s'.", rd->m_filename.c_str());
             return false;
         }
-        rd.m_stk_version = s1;
+        rd->m_stk_version = s1;
     }
     else
-        rd.m_stk_version = "";
+        rd->m_stk_version = "";
 
     while(true)
     {
@@ -172,21 +224,21 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             break;
         }
 
-        rd.m_kart_list.push_back(std::string(s1));
+        rd->m_kart_list.push_back(std::string(s1));
         if (scanned == 2)
         {
             // If username of kart is present, use it
-            rd.m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
-            if (rd.m_name_list.size() == 1)
+            rd->m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
+            if (rd->m_name_list.size() == 1)
             {
                 // First user is the game master and the "owner" of this replay file
-                rd.m_user_name = rd.m_name_list[0];
+                rd->m_user_name = rd->m_name_list[0];
             }
         } else
         { // scanned == 1
             // If username is not present, kart display name will default to kart name
             // (see GhostController::getName)
-            rd.m_name_list.push_back("");
+            rd->m_name_list.push_back("");
         }
 
         // Read kart color data
@@ -196,28 +248,28 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             fgets(s, 1023, fd);
             if(sscanf(s, "kart_color: %f", &f) != 1)
             {
-                Log::warn("Replay", "Kart color missing in replay file, '%s'.", fn.c_str());
+                Log::warn("Replay", "Kart color missing in replay file, '%s'.", rd->m_filename.c_str());
                 return false;
             }
-            rd.m_kart_color.push_back(f);
+            rd->m_kart_color.push_back(f);
         }
         else
-            rd.m_kart_color.push_back(0.0f); // Use default kart color
+            rd->m_kart_color.push_back(0.0f); // Use default kart color
     }
 
     int reverse = 0;
     fgets(s, 1023, fd);
     if(sscanf(s, "reverse: %d", &reverse) != 1)
     {
-        Log::warn("Replay", "No reverse info found in replay file, '%s'.", fn.c_str());
+        Log::warn("Replay", "No reverse info found in replay file, '%s'.", rd->m_filename.c_str());
         return false;
     }
-    rd.m_reverse = reverse != 0;
+    rd->m_reverse = reverse != 0;
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "difficulty: %u", &rd.m_difficulty) != 1)
+    if (sscanf(s, "difficulty: %u", &rd->m_difficulty) != 1)
     {
-        Log::warn("Replay", " No difficulty found in replay file, '%s'.", fn.c_str());
+        Log::warn("Replay", " No difficulty found in replay file, '%s'.", rd->m_filename.c_str());
         return false;
     }
 
@@ -226,14 +278,14 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         fgets(s, 1023, fd);
         if (sscanf(s, "mode: %1023s", s1) != 1)
         {
-            Log::warn("Replay", "Replay mode not found in replay file, '%s'.", fn.c_str());
+            Log::warn("Replay", "Replay mode not found in replay file, '%s'.", rd->m_filename.c_str());
             return false;
         }
-        rd.m_minor_mode = s1;
+        rd->m_minor_mode = s1;
     }
     // Assume time-trial mode for old replays
     else
-        rd.m_minor_mode = "time-trial";
+        rd->m_minor_mode = "time-trial";
 
     // sscanf always stops at whitespaces, but a track name may contain a whitespace
     // Official tracks should avoid whitespaces in their name, but it
@@ -253,73 +305,130 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
 
         if (i >= 8)
         {
-            rd.m_track_name = std::string(s1);
+            rd->m_track_name = std::string(s1);
         }
         else
         {
-            Log::warn("Replay", "Track name is empty in replay file, '%s'.", fn.c_str());
+            Log::warn("Replay", "Track name is empty in replay file, '%s'.", rd->m_filename.c_str());
             return false;
         }         
     }
     else
     {
-        Log::warn("Replay", "Track info not found in replay file, '%s'.", fn.c_str());
-        return false;
-    }
-
-    // If former official tracks are present as addons, show the matching replays.
-    if (rd.m_track_name.compare("greenvalley") == 0)
-        rd.m_track_name = std::string("addon_green-valley");
-    if (rd.m_track_name.compare("mansion") == 0)
-        rd.m_track_name = std::string("addon_blackhill-mansion");
-
-    Track* t = track_manager->getTrack(rd.m_track_name);
-    if (t == NULL)
-    {
-        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
-        rd.m_track_name.c_str(), fn.c_str());
+        Log::warn("Replay", "Track info not found in replay file, '%s'.", rd->m_filename.c_str());
         return false;
     }
 
-    rd.m_track = t;
-
     fgets(s, 1023, fd);
-    if (sscanf(s, "laps: %u", &rd.m_laps) != 1)
+    if (sscanf(s, "laps: %u", &rd->m_laps) != 1)
     {
-        Log::warn("Replay", "No number of laps found in replay file, '%s'.", fn.c_str());
+        Log::warn("Replay", "No number of laps found in replay file, '%s'.", rd->m_filename.c_str());
         return false;
     }
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "min_time: %f", &rd.m_min_time) != 1)
+    if (sscanf(s, "min_time: %f", &rd->m_min_time) != 1)
     {
-        Log::warn("Replay", "Finish time not found in replay file, '%s'.", fn.c_str());
+        Log::warn("Replay", "Finish time not found in replay file, '%s'.", rd->m_filename.c_str());
         return false;
     }
 
     if (version >= 4)
     {
         fgets(s, 1023, fd);
-        if (sscanf(s, "replay_uid: %" PRIu64, &rd.m_replay_uid) != 1)
+        if (sscanf(s, "replay_uid: %" PRIu64, &rd->m_replay_uid) != 1)
         {
-            Log::warn("Replay", "Replay UID not found in replay file, '%s'.", fn.c_str());
+            Log::warn("Replay", "Replay UID not found in replay file, '%s'.", rd->m_filename.c_str());
             return false;
         }
     }
     // No UID in old replay format
     else
-        rd.m_replay_uid = call_index;
+        rd->m_replay_uid = call_index;
 
-    m_replay_file_list.push_back(rd);
+    return true;
+}   // readTextHeader
 
-    assert(m_replay_file_list.size() > 0);
-    // Force to use custom replay file immediately
-    if (custom_replay)
-        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+//-----------------------------------------------------------------------------
+/** Reads the header block of a binary replay file, without reading any
+ *  of the frames stored after it.
+ *  \param fd The file, positioned after the magic bytes.
+ *  \param rd The replay data to fill in.
+ */
+bool ReplayPlay::readBinaryHeader(FILE *fd, ReplayData *rd)
+{
+    char prefix_data[6];
+    if (fread(prefix_data, 1, sizeof(prefix_data), fd) != sizeof(prefix_data))
+    {
+        Log::warn("Replay", "Truncated replay file '%s'.",
+                  rd->m_filename.c_str());
+        return false;
+    }
+    BareNetworkString prefix(prefix_data, sizeof(prefix_data));
+    unsigned int version = prefix.getUInt16();
+    if (version < FIRST_BINARY_VERSION ||
+        version > getCurrentReplayVersion())
+    {
+        Log::warn("Replay", "Replay is version '%d', STK replay version is '%d', skipped '%s'",
+                  version, getCurrentReplayVersion(), rd->m_filename.c_str());
+        return false;
+    }
+    rd->m_replay_version = version;
 
-    return true;
+    uint32_t header_size = prefix.getUInt32();
+    std::vector<char> header_data;
+    if (header_size > MAX_HEADER_SIZE ||
+        (header_data.resize(header_size),
+         fread(header_data.data(), 1, header_size, fd) != header_size))
+    {
+        Log::warn("Replay", "Invalid header in replay file '%s'.",
+                  rd->m_filename.c_str());
+        return false;
+    }
 
-}   // addReplayFile
+    try
+    {
+        BareNetworkString header(header_data.data(), (int)header_size);
+        std::string s;
+        header.decodeString(&s);
+        rd->m_stk_version = StringUtils::utf8ToWide(s);
+
+        unsigned int num_karts = header.getUInt8();
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            header.decodeString(&s);
+            rd->m_kart_list.push_back(s);
+            header.decodeString(&s);
+            rd->m_name_list.push_back(StringUtils::utf8ToWide(s));
+            rd->m_kart_color.push_back(header.getFloat());
+        }
+        // First user is the game master and the "owner" of this replay file
+        if (!rd->m_name_list.empty())
+            rd->m_user_name = rd->m_name_list[0];
+
+        rd->m_reverse = header.getUInt8() != 0;
+        rd->m_difficulty = header.getUInt8();
+        header.decodeString(&rd->m_minor_mode);
+        header.decodeString(&rd->m_track_name);
+        rd->m_laps = header.getUInt32();
+        rd->m_min_time = header.getFloat();
+        rd->m_replay_uid = header.getUInt64();
+    }
+    catch (std::out_of_range&)
+    {
+        Log::warn("Replay", "Truncated header in replay file '%s'.",
+                  rd->m_filename.c_str());
+        return false;
+    }
+
+    if (rd->m_track_name.empty())
+    {
+        Log::warn("Replay", "Track name is empty in replay file, '%s'.",
+                  rd->m_filename.c_str());
+        return false;
+    }
+    return true;
+}   // readBinaryHeader
 
 //-----------------------------------------------------------------------------
 void ReplayPlay::load()
@@ -357,6 +466,13 @@ void ReplayPlay::loadFile(bool second_replay)
                     getReplayFilename(replay_file_number).c_str());
 
     ReplayData &rd = m_replay_file_list[replay_index];
+    if (rd.m_replay_version >= FIRST_BINARY_VERSION)
+    {
+        readBinaryKartData(fd, second_replay);
+        fclose(fd);
+        return;
+    }
+
     unsigned int num_kart = (unsigned int)m_replay_file_list.at(replay_index)
                                                             .m_kart_list.size();
     unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
@@ -378,13 +494,11 @@ void ReplayPlay::loadFile(bool second_replay)
 }   // loadFile
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Creates the next ghost kart of a replay file and its controller.
+ *  \return The index of the new ghost kart.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+unsigned int ReplayPlay::addGhostKart(bool second_replay)
 {
-    char s[1024];
-
     int replay_index = second_replay ? m_second_replay_file
                                      : m_current_replay_file;
 
@@ -403,6 +517,110 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
     Controller* controller = new GhostController(getGhostKart(kart_num).get(),
                                                  rd.m_name_list[kart_num-first_loaded_f_num]);
     getGhostKart(kart_num)->setController(controller);
+    return kart_num;
+}   // addGhostKart
+
+//-----------------------------------------------------------------------------
+/** Reads the frames of all karts from a binary replay file.
+ *  \param fd The file descriptor from which to read.
+ */
+void ReplayPlay::readBinaryKartData(FILE *fd, bool second_replay)
+{
+    int replay_index = second_replay ? m_second_replay_file
+                                     : m_current_replay_file;
+    const ReplayData &rd = m_replay_file_list[replay_index];
+
+    // Skip magic, version and the header block read in addReplayFile
+    char prefix_data[6];
+    char body_info_data[9];
+    if (fseek(fd, sizeof(BINARY_MAGIC), SEEK_SET) != 0 ||
+        fread(prefix_data, 1, sizeof(prefix_data), fd) != sizeof(prefix_data))
+    {
+        Log::error("Replay", "Can't read replay header of '%s'.",
+                   rd.m_filename.c_str());
+        return;
+    }
+    BareNetworkString prefix(prefix_data, sizeof(prefix_data));
+    prefix.getUInt16();
+    if (fseek(fd, prefix.getUInt32(), SEEK_CUR) != 0 ||
+        fread(body_info_data, 1, sizeof(body_info_data), fd) !=
+                                                    sizeof(body_info_data))
+    {
+        Log::error("Replay", "Can't read replay data of '%s'.",
+                   rd.m_filename.c_str());
+        return;
+    }
+    BareNetworkString body_info(body_info_data, sizeof(body_info_data));
+    const bool is_compressed = body_info.getUInt8() != 0;
+    const uint32_t raw_size = body_info.getUInt32();
+    const uint32_t stored_size = body_info.getUInt32();
+
+    // Both sizes come from the file, so check them before allocating
+    // anything: the stored data must be in the rest of the file.
+    const long body_start = ftell(fd);
+    long file_size = -1;
+    if (body_start >= 0 && fseek(fd, 0, SEEK_END) == 0)
+        file_size = ftell(fd);
+    if (file_size < 0 || fseek(fd, body_start, SEEK_SET) != 0 ||
+        raw_size > MAX_BODY_SIZE || stored_size > MAX_BODY_SIZE ||
+        (long)stored_size > file_size - body_start ||
+        (!is_compressed && stored_size != raw_size))
+    {
+        Log::error("Replay", "Invalid replay data size in '%s'.",
+                   rd.m_filename.c_str());
+        return;
+    }
+
+    std::vector<uint8_t> stored(stored_size);
+    BareNetworkString body;
+    if (fread(stored.data(), 1, stored_size, fd) != stored_size ||
+        (is_compressed && !uncompressBody(stored, raw_size, &body)))
+    {
+        Log::error("Replay", "Corrupted replay data in '%s'.",
+                   rd.m_filename.c_str());
+        return;
+    }
+    if (!is_compressed)
+        body = BareNetworkString((char*)stored.data(), (int)stored_size);
+
+    try
+    {
+        for (unsigned int k = 0; k < rd.m_kart_list.size(); k++)
+        {
+            const unsigned int kart_num = addGhostKart(second_replay);
+            const unsigned int size = body.getUInt32();
+            FrameCodecState state;
+            for (unsigned int i = 0; i < size; i++)
+            {
+                TransformEvent te;
+                PhysicInfo pi;
+                BonusInfo bi;
+                KartReplayEvent kre;
+                decodeFrame(body, &state, &te, &pi, &bi, &kre);
+                m_ghost_karts[kart_num]->addReplayEvent(te.m_time,
+                    te.m_transform, pi, bi, kre);
+            }
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        Log::error("Replay", "Truncated replay data in '%s'.",
+                   rd.m_filename.c_str());
+    }
+}   // readBinaryKartData
+
+//-----------------------------------------------------------------------------
+/** Reads all data from a replay file for a specific kart.
+ *  \param fd The file descriptor from which to read.
+ */
+void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+{
+    char s[1024];
+
+    int replay_index = second_replay ? m_second_replay_file
+                                     : m_current_replay_file;
+    ReplayData &rd = m_replay_file_list[replay_index];
+    const unsigned int kart_num = addGhostKart(second_replay);
 
     unsigned int size;
     if(sscanf(next_line,"size: %u",&size)!=1)
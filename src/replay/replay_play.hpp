@@ -125,6 +125,10 @@ private:
           ReplayPlay();
          ~ReplayPlay();
     void  readKartData(FILE *fd, char *next_line, bool second_replay);
+    void  readBinaryKartData(FILE *fd, bool second_replay);
+    unsigned int addGhostKart(bool second_replay);
+    bool  readTextHeader(FILE *fd, ReplayData *rd, int call_index);
+    bool  readBinaryHeader(FILE *fd, ReplayData *rd);
 public:
     void  reset();
     void  load();
@@ -31,6 +31,7 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "physics/btKart.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
@@ -395,26 +396,34 @@ void ReplayRecorder::save()
         StringUtils::utf8ToWide(file_manager->getReplayDir() + getReplayFilename()));
     MessageQueue::add(MessageQueue::MT_GENERIC, msg);
 
-    fprintf(fd, "version: %d\n", getCurrentReplayVersion());
-    fprintf(fd, "stk_version: %s\n", STK_VERSION);
+    // The header only contains the data needed to list the replay, so
+    // that ReplayPlay::addReplayFile does not need to read the frames.
+    BareNetworkString header;
+    header.encodeString(std::string(STK_VERSION));
 
-    unsigned int player_count = 0;
-    for (unsigned int real_karts = 0; real_karts < num_karts; real_karts++)
+    std::vector<unsigned int> real_karts;
+    for (unsigned int k = 0; k < num_karts; k++)
     {
-        const AbstractKart *kart = world->getKart(real_karts);
-        if (kart->isGhostKart()) continue;
+        if (!world->getKart(k)->isGhostKart())
+            real_karts.push_back(k);
+    }
+    header.addUInt8((uint8_t)real_karts.size());
 
-        // XML encode the username to handle Unicode
-        fprintf(fd, "kart: %s %s\n", kart->getIdent().c_str(),
-                StringUtils::xmlEncode(kart->getController()->getName()).c_str());
+    unsigned int player_count = 0;
+    for (unsigned int k : real_karts)
+    {
+        const AbstractKart *kart = world->getKart(k);
+        header.encodeString(kart->getIdent())
+              .encodeString(kart->getController()->getName());
 
         if (kart->getController()->isPlayerController())
         {
-            fprintf(fd, "kart_color: %f\n", StateManager::get()->getActivePlayer(player_count)->getConstProfile()->getDefaultKartColor());
+            header.addFloat(StateManager::get()->getActivePlayer(player_count)
+                            ->getConstProfile()->getDefaultKartColor());
             player_count++;
         }
         else
-            fprintf(fd, "kart_color: 0\n");
+            header.addFloat(0.0f);
     }
 
     m_last_uid = computeUID(min_time);
@@ -422,60 +431,49 @@ void ReplayRecorder::save()
     int num_laps = RaceManager::get()->getNumLaps();
     if (num_laps == 9999) num_laps = 0; // no lap in that race mode
 
-    fprintf(fd, "kart_list_end\n");
-    fprintf(fd, "reverse: %d\n",    (int)RaceManager::get()->getReverseTrack());
-    fprintf(fd, "difficulty: %d\n", RaceManager::get()->getDifficulty());
-    fprintf(fd, "mode: %s\n",       RaceManager::get()->getMinorModeName().c_str());
-    fprintf(fd, "track: %s\n",      Track::getCurrentTrack()->getIdent().c_str());
-    fprintf(fd, "laps: %d\n",       num_laps);
-    fprintf(fd, "min_time: %f\n",   min_time);
-    fprintf(fd, "replay_uid: %" PRIu64 "\n", m_last_uid);
+    header.addUInt8(RaceManager::get()->getReverseTrack() ? 1 : 0)
+          .addUInt8((uint8_t)RaceManager::get()->getDifficulty())
+          .encodeString(RaceManager::get()->getMinorModeName())
+          .encodeString(Track::getCurrentTrack()->getIdent())
+          .addUInt32(num_laps)
+          .addFloat(min_time)
+          .addUInt64(m_last_uid);
 
-    for (unsigned int k = 0; k < num_karts; k++)
+    BareNetworkString body(4096);
+    for (unsigned int k : real_karts)
     {
-        if (world->getKart(k)->isGhostKart()) continue;
-
         const unsigned int num_transforms = std::min(m_max_frames,
                                                      m_count_transforms[k]);
-
-        fprintf(fd, "size:     %d\n", num_transforms);
-
+        body.addUInt32(num_transforms);
+        FrameCodecState state;
         for (unsigned int i = 0; i < num_transforms; i++)
         {
-            const TransformEvent *p  = &(m_transform_events[k][i]);
-            const PhysicInfo *q      = &(m_physic_info[k][i]);
-            const BonusInfo *b      = &(m_bonus_info[k][i]);
-            const KartReplayEvent *r = &(m_kart_replay_event[k][i]);
-            fprintf(fd, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                    p->m_time,
-                    p->m_transform.getOrigin().getX(),
-                    p->m_transform.getOrigin().getY(),
-                    p->m_transform.getOrigin().getZ(),
-                    p->m_transform.getRotation().getX(),
-                    p->m_transform.getRotation().getY(),
-                    p->m_transform.getRotation().getZ(),
-                    p->m_transform.getRotation().getW(),
-                    q->m_speed,
-                    q->m_steer,
-                    q->m_suspension_length[0],
-                    q->m_suspension_length[1],
-                    q->m_suspension_length[2],
-                    q->m_suspension_length[3],
-                    q->m_skidding_state,
-                    b->m_attachment,
-                    b->m_nitro_amount,
-                    b->m_item_amount,
-                    b->m_item_type,
-                    b->m_special_value,
-                    r->m_distance,
-                    r->m_nitro_usage,
-                    (int)r->m_zipper_usage,
-                    r->m_skidding_effect,
-                    (int)r->m_red_skidding,
-                    (int)r->m_jumping
-                );
+            encodeFrame(&body, &state, m_transform_events[k][i],
+                        m_physic_info[k][i], m_bonus_info[k][i],
+                        m_kart_replay_event[k][i]);
         }   // for i
     }
+
+    std::vector<uint8_t> compressed;
+    const bool is_compressed = compressBody(body, &compressed);
+
+    BareNetworkString prefix;
+    prefix.addUInt16((uint16_t)getCurrentReplayVersion())
+          .addUInt32(header.getTotalSize());
+    BareNetworkString body_info;
+    body_info.addUInt8(is_compressed ? 1 : 0)
+             .addUInt32(body.getTotalSize())
+             .addUInt32(is_compressed ? (uint32_t)compressed.size()
+                                      : body.getTotalSize());
+
+    fwrite(BINARY_MAGIC, 1, sizeof(BINARY_MAGIC), fd);
+    fwrite(prefix.getData(), 1, prefix.getTotalSize(), fd);
+    fwrite(header.getData(), 1, header.getTotalSize(), fd);
+    fwrite(body_info.getData(), 1, body_info.getTotalSize(), fd);
+    if (is_compressed)
+        fwrite(compressed.data(), 1, compressed.size(), fd);
+    else
+        fwrite(body.getData(), 1, body.getTotalSize(), fd);
     fclose(fd);
 }   // save
 
@@ -52,6 +52,62 @@ namespace Scripting
 {
     const char* MODULE_ID_MAIN_SCRIPT_FILE = "main";
 
+    /** A binary stream in memory, used to save and load the bytecode of
+     *  compiled scripts. AngelScript reads and writes most values one byte
+     *  at a time, so a FILE* would be too slow here.
+     */
+    class MemoryBinaryStream : public asIBinaryStream
+    {
+    public:
+        std::string m_data;
+        size_t      m_read_pos;
+
+        MemoryBinaryStream() : m_read_pos(0) {}
+        // --------------------------------------------------------------------
+        virtual int Read(void *ptr, asUINT size)
+        {
+            if (size > m_data.size() - m_read_pos)
+                return -1;
+            memcpy(ptr, m_data.data() + m_read_pos, size);
+            m_read_pos += size;
+            return 0;
+        }
+        // --------------------------------------------------------------------
+        virtual int Write(const void *ptr, asUINT size)
+        {
+            m_data.append((const char*)ptr, size);
+            return 0;
+        }
+    };   // MemoryBinaryStream
+
+    // ------------------------------------------------------------------------
+    /** Start value of a 64-bit FNV-1a hash. */
+    static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+    /** Magic at the start of a bytecode cache file, followed by the payload
+     *  length and the payload hash (both uint64_t) and then the payload. */
+    static const char BYTECODE_MAGIC[8] = { 'S', 'T', 'K', 'A',
+                                            'S', 'B', 'C', '1' };
+    static const size_t BYTECODE_HEADER_SIZE = sizeof(BYTECODE_MAGIC) +
+                                               2 * sizeof(uint64_t);
+
+    // ------------------------------------------------------------------------
+    /** 64-bit FNV-1a, used for the bytecode cache key and payload hash. */
+    static void hashBytes(uint64_t *hash, const void *data, size_t len)
+    {
+        const unsigned char *bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < len; i++)
+            *hash = (*hash ^ bytes[i]) * 1099511628211ULL;
+    }   // hashBytes
+
+    // ------------------------------------------------------------------------
+    static void hashString(uint64_t *hash, const char *str)
+    {
+        // Include the terminating 0, so that "ab" + "c" != "a" + "bc"
+        if (str)
+            hashBytes(hash, str, strlen(str) + 1);
+    }   // hashString
+
     void AngelScript_ErrorCallback (const asSMessageInfo *msg, void *param)
     {
         const char *type = "ERR ";
@@ -80,16 +136,95 @@ namespace Scripting
         // Configure the script engine with all the functions, 
         // and variables that the script should be able to use.
         configureEngine(m_engine);
+
+        // Let the engine (and add-ons like the script array) take their
+        // contexts from our pool
+        m_engine->SetContextCallbacks(requestContext, returnContext, this);
+
+        // Bytecode refers to the registered interface by declaration, so
+        // any change of it has to invalidate the cached bytecode.
+        m_config_hash = FNV_OFFSET_BASIS;
+        for (asUINT i = 0; i < m_engine->GetGlobalFunctionCount(); i++)
+        {
+            hashString(&m_config_hash, m_engine->GetGlobalFunctionByIndex(i)
+                                       ->GetDeclaration(true, true, true));
+        }
+        for (asUINT i = 0; i < m_engine->GetGlobalPropertyCount(); i++)
+        {
+            const char *name = NULL, *name_space = NULL;
+            int type_id = 0;
+            m_engine->GetGlobalPropertyByIndex(i, &name, &name_space,
+                                               &type_id);
+            hashString(&m_config_hash, name);
+            hashString(&m_config_hash, name_space);
+            hashString(&m_config_hash,
+                       m_engine->GetTypeDeclaration(type_id, true));
+        }
+        for (asUINT i = 0; i < m_engine->GetObjectTypeCount(); i++)
+        {
+            asITypeInfo *type = m_engine->GetObjectTypeByIndex(i);
+            hashString(&m_config_hash, type->GetName());
+            for (asUINT j = 0; j < type->GetMethodCount(); j++)
+            {
+                hashString(&m_config_hash, type->GetMethodByIndex(j)
+                                           ->GetDeclaration(true, true, true));
+            }
+            for (asUINT j = 0; j < type->GetPropertyCount(); j++)
+                hashString(&m_config_hash, type->GetPropertyDeclaration(j));
+        }
+        for (asUINT i = 0; i < m_engine->GetEnumCount(); i++)
+        {
+            asITypeInfo *type = m_engine->GetEnumByIndex(i);
+            hashString(&m_config_hash, type->GetName());
+            for (asUINT j = 0; j < type->GetEnumValueCount(); j++)
+            {
+                int value = 0;
+                hashString(&m_config_hash,
+                           type->GetEnumValueByIndex(j, &value));
+                hashBytes(&m_config_hash, &value, sizeof(value));
+            }
+        }
     }
 
     ScriptEngine::~ScriptEngine()
     {
         // Release the engine
         m_pending_timeouts.clearAndDeleteAll();
+        for (asIScriptContext* ctx : m_context_pool)
+            ctx->Release();
+        m_context_pool.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
         m_engine->Release();
     }
 
+    //-----------------------------------------------------------------------------
+    /** Called by the engine for RequestContext. Returns a pooled context, or
+    *  creates a new one if all are in use (e.g. a script function calling
+    *  back into C++ which runs another script function).
+    */
+    asIScriptContext* ScriptEngine::requestContext(asIScriptEngine* engine,
+                                                   void* param)
+    {
+        ScriptEngine* self = (ScriptEngine*)param;
+        if (self->m_context_pool.empty())
+            return engine->CreateContext();
+        asIScriptContext* ctx = self->m_context_pool.back();
+        self->m_context_pool.pop_back();
+        return ctx;
+    }   // requestContext
+
+    //-----------------------------------------------------------------------------
+    /** Called by the engine for ReturnContext. Puts the context back into the
+    *  pool, after releasing the function and objects it still refers to.
+    */
+    void ScriptEngine::returnContext(asIScriptEngine* engine,
+                                     asIScriptContext* ctx, void* param)
+    {
+        ScriptEngine* self = (ScriptEngine*)param;
+        ctx->Unprepare();
+        self->m_context_pool.push_back(ctx);
+    }   // returnContext
+
 
 
     /** Get Script By it's file name
@@ -188,11 +323,12 @@ namespace Scripting
             return;
         }
 
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = m_engine->RequestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "evalScript: Failed to create the context.");
             //m_engine->Release();
+            func->Release();
             return;
         }
 
@@ -200,7 +336,8 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "evalScript: Failed to prepare the context.");
-            ctx->Release();
+            m_engine->ReturnContext(ctx);
+            func->Release();
             return;
         }
 
@@ -223,7 +360,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        m_engine->ReturnContext(ctx);
         func->Release();
     }
 
@@ -231,7 +368,7 @@ namespace Scripting
 
     void ScriptEngine::runDelegate(asIScriptFunction* delegate)
     {
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = m_engine->RequestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "runMethod: Failed to create the context.");
@@ -243,7 +380,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "runMethod: Failed to prepare the context.");
-            ctx->Release();
+            m_engine->ReturnContext(ctx);
             return;
         }
 
@@ -268,7 +405,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        m_engine->ReturnContext(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -325,7 +462,8 @@ namespace Scripting
     /** runs the specified script
     *  \param string scriptName = name of script to run
     */
-    void ScriptEngine::runFunction(bool warn_if_not_found, std::string function_name)
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+                                   const std::string& function_name)
     {
         std::function<void(asIScriptContext*)> callback;
         std::function<void(asIScriptContext*)> get_return_value;
@@ -334,7 +472,8 @@ namespace Scripting
 
     //-----------------------------------------------------------------------------
 
-    void ScriptEngine::runFunction(bool warn_if_not_found, std::string function_name,
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+                                   const std::string& function_name,
         std::function<void(asIScriptContext*)> callback)
     {
         std::function<void(asIScriptContext*)> get_return_value;
@@ -346,7 +485,8 @@ namespace Scripting
     /** runs the specified script
     *  \param string scriptName = name of script to run
     */
-    void ScriptEngine::runFunction(bool warn_if_not_found, std::string function_name,
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+                                   const std::string& function_name,
         std::function<void(asIScriptContext*)> callback,
         std::function<void(asIScriptContext*)> get_return_value)
     {
@@ -406,8 +546,9 @@ namespace Scripting
             return; // function unavailable
         }
 
-        // Create a context that will execute the script.
-        asIScriptContext *ctx = m_engine->CreateContext();
+        // Get a context that will execute the script. Contexts are pooled,
+        // so this only allocates for the first (or a nested) call.
+        asIScriptContext *ctx = m_engine->RequestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "Failed to create the context.");
@@ -424,7 +565,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "Failed to prepare the context.");
-            ctx->Release();
+            m_engine->ReturnContext(ctx);
             //m_engine->Release();
             return;
         }
@@ -472,8 +613,8 @@ namespace Scripting
                 get_return_value(ctx);
         }
 
-        // We must release the contexts when no longer using them
-        ctx->Release();
+        // We must return the contexts when no longer using them
+        m_engine->ReturnContext(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -486,6 +627,7 @@ namespace Scripting
                 curr.second->Release();
         }
         m_functions_cache.clear();
+        m_script_sections.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
     }
 
@@ -522,8 +664,6 @@ namespace Scripting
 
     bool ScriptEngine::loadScript(std::string script_path, bool clear_previous)
     {
-        int r;
-
         std::string script = getScript(script_path);
         if (script.size() == 0)
         {
@@ -531,20 +671,16 @@ namespace Scripting
             return false;
         }
 
-        // Add the script sections that will be compiled into executable code.
+        // Only keep the script sections here, they are added to the module
+        // in compileLoadedScripts if there is no cached bytecode for them.
         // If we want to combine more than one file into the same script, then 
-        // we can call AddScriptSection() several times for the same module and
-        // the script engine will treat them all as if they were one. The script
-        // section name, will allow us to localize any errors in the script code.
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
+        // we can add several sections for the same module and the script
+        // engine will treat them all as if they were one.
+        m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
             clear_previous ? asGM_ALWAYS_CREATE : asGM_CREATE_IF_NOT_EXISTS);
-        r = mod->AddScriptSection("script", &script[0], script.size());
-        if (r < 0)
-        {
-            Log::error("Scripting", "AddScriptSection() failed");
-            return false;
-        }
-    
+        if (clear_previous)
+            m_script_sections.clear();
+        m_script_sections.push_back(std::move(script));
         return true;
     }
 
@@ -553,8 +689,37 @@ namespace Scripting
     bool ScriptEngine::compileLoadedScripts()
     {
         int r;
+
+        // Scripts of a track only change with the track, so the compiled
+        // bytecode is cached and reused the next time the track is loaded.
+        std::string cache_file;
+        if (!m_script_sections.empty())
+        {
+            cache_file = getBytecodeCacheFilename();
+            if (loadBytecode(cache_file))
+            {
+                m_script_sections.clear();
+                return true;
+            }
+        }
+        // Only fetched now, a failed loadBytecode discards the module
         asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_CREATE_IF_NOT_EXISTS);
 
+        // Add the script sections that will be compiled into executable
+        // code. The script section name will allow us to localize any errors
+        // in the script code.
+        for (const std::string& script : m_script_sections)
+        {
+            r = mod->AddScriptSection("script", script.data(), script.size());
+            if (r < 0)
+            {
+                Log::error("Scripting", "AddScriptSection() failed");
+                m_script_sections.clear();
+                return false;
+            }
+        }
+        m_script_sections.clear();
+
         // Compile the script. If there are any compiler messages they will
         // be written to the message stream that we set right after creating the 
         // script engine. If there are no errors, and no warnings, nothing will
@@ -566,6 +731,9 @@ namespace Scripting
             return false;
         }
 
+        if (!cache_file.empty())
+            saveBytecode(mod, cache_file);
+
         // The engine doesn't keep a copy of the script sections after Build() has
         // returned. So if the script needs to be recompiled, then all the script
         // sections must be added again.
@@ -579,6 +747,218 @@ namespace Scripting
         return true;
     }
 
+    //-----------------------------------------------------------------------------
+    /** Returns the name of the bytecode cache file for the currently loaded
+    *  script sections. Besides the preprocessed scripts (which already depend
+    *  on STK_VERSION) the name depends on the AngelScript library and the
+    *  registered interface, since bytecode refers to both.
+    */
+    std::string ScriptEngine::getBytecodeCacheFilename() const
+    {
+        uint64_t hash = m_config_hash;
+        hashString(&hash, asGetLibraryVersion());
+        hashString(&hash, asGetLibraryOptions());
+        const unsigned pointer_size = sizeof(void*);
+        hashBytes(&hash, &pointer_size, sizeof(pointer_size));
+        for (const std::string& script : m_script_sections)
+        {
+            const uint64_t size = script.size();
+            hashBytes(&hash, &size, sizeof(size));
+            hashBytes(&hash, script.data(), script.size());
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "script-%016llx.asbc",
+                 (unsigned long long)hash);
+        return file_manager->getCachedDataDir() + name;
+    }   // getBytecodeCacheFilename
+
+    //-----------------------------------------------------------------------------
+    /** Loads the bytecode saved by saveBytecode into a new main module.
+    *  \return False if there is no such file or it could not be loaded, in
+    *          which case the main module was discarded and the scripts must
+    *          be built.
+    */
+    bool ScriptEngine::loadBytecode(const std::string& filename)
+    {
+        FILE *f = FileUtils::fopenU8Path(filename, "rb");
+        if (!f)
+            return false;
+        // The header must match, otherwise a truncated or foreign file
+        // would be handed to the engine
+        char magic[sizeof(BYTECODE_MAGIC)];
+        uint64_t length = 0, hash = 0;
+        bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+                  memcmp(magic, BYTECODE_MAGIC, sizeof(magic)) == 0 &&
+                  fread(&length, sizeof(length), 1, f) == 1 &&
+                  fread(&hash, sizeof(hash), 1, f) == 1;
+        if (ok)
+        {
+            fseek(f, 0, SEEK_END);
+            long file_size = ftell(f);
+            fseek(f, BYTECODE_HEADER_SIZE, SEEK_SET);
+            ok = length > 0 && file_size >= (long)BYTECODE_HEADER_SIZE &&
+                 length == (uint64_t)(file_size - BYTECODE_HEADER_SIZE);
+        }
+        MemoryBinaryStream stream;
+        if (ok)
+        {
+            stream.m_data.resize((size_t)length);
+            uint64_t payload_hash = FNV_OFFSET_BASIS;
+            ok = fread(&stream.m_data[0], stream.m_data.size(), 1, f) == 1;
+            if (ok)
+            {
+                hashBytes(&payload_hash, stream.m_data.data(),
+                          stream.m_data.size());
+                ok = payload_hash == hash;
+            }
+        }
+        fclose(f);
+
+        asIScriptModule* mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
+                                                   asGM_ALWAYS_CREATE);
+        if (ok && mod->LoadByteCode(&stream) >= 0)
+            return true;
+
+        Log::warn("Scripting", "Can't load script bytecode cache '%s', "
+                  "compiling the scripts.", filename.c_str());
+        // A failed load can leave parts of the bytecode in the module
+        mod->Discard();
+        return false;
+    }   // loadBytecode
+
+    //-----------------------------------------------------------------------------
+    /** Saves the bytecode of the just built module, including debug info so
+    *  that exceptions still report line numbers. The bytecode is preceded by
+    *  a header with a magic, the payload length and its hash, which
+    *  loadBytecode verifies.
+    */
+    void ScriptEngine::saveBytecode(asIScriptModule* mod,
+                                    const std::string& filename) const
+    {
+        MemoryBinaryStream stream;
+        bool ok = mod->SaveByteCode(&stream, /*stripDebugInfo*/false) >= 0 &&
+                  !stream.m_data.empty();
+        if (ok)
+        {
+            const uint64_t length = stream.m_data.size();
+            uint64_t hash = FNV_OFFSET_BASIS;
+            hashBytes(&hash, stream.m_data.data(), stream.m_data.size());
+            ok = file_manager->writeFileAtomically(filename, [&](FILE* f)
+            {
+                return fwrite(BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC), 1, f) == 1 &&
+                       fwrite(&length, sizeof(length), 1, f) == 1 &&
+                       fwrite(&hash, sizeof(hash), 1, f) == 1 &&
+                       fwrite(stream.m_data.data(), stream.m_data.size(), 1,
+                              f) == 1;
+            });
+        }
+
+        if (!ok)
+        {
+            Log::warn("Scripting", "Can't write script bytecode cache '%s'.",
+                      filename.c_str());
+        }
+    }   // saveBytecode
+
+    //-----------------------------------------------------------------------------
+    /** Builds a script, round-trips its bytecode through the cache file and
+    *  checks that a corrupted cache file is rejected.
+    */
+    void ScriptEngine::unitTesting()
+    {
+        const std::string script_file =
+            file_manager->getCachedDataDir() + "unit-test-script.as";
+        FILE *f = FileUtils::fopenU8Path(script_file, "wb");
+        assert(f);
+        const char script[] = "int add(int a, int b) { return a + b + 1; }\n";
+        fwrite(script, strlen(script), 1, f);
+        fclose(f);
+
+        ScriptEngine* se = ScriptEngine::getInstance<ScriptEngine>();
+        auto call_add = [se]()
+        {
+            int result = -1;
+            se->runFunction(true, "int add(int, int)",
+                [](asIScriptContext* ctx)
+                {
+                    ctx->SetArgDWord(0, 2);
+                    ctx->SetArgDWord(1, 3);
+                },
+                [&result](asIScriptContext* ctx)
+                {
+                    result = (int)ctx->GetReturnDWord();
+                });
+            return result;
+        };
+
+        // First compilation builds the module and writes the cache
+        bool ok = se->loadScript(script_file, true);
+        assert(ok);
+        const std::string cache_file = se->getBytecodeCacheFilename();
+        file_manager->removeFile(cache_file);
+        ok = se->compileLoadedScripts();
+        assert(ok);
+        assert(file_manager->fileExists(cache_file));
+        assert(call_add() == 6);
+
+        // Load the bytecode from the cache into a fresh module
+        se->cleanupCache();
+        ok = se->loadBytecode(cache_file);
+        assert(ok);
+        assert(call_add() == 6);
+
+        // A changed payload byte must be detected by the header hash
+        f = FileUtils::fopenU8Path(cache_file, "r+b");
+        assert(f);
+        fseek(f, -1, SEEK_END);
+        int last = fgetc(f);
+        fseek(f, -1, SEEK_END);
+        fputc(last ^ 0xff, f);
+        fclose(f);
+        se->cleanupCache();
+        ok = se->loadBytecode(cache_file);
+        assert(!ok);
+        assert(!se->m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
+                                        asGM_ONLY_IF_EXISTS));
+
+        // A truncated file must be detected by the header length
+        std::string content;
+        f = FileUtils::fopenU8Path(cache_file, "rb");
+        assert(f);
+        char buffer[1024];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+            content.append(buffer, n);
+        fclose(f);
+        f = FileUtils::fopenU8Path(cache_file, "wb");
+        assert(f);
+        fwrite(content.data(), content.size() / 2, 1, f);
+        fclose(f);
+        se->cleanupCache();
+        ok = se->loadBytecode(cache_file);
+        assert(!ok);
+
+        // And the scripts are compiled again, replacing the corrupt file.
+        // The built module must be the one the engine uses.
+        se->cleanupCache();
+        ok = se->loadScript(script_file, true) && se->compileLoadedScripts();
+        assert(ok);
+        asIScriptModule* mod = se->m_engine->GetModule(
+            MODULE_ID_MAIN_SCRIPT_FILE, asGM_ONLY_IF_EXISTS);
+        assert(mod && mod->GetFunctionByDecl("int add(int, int)"));
+        assert(call_add() == 6);
+        se->cleanupCache();
+        ok = se->loadBytecode(cache_file);
+        assert(ok);
+        assert(call_add() == 6);
+
+        se->cleanupCache();
+        file_manager->removeFile(cache_file);
+        file_manager->removeFile(script_file);
+        ScriptEngine::kill();
+    }   // unitTesting
+
     //-----------------------------------------------------------------------------
 
     PendingTimeout::PendingTimeout(double time, asIScriptFunction* callback_delegate) 
@@ -25,9 +25,11 @@
 #include "utils/singleton.hpp"
 
 #include <angelscript.h>
+#include <cstdint>
 #include <functional>
-#include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class TrackObjectPresentation;
 
@@ -67,10 +69,13 @@ namespace Scripting
     public:
 
 
-        void runFunction(bool warn_if_not_found, std::string function_name);
-        void runFunction(bool warn_if_not_found, std::string function_name,
+        void runFunction(bool warn_if_not_found,
+                         const std::string& function_name);
+        void runFunction(bool warn_if_not_found,
+                         const std::string& function_name,
             std::function<void(asIScriptContext*)> callback);
-        void runFunction(bool warn_if_not_found, std::string function_name,
+        void runFunction(bool warn_if_not_found,
+                         const std::string& function_name,
             std::function<void(asIScriptContext*)> callback,
             std::function<void(asIScriptContext*)> get_return_value);
         void runDelegate(asIScriptFunction* delegate_fn);
@@ -86,12 +91,39 @@ namespace Scripting
 
         asIScriptEngine* getEngine() { return m_engine; }
 
+        static void unitTesting();
+
     private:
         asIScriptEngine *m_engine;
-        std::map<std::string, asIScriptFunction*> m_functions_cache;
+
+        /** Resolved script functions, keyed by their declaration. NULL is
+         *  stored for functions which do not exist in the module. */
+        std::unordered_map<std::string, asIScriptFunction*> m_functions_cache;
+
+        /** Contexts which finished executing and can be reused, so that not
+         *  every script call has to create (and allocate the stack of) a new
+         *  context. The engine hands them out via RequestContext. */
+        std::vector<asIScriptContext*> m_context_pool;
+
+        /** Preprocessed sections of all scripts loaded since the last
+         *  compileLoadedScripts call. */
+        std::vector<std::string> m_script_sections;
+
+        /** Hash of the registered application interface, part of the
+         *  bytecode cache key. */
+        uint64_t m_config_hash;
+
         PtrVector<PendingTimeout> m_pending_timeouts;
 
         void configureEngine(asIScriptEngine *engine);
+        std::string getBytecodeCacheFilename() const;
+        bool loadBytecode(const std::string& filename);
+        void saveBytecode(asIScriptModule* mod,
+                          const std::string& filename) const;
+        static asIScriptContext* requestContext(asIScriptEngine* engine,
+                                                void* param);
+        static void returnContext(asIScriptEngine* engine,
+                                  asIScriptContext* ctx, void* param);
     };   // class ScriptEngine
 
 }
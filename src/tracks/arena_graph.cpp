@@ -21,14 +21,29 @@
 #include "config/user_config.hpp"
 #include "io/file_manager.hpp"
 #include "io/xml_node.hpp"
+#include "network/crypto.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/arena_node.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <queue>
+#include <thread>
+
+namespace
+{
+    /** Stored at the start of a shortest path cache file, change it when
+     *  the format of the file or the path computation changes. */
+    const char SHORTEST_PATH_CACHE_MAGIC[8] = { 'S', 'T', 'K', 'A', 'G',
+                                                'S', 'P', '1' };
+}   // anonymous namespace
 
 // -----------------------------------------------------------------------------
 ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
@@ -36,9 +51,15 @@ ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
 {
     loadNavmesh(navmesh);
     buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    // Compute shortest distance from all nodes, unless they were already
+    // computed for the very same navmesh before
+    const std::string cache_file = getCacheFilename(navmesh);
+    if (cache_file.empty() || !loadShortestPaths(cache_file))
+    {
+        computeAllShortestPaths();
+        if (!cache_file.empty())
+            saveShortestPaths(cache_file);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -171,6 +192,7 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
         }
     }
     delete xml;
+    buildSpatialGrid();
 
 }   // loadNavmesh
 
@@ -179,8 +201,8 @@ void ArenaGraph::buildGraph()
 {
     const unsigned int n_nodes = getNumNodes();
 
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
+    m_distance_matrix.assign(n_nodes * n_nodes, 9999.9f);
+    m_edge_length.assign(n_nodes, std::vector<float>());
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         ArenaNode* cur_node = getNode(i);
@@ -188,22 +210,22 @@ void ArenaGraph::buildGraph()
         {
             Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
             float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
+            m_distance_matrix[i * n_nodes + adjacent] = distance;
+            m_edge_length[i].push_back(distance);
         }
-        m_distance_matrix[i][i] = 0.0f;
+        m_distance_matrix[i * n_nodes + i] = 0.0f;
     }
 
     // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
+    m_parent_node.assign(n_nodes * n_nodes, Graph::UNKNOWN_SECTOR);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         for (unsigned int j = 0; j < n_nodes; j++)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
+            if (i == j || m_distance_matrix[i * n_nodes + j] >= 9899.9f)
+                m_parent_node[i * n_nodes + j] = -1;
             else
-                m_parent_node[i][j] = i;
+                m_parent_node[i * n_nodes + j] = i;
         }   // for j
     }   // for i
 
@@ -216,6 +238,8 @@ void ArenaGraph::buildGraph()
  *  source to j and m_parent_node[source][j] stores the last vertex visited on
  *  the shortest path from i to j before visiting j. Suppose the shortest path
  *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  Only the row of 'source' is written, and edge lengths are taken from
+ *  m_edge_length, so different sources can be computed concurrently.
  */
 void ArenaGraph::computeDijkstra(int source)
 {
@@ -235,6 +259,8 @@ void ArenaGraph::computeDijkstra(int source)
     IndDistPair begin(source, 0.0f);
     queue.push(begin);
     const unsigned int n = getNumNodes();
+    float* distance = &m_distance_matrix[source * n];
+    int16_t* parent = &m_parent_node[source * n];
     std::vector<bool> visited;
     visited.resize(n, false);
     while (!queue.empty())
@@ -246,24 +272,58 @@ void ArenaGraph::computeDijkstra(int source)
         if (visited[cur_index]) continue;
         visited[cur_index] = true;
 
-        for (const int& adjacent : getNode(cur_index)->getAdjacentNodes())
+        const std::vector<int>& adjacents =
+            getNode(cur_index)->getAdjacentNodes();
+        const std::vector<float>& edge_length = m_edge_length[cur_index];
+        for (unsigned int a = 0; a < adjacents.size(); a++)
         {
+            const int adjacent = adjacents[a];
             // Distance already computed, can be ignored
             if (visited[adjacent]) continue;
 
-            float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+            float new_dist = current.second + edge_length[a];
+            // Direct neighbours of the source start with the edge length
+            // from buildGraph, they still need to be expanded
+            if (new_dist > distance[adjacent]) continue;
+            if (new_dist < distance[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                distance[adjacent] = new_dist;
+                parent[adjacent] = cur_index;
             }
-            IndDistPair pair(adjacent, new_dist);
-            queue.push(pair);
+            queue.push(IndDistPair(adjacent, new_dist));
         }
     }
 }   // computeDijkstra
 
+// ----------------------------------------------------------------------------
+/** Computes the shortest paths from all nodes. The Dijkstra runs of the
+ *  different sources are independent, so large navmeshes distribute them
+ *  over several threads.
+ */
+void ArenaGraph::computeAllShortestPaths()
+{
+    const unsigned int n = getNumNodes();
+    unsigned int num_threads = std::thread::hardware_concurrency();
+    // Starting threads is not worth it for small arenas
+    if (n < 256 || num_threads == 0)
+        num_threads = 1;
+    num_threads = std::min(num_threads, 8u);
+
+    std::atomic<unsigned int> next_source(0);
+    auto worker = [this, n, &next_source]()
+    {
+        unsigned int source;
+        while ((source = next_source.fetch_add(1)) < n)
+            computeDijkstra(source);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < num_threads; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& t : threads)
+        t.join();
+}   // computeAllShortestPaths
+
 // ----------------------------------------------------------------------------
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
@@ -280,16 +340,19 @@ void ArenaGraph::computeFloydWarshall()
 
     for (unsigned int k = 0; k < n; k++)
     {
+        const float* dist_k = &m_distance_matrix[k * n];
+        const int16_t* parent_k = &m_parent_node[k * n];
         for (unsigned int i = 0; i < n; i++)
         {
+            float* dist_i = &m_distance_matrix[i * n];
+            int16_t* parent_i = &m_parent_node[i * n];
+            const float dist_ik = dist_i[k];
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
+                if (dist_ik + dist_k[j] < dist_i[j])
                 {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
+                    dist_i[j] = dist_ik + dist_k[j];
+                    parent_i[j] = parent_k[j];
                 }
             }
         }
@@ -297,6 +360,94 @@ void ArenaGraph::computeFloydWarshall()
 
 }   // computeFloydWarshall
 
+// ----------------------------------------------------------------------------
+/** Returns the name of the file in which the shortest paths of the given
+ *  navmesh are cached. The name contains a hash of the navmesh content, so
+ *  a modified navmesh never uses outdated data. Returns an empty string if
+ *  the navmesh can not be read.
+ */
+std::string ArenaGraph::getCacheFilename(const std::string &navmesh) const
+{
+    FILE* fp = FileUtils::fopenU8Path(navmesh, "rb");
+    if (!fp)
+        return "";
+    std::string content;
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        content.append(buffer, len);
+    fclose(fp);
+
+    std::string name = "arena-";
+    for (uint8_t c : Crypto::sha256(content))
+    {
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", c);
+        name += hex;
+    }
+    return file_manager->getCachedDataDir() + name + ".paths";
+}   // getCacheFilename
+
+// ----------------------------------------------------------------------------
+/** Loads the distance and parent matrix from a cache file written by
+ *  saveShortestPaths.
+ *  \return False if the file does not exist or does not match this graph.
+ */
+bool ArenaGraph::loadShortestPaths(const std::string &cache_file)
+{
+    FILE* fp = FileUtils::fopenU8Path(cache_file, "rb");
+    if (!fp)
+        return false;
+
+    const unsigned int n = getNumNodes();
+    char magic[sizeof(SHORTEST_PATH_CACHE_MAGIC)];
+    uint32_t num_nodes = 0;
+    std::vector<float> distance(n * n);
+    std::vector<int16_t> parent(n * n);
+    bool ok =
+        fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+        memcmp(magic, SHORTEST_PATH_CACHE_MAGIC, sizeof(magic)) == 0 &&
+        fread(&num_nodes, sizeof(num_nodes), 1, fp) == 1 &&
+        num_nodes == n &&
+        fread(distance.data(), sizeof(float), n * n, fp) == n * n &&
+        fread(parent.data(), sizeof(int16_t), n * n, fp) == n * n;
+    fclose(fp);
+
+    if (!ok)
+    {
+        Log::warn("ArenaGraph", "Ignoring invalid navmesh cache '%s'.",
+                  cache_file.c_str());
+        return false;
+    }
+    m_distance_matrix.swap(distance);
+    m_parent_node.swap(parent);
+    return true;
+}   // loadShortestPaths
+
+// ----------------------------------------------------------------------------
+/** Saves the distance and parent matrix, so that the next load of the same
+ *  navmesh can skip computing them.
+ */
+void ArenaGraph::saveShortestPaths(const std::string &cache_file) const
+{
+    const uint32_t n = getNumNodes();
+    auto write = [this, n](FILE* fp)
+    {
+        return
+            fwrite(SHORTEST_PATH_CACHE_MAGIC, 1,
+                   sizeof(SHORTEST_PATH_CACHE_MAGIC), fp) ==
+                                         sizeof(SHORTEST_PATH_CACHE_MAGIC) &&
+            fwrite(&n, sizeof(n), 1, fp) == 1 &&
+            fwrite(m_distance_matrix.data(), sizeof(float), n * n, fp) == n * n &&
+            fwrite(m_parent_node.data(), sizeof(int16_t), n * n, fp) == n * n;
+    };
+    if (!file_manager->writeFileAtomically(cache_file, write))
+    {
+        Log::warn("ArenaGraph", "Can't write navmesh cache '%s'.",
+                  cache_file.c_str());
+    }
+}   // saveShortestPaths
+
 // -----------------------------------------------------------------------------
 void ArenaGraph::loadGoalNodes(const XMLNode *node)
 {
@@ -349,7 +500,8 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<float> dist(m_distance_matrix.begin() + i * getNumNodes(),
+                            m_distance_matrix.begin() + (i + 1) * getNumNodes());
 
         // Skip the same node
         dist[i] = 999999.0f;
@@ -370,14 +522,14 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
 /** Determines the full path from 'from' to 'to' and returns it in a
  *  std::vector (in reverse order). Used only for unit testing.
  */
-std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
+std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to, unsigned n,
+                                       const std::vector<int16_t>& parent_node)
 {
     std::vector<int16_t> path;
     path.push_back(to);
     while(from!=to)
     {
-        to = parent_node[from][to];
+        to = parent_node[from * n + to];
         path.push_back(to);
     }
     return path;
@@ -398,11 +550,21 @@ void ArenaGraph::unitTesting()
     double s = StkTime::getRealTime();
     ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
     double e = StkTime::getRealTime();
+    Log::error("Time", "Cached/Dijkstra %lf", e-s);
+
+    // Recompute the paths, so that both the cached and the computed
+    // results are compared with Floyd-Warshall
+    std::vector<float> cached_distance_matrix = ag->m_distance_matrix;
+    ag->buildGraph();
+    s = StkTime::getRealTime();
+    ag->computeAllShortestPaths();
+    e = StkTime::getRealTime();
     Log::error("Time", "Dijkstra       %lf", e-s);
+    assert(cached_distance_matrix == ag->m_distance_matrix);
 
     // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
+    std::vector<float> distance_matrix = ag->m_distance_matrix;
+    std::vector<int16_t> parent_node = ag->m_parent_node;
     ag->buildGraph();
 
     // Now compute results with Floyd-Warshall
@@ -412,15 +574,16 @@ void ArenaGraph::unitTesting()
     Log::error("Time", "Floyd-Warshall %lf", e-s);
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    const unsigned int n = ag->getNumNodes();
+    for(unsigned int i=0; i<n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for(unsigned int j=0; j<n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            if(fabsf(ag->m_distance_matrix[i*n+j] - distance_matrix[i*n+j]) > 0.001f)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, distance_matrix[i*n+j], ag->m_distance_matrix[i*n+j]);
                 error_count++;
             }    // if distance is too different
 
@@ -432,16 +595,16 @@ void ArenaGraph::unitTesting()
             // debugging in the feature
 #undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
 #ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if(ag->m_parent_node[i*n+j] != parent_node[i*n+j])
             {
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
+                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, n, parent_node);
+                std::vector<int16_t> floyd_path = getPathFromTo(i, j, n, ag->m_parent_node);
                 if(dijkstra_path.size()!=floyd_path.size())
                 {
                     Log::error("ArenaGraph",
                                "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
+                               i, j, parent_node[i*n+j], ag->m_parent_node[i*n+j]);
                     continue;
                 }
                 Log::error("ArenaGraph", "Path problems from %d to %d:",
@@ -34,11 +34,17 @@ class XMLNode;
 class ArenaGraph : public Graph
 {
 private:
-    /** The actual graph data structure, it is an adjacency matrix. */
-    std::vector<std::vector<float>> m_distance_matrix;
+    /** The actual graph data structure, it is an adjacency matrix. Stored
+     *  row by row, the distance from i to j is at i * getNumNodes() + j. */
+    std::vector<float> m_distance_matrix;
 
-    /** The matrix that is used to store computed shortest paths. */
-    std::vector<std::vector<int16_t>> m_parent_node;
+    /** The matrix that is used to store computed shortest paths, same
+     *  layout as m_distance_matrix. */
+    std::vector<int16_t> m_parent_node;
+
+    /** Length of the edges to the adjacent nodes of each node, in the same
+     *  order as ArenaNode::getAdjacentNodes(). */
+    std::vector<std::vector<float> > m_edge_length;
 
     /** Used in soccer mode to colorize the goal lines in minimap. */
     std::set<int> m_red_node;
@@ -56,10 +62,18 @@ private:
     // ------------------------------------------------------------------------
     void computeDijkstra(int n);
     // ------------------------------------------------------------------------
+    void computeAllShortestPaths();
+    // ------------------------------------------------------------------------
     void computeFloydWarshall();
     // ------------------------------------------------------------------------
-    static std::vector<int16_t> getPathFromTo(int from, int to,
-                     const std::vector< std::vector< int16_t > >& parent_node);
+    std::string getCacheFilename(const std::string &navmesh) const;
+    // ------------------------------------------------------------------------
+    bool loadShortestPaths(const std::string &cache_file);
+    // ------------------------------------------------------------------------
+    void saveShortestPaths(const std::string &cache_file) const;
+    // ------------------------------------------------------------------------
+    static std::vector<int16_t> getPathFromTo(int from, int to, unsigned n,
+                                      const std::vector<int16_t>& parent_node);
     // ------------------------------------------------------------------------
     virtual bool hasLapLine() const OVERRIDE                  { return false; }
     // ------------------------------------------------------------------------
@@ -84,7 +98,7 @@ public:
     {
         if (i == Graph::UNKNOWN_SECTOR || j == Graph::UNKNOWN_SECTOR)
             return Graph::UNKNOWN_SECTOR;
-        return (int)(m_parent_node[j][i]);
+        return (int)(m_parent_node[j * getNumNodes() + i]);
     }
     // ------------------------------------------------------------------------
     /** Returns the distance between any two nodes */
@@ -92,7 +106,7 @@ public:
     {
         if (from == Graph::UNKNOWN_SECTOR || to == Graph::UNKNOWN_SECTOR)
             return 99999.0f;
-        return m_distance_matrix[from][to];
+        return m_distance_matrix[from * getNumNodes() + to];
     }
 
 };   // ArenaGraph
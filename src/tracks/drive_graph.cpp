@@ -160,6 +160,7 @@ void DriveGraph::load(const std::string &quad_file_name,
             max_height_testing);
     }
     delete quad;
+    buildSpatialGrid();
 
     const XMLNode *xml = file_manager->createXMLTree(filename);
 
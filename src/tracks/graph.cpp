@@ -31,11 +31,21 @@
 #include "tracks/drive_node_2d.hpp"
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
+#include "io/file_manager.hpp"
+#include "tracks/arena_graph.hpp"
+#include "tracks/drive_graph.hpp"
+#include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
 
 #include <ICameraSceneNode.h>
 #include <ISceneManager.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
 #ifndef SERVER_ONLY
 #include <ge_main.hpp>
 #endif
@@ -55,6 +65,11 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x     = 0.0f;
+    m_grid_min_z     = 0.0f;
+    m_grid_cell_size = 1.0f;
+    m_grid_width     = 0;
+    m_grid_height    = 0;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -676,6 +691,31 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
         return;
     }   // if still on same quad
 
+    // Without a list of sectors only the quads in the grid cell of xyz need
+    // to be tested, in the same order as the full search below.
+    if (all_sectors == NULL && m_grid_width > 0)
+    {
+        int start_node = *sector == UNKNOWN_SECTOR ||
+            *sector + 1 >= (int)m_all_nodes.size() ? 0 : *sector + 1;
+        int cx = (int)floorf((xyz.getX() - m_grid_min_x) / m_grid_cell_size);
+        int cz = (int)floorf((xyz.getZ() - m_grid_min_z) / m_grid_cell_size);
+        if (cx < 0 || cx >= m_grid_width || cz < 0 || cz >= m_grid_height)
+        {
+            *sector = m_grid_unbounded_nodes.empty() ? UNKNOWN_SECTOR :
+                findRoadSectorInList(xyz, start_node,
+                m_grid_unbounded_nodes.data(),
+                (unsigned int)m_grid_unbounded_nodes.size(), ignore_vertical);
+            return;
+        }
+        unsigned int cell = cz * m_grid_width + cx;
+        unsigned int begin = m_grid_cell_start[cell];
+        unsigned int count = m_grid_cell_start[cell + 1] - begin;
+        *sector = count == 0 ? UNKNOWN_SECTOR :
+            findRoadSectorInList(xyz, start_node, &m_grid_nodes[begin], count,
+            ignore_vertical);
+        return;
+    }
+
     // Now we search through all quads, starting with
     // the current one
     int indx       = *sector;
@@ -710,6 +750,27 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
     return;
 }   // findRoadSector
 
+//-----------------------------------------------------------------------------
+/** Returns the first node of a sorted list of nodes that contains xyz, in the
+ *  order starting with start_node and wrapping around at the end of the
+ *  graph, or UNKNOWN_SECTOR if no node contains xyz.
+ */
+int Graph::findRoadSectorInList(const Vec3& xyz, int start_node,
+                                const int* nodes, unsigned int count,
+                                bool ignore_vertical) const
+{
+    unsigned int first =
+        (unsigned int)(std::lower_bound(nodes, nodes + count, start_node) -
+        nodes);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int j = first + i < count ? first + i : first + i - count;
+        if (getQuad(nodes[j])->pointInside(xyz, ignore_vertical))
+            return nodes[j];
+    }
+    return UNKNOWN_SECTOR;
+}   // findRoadSectorInList
+
 //-----------------------------------------------------------------------------
 /** findOutOfRoadSector finds the sector where XYZ is, but as it name
     implies, it is more accurate for the outside of the track than the
@@ -754,10 +815,8 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
         // shortcut. If we only tested a limited number of quads to
         // improve the performance the crossing of a lap might not be
         // detected (because quad 0 is not tested, only quads on the
-        // shortcuts are tested). If this should become a performance
-        // bottleneck, we need to set up a graph of 'next' quads for each
-        // quad (similar to what the AI does), and only test the quads
-        // in this graph.
+        // shortcuts are tested). The spatial grid (see buildSpatialGrid)
+        // gives the same result without testing all quads.
         const int LIMIT = getNumNodes();
         count           = LIMIT;
         // Start 10 quads before the current quad, so the quads closest
@@ -766,6 +825,24 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
         if(current_sector<0) current_sector += getNumNodes();
     }
 
+    if (!all_sectors && m_grid_width > 0)
+    {
+        // Same result as the full search below: the scan order starting
+        // after current_sector is only used to break ties.
+        int start_node = (current_sector + 1) % (int)getNumNodes();
+        if (start_node < 0)
+            start_node += getNumNodes();
+        for (int phase = 0; phase < 2; phase++)
+        {
+            int sector = findOutOfRoadSectorInGrid(xyz, start_node, phase,
+                                                   ignore_vertical);
+            if (sector != UNKNOWN_SECTOR)
+                return sector;
+        }
+        Log::warn("Graph", "unknown sector found.");
+        return 0;
+    }
+
     int   min_sector = UNKNOWN_SECTOR;
     float min_dist_2 = 999999.0f*999999.0f;
 
@@ -821,6 +898,499 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
     return 0;
 }   // findOutOfRoadSector
 
+//-----------------------------------------------------------------------------
+/** Finds the closest node for findOutOfRoadSector using the grid: the cells
+ *  are visited in rings around xyz, until no node in a cell further away can
+ *  be closer than the closest node found so far.
+ *  \param start_node Node first tested by the full search, used to select
+ *         the same node if two nodes have the same distance.
+ *  \param phase 0 if the height of the node should be tested, 1 otherwise.
+ */
+int Graph::findOutOfRoadSectorInGrid(const Vec3& xyz, int start_node,
+                                     int phase, bool ignore_vertical) const
+{
+    const int num_nodes = (int)getNumNodes();
+    const float x = xyz.getX();
+    const float z = xyz.getZ();
+    int cx = (int)floorf((x - m_grid_min_x) / m_grid_cell_size);
+    int cz = (int)floorf((z - m_grid_min_z) / m_grid_cell_size);
+    cx = std::min(std::max(cx, 0), m_grid_width - 1);
+    cz = std::min(std::max(cz, 0), m_grid_height - 1);
+
+    int   min_sector = UNKNOWN_SECTOR;
+    int   min_order  = num_nodes;
+    float min_dist_2 = 999999.0f*999999.0f;
+    const int max_ring = std::max(m_grid_width, m_grid_height);
+    for (int ring = 0; ring <= max_ring; ring++)
+    {
+        for (int z_cell = cz - ring; z_cell <= cz + ring; z_cell++)
+        {
+            if (z_cell < 0 || z_cell >= m_grid_height)
+                continue;
+            // Only the border of the ring is new
+            const bool border = z_cell == cz - ring || z_cell == cz + ring;
+            for (int x_cell = cx - ring; x_cell <= cx + ring;
+                 x_cell += border || ring == 0 ? 1 : 2 * ring)
+            {
+                if (x_cell < 0 || x_cell >= m_grid_width)
+                    continue;
+                unsigned int cell = z_cell * m_grid_width + x_cell;
+                for (unsigned int i = m_grid_cell_start[cell];
+                     i < m_grid_cell_start[cell + 1]; i++)
+                {
+                    const int node = m_grid_nodes[i];
+                    const Quad* q = getQuad(node);
+                    if (q->isIgnored())
+                        continue;
+                    float dist_2 = q->getDistance2FromPoint(xyz);
+                    int order = node >= start_node ? node - start_node
+                                                   : node - start_node +
+                                                     num_nodes;
+                    // Equal distances are resolved like the full search,
+                    // which only replaces the found node if it is closer
+                    if (!(dist_2 < min_dist_2 ||
+                        (min_sector != UNKNOWN_SECTOR &&
+                        dist_2 == min_dist_2 && order < min_order)))
+                        continue;
+                    float dist = xyz.getY() - q->getMinHeight();
+                    if (phase == 1 || (dist < 5.0f && dist > -1.0f) ||
+                        q->is3DQuad() || ignore_vertical)
+                    {
+                        min_dist_2 = dist_2;
+                        min_sector = node;
+                        min_order  = order;
+                    }
+                }   // for i in cell
+            }   // for x_cell
+        }   // for z_cell
+
+        // All cells visited
+        if (cx - ring <= 0 && cx + ring >= m_grid_width - 1 &&
+            cz - ring <= 0 && cz + ring >= m_grid_height - 1)
+            break;
+
+        // Minimum distance of xyz to any cell outside of the visited rings,
+        // each node is in all cells its bounding box touches, so a node
+        // that was not tested is at least that far away.
+        float bound = -1.0f;
+        if (cx - ring > 0)
+            bound = x - (m_grid_min_x + (cx - ring) * m_grid_cell_size);
+        if (cx + ring < m_grid_width - 1)
+        {
+            float d = m_grid_min_x + (cx + ring + 1) * m_grid_cell_size - x;
+            bound = bound < 0.0f ? d : std::min(bound, d);
+        }
+        if (cz - ring > 0)
+        {
+            float d = z - (m_grid_min_z + (cz - ring) * m_grid_cell_size);
+            bound = bound < 0.0f ? d : std::min(bound, d);
+        }
+        if (cz + ring < m_grid_height - 1)
+        {
+            float d = m_grid_min_z + (cz + ring + 1) * m_grid_cell_size - z;
+            bound = bound < 0.0f ? d : std::min(bound, d);
+        }
+        if (min_sector != UNKNOWN_SECTOR && bound > 0.0f &&
+            bound * bound > min_dist_2)
+            break;
+    }   // for ring
+    return min_sector;
+}   // findOutOfRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Sorts all nodes into a uniform 2d grid, so findRoadSector and
+ *  findOutOfRoadSector only need to test the nodes close to a point. Each
+ *  node is added to all cells touched by the bounding box of the area in
+ *  which pointInside can be true (which includes the center line used by
+ *  getDistance2FromPoint). This must be called after all nodes are created.
+ */
+void Graph::buildSpatialGrid()
+{
+    m_grid_cell_start.clear();
+    m_grid_nodes.clear();
+    m_grid_unbounded_nodes.clear();
+    m_grid_width = 0;
+    m_grid_height = 0;
+    const unsigned int num_nodes = getNumNodes();
+    if (num_nodes == 0)
+        return;
+
+    // Added to each bounding box, so that rounding errors near the border
+    // of a quad or a slightly non-planar 3d box never matter
+    const float margin = 0.5f;
+    float min_x = std::numeric_limits<float>::max();
+    float min_z = std::numeric_limits<float>::max();
+    float max_x = -std::numeric_limits<float>::max();
+    float max_z = -std::numeric_limits<float>::max();
+    float total_size = 0.0f;
+    std::vector<bool> unbounded(num_nodes, false);
+    // Bounding box (min x, min z, max x, max z) of each node
+    std::vector<float> node_bb(num_nodes * 4);
+    for (unsigned int i = 0; i < num_nodes; i++)
+    {
+        const Quad* q = getQuad(i);
+        std::vector<Vec3> points;
+        for (int j = 0; j < 4; j++)
+        {
+            points.push_back((*q)[j]);
+            if (q->is3DQuad())
+            {
+                // See BoundingBox3D
+                points.push_back((*q)[j] + 5.0f * q->getNormal());
+                points.push_back((*q)[j] - 1.0f * q->getNormal());
+            }
+        }
+        float* bb = &node_bb[i * 4];
+        bb[0] = bb[1] = std::numeric_limits<float>::max();
+        bb[2] = bb[3] = -std::numeric_limits<float>::max();
+        for (const Vec3& p : points)
+        {
+            bb[0] = std::min(bb[0], p.getX());
+            bb[1] = std::min(bb[1], p.getZ());
+            bb[2] = std::max(bb[2], p.getX());
+            bb[3] = std::max(bb[3], p.getZ());
+        }
+        // Quad::pointInside tests the triangles 0,1,2 and 0,2,3 (and the 3d
+        // box is built on them). Only if one of them has (almost) no area
+        // the tested area can be unbounded.
+        Vec3 d01 = (*q)[1] - (*q)[0], d02 = (*q)[2] - (*q)[0];
+        Vec3 d03 = (*q)[3] - (*q)[0];
+        if (!q->is3DQuad())
+        {
+            d01.setY(0.0f);
+            d02.setY(0.0f);
+            d03.setY(0.0f);
+        }
+        float area_1 = d01.cross(d02).length();
+        float area_2 = d02.cross(d03).length();
+        bool degenerated = area_1 <= 0.001f * (d01.length2() + d02.length2())
+                        || area_2 <= 0.001f * (d02.length2() + d03.length2());
+        if (degenerated || !std::isfinite(bb[0] + bb[1] + bb[2] + bb[3]))
+        {
+            unbounded[i] = true;
+            m_grid_unbounded_nodes.push_back(i);
+            if (!std::isfinite(bb[0] + bb[1] + bb[2] + bb[3]))
+            {
+                bb[0] = bb[1] = bb[2] = bb[3] = 0.0f;
+                continue;
+            }
+        }
+        bb[0] -= margin;
+        bb[1] -= margin;
+        bb[2] += margin;
+        bb[3] += margin;
+        min_x = std::min(min_x, bb[0]);
+        min_z = std::min(min_z, bb[1]);
+        max_x = std::max(max_x, bb[2]);
+        max_z = std::max(max_z, bb[3]);
+        total_size += 0.5f * (bb[2] - bb[0] + bb[3] - bb[1]);
+    }
+    if (min_x > max_x)
+        return;
+
+    // Cells about the size of an average node, so a point is in the cell
+    // of only a few nodes, limited to a reasonable number of cells.
+    m_grid_min_x = min_x;
+    m_grid_min_z = min_z;
+    m_grid_cell_size = std::max(total_size / num_nodes, 1.0f);
+    const float max_cells = 512.0f * 512.0f;
+    float cells = ((max_x - min_x) / m_grid_cell_size + 1.0f) *
+        ((max_z - min_z) / m_grid_cell_size + 1.0f);
+    if (cells > max_cells)
+        m_grid_cell_size *= sqrtf(cells / max_cells);
+    m_grid_width  = (int)((max_x - min_x) / m_grid_cell_size) + 1;
+    m_grid_height = (int)((max_z - min_z) / m_grid_cell_size) + 1;
+
+    // Count the nodes in each cell, then fill in node order so that each
+    // cell is sorted by node index.
+    const unsigned int num_cells = m_grid_width * m_grid_height;
+    m_grid_cell_start.assign(num_cells + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<unsigned int> next;
+        if (pass == 1)
+        {
+            for (unsigned int c = 0; c < num_cells; c++)
+                m_grid_cell_start[c + 1] += m_grid_cell_start[c];
+            m_grid_nodes.resize(m_grid_cell_start[num_cells]);
+            next.assign(m_grid_cell_start.begin(),
+                        m_grid_cell_start.end() - 1);
+        }
+        for (unsigned int i = 0; i < num_nodes; i++)
+        {
+            const float* bb = &node_bb[i * 4];
+            int x0 = 0, z0 = 0;
+            int x1 = m_grid_width - 1, z1 = m_grid_height - 1;
+            if (!unbounded[i])
+            {
+                x0 = (int)((bb[0] - m_grid_min_x) / m_grid_cell_size);
+                z0 = (int)((bb[1] - m_grid_min_z) / m_grid_cell_size);
+                x1 = std::min((int)((bb[2] - m_grid_min_x) /
+                    m_grid_cell_size), m_grid_width - 1);
+                z1 = std::min((int)((bb[3] - m_grid_min_z) /
+                    m_grid_cell_size), m_grid_height - 1);
+            }
+            for (int z = z0; z <= z1; z++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    unsigned int cell = z * m_grid_width + x;
+                    if (pass == 0)
+                        m_grid_cell_start[cell + 1]++;
+                    else
+                        m_grid_nodes[next[cell]++] = i;
+                }
+            }
+        }
+    }
+    Log::debug("Graph", "Spatial grid %dx%d, cell size %f, %d entries.",
+        m_grid_width, m_grid_height, m_grid_cell_size,
+        (int)m_grid_nodes.size());
+}   // buildSpatialGrid
+
+namespace
+{
+    /** A graph of nodes given by the unit test, without a track. Arena nodes
+     *  are used since drive nodes need a DriveGraph. */
+    class TestGraph : public Graph
+    {
+    private:
+        virtual bool hasLapLine() const                     { return false; }
+        virtual void differentNodeColor(int n, video::SColor* c) const     {}
+    public:
+        void addNode(const Vec3& p0, const Vec3& p1, const Vec3& p2,
+                     const Vec3& p3)
+        {
+            createQuad(p0, p1, p2, p3, getNumNodes(), /*invisible*/false,
+                /*ai_ignore*/false, /*is_arena*/true, /*ignore*/false);
+        }   // addNode
+        void build()                                 { buildSpatialGrid(); }
+    };   // TestGraph
+}   // anonymous namespace
+
+//-----------------------------------------------------------------------------
+/** Checks that findRoadSector and findOutOfRoadSector give the same node
+ *  with the spatial grid as with the linear search over all nodes. The graph
+ *  has a ring road, a bridge crossing it, sloped (3d) nodes and a degenerate
+ *  node. The points are random points on and off the road, and points on
+ *  the edges of the grid cells and of the nodes.
+ */
+void Graph::unitTesting()
+{
+    TestGraph graph;
+    // A ring of 48 nodes with varying width
+    const int ring_nodes = 48;
+    for (int i = 0; i < ring_nodes; i++)
+    {
+        float a0 = 2.0f * M_PI * i / ring_nodes;
+        float a1 = 2.0f * M_PI * (i + 1) / ring_nodes;
+        float w0 = 4.0f + 2.0f * sinf(3.0f * a0);
+        float w1 = 4.0f + 2.0f * sinf(3.0f * a1);
+        graph.addNode(Vec3(cosf(a0) * (50 - w0), 0, sinf(a0) * (50 - w0)),
+                      Vec3(cosf(a0) * (50 + w0), 0, sinf(a0) * (50 + w0)),
+                      Vec3(cosf(a1) * (50 + w1), 0, sinf(a1) * (50 + w1)),
+                      Vec3(cosf(a1) * (50 - w1), 0, sinf(a1) * (50 - w1)));
+    }
+    // A bridge crossing the ring at x = 0, with sloped ramps, so that some
+    // points are inside of several nodes
+    for (int i = 0; i < 12; i++)
+    {
+        float z0 = -60.0f + 10.0f * i, z1 = z0 + 10.0f;
+        float y0 = i == 0 ? 0.0f : 8.0f, y1 = i == 11 ? 0.0f : 8.0f;
+        graph.addNode(Vec3(-3, y0, z0), Vec3(3, y0, z0), Vec3(3, y1, z1),
+                      Vec3(-3, y1, z1));
+    }
+    // A node whose second triangle has no area
+    graph.addNode(Vec3(70, 0, 70), Vec3(75, 0, 70), Vec3(75, 0, 75),
+                  Vec3(75, 0, 75));
+    graph.build();
+    assert(graph.m_grid_width > 1 && graph.m_grid_height > 1);
+    assert(!graph.m_grid_unbounded_nodes.empty());
+
+    std::vector<Vec3> points;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> random_xz(-90.0f, 90.0f);
+    std::uniform_real_distribution<float> random_y(-3.0f, 12.0f);
+    for (unsigned int i = 0; i < 5000; i++)
+    {
+        points.push_back(Vec3(random_xz(random), random_y(random),
+                              random_xz(random)));
+    }
+    // Points on the edges and corners of grid cells, including the border
+    // of the grid and outside of it
+    for (int z = -1; z <= graph.m_grid_height + 1; z++)
+    {
+        for (int x = -1; x <= graph.m_grid_width + 1; x++)
+        {
+            points.push_back(Vec3(
+                graph.m_grid_min_x + x * graph.m_grid_cell_size, 0.0f,
+                graph.m_grid_min_z + z * graph.m_grid_cell_size));
+        }
+    }
+    // Points on the corners and edges of all nodes
+    for (unsigned int n = 0; n < graph.getNumNodes(); n++)
+    {
+        const Quad& q = *graph.getQuad(n);
+        for (int j = 0; j < 4; j++)
+        {
+            points.push_back(q[j]);
+            points.push_back((q[j] + q[(j + 1) % 4]) * 0.5f);
+        }
+        points.push_back(q.getCenter());
+    }
+
+    // Run with the grid, then with the grid disabled
+    std::uniform_int_distribution<int>
+        random_node(0, graph.getNumNodes() - 1);
+    std::vector<int> results[2];
+    const int grid_width = graph.m_grid_width;
+    for (int use_grid = 1; use_grid >= 0; use_grid--)
+    {
+        graph.m_grid_width = use_grid ? grid_width : 0;
+        std::mt19937 random_start(7);
+        for (const Vec3& xyz : points)
+        {
+            const int start = random_node(random_start);
+            for (int ignore_vertical = 0; ignore_vertical < 2;
+                 ignore_vertical++)
+            {
+                int sector = UNKNOWN_SECTOR;
+                graph.findRoadSector(xyz, &sector, NULL, ignore_vertical != 0);
+                results[use_grid].push_back(sector);
+                sector = start;
+                graph.findRoadSector(xyz, &sector, NULL, ignore_vertical != 0);
+                results[use_grid].push_back(sector);
+                results[use_grid].push_back(graph.findOutOfRoadSector(xyz,
+                    UNKNOWN_SECTOR, NULL, ignore_vertical != 0));
+                results[use_grid].push_back(graph.findOutOfRoadSector(xyz,
+                    start, NULL, ignore_vertical != 0));
+            }
+        }
+    }
+    graph.m_grid_width = grid_width;
+
+    unsigned int on_road = 0, off_road = 0;
+    for (unsigned int i = 0; i < results[0].size(); i++)
+    {
+        if (results[0][i] != results[1][i])
+        {
+            const Vec3& xyz = points[i / 8];
+            Log::error("Graph", "Lookup %d of point %f %f %f: grid %d, "
+                "linear search %d.", i % 8, xyz.getX(), xyz.getY(),
+                xyz.getZ(), results[1][i], results[0][i]);
+        }
+        assert(results[0][i] == results[1][i]);
+        if (i % 4 == 0)
+        {
+            if (results[0][i] == UNKNOWN_SECTOR)
+                off_road++;
+            else
+                on_road++;
+        }
+    }
+    // Both cases must be covered
+    assert(on_road > 100 && off_road > 100);
+}   // unitTesting
+
+//-----------------------------------------------------------------------------
+/** Compares findRoadSector and findOutOfRoadSector using the spatial grid
+ *  with the full search over all nodes, for the graphs of all tracks. The
+ *  points are random positions around the nodes, and both searches must
+ *  give the same node.
+ */
+void Graph::benchmark()
+{
+    typedef std::chrono::steady_clock Clock;
+    const unsigned int num_points = 20000;
+    double total_grid = 0.0, total_scan = 0.0;
+    unsigned int total_lookups = 0, total_mismatches = 0;
+    for (unsigned int t = 0; t < track_manager->getNumberOfTracks(); t++)
+    {
+        Track* track = track_manager->getTrack(t);
+        if (track->isInternal())
+            continue;
+        assert(m_graph == NULL);
+        if (track->hasNavMesh())
+        {
+            setGraph(new ArenaGraph(track->getTrackFile("navmesh.xml")));
+        }
+        else if (track->isRaceTrack() &&
+            file_manager->fileExists(track->getTrackFile("quads.xml")))
+        {
+            // setGraph is done in DriveGraph constructor
+            new DriveGraph(track->getTrackFile("quads.xml"),
+                track->getTrackFile("graph.xml"), false/*reverse*/);
+        }
+        if (!m_graph || m_graph->getNumNodes() == 0)
+        {
+            destroy();
+            continue;
+        }
+
+        Graph* graph = m_graph;
+        std::mt19937 random(t);
+        std::uniform_int_distribution<unsigned int>
+            random_node(0, graph->getNumNodes() - 1);
+        std::uniform_real_distribution<float> random_xz(-15.0f, 15.0f);
+        std::uniform_real_distribution<float> random_y(-3.0f, 6.0f);
+        std::vector<Vec3> points;
+        for (unsigned int i = 0; i < num_points; i++)
+        {
+            Vec3 xyz = graph->getQuad(random_node(random))->getCenter();
+            points.push_back(xyz + Vec3(random_xz(random), random_y(random),
+                                        random_xz(random)));
+        }
+
+        // Run with the grid, then with the grid disabled
+        std::vector<int> results[2];
+        double seconds[2];
+        const int grid_width = graph->m_grid_width;
+        for (int use_grid = 1; use_grid >= 0; use_grid--)
+        {
+            graph->m_grid_width = use_grid ? grid_width : 0;
+            std::vector<int>& result = results[use_grid];
+            Clock::time_point start = Clock::now();
+            int out_of_road = UNKNOWN_SECTOR;
+            for (const Vec3& xyz : points)
+            {
+                int sector = UNKNOWN_SECTOR;
+                graph->findRoadSector(xyz, &sector);
+                result.push_back(sector);
+                out_of_road = graph->findOutOfRoadSector(xyz, out_of_road);
+                result.push_back(out_of_road);
+            }
+            seconds[use_grid] = std::chrono::duration<double>
+                (Clock::now() - start).count();
+        }
+        graph->m_grid_width = grid_width;
+
+        unsigned int mismatches = 0;
+        for (unsigned int i = 0; i < results[0].size(); i++)
+        {
+            if (results[0][i] != results[1][i])
+                mismatches++;
+        }
+        Log::info("Graph", "%s: %d nodes, %.0f lookups/s with grid, "
+            "%.0f lookups/s with full search, %d mismatches.",
+            track->getIdent().c_str(), graph->getNumNodes(),
+            results[1].size() / seconds[1], results[0].size() / seconds[0],
+            mismatches);
+        total_grid += seconds[1];
+        total_scan += seconds[0];
+        total_lookups += (unsigned int)results[0].size();
+        total_mismatches += mismatches;
+        destroy();
+    }
+    if (total_lookups == 0)
+    {
+        Log::warn("Graph", "No track with a graph found.");
+        return;
+    }
+    Log::info("Graph", "All tracks: %.0f lookups/s with grid, %.0f lookups/s "
+        "with full search, %d mismatches.", total_lookups / total_grid,
+        total_lookups / total_scan, total_mismatches);
+}   // benchmark
+
 //-----------------------------------------------------------------------------
 void Graph::loadBoundingBoxNodes()
 {
@@ -66,6 +66,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void buildSpatialGrid();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -75,6 +77,20 @@ private:
     /** The 4 closest graph nodes to the bounding box. */
     int m_bb_nodes[4];
 
+    /** A uniform 2d (x and z) grid over all nodes, used to speed up
+     *  findRoadSector and findOutOfRoadSector. Cell i contains the nodes
+     *  m_grid_nodes[m_grid_cell_start[i]] to
+     *  m_grid_nodes[m_grid_cell_start[i+1]-1], sorted by node index. */
+    std::vector<unsigned int> m_grid_cell_start;
+    std::vector<int> m_grid_nodes;
+
+    /** Nodes with degenerate shape whose pointInside area can't be bounded,
+     *  they are in all cells and are also tested outside of the grid. */
+    std::vector<int> m_grid_unbounded_nodes;
+
+    float m_grid_min_x, m_grid_min_z, m_grid_cell_size;
+    int m_grid_width, m_grid_height;
+
     /** The node of the graph mesh. */
     scene::ISceneNode *m_node;
 
@@ -103,6 +119,13 @@ private:
     // ------------------------------------------------------------------------
     void cleanupDebugMesh();
     // ------------------------------------------------------------------------
+    int findRoadSectorInList(const Vec3& xyz, int start_node,
+                             const int* nodes, unsigned int count,
+                             bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorInGrid(const Vec3& xyz, int start_node,
+                                  int phase, bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
@@ -137,6 +160,10 @@ public:
         }
     }   // destroy
     // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
     Graph();
     // ------------------------------------------------------------------------
     virtual ~Graph();
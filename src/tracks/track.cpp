@@ -60,6 +60,7 @@
 #include "main_loop.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/easter_egg_hunt.hpp"
+#include "modes/profile_world.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
@@ -1248,6 +1249,7 @@ bool Track::loadMainTrack(const XMLNode &root)
 
     m_track_mesh      = new TriangleMesh(/*can_be_transformed*/false);
     m_gfx_effect_mesh = new TriangleMesh(/*can_be_transformed*/false);
+    m_track_mesh->enableBvhCache();
 
     const XMLNode *track_node = root.getNode("track");
     std::string model_name;
@@ -1683,7 +1685,10 @@ void Track::update(int ticks)
     }
     float dt = stk_config->ticks2Time(ticks);
     m_check_manager->update(dt);
-    m_item_manager->update(ticks);
+    {
+        ProfileWorld::SectionTimer timer(ProfileWorld::PS_ITEMS);
+        m_item_manager->update(ticks);
+    }
 
     // TODO: enable onUpdate scripts if we ever find a compelling use for them
     //Scripting::ScriptEngine* script_engine = World::getWorld()->getScriptEngine();
@@ -2248,6 +2253,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     if (!GUIEngine::isNoGraphics())
     {
         m_height_map_mesh = new TriangleMesh(/*can_be_transformed*/false);
+        m_height_map_mesh->enableBvhCache();
         m_height_map_mesh->copyFrom(*m_track_mesh);
         TriangleMesh* gfx_effect_mesh = m_gfx_effect_mesh;
         std::swap(m_track_mesh, m_height_map_mesh);
@@ -2986,6 +2992,7 @@ void Track::copyFromMainProcess()
     m_track_mesh = new TriangleMesh(/*can_be_transformed*/false);
     m_height_map_mesh = NULL;
     m_gfx_effect_mesh = new TriangleMesh(/*can_be_transformed*/false);
+    m_track_mesh->enableBvhCache();
     m_track_mesh->copyFrom(*main_track->m_track_mesh);
     m_gfx_effect_mesh->copyFrom(*main_track->m_gfx_effect_mesh);
 
@@ -21,11 +21,16 @@
 #include "config/user_config.hpp"
 #include "network/network_config.hpp"
 #include "utils/file_utils.hpp"
+#include "utils/time.hpp"
 #include "utils/tls.hpp"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <ctime>
+#include <mutex>
 #include <stdio.h>
+#include <thread>
 
 #ifdef ANDROID
 #  include <android/log.h>
@@ -46,8 +51,25 @@ FILE*         Log::m_file_stdout   = NULL;
 size_t        Log::m_buffer_size = 1;
 bool          Log::m_console_log = true;
 Synchronised<std::vector<struct Log::LineInfo> > Log::m_line_buffer;
+std::atomic_bool Log::m_async_writer(false);
 thread_local  char g_prefix[11] = {};
 
+namespace
+{
+    /** Lines waiting to be written by the asynchronous writer. If the writer
+     *  can't keep up, new lines are dropped instead of blocking the caller.
+     */
+    const size_t MAX_ASYNC_LINES = 16384;
+    std::mutex g_async_mutex;
+    std::condition_variable g_async_cv;
+    std::vector<std::pair<std::string, int> > g_async_lines;
+    unsigned g_async_dropped = 0;
+    /** True while the writer writes lines which were already dequeued. */
+    bool g_async_busy = false;
+    bool g_async_stop = false;
+    std::thread g_async_thread;
+}   // anonymous namespace
+
 // ----------------------------------------------------------------------------
 void Log::setPrefix(const char* prefix)
 {
@@ -199,6 +221,12 @@ void Log::printMessage(int level, const char *component, const char *format,
     index = index > MAX_LENGTH - 1 ? MAX_LENGTH - 1 : index;
     sprintf(line + index, "\n");
 
+    if (level >= LL_FATAL)
+        stopAsyncWriter();
+    else if (m_async_writer.load(std::memory_order_relaxed) &&
+             queueAsyncLine(line, level))
+        return;
+
     // If the data is not buffered, immediately print it:
     if (m_buffer_size <= 1)
     {
@@ -299,6 +327,14 @@ void Log::toggleConsoleLog(bool val)
  */
 void Log::flushBuffers()
 {
+    if (m_async_writer.load() &&
+        g_async_thread.get_id() != std::this_thread::get_id())
+    {
+        // Wait till the writer has written all queued lines
+        std::unique_lock<std::mutex> ul(g_async_mutex);
+        g_async_cv.wait(ul, []() { return (g_async_lines.empty() &&
+                                           !g_async_busy) || g_async_stop; });
+    }
     m_line_buffer.lock();
     for (unsigned int i = 0; i < m_line_buffer.getData().size(); i++)
     {
@@ -333,6 +369,225 @@ void Log::openOutputFiles(const std::string &logout)
 /** Function to close output files */
 void Log::closeOutputFiles()
 {
+    stopAsyncWriter();
     fclose(m_file_stdout);
+    m_file_stdout = NULL;
 } // closeOutputFiles
 
+// ----------------------------------------------------------------------------
+/** Starts a thread which writes all log lines, so that logging never waits
+ *  for the terminal or the disk. Lines are formatted by the calling thread,
+ *  so they keep their time stamp and order.
+ */
+void Log::startAsyncWriter()
+{
+    if (m_async_writer.load())
+        return;
+    g_async_stop = false;
+    g_async_thread = std::thread(asyncWriterLoop);
+    m_async_writer.store(true);
+    static bool registered = false;
+    if (!registered)
+    {
+        // Write the remaining lines if exit() is called anywhere
+        registered = true;
+        atexit(stopAsyncWriter);
+    }
+}   // startAsyncWriter
+
+// ----------------------------------------------------------------------------
+/** Writes all queued lines and stops the asynchronous writer thread. Later
+ *  messages are written directly again.
+ */
+void Log::stopAsyncWriter()
+{
+    if (!m_async_writer.exchange(false))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(g_async_mutex);
+        g_async_stop = true;
+    }
+    g_async_cv.notify_all();
+    if (g_async_thread.get_id() == std::this_thread::get_id())
+        g_async_thread.detach();
+    else
+        g_async_thread.join();
+}   // stopAsyncWriter
+
+// ----------------------------------------------------------------------------
+/** Adds a line to the queue of the asynchronous writer.
+ *  \return False if the writer was stopped in the meantime, in which case
+ *          the line must be written by the caller.
+ */
+bool Log::queueAsyncLine(const char *line, int level)
+{
+    std::lock_guard<std::mutex> lock(g_async_mutex);
+    if (g_async_stop)
+        return false;
+    if (g_async_lines.size() >= MAX_ASYNC_LINES)
+    {
+        g_async_dropped++;
+        return true;
+    }
+    bool was_empty = g_async_lines.empty();
+    g_async_lines.emplace_back(line, level);
+    if (was_empty)
+        g_async_cv.notify_all();
+    return true;
+}   // queueAsyncLine
+
+// ----------------------------------------------------------------------------
+void Log::asyncWriterLoop()
+{
+    setPrefix("LogWriter");
+    std::vector<std::pair<std::string, int> > lines;
+    std::unique_lock<std::mutex> ul(g_async_mutex);
+    while (true)
+    {
+        g_async_cv.wait(ul, []() { return !g_async_lines.empty() ||
+                                          g_async_stop; });
+        if (g_async_lines.empty() && g_async_stop)
+            break;
+        std::swap(lines, g_async_lines);
+        unsigned dropped = g_async_dropped;
+        g_async_dropped = 0;
+        g_async_busy = true;
+        ul.unlock();
+
+        if (dropped > 0)
+        {
+            char line[128];
+            snprintf(line, 128, "[warn   ] Log: %u log messages were "
+                "dropped, the log writer can't keep up.\n", dropped);
+            writeLine(line, LL_WARN);
+        }
+        for (auto& line : lines)
+        {
+            if (m_buffer_size <= 1)
+            {
+                writeLine(line.first.c_str(), line.second);
+                continue;
+            }
+            LineInfo li;
+            li.m_line = std::move(line.first);
+            li.m_level = line.second;
+            m_line_buffer.lock();
+            m_line_buffer.getData().push_back(std::move(li));
+            bool full = m_line_buffer.getData().size() >= m_buffer_size;
+            m_line_buffer.unlock();
+            if (full)
+                flushBuffers();
+        }
+        lines.clear();
+
+        ul.lock();
+        g_async_busy = false;
+        // Wake up flushBuffers() if it is waiting for the queue to be empty
+        if (g_async_lines.empty())
+            g_async_cv.notify_all();
+    }
+}   // asyncWriterLoop
+
+// ----------------------------------------------------------------------------
+/** Returns true if a message of this call site should be printed, i.e. if
+ *  none was printed in the last interval_ms milliseconds. Thread-safe.
+ *  \param suppressed Set to the number of messages not printed since the
+ *         last printed message, if this one is to be printed.
+ */
+bool Log::RateLimiter::allow(uint64_t interval_ms, uint32_t* suppressed)
+{
+    uint64_t now = StkTime::getMonoTimeMs();
+    uint64_t next = m_next_time.load(std::memory_order_relaxed);
+    if (now < next ||
+        !m_next_time.compare_exchange_strong(next, now + interval_ms))
+    {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    *suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}   // RateLimiter::allow
+
+// ----------------------------------------------------------------------------
+/** Tests the log macros, rate limiting and the asynchronous writer. All
+ *  messages of this test are written to a temporary file only.
+ */
+void Log::unitTesting()
+{
+    const bool was_async = m_async_writer.load();
+    stopAsyncWriter();
+    flushBuffers();
+    FILE* old_file = m_file_stdout;
+    const bool old_console_log = m_console_log;
+    const LogLevel old_level = m_min_log_level;
+    m_file_stdout = tmpfile();
+    assert(m_file_stdout);
+    m_console_log = false;
+    m_min_log_level = LL_INFO;
+
+    // Returns how often text was written so far
+    auto count = [](const std::string& text)
+    {
+        flushBuffers();
+        fflush(m_file_stdout);
+        rewind(m_file_stdout);
+        std::string output;
+        char buffer[1024];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), m_file_stdout)) > 0)
+            output.append(buffer, n);
+        fseek(m_file_stdout, 0, SEEK_END);
+        unsigned found = 0;
+        for (size_t i = output.find(text); i != std::string::npos;
+             i = output.find(text, i + 1))
+            found++;
+        return found;
+    };
+
+    // Arguments of disabled messages are not evaluated
+    int evaluated = 0;
+    STK_LOG_DEBUG("UnitTest", "debug message %d", ++evaluated);
+    assert(evaluated == 0);
+    STK_LOG_INFO("UnitTest", "info message %d", ++evaluated);
+    const bool info_enabled = LL_INFO >= STK_LOG_MIN_LEVEL;
+    assert(evaluated == (info_enabled ? 1 : 0));
+    assert(count("debug message") == 0);
+    assert(count("info message 1") == (info_enabled ? 1u : 0u));
+
+    // A rate limiter counts the messages it suppressed
+    RateLimiter limiter;
+    uint32_t suppressed = 99;
+    bool allowed = limiter.allow(20, &suppressed);
+    assert(allowed && suppressed == 0);
+    for (unsigned i = 0; i < 3; i++)
+    {
+        allowed = limiter.allow(20, &suppressed);
+        assert(!allowed);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    allowed = limiter.allow(20, &suppressed);
+    assert(allowed && suppressed == 3);
+
+    for (int i = 0; i < 5; i++)
+        STK_LOG_EVERY(3600 * 1000, info, "UnitTest", "every hour %d.", i);
+    assert(count("every hour 0.") == 1);
+    assert(count("every hour") == 1);
+
+    // The asynchronous writer writes all lines in order when flushed, and
+    // lines are written directly once it is stopped
+    startAsyncWriter();
+    for (int i = 0; i < 100; i++)
+        Log::info("UnitTest", "async line %d.", i);
+    assert(count("async line ") == 100);
+    assert(count("async line 99.") == 1);
+    stopAsyncWriter();
+    Log::info("UnitTest", "direct line");
+    assert(count("direct line") == 1);
+
+    fclose(m_file_stdout);
+    m_file_stdout = old_file;
+    m_console_log = old_console_log;
+    m_min_log_level = old_level;
+    if (was_async)
+        startAsyncWriter();
+}   // unitTesting
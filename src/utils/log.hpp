@@ -23,12 +23,20 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
+#include <atomic>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <vector>
 
+/** Log messages below this level (see Log::LogLevel) are removed at compile
+ *  time when using the STK_LOG_* macros. */
+#ifndef STK_LOG_MIN_LEVEL
+#  define STK_LOG_MIN_LEVEL 0
+#endif
+
 
 #if defined(__GLIBC__)
 #  define VALIST __gnuc_va_list
@@ -74,6 +82,9 @@ private:
     };
     static Synchronised<std::vector<struct LineInfo> > m_line_buffer;
 
+    /** True if lines are written by a separate thread. */
+    static std::atomic_bool m_async_writer;
+
     /** <0 if no buffered logging is to be used, otherwise this is
      ** the maximum number of lines the buffer should hold. */
     static size_t m_buffer_size;
@@ -81,6 +92,8 @@ private:
     static void setTerminalColor(LogLevel level);
     static void resetTerminalColor();
     static void writeLine(const char *line, int level);
+    static bool queueAsyncLine(const char *line, int level);
+    static void asyncWriterLoop();
 
     static void printMessage(int level, const char *component,
                              const char *format, VALIST va_list);
@@ -94,6 +107,7 @@ public:
 #define LOG(NAME, LEVEL)                                             \
     static void NAME(const char *component, const char *format, ...) \
     {                                                                \
+        if(LEVEL < STK_LOG_MIN_LEVEL) return;                        \
         if(LEVEL < m_min_log_level) return;                          \
         va_list args;                                                \
         va_start(args, format);                                      \
@@ -106,6 +120,18 @@ public:
             exit(1);                                                 \
         }                                                            \
     }
+    // ------------------------------------------------------------------------
+    /** Limits how often a log call site prints, see STK_LOG_EVERY. */
+    class RateLimiter
+    {
+    private:
+        std::atomic<uint64_t> m_next_time;
+        std::atomic<uint32_t> m_suppressed;
+    public:
+        RateLimiter() : m_next_time(0), m_suppressed(0) {}
+        bool allow(uint64_t interval_ms, uint32_t* suppressed);
+    };   // RateLimiter
+
     LOG(verbose, LL_VERBOSE);
     LOG(debug,   LL_DEBUG);
     LOG(info,    LL_INFO);
@@ -118,6 +144,9 @@ public:
     static void closeOutputFiles();
     static void flushBuffers();
     static void toggleConsoleLog(bool val);
+    static void startAsyncWriter();
+    static void stopAsyncWriter();
+    static void unitTesting();
 
     // ------------------------------------------------------------------------
     /** Sets the number of lines to buffer. Setting the buffer size to a 
@@ -153,4 +182,39 @@ public:
      *  remaining characters are ignored. */
     static void setPrefix(const char* prefix);
 };   // Log
+
+/** Log macros which, unlike calling Log:: directly, don't evaluate their
+ *  arguments if the message is not printed, and are removed completely when
+ *  the level is below STK_LOG_MIN_LEVEL. Use them in hot paths. */
+#define STK_LOG_AT(LEVEL, NAME, ...)                                         \
+    do                                                                       \
+    {                                                                        \
+        if (Log::LEVEL >= STK_LOG_MIN_LEVEL &&                               \
+            Log::LEVEL >= Log::getLogLevel())                                \
+            Log::NAME(__VA_ARGS__);                                          \
+    } while (false)
+#define STK_LOG_DEBUG(...)   STK_LOG_AT(LL_DEBUG,   debug,   __VA_ARGS__)
+#define STK_LOG_VERBOSE(...) STK_LOG_AT(LL_VERBOSE, verbose, __VA_ARGS__)
+#define STK_LOG_INFO(...)    STK_LOG_AT(LL_INFO,    info,    __VA_ARGS__)
+#define STK_LOG_WARN(...)    STK_LOG_AT(LL_WARN,    warn,    __VA_ARGS__)
+#define STK_LOG_ERROR(...)   STK_LOG_AT(LL_ERROR,   error,   __VA_ARGS__)
+
+/** Prints a message at most once every INTERVAL_MS milliseconds for each
+ *  call site, e.g. STK_LOG_EVERY(1000, info, "Kart", "Speed %f", speed).
+ *  The number of skipped messages is printed with the next one. */
+#define STK_LOG_EVERY(INTERVAL_MS, NAME, COMPONENT, ...)                     \
+    do                                                                       \
+    {                                                                        \
+        static Log::RateLimiter stk_log_rate_limiter;                       \
+        uint32_t stk_log_suppressed = 0;                                     \
+        if (stk_log_rate_limiter.allow(INTERVAL_MS, &stk_log_suppressed))    \
+        {                                                                    \
+            Log::NAME(COMPONENT, __VA_ARGS__);                               \
+            if (stk_log_suppressed > 0)                                      \
+            {                                                                \
+                Log::NAME(COMPONENT, "(%u similar messages suppressed)",     \
+                          stk_log_suppressed);                               \
+            }                                                                \
+        }                                                                    \
+    } while (false)
 #endif
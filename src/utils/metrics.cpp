@@ -0,0 +1,218 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/metrics.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+Metrics::Histogram::Histogram(const std::vector<double>& bounds)
+                 : m_bounds(bounds), m_sum(0.0)
+{
+    assert(std::is_sorted(m_bounds.begin(), m_bounds.end()));
+    m_buckets.reset(new std::atomic<uint64_t>[m_bounds.size() + 1]);
+    for (unsigned i = 0; i <= m_bounds.size(); i++)
+        m_buckets[i].store(0);
+}   // Histogram
+
+// ----------------------------------------------------------------------------
+void Metrics::Histogram::observe(double value)
+{
+    size_t bucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), value)
+        - m_bounds.begin();
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    double sum = m_sum.load(std::memory_order_relaxed);
+    while (!m_sum.compare_exchange_weak(sum, sum + value,
+        std::memory_order_relaxed))
+    {
+    }
+}   // observe
+
+// ----------------------------------------------------------------------------
+std::mutex& Metrics::getMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}   // getMutex
+
+// ----------------------------------------------------------------------------
+std::vector<std::unique_ptr<Metrics::Entry> >& Metrics::getEntries()
+{
+    // Never destroyed, so that metrics can still be recorded by threads
+    // which are stopped after static destruction started
+    static std::vector<std::unique_ptr<Entry> >* entries =
+        new std::vector<std::unique_ptr<Entry> >();
+    return *entries;
+}   // getEntries
+
+// ----------------------------------------------------------------------------
+/** Returns the metric with the given name, or creates it if it doesn't exist
+ *  yet. The caller must lock the mutex. */
+Metrics::Entry* Metrics::getEntry(const std::string& name,
+                                  const std::string& help, MetricType type)
+{
+    for (auto& entry : getEntries())
+    {
+        if (entry->m_name == name)
+        {
+            assert(entry->m_type == type);
+            return entry.get();
+        }
+    }
+    Entry* entry = new Entry();
+    entry->m_name = name;
+    entry->m_help = help;
+    entry->m_type = type;
+    getEntries().emplace_back(entry);
+    return entry;
+}   // getEntry
+
+// ----------------------------------------------------------------------------
+Metrics::Counter& Metrics::counter(const std::string& name,
+                                   const std::string& help)
+{
+    std::lock_guard<std::mutex> lock(getMutex());
+    Entry* entry = getEntry(name, help, MT_COUNTER);
+    if (!entry->m_counter)
+        entry->m_counter.reset(new Counter());
+    return *entry->m_counter;
+}   // counter
+
+// ----------------------------------------------------------------------------
+Metrics::Gauge& Metrics::gauge(const std::string& name,
+                               const std::string& help)
+{
+    std::lock_guard<std::mutex> lock(getMutex());
+    Entry* entry = getEntry(name, help, MT_GAUGE);
+    if (!entry->m_gauge)
+        entry->m_gauge.reset(new Gauge());
+    return *entry->m_gauge;
+}   // gauge
+
+// ----------------------------------------------------------------------------
+Metrics::Histogram& Metrics::histogram(const std::string& name,
+                                       const std::string& help,
+                                       const std::vector<double>& bounds)
+{
+    std::lock_guard<std::mutex> lock(getMutex());
+    Entry* entry = getEntry(name, help, MT_HISTOGRAM);
+    if (!entry->m_histogram)
+        entry->m_histogram.reset(new Histogram(bounds));
+    return *entry->m_histogram;
+}   // histogram
+
+// ----------------------------------------------------------------------------
+/** Bucket bounds in seconds for durations of a tick or a request. */
+std::vector<double> Metrics::getDurationBounds()
+{
+    return { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5,
+        1.0, 2.5, 5.0 };
+}   // getDurationBounds
+
+// ----------------------------------------------------------------------------
+/** Returns all metrics in the Prometheus text exposition format. */
+std::string Metrics::render()
+{
+    std::string out;
+    char line[256];
+    std::lock_guard<std::mutex> lock(getMutex());
+    for (auto& entry : getEntries())
+    {
+        const char* name = entry->m_name.c_str();
+        static const char* types[] = { "counter", "gauge", "histogram" };
+        out += "# HELP " + entry->m_name + " " + entry->m_help + "\n";
+        out += "# TYPE " + entry->m_name + " " + types[entry->m_type] + "\n";
+        switch (entry->m_type)
+        {
+        case MT_COUNTER:
+            snprintf(line, sizeof(line), "%s %llu\n", name,
+                (unsigned long long)entry->m_counter->get());
+            out += line;
+            break;
+        case MT_GAUGE:
+            snprintf(line, sizeof(line), "%s %lld\n", name,
+                (long long)entry->m_gauge->get());
+            out += line;
+            break;
+        case MT_HISTOGRAM:
+        {
+            const Histogram& h = *entry->m_histogram;
+            uint64_t count = 0;
+            for (unsigned i = 0; i <= h.m_bounds.size(); i++)
+            {
+                count += h.m_buckets[i].load(std::memory_order_relaxed);
+                if (i < h.m_bounds.size())
+                {
+                    snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n",
+                        name, h.m_bounds[i], (unsigned long long)count);
+                }
+                else
+                {
+                    snprintf(line, sizeof(line),
+                        "%s_bucket{le=\"+Inf\"} %llu\n", name,
+                        (unsigned long long)count);
+                }
+                out += line;
+            }
+            snprintf(line, sizeof(line), "%s_sum %.9g\n%s_count %llu\n", name,
+                h.m_sum.load(std::memory_order_relaxed), name,
+                (unsigned long long)count);
+            out += line;
+            break;
+        }
+        }
+    }
+    return out;
+}   // render
+
+// ----------------------------------------------------------------------------
+void Metrics::unitTesting()
+{
+    Counter& c = counter("stk_unit_test_total", "Test counter.");
+    assert(&c == &counter("stk_unit_test_total", "Test counter."));
+    c.increase();
+    c.increase(4);
+    assert(c.get() == 5);
+
+    Gauge& g = gauge("stk_unit_test_gauge", "Test gauge.");
+    g.set(10);
+    g.add(-3);
+    assert(g.get() == 7);
+
+    Histogram& h = histogram("stk_unit_test_seconds", "Test histogram.",
+        { 0.1, 1.0 });
+    h.observe(0.05);
+    h.observe(0.1);
+    h.observe(0.5);
+    h.observe(7.0);
+
+    std::string text = render();
+    assert(text.find("# TYPE stk_unit_test_total counter\n"
+        "stk_unit_test_total 5\n") != std::string::npos);
+    assert(text.find("stk_unit_test_gauge 7\n") != std::string::npos);
+    // Buckets are cumulative, a value equal to a bound is in its bucket
+    assert(text.find("# TYPE stk_unit_test_seconds histogram\n"
+        "stk_unit_test_seconds_bucket{le=\"0.1\"} 2\n"
+        "stk_unit_test_seconds_bucket{le=\"1\"} 3\n"
+        "stk_unit_test_seconds_bucket{le=\"+Inf\"} 4\n"
+        "stk_unit_test_seconds_sum 7.65\n"
+        "stk_unit_test_seconds_count 4\n") != std::string::npos);
+}   // unitTesting
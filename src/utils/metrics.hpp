@@ -0,0 +1,122 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_METRICS_HPP
+#define HEADER_METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** A registry of counters, gauges and histograms which can be exported in
+ *  the Prometheus text format (see MetricsServer). Metrics are registered
+ *  once (which locks a mutex) and never removed, so callers keep a reference
+ *  to them, typically in a function static:
+ *
+ *      static Metrics::Counter& sent =
+ *          Metrics::counter("stk_sent_bytes_total", "Bytes sent.");
+ *      sent.increase(size);
+ *
+ *  Recording only uses relaxed atomic operations, it is lock-free and can be
+ *  done from any thread.
+ */
+class Metrics
+{
+public:
+    /** A value which only increases. */
+    class Counter
+    {
+    private:
+        std::atomic<uint64_t> m_value;
+    public:
+        Counter() : m_value(0) {}
+        // --------------------------------------------------------------------
+        void increase(uint64_t value = 1)
+                      { m_value.fetch_add(value, std::memory_order_relaxed); }
+        // --------------------------------------------------------------------
+        uint64_t get() const   { return m_value.load(std::memory_order_relaxed); }
+    };   // Counter
+
+    // ========================================================================
+    /** A value which can go up and down. */
+    class Gauge
+    {
+    private:
+        std::atomic<int64_t> m_value;
+    public:
+        Gauge() : m_value(0) {}
+        // --------------------------------------------------------------------
+        void set(int64_t value)
+                           { m_value.store(value, std::memory_order_relaxed); }
+        // --------------------------------------------------------------------
+        void add(int64_t value)
+                      { m_value.fetch_add(value, std::memory_order_relaxed); }
+        // --------------------------------------------------------------------
+        int64_t get() const    { return m_value.load(std::memory_order_relaxed); }
+    };   // Gauge
+
+    // ========================================================================
+    /** Counts observed values in buckets with fixed upper bounds. */
+    class Histogram
+    {
+    private:
+        friend class Metrics;
+        /** Upper bounds of the buckets in increasing order, the last bucket
+         *  (+Inf) is implicit. */
+        const std::vector<double> m_bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+        std::atomic<double> m_sum;
+    public:
+        Histogram(const std::vector<double>& bounds);
+        void observe(double value);
+    };   // Histogram
+
+private:
+    enum MetricType { MT_COUNTER, MT_GAUGE, MT_HISTOGRAM };
+
+    struct Entry
+    {
+        std::string m_name;
+        std::string m_help;
+        MetricType m_type;
+        std::unique_ptr<Counter> m_counter;
+        std::unique_ptr<Gauge> m_gauge;
+        std::unique_ptr<Histogram> m_histogram;
+    };
+
+    static std::mutex& getMutex();
+    static std::vector<std::unique_ptr<Entry> >& getEntries();
+    static Entry* getEntry(const std::string& name, const std::string& help,
+                           MetricType type);
+
+public:
+    static Counter& counter(const std::string& name, const std::string& help);
+    static Gauge& gauge(const std::string& name, const std::string& help);
+    static Histogram& histogram(const std::string& name,
+                                const std::string& help,
+                                const std::vector<double>& bounds =
+                                getDurationBounds());
+    static std::vector<double> getDurationBounds();
+    static std::string render();
+    static void unitTesting();
+};   // class Metrics
+
+#endif   // HEADER_METRICS_HPP
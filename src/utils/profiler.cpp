@@ -36,6 +36,7 @@
 
 #include <algorithm>
 #include <fstream>
+#include <limits>
 #include <ostream>
 #include <stack>
 #include <sstream>
@@ -44,6 +45,8 @@
 
 Profiler profiler;
 
+const int Profiler::MAX_THREADS;
+
 // Unit is in pencentage of the screen dimensions
 #define MARGIN_X    0.02f    // left and right margin
 #define MARGIN_Y    0.02f    // top margin
@@ -104,16 +107,15 @@ Profiler::~Profiler()
 {
 }   // ~Profiler
 
+/** The id of the current thread in the profiler, -1 if the thread did not
+ *  use the profiler yet, and -2 if there are too many threads. */
 thread_local int g_thread_id = -1;
-const int MAX_THREADS = 10;
 //-----------------------------------------------------------------------------
 /** It is split from the constructor so that it can be avoided allocating
  *  unnecessary memory when the profiler is never used (for example in no
  *  graphics). */
 void Profiler::init()
 {
-    m_all_threads_data.resize(MAX_THREADS);
-
     // Add this thread to the thread mapping
     g_thread_id = 0;
     m_gpu_times.resize(Q_LAST * m_max_frames);
@@ -124,73 +126,146 @@ void Profiler::init()
  */
 void Profiler::reset()
 {
-    for (int i = 0; i < m_threads_used; i++)
+    m_lock.lock();
+    for (int i = 0; i < MAX_THREADS; i++)
     {
         ThreadData &td = m_all_threads_data[i];
         td.m_all_event_data.clear();
         td.m_event_stack.clear();
         td.m_ordered_headings.clear();
+        // Ignore all events recorded so far, also in the trace file
+        td.m_trace_read  = td.m_trace_count.load(std::memory_order_acquire);
+        td.m_trace_first = td.m_trace_read;
     }   // for i in threads
 
-    m_all_threads_data.clear();
-    m_gpu_times.clear();
-    m_all_event_names.clear();
+    std::fill(m_gpu_times.begin(), m_gpu_times.end(), 0);
     m_current_frame       = 0;
     m_has_wrapped_around  = false;
     m_freeze_state        = UNFROZEN;
+    m_lock.unlock();
 }   // reset
 
 //-----------------------------------------------------------------------------
 /** Returns a unique index for a thread. If the calling thread is not yet in
- *  the mapping, it will assign a new unique id to this thread. */
+ *  the mapping, it will assign a new unique id to this thread. Returns -1 if
+ *  there are already MAX_THREADS threads, events of this thread are then
+ *  ignored. */
 int Profiler::getThreadID()
 {
     if (g_thread_id == -1)
     {
-        if (m_threads_used >= MAX_THREADS)
+        int id = m_threads_used.load();
+        do
         {
-            g_thread_id = MAX_THREADS - 1;
-            return g_thread_id;
-        }
-        g_thread_id = m_threads_used.fetch_add(1);
+            if (id >= MAX_THREADS)
+            {
+                g_thread_id = -2;
+                break;
+            }
+        } while (!m_threads_used.compare_exchange_weak(id, id + 1));
+        if (g_thread_id == -1)
+            g_thread_id = id;
     }
-    return g_thread_id;
+    return g_thread_id < 0 ? -1 : g_thread_id;
 }   // getThreadID
 
 //-----------------------------------------------------------------------------
-/// Push a new marker that starts now
-void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
+/** Returns the id of the marker with the given name, adding a new marker if
+ *  the name is not used yet. The colour is only used for new markers.
+ *  \param name Name of the marker.
+ *  \param colour Colour of the marker in the on-screen display.
+ */
+int Profiler::getMarkerID(const char* name, const video::SColor& colour)
 {
-    // Don't do anything when disabled or frozen
-    if (!UserConfigParams::m_profiler_enabled ||
-         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
-        return;
-
-    // We need to look before getting the thread id (since this might
-    // be a new thread which changes the structure).
     m_lock.lock();
-    int thread_id = getThreadID();
-
-    ThreadData &td = m_all_threads_data[thread_id];
-    AllEventData::iterator i = td.m_all_event_data.find(name);
-    double  start = getTimeMilliseconds() - m_time_last_sync;
-    if (i != td.m_all_event_data.end())
+    auto it = m_marker_ids.find(name);
+    int id;
+    if (it != m_marker_ids.end())
     {
-        i->second.setStart(m_current_frame, start, (int)td.m_event_stack.size());
+        id = it->second;
     }
     else
     {
-        EventData ed(colour, m_max_frames);
-        ed.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-        td.m_all_event_data[name] = ed;
+        id = (int)m_marker_names.size();
+        m_marker_names.push_back(name);
+        m_marker_colours.push_back(colour);
+        m_marker_ids[name] = id;
+    }
+    m_lock.unlock();
+    return id;
+}   // getMarkerID
+
+//-----------------------------------------------------------------------------
+/** Returns the EventData of a thread for the given marker id. If the marker
+ *  was not used in this thread before, the markers for all frames are
+ *  allocated. Must be called while m_lock is locked.
+ */
+Profiler::EventData& Profiler::getEventData(ThreadData &td, int marker_id)
+{
+    if (marker_id >= (int)td.m_all_event_data.size())
+        td.m_all_event_data.resize(marker_id + 1);
+    EventData &ed = td.m_all_event_data[marker_id];
+    if (!ed.isUsed())
+    {
+        ed = EventData(m_marker_colours[marker_id], m_max_frames);
         // Ordered headings is used to determine the order in which the
         // bar graph is drawn. Outer profiling events will be added first,
         // so they will be drawn first, which gives the proper nested
         // displayed of events.
-        td.m_ordered_headings.push_back(name);
+        td.m_ordered_headings.push_back(marker_id);
     }
-    td.m_event_stack.push_back(name);
-    m_lock.unlock();
+    return ed;
+}   // getEventData
+
+//-----------------------------------------------------------------------------
+/** Adds an event to the trace buffer of the calling thread. Only this thread
+ *  writes to its buffer, so no lock is needed.
+ *  \param marker_id Id of the pushed marker, or -1 for a pop.
+ */
+void Profiler::addTraceEvent(int marker_id)
+{
+    int thread_id = getThreadID();
+    if (thread_id < 0)
+        return;
+    ThreadData &td = m_all_threads_data[thread_id];
+    TraceSlot *events = td.m_trace_events.load(std::memory_order_relaxed);
+    if (!events)
+    {
+        events = new TraceSlot[TRACE_BUFFER_SIZE];
+        td.m_trace_events.store(events, std::memory_order_release);
+    }
+    uint64_t count = td.m_trace_count.load(std::memory_order_relaxed);
+    // A reader which sees the new content of the slot must also see the
+    // count published before, so that it knows the old event is gone
+    std::atomic_thread_fence(std::memory_order_release);
+    TraceSlot &event = events[count % TRACE_BUFFER_SIZE];
+    event.m_time.store(getTimeMilliseconds(), std::memory_order_relaxed);
+    event.m_marker_id.store(marker_id, std::memory_order_relaxed);
+    td.m_trace_count.store(count + 1, std::memory_order_release);
+}   // addTraceEvent
+
+//-----------------------------------------------------------------------------
+/// Push a new marker that starts now
+void Profiler::pushCPUMarker(int marker_id)
+{
+    // Don't do anything when disabled or frozen
+    if (!UserConfigParams::m_profiler_enabled ||
+         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+        return;
+    addTraceEvent(marker_id);
+}   // pushCPUMarker
+
+//-----------------------------------------------------------------------------
+/** Push a new marker that starts now. This needs to look up the name of the
+ *  marker each time, so it should only be used if the name is not constant.
+ */
+void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
+{
+    // Don't do anything when disabled or frozen
+    if (!UserConfigParams::m_profiler_enabled ||
+         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+        return;
+    addTraceEvent(getMarkerID(name, colour));
 }   // pushCPUMarker
 
 //-----------------------------------------------------------------------------
@@ -201,29 +276,62 @@ void Profiler::popCPUMarker()
     if( !UserConfigParams::m_profiler_enabled ||
         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
         return;
-    double now = getTimeMilliseconds();
-
-    m_lock.lock();
-    int thread_id = getThreadID();
-    ThreadData &td = m_all_threads_data[thread_id];
+    addTraceEvent(-1);
+}   // popCPUMarker
 
-    // When the profiler gets enabled (which happens in the middle of the
-    // main loop), there can be some pops without matching pushes (for one
-    // frame) - ignore those events.
-    if (td.m_event_stack.size() == 0)
-    {
-        m_lock.unlock();
+//-----------------------------------------------------------------------------
+/** Adds all events of a thread up to the given time, which were not added
+ *  yet, to the markers of the current frame. Must be called while m_lock is
+ *  locked.
+ *  \param td The data of the thread.
+ *  \param until Only events up to this (absolute) time are added.
+ */
+void Profiler::readTraceEvents(ThreadData &td, double until)
+{
+    const TraceSlot *events =
+        td.m_trace_events.load(std::memory_order_acquire);
+    if (!events)
         return;
-    }
-
-    assert(td.m_event_stack.size() > 0);
 
-    const std::string &name = td.m_event_stack.back();
-    td.m_all_event_data[name].setEnd(m_current_frame, now - m_time_last_sync);
+    uint64_t count = td.m_trace_count.load(std::memory_order_acquire);
+    while (td.m_trace_read < count)
+    {
+        const TraceEvent event =
+            events[td.m_trace_read % TRACE_BUFFER_SIZE].load();
+        // The event must be read before checking if it was overwritten
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // If the thread has overwritten this event, or is overwriting it
+        // (which happens only if there was no frame for a long time) the
+        // nesting is lost, so restart with the next event.
+        count = td.m_trace_count.load(std::memory_order_acquire);
+        if (count - td.m_trace_read >= (uint64_t)TRACE_BUFFER_SIZE)
+        {
+            td.m_trace_read = count;
+            td.m_event_stack.clear();
+            break;
+        }
+        if (event.m_time > until)
+            break;
+        td.m_trace_read++;
 
-    td.m_event_stack.pop_back();
-    m_lock.unlock();
-}   // popCPUMarker
+        const double time = event.m_time - m_time_last_sync;
+        if (event.m_marker_id >= 0)
+        {
+            getEventData(td, event.m_marker_id)
+                .setStart(m_current_frame, time, (int)td.m_event_stack.size());
+            td.m_event_stack.push_back(event.m_marker_id);
+        }
+        // When the profiler gets enabled (which happens in the middle of the
+        // main loop), there can be some pops without matching pushes (for
+        // one frame) - ignore those events.
+        else if (!td.m_event_stack.empty())
+        {
+            getEventData(td, td.m_event_stack.back())
+                .setEnd(m_current_frame, time);
+            td.m_event_stack.pop_back();
+        }
+    }   // while m_trace_read < count
+}   // readTraceEvents
 
 //-----------------------------------------------------------------------------
 /** Switches the profiler on
@@ -280,16 +388,19 @@ void Profiler::synchronizeFrame()
         m_has_wrapped_around = true;
     }
 
-    // First finish all markers that are currently in progress, and add
+    // First add all events recorded by the threads since the last frame.
+    // Then finish all markers that are currently in progress, and add
     // a new start marker for the next frame. So e.g. if a thread is busy in
     // one event while the main thread syncs the frame, this event will get
     // split into two parts in two consecutive frames
-    for (int i = 0; i < m_threads_used; i++)
+    const int threads_used = std::min((int)m_threads_used, MAX_THREADS);
+    for (int i = 0; i < threads_used; i++)
     {
         ThreadData &td = m_all_threads_data[i];
+        readTraceEvents(td, now);
         for(unsigned int j=0; j<td.m_event_stack.size(); j++)
         {
-            EventData &ed = td.m_all_event_data[td.m_event_stack[j]];
+            EventData &ed = getEventData(td, td.m_event_stack[j]);
             ed.setEnd(m_current_frame, now-m_time_last_sync);
             ed.setStart(next_frame, 0, j);
         }   // for j in event stack
@@ -300,13 +411,14 @@ void Profiler::synchronizeFrame()
         // The new entries for the circular buffer need to be cleared
         // to make sure the new values are not accumulated on top of
         // the data from a previous frame.
-        for (int i = 0; i < m_threads_used; i++)
+        for (int i = 0; i < threads_used; i++)
         {
             ThreadData &td = m_all_threads_data[i];
-            AllEventData &aed = td.m_all_event_data;
-            AllEventData::iterator k;
-            for (k = aed.begin(); k != aed.end(); ++k)
-                k->second.getMarker(next_frame).clear();
+            for (unsigned int k = 0; k < td.m_ordered_headings.size(); k++)
+            {
+                td.m_all_event_data[td.m_ordered_headings[k]]
+                    .getMarker(next_frame).clear();
+            }
         }
     }   // is has wrapped around
 
@@ -364,12 +476,13 @@ void Profiler::draw()
     // Use this thread to compute start and end time. All other
     // threads might have 'unfinished' events, or multiple identical events
     // in this frame (i.e. start time would be incorrect).
-    int thread_id = getThreadID();
-    AllEventData &aed = m_all_threads_data[thread_id].m_all_event_data;
-    AllEventData::iterator j;
-    for (j = aed.begin(); j != aed.end(); ++j)
+    int thread_id = std::max(getThreadID(), 0);
+    m_lock.lock();
+    const ThreadData &main_td = m_all_threads_data[thread_id];
+    for (unsigned int j = 0; j < main_td.m_ordered_headings.size(); j++)
     {
-        const Marker &marker = j->second.getMarker(indx);
+        const Marker &marker = main_td.m_all_event_data
+                               [main_td.m_ordered_headings[j]].getMarker(indx);
         start = std::min(start, marker.getStart());
         end = std::max(end, marker.getEnd());
     }   // for j in events
@@ -381,8 +494,10 @@ void Profiler::draw()
     // Get the mouse pos
     core::vector2di mouse_pos = GUIEngine::EventHandler::get()->getMousePos();
 
-    std::stack<AllEventData::iterator> hovered_markers;
-    for (int i = 0; i < m_threads_used; i++)
+    // Thread and marker id of all markers below the mouse pointer
+    std::stack<std::pair<int, int> > hovered_markers;
+    const int threads_used = std::min((int)m_threads_used, MAX_THREADS);
+    for (int i = 0; i < threads_used; i++)
     {
         ThreadData &td = m_all_threads_data[i];
         AllEventData &aed = td.m_all_event_data;
@@ -394,8 +509,8 @@ void Profiler::draw()
         double start_xpos = 0;
         for(int k=0; k<(int)td.m_ordered_headings.size(); k++)
         {
-            AllEventData::iterator j = aed.find(td.m_ordered_headings[k]);
-            const Marker &marker = j->second.getMarker(indx);
+            const EventData &ed = aed[td.m_ordered_headings[k]];
+            const Marker &marker = ed.getMarker(indx);
             if (i == thread_id)
                 start_xpos = factor*marker.getStart();
             core::rect<s32> pos((s32)(x_offset + start_xpos),
@@ -410,11 +525,12 @@ void Profiler::draw()
             pos.UpperLeftCorner.Y  += 2 * (int)marker.getLayer();
             pos.LowerRightCorner.Y -= 2 * (int)marker.getLayer();
 
-            GL32_draw2DRectangle(j->second.getColour(), pos);
+            GL32_draw2DRectangle(ed.getColour(), pos);
             // If the mouse cursor is over the marker, get its information
             if (pos.isPointInside(mouse_pos))
             {
-                hovered_markers.push(j);
+                hovered_markers.push(std::make_pair(i,
+                                                td.m_ordered_headings[k]));
             }
 
         }   // for j in AllEventdata
@@ -424,7 +540,7 @@ void Profiler::draw()
     // GPU profiler
     QueryPerf hovered_gpu_marker = Q_LAST;
     long hovered_gpu_marker_elapsed = 0;
-    int gpu_y = int(y_offset + m_threads_used*line_height + line_height/2);
+    int gpu_y = int(y_offset + threads_used*line_height + line_height/2);
     float total = 0;
     for (unsigned i = 0; i < Q_LAST; i++)
     {
@@ -475,7 +591,7 @@ void Profiler::draw()
     {
         s32 x_sync = (s32)(x_offset + factor*m_time_between_sync);
         s32 y_up_sync = (s32)(MARGIN_Y*screen_size.Height);
-        s32 y_down_sync = (s32)( (MARGIN_Y + (2+m_threads_used)*LINE_HEIGHT)
+        s32 y_down_sync = (s32)( (MARGIN_Y + (2+threads_used)*LINE_HEIGHT)
                                 * screen_size.Height                         );
 
         GL32_draw2DRectangle(video::SColor(0xFF, 0x00, 0x00, 0x00),
@@ -490,11 +606,12 @@ void Profiler::draw()
         core::stringw text;
         while(!hovered_markers.empty())
         {
-            AllEventData::iterator j = hovered_markers.top();
-            const Marker &marker = j->second.getMarker(indx);
+            const std::pair<int, int> &j = hovered_markers.top();
+            const Marker &marker = m_all_threads_data[j.first]
+                                  .m_all_event_data[j.second].getMarker(indx);
             std::ostringstream oss;
             oss.precision(4);
-            oss << j->first << " [" << (marker.getDuration()) << " ms / ";
+            oss << m_marker_names[j.second] << " [" << (marker.getDuration()) << " ms / ";
             oss.precision(3);
             oss << marker.getDuration()*100.0 / duration << "%]" << std::endl;
             text += oss.str().c_str();
@@ -511,6 +628,7 @@ void Profiler::draw()
                        video::SColor(0xFF, 0xFF, 0x00, 0x00));
         }
     }
+    m_lock.unlock();
 
     PROFILER_POP_CPU_MARKER();
 #endif
@@ -596,7 +714,7 @@ void Profiler::computeStableFPS()
     m_frame_times.clear();
     m_total_frametime = 0;
 
-    while (start != m_current_frame)
+    while (start != m_current_frame && !td.m_ordered_headings.empty())
     {
         // The overall duration of a frame is recorded in the outermost
         // marker event, which is always the 1st event in the list.
@@ -758,7 +876,8 @@ void Profiler::writeToFile()
     f.close();
 
     // 2: Save per-thread CPU data
-    for (int thread_id = 0; thread_id < m_threads_used; thread_id++)
+    const int threads_used = std::min((int)m_threads_used, MAX_THREADS);
+    for (int thread_id = 0; thread_id < threads_used; thread_id++)
     {
         std::ofstream f(FileUtils::getPortableWritingPath(base_name +
             ".profile-" + (Track::getCurrentTrack() != NULL ? Track::getCurrentTrack()->getIdent() : "menu") +
@@ -766,7 +885,7 @@ void Profiler::writeToFile()
         ThreadData &td = m_all_threads_data[thread_id];
         f << "#  ";
         for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
-            f << "\"" << td.m_ordered_headings[i] << "(" << i+1 <<")\",   ";
+            f << "\"" << m_marker_names[td.m_ordered_headings[i]] << "(" << i+1 <<")\",   ";
         f << std::endl;
         int start = m_has_wrapped_around ? m_current_frame + 1 : 0;
         if (start > m_max_frames) start -= m_max_frames;
@@ -807,6 +926,109 @@ void Profiler::writeToFile()
         start = (start + 1) % m_max_frames;
     }
     f_gpu.close();
+
+    // 4: Save all recorded markers as Chrome trace
+    writeTraceFile(base_name + ".profile-" +
+        (Track::getCurrentTrack() != NULL ? Track::getCurrentTrack()->getIdent() : "menu") +
+        ".trace.json");
     m_lock.unlock();
 
 }   // writeFile
+
+//-----------------------------------------------------------------------------
+/** Copies the events of a thread's trace buffer that belong to the current
+ *  profiling run, oldest first. Events which the thread overwrites while
+ *  they are copied are dropped.
+ *  \param td The data of the thread.
+ *  \param events On return contains the events.
+ */
+void Profiler::copyTraceEvents(const ThreadData &td,
+                               std::vector<TraceEvent> *events) const
+{
+    events->clear();
+    const TraceSlot *buffer = td.m_trace_events.load(std::memory_order_acquire);
+    if (!buffer)
+        return;
+    const uint64_t count = td.m_trace_count.load(std::memory_order_acquire);
+    uint64_t first = std::max(td.m_trace_first,
+        count > (uint64_t)TRACE_BUFFER_SIZE ? count - TRACE_BUFFER_SIZE : 0);
+    for (uint64_t i = first; i < count; i++)
+        events->push_back(buffer[i % TRACE_BUFFER_SIZE].load());
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // Remove all events that might have been overwritten during the copy,
+    // i.e. all events before the one which will be overwritten next
+    const uint64_t new_count = td.m_trace_count.load(std::memory_order_acquire);
+    if (new_count - first >= (uint64_t)TRACE_BUFFER_SIZE)
+    {
+        const uint64_t lost = std::min(new_count - first - TRACE_BUFFER_SIZE + 1,
+                                       (uint64_t)events->size());
+        events->erase(events->begin(), events->begin() + lost);
+    }
+}   // copyTraceEvents
+
+//-----------------------------------------------------------------------------
+/** Writes the trace buffers of all threads in the Chrome trace event format,
+ *  which can be loaded in chrome://tracing or https://ui.perfetto.dev.
+ *  Must be called while m_lock is locked.
+ *  \param file_name Name of the file to write.
+ */
+void Profiler::writeTraceFile(const std::string &file_name)
+{
+    const int threads_used = std::min((int)m_threads_used, MAX_THREADS);
+    std::vector<std::vector<TraceEvent> > all_events(threads_used);
+    double start_time = std::numeric_limits<double>::max();
+    for (int i = 0; i < threads_used; i++)
+    {
+        copyTraceEvents(m_all_threads_data[i], &all_events[i]);
+        if (!all_events[i].empty())
+            start_time = std::min(start_time, all_events[i][0].m_time);
+    }
+
+    std::ofstream f(FileUtils::getPortableWritingPath(file_name));
+    f << std::fixed;
+    f.precision(3);
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    f << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+      << "\"args\":{\"name\":\"supertuxkart\"}}";
+    for (int i = 0; i < threads_used; i++)
+    {
+        f << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+          << i << ",\"args\":{\"name\":\""
+          << (i == 0 ? std::string("Main") : "Thread " + StringUtils::toString(i))
+          << "\"}}";
+        // The first events in the buffer can be pops of events whose push
+        // was already overwritten, which are skipped. Events still in
+        // progress are ended at the time of the last event.
+        unsigned int depth = 0;
+        const std::vector<TraceEvent> &events = all_events[i];
+        for (const TraceEvent &event : events)
+        {
+            const double ts = (event.m_time - start_time) * 1000.0;
+            if (event.m_marker_id >= 0)
+            {
+                std::string name = m_marker_names[event.m_marker_id];
+                name = StringUtils::findAndReplace(name, "\\", "\\\\");
+                name = StringUtils::findAndReplace(name, "\"", "\\\"");
+                f << ",\n{\"name\":\"" << name << "\",\"cat\":\"cpu\","
+                  << "\"ph\":\"B\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << i
+                  << "}";
+                depth++;
+            }
+            else if (depth > 0)
+            {
+                f << ",\n{\"ph\":\"E\",\"ts\":" << ts << ",\"pid\":1,\"tid\":"
+                  << i << "}";
+                depth--;
+            }
+        }   // for event in events
+        for (; depth > 0; depth--)
+        {
+            f << ",\n{\"ph\":\"E\",\"ts\":"
+              << (events.back().m_time - start_time) * 1000.0
+              << ",\"pid\":1,\"tid\":" << i << "}";
+        }
+    }   // for i < threads_used
+    f << "\n]}\n";
+    f.close();
+}   // writeTraceFile
@@ -29,6 +29,7 @@
 #include <stack>
 #include <streambuf>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <vector2d.h>
@@ -72,7 +73,18 @@ double getTimeMilliseconds();
 #define ENABLE_PROFILER
 
 #ifdef ENABLE_PROFILER
-    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b) \
+    /** The name must be a constant string: it is converted to a marker id
+     *  only once per call site. Use PROFILER_PUSH_DYNAMIC_CPU_MARKER for
+     *  names that are computed at runtime. */
+    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)                         \
+        do                                                                  \
+        {                                                                   \
+            static const int profiler_marker_id =                           \
+                profiler.getMarkerID(name, video::SColor(0xFF, r, g, b));   \
+            profiler.pushCPUMarker(profiler_marker_id);                     \
+        } while (0)
+
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b) \
         profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b))
 
     #define PROFILER_POP_CPU_MARKER()  \
@@ -85,6 +97,7 @@ double getTimeMilliseconds();
         profiler.draw()
 #else
     #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b)
     #define PROFILER_POP_CPU_MARKER()
     #define PROFILER_SYNC_FRAME()
     #define PROFILER_DRAW()
@@ -201,31 +214,98 @@ private:
         /** Returns the colour for this event. */
         video::SColor getColour() const { return m_colour;  }
         // --------------------------------------------------------------------
+        /** Returns if this event was used in its thread. */
+        bool isUsed() const { return !m_all_markers.empty(); }
+        // --------------------------------------------------------------------
     };   // EventData
 
     // ========================================================================
-    /** The mapping of event names to the corresponding EventData. */
-    typedef std::map<std::string, EventData> AllEventData;
+    /** The EventData of a thread, indexed by marker id. Markers that were
+     *  not used in a thread have an EventData without markers. */
+    typedef std::vector<EventData> AllEventData;
+    // ========================================================================
+    /** A push or pop of a marker as recorded by pushCPUMarker and
+     *  popCPUMarker. */
+    struct TraceEvent
+    {
+        /** Absolute time of the event in ms. */
+        double m_time;
+        /** Marker id of a push, or -1 for a pop. */
+        int    m_marker_id;
+    };   // TraceEvent
+    // ========================================================================
+    /** A TraceEvent in the ring buffer of a thread. The thread can overwrite
+     *  it while another thread reads it (which then detects this with
+     *  m_trace_count and drops the event), so its members are atomic. */
+    struct TraceSlot
+    {
+        std::atomic<double> m_time;
+        std::atomic<int>    m_marker_id;
+        // --------------------------------------------------------------------
+        TraceEvent load() const
+        {
+            TraceEvent event;
+            event.m_time      = m_time.load(std::memory_order_relaxed);
+            event.m_marker_id = m_marker_id.load(std::memory_order_relaxed);
+            return event;
+        }   // load
+    };   // TraceSlot
     // ========================================================================
     struct ThreadData
     {
-        /** Stack of events to detect nesting. */
-        std::vector< std::string > m_event_stack;
+        /** Ring buffer of the last TRACE_BUFFER_SIZE events of this thread.
+         *  It is only written by its own thread, so pushing and popping
+         *  markers does not need a lock. It is allocated when the thread
+         *  uses the profiler the first time. */
+        std::atomic<TraceSlot*> m_trace_events;
+
+        /** Number of events ever written to m_trace_events. */
+        std::atomic<uint64_t> m_trace_count;
+
+        /** Number of events already added to m_all_event_data by
+         *  synchronizeFrame. */
+        uint64_t m_trace_read;
 
-        /** This stores the event names in the order in which they occur.
+        /** Index of the first event of the current profiling run. */
+        uint64_t m_trace_first;
+
+        /** Stack of marker ids to detect nesting. */
+        std::vector<int> m_event_stack;
+
+        /** This stores the marker ids in the order in which they occur.
         *  This means that 'outer' events occur here before any child
         *  events. This list is then used to determine the order in which the
         *  bar graphs are drawn, which results in the proper nesting of events.*/
-        std::vector<std::string> m_ordered_headings;
+        std::vector<int> m_ordered_headings;
 
         AllEventData m_all_event_data;
+
+        ThreadData() : m_trace_events(NULL), m_trace_count(0),
+                       m_trace_read(0), m_trace_first(0) {}
+        ~ThreadData() { delete [] m_trace_events.load(); }
     };   // class ThreadData
 
     // ========================================================================
 
+    /** Maximum number of threads that are profiled. Markers of all further
+     *  threads are ignored. */
+    static const int MAX_THREADS = 10;
+
+    /** Number of events kept in the trace buffer of each thread. */
+    static const int TRACE_BUFFER_SIZE = 64 * 1024;
+
     /** Data structure containing all currently buffered markers. The index
      *  is the thread id. */
-    std::vector< ThreadData> m_all_threads_data;
+    ThreadData m_all_threads_data[MAX_THREADS];
+
+    /** The name of each marker, indexed by marker id. */
+    std::vector<std::string> m_marker_names;
+
+    /** The colour of each marker, indexed by marker id. */
+    std::vector<video::SColor> m_marker_colours;
+
+    /** Maps marker names to their id. */
+    std::unordered_map<std::string, int> m_marker_ids;
 
     /** Buffer for the GPU times (in ms). */
     std::vector<int> m_gpu_times;
@@ -288,11 +368,6 @@ private:
     /** Time between now and last sync, used to scale the GUI bar. */
     double m_time_between_sync;
 
-    /** List of all event names. This list is sorted to make sure
-     *  if the circular buffer is dumped more than once the order
-     *  of events remains the same. */
-    std::vector<std::string> m_all_event_names;
-
     // Handling freeze/unfreeze by clicking on the display
     enum FreezeState
     {
@@ -307,12 +382,20 @@ private:
 private:
     int  getThreadID();
     void drawBackground();
+    void addTraceEvent(int marker_id);
+    void readTraceEvents(ThreadData &td, double until);
+    void copyTraceEvents(const ThreadData &td,
+                         std::vector<TraceEvent> *events) const;
+    EventData& getEventData(ThreadData &td, int marker_id);
+    void writeTraceFile(const std::string &file_name);
 
 public:
              Profiler();
     virtual ~Profiler();
     void     init();
     void     reset();
+    int      getMarkerID(const char* name, const video::SColor& colour);
+    void     pushCPUMarker(int marker_id);
     void     pushCPUMarker(const char* name="N/A",
                            const video::SColor& color=video::SColor());
     void     popCPUMarker();
@@ -0,0 +1,144 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/thread_pool.hpp"
+#include "utils/vs.hpp"
+
+#include <cassert>
+
+// ----------------------------------------------------------------------------
+ThreadPool::ThreadPool(unsigned thread_count, const std::string& name)
+          : m_function(NULL), m_count(0), m_next(0), m_generation(0),
+            m_busy_workers(0), m_stop(false)
+{
+    ProcessType pt = STKProcess::getType();
+    for (unsigned i = 0; i < thread_count; i++)
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, pt, name);
+}   // ThreadPool
+
+// ----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~ThreadPool
+
+// ----------------------------------------------------------------------------
+void ThreadPool::runIterations()
+{
+    while (true)
+    {
+        unsigned i = m_next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= m_count)
+            return;
+        (*m_function)(i);
+    }
+}   // runIterations
+
+// ----------------------------------------------------------------------------
+void ThreadPool::workerLoop(ProcessType pt, const std::string& name)
+{
+    STKProcess::init(pt);
+    VS::setThreadName(name.c_str());
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    while (true)
+    {
+        m_start.wait(ul, [this, generation]()
+            { return m_stop || m_generation != generation; });
+        if (m_stop)
+            return;
+        generation = m_generation;
+        ul.unlock();
+        runIterations();
+        ul.lock();
+        if (--m_busy_workers == 0)
+            m_done.notify_one();
+    }
+}   // workerLoop
+
+// ----------------------------------------------------------------------------
+/** Calls function(i) for each i in [0, count), in parallel on the workers
+ *  and the calling thread, and returns when all calls are done. The order of
+ *  the calls is undefined.
+ */
+void ThreadPool::parallelFor(unsigned count,
+                             const std::function<void(unsigned)>& function)
+{
+    if (m_threads.empty() || count < 2)
+    {
+        for (unsigned i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call_lock(m_call_mutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_function = &function;
+        m_count = count;
+        m_next.store(0, std::memory_order_relaxed);
+        m_busy_workers = (unsigned)m_threads.size();
+        m_generation++;
+    }
+    m_start.notify_all();
+    runIterations();
+
+    // Workers which wake up late find no iteration left, but the loop state
+    // must not change before all of them saw it
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_done.wait(ul, [this]() { return m_busy_workers == 0; });
+    m_function = NULL;
+}   // parallelFor
+
+// ----------------------------------------------------------------------------
+void ThreadPool::unitTesting()
+{
+    ThreadPool pool(3, "UnitTest");
+    assert(pool.getThreadCount() == 3);
+    for (unsigned count : { 0, 1, 2, 7, 1000 })
+    {
+        std::vector<std::atomic<unsigned> > calls(count);
+        for (auto& c : calls)
+            c.store(0);
+        pool.parallelFor(count, [&calls](unsigned i) { calls[i]++; });
+        for (auto& c : calls)
+            assert(c.load() == 1);
+    }
+
+    // Workers keep the process type of the thread which created the pool
+    std::atomic_bool same_type(true);
+    ProcessType pt = STKProcess::getType();
+    pool.parallelFor(100, [&same_type, pt](unsigned i)
+        {
+            if (STKProcess::getType() != pt)
+                same_type.store(false);
+        });
+    assert(same_type.load());
+
+    // Without workers everything runs on the calling thread
+    ThreadPool empty(0, "UnitTest");
+    std::thread::id id = std::this_thread::get_id();
+    empty.parallelFor(10, [id](unsigned i)
+        { assert(std::this_thread::get_id() == id); });
+}   // unitTesting
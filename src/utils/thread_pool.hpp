@@ -0,0 +1,86 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_THREAD_POOL_HPP
+#define HEADER_THREAD_POOL_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A small pool of worker threads which run the iterations of a loop in
+ *  parallel. The calling thread works on the loop too, and parallelFor only
+ *  returns once all iterations are done, so the function can safely use
+ *  variables of the caller. Workers belong to the STKProcess of the thread
+ *  which created the pool.
+ */
+class ThreadPool : public NoCopy
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    /** Serializes parallelFor calls from different threads. */
+    std::mutex m_call_mutex;
+
+    std::mutex m_mutex;
+
+    /** Wakes up workers when a new loop starts or the pool is destroyed. */
+    std::condition_variable m_start;
+
+    /** Wakes up the caller when the last worker finished. */
+    std::condition_variable m_done;
+
+    const std::function<void(unsigned)>* m_function;
+
+    unsigned m_count;
+
+    /** Next iteration to run. */
+    std::atomic<unsigned> m_next;
+
+    /** Incremented for each loop, so that workers run each loop once. */
+    uint64_t m_generation;
+
+    /** Number of workers still working on the current loop. */
+    unsigned m_busy_workers;
+
+    bool m_stop;
+
+    void workerLoop(ProcessType pt, const std::string& name);
+    void runIterations();
+
+public:
+    ThreadPool(unsigned thread_count, const std::string& name);
+    ~ThreadPool();
+    void parallelFor(unsigned count,
+                     const std::function<void(unsigned)>& function);
+    // ------------------------------------------------------------------------
+    /** Returns the number of worker threads, without the calling thread. */
+    unsigned getThreadCount() const         { return (unsigned)m_threads.size(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // class ThreadPool
+
+#endif   // HEADER_THREAD_POOL_HPP